@@ -45,30 +45,90 @@
 	John Gedde Rev 3 02/28/23 Fixed issue with COS timeout on start-up.
 	John Gedde Rev 4 03/23/23 Added support for network status LED and shutdown switch
 	John Gedde Rev 5 03/24/23 Got rid of command line setuip in favor of conf file.	
+	agent Rev 6 10/17/26 Moved the main loop onto an event loop (epoll or io_uring),
+						 Asterisk commands over the control socket, added metrics.
+	agent Rev 7 10/17/26 Start-up, Asterisk reconnect and shutdown are now sequences
+						 on the event loop instead of blocking code in main().
+	agent Rev 8 10/17/26 COS key/unkey/timeout logic moved to a table driven state
+						 machine per channel (channel.c), optional second channel.
+	agent Rev 9 10/17/26 PTT sensing and transmit duty cycle governor, shared state
+						 segment in /dev/shm/COSmon.
+	agent Rev 10 10/17/26 FOB audio capture and dead carrier detection.
+	agent Rev 11 10/17/26 Captured audio goes into a shared memory ring, each
+						 audio analyzer reads it with its own cursor.
+	agent Rev 12 10/17/26 Audio round trip latency probe.
+	agent Rev 13 10/17/26 FOB input level meter and volume recommendation.
+	agent Rev 14 10/17/26 Transmission recorder.
+	agent Rev 15 10/17/26 Optional MQTT status publishing.
+	agent Rev 16 10/17/26 Prometheus /metrics endpoint.
+	agent Rev 17 10/17/26 COS / PTT sense from serial port modem lines, builds
+						 without wiringPi (make NO_WIRINGPI=1).
+	agent Rev 18 10/17/26 Local repeat fallback while Asterisk is down.
+	agent Rev 19 10/17/26 CPU PM QoS / cpufreq boost while COS is up.
+	agent Rev 20 10/17/26 Wi-Fi power save off while COS / PTT is active.
+	agent Rev 21 10/17/26 Voice traffic priority (HTB + u32 + DSCP) over rtnetlink.
+	agent Rev 22 10/17/26 Node registration / link state from AMI events.
+	agent Rev 23 10/17/26 COS attack / hang calibration mode.
+	agent Rev 24 10/17/26 Periodic COS interference detection and suppression.
+	agent Rev 25 10/17/26 Per channel command rate governor for flapping COS.
+	agent Rev 26 10/17/26 COS edges go through a configurable per channel pipeline.
+	agent Rev 27 10/17/26 Soak test: weeks of synthetic COS traffic in virtual time.
+	agent Rev 28 10/17/26 Asterisk control socket path configurable (for aststub).
+	agent Rev 29 10/17/26 APRS / digital data bursts don't key the node.
+	agent Rev 30 10/17/26 I2C character LCD status display.
+	agent Rev 31 10/17/26 -c to run with another config file.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <wiringPi.h>
+#include "gpio.h"
 #include <string.h>
 #include <iniparser.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
 
 #include "getIP.h"
 #include "ini.h"
+#include "evloop.h"
+#include "astctl.h"
+#include "metrics.h"
+#include "seq.h"
+#include "channel.h"
+#include "dutycycle.h"
+#include "shmstate.h"
+#include "audio.h"
+#include "mqtt.h"
+#include "prom.h"
+#include "serialcos.h"
+#include "repeat.h"
+#include "boost.h"
+#include "wifips.h"
+#include "qos.h"
+#include "ami.h"
+#include "calib.h"
+#include "periodic.h"
+#include "pipeline.h"
+#include "soak.h"
+#include "lcd.h"
 
 const char strVersion[]="v1.1";
 
-// This is where COS will come into the Rasppi
-#define DEFAULT_EXTCOS_GPIO			29 		// GPIO.29 (pin 40)
+#define DEFAULT_CONF_FILE			"/etc/COSmon.conf"
 #define DEFAULT_LOOP_DELAY			100		// milliseconds	
-#define DEFAULT_COS_TIMEOUT_MS		150000	// milliseconds
-#define DEFAULT_COS_TIMEOUT_COUNT	(DEFAULT_COS_TIMEOUT_MS / DEFAULT_LOOP_DELAY)
 #define DEFAULT_NETWORK_GPIO		3		// GPIO.3 (pin 15)
 #define DEFAULT_SHUTDOWN_GPIO		7		// GPIO.7 (pin 7)
 #define DEFAULT_NET_CHECK_DIVISOR	20		// every 20 times through the main COS loop
 #define DEFAULT_SD_ACTIVATE_COUNT	30      // Must be pressed for 30 times through the main loop
+#define DEFAULT_EVLOOP_BACKEND		"epoll"	// or "io_uring" if built with IO_URING=1
+#define DEFAULT_STARTUP_WAIT_MS		0		// how long to wait for Asterisk at start-up
+#define DEFAULT_ASTDN_TIMEOUT_MS	60000	// how long astdn.sh gets before we power off anyway
+#define SHUTDOWN_SETTLE_MS			5000
+#define RECONNECT_MIN_MS			1000	// Asterisk reconnect back-off
+#define RECONNECT_MAX_MS			30000
+#define FLAP_LED_MS					250		// network LED flash rate while a channel is flapping
 
 enum
 {
@@ -81,6 +141,19 @@ enum
 
 static const uint16_t GPIOAllowed[]={0, 1, 2, 3, 4, 5, 6, 7, 21, 22, 23, 24, 25, 26, 27, 28, 29};
 static uint16_t networkStatusPin=DEFAULT_NETWORK_GPIO;
+static bool		networkLedOn=false;			// what the network LED should be showing
+static uint32_t	flappingChannels=0;			// bit per channel held for flapping
+static int		flapLedTimer=-1;
+
+// Network LED (GPIO and serial port).  Left alone while it's flashing.
+static void networkLed(bool on)
+{
+	networkLedOn=on;
+	if (flappingChannels)
+		return;
+	digitalWrite(networkStatusPin, on ? HIGH : LOW);
+	serialNetworkLed(on);
+}
 
 /*-----------------------------------------------------------------------------
 Function:
@@ -102,20 +175,364 @@ static void wifiLightHandler()
 		
 	getIPaddress(IPaddr);
 	IPlen=strlen(IPaddr);
+
+	// Optionally the light means registered, not just "has an IP"
+	if (!amiLedUp())
+		IPlen=0;
 	
 	if (IPlen==0 && lastWrite==HIGH)
 	{
-		digitalWrite(networkStatusPin, LOW);
+		networkLed(false);
 		lastWrite=HIGH;
+		mqttState("network", "down");
 	}
 	else if ((IPlen!=0) & (lastWrite==LOW))
 	{
-		digitalWrite(networkStatusPin, HIGH);
+		networkLed(true);
 		lastWrite = LOW;
+		mqttState("network", "up");
 	}		
 }
 
 
+static void flapLedHandler(uint64_t expirations, void *ctx)
+{
+	static bool lit=false;
+
+	(void)expirations;
+	(void)ctx;
+	lit=!lit;
+	digitalWrite(networkStatusPin, lit ? HIGH : LOW);
+	serialNetworkLed(lit);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	flapAlarm
+Synopsis:
+	The command governor is holding a channel (or let it go).  The network
+	LED flashes while any channel is held.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	bool flapping: held or released
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void flapAlarm(int idx, bool flapping)
+{
+	if (flapping)
+		flappingChannels|=1u<<idx;
+	else
+		flappingChannels&=~(1u<<idx);
+
+	if (flappingChannels)
+		evloopArmTimer(flapLedTimer, FLAP_LED_MS, FLAP_LED_MS);
+	else
+	{
+		evloopArmTimer(flapLedTimer, 0, 0);
+		networkLed(networkLedOn);
+	}
+}
+
+
+/*-----------------------------------------------------------------------------
+	Main loop state.  Used to be locals of main(), now shared with the
+	event loop handlers.
+-----------------------------------------------------------------------------*/
+static uint16_t 	netCheckDivisor;
+static bool 		networkStatusOn;
+static uint16_t 	shutdownSwitchPin;
+static uint16_t		SDswitchActivateCount;
+static uint16_t		SDswitchPressedCount;
+static unsigned int loopCount=0;
+static uint16_t	 	LoopDelayMs;
+static uint32_t		startupWaitMs;
+static uint32_t		astdnTimeoutMs;
+static const char	*astSocket;
+
+static seq_t		startupSeq;
+static seq_t		reconnectSeq;
+static seq_t		shutdownSeq;
+
+
+// Current COS level of a channel, from its GPIO pin or serial port
+static bool cosRead(int i)
+{
+	if (channels[i].cosSerial)
+		return serialCos(i);
+	return digitalRead(channels[i].cosPin)==HIGH;
+}
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	cosLoopHandler
+Synopsis:
+	One pass of the COS poll loop.  Runs off a periodic timer every
+	COS_poll_loop_interval_ms.
+Author:
+	agent
+Inputs:
+	uint64_t expirations: timer periods since last call (unused)
+	void *ctx: unused
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void cosLoopHandler(uint64_t expirations, void *ctx)
+{
+	uint64_t now=evloopNowUs();
+	int i;
+
+	(void)expirations;
+	(void)ctx;
+
+	// Serial port edges also come in on their own, this catches anything they missed
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (channels[i].enabled)
+			channelPoll(&channels[i], cosRead(i), now);
+		if (serialPttWired(i))
+			dutyPoll(i, serialPtt(i), now);
+		else if (dutyPttPin(i)>=0)
+			dutyPoll(i, digitalRead(dutyPttPin(i))==HIGH, now);
+	}
+
+	// Handle shutdown switch.  Needs to be pressed for SDswitchActivateCount times through the loop
+	if (digitalRead(shutdownSwitchPin)==LOW)	// Active low
+	{
+		SDswitchPressedCount++;
+		if (SDswitchPressedCount>SDswitchActivateCount && !seqRunning(&shutdownSeq))
+			seqStart(&shutdownSeq);
+
+	}
+	else
+		SDswitchPressedCount=0;
+
+
+	// if enabled check network status, but only netCheckDivisor times through the main loop
+	if ((loopCount++ % netCheckDivisor)==0 && networkStatusOn)
+		wifiLightHandler();
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	startupSeqFunc
+Synopsis:
+	Start-up sequence: wait for Asterisk, set up the pins, connect to
+	Asterisk, unkey it and start polling COS.
+Author:
+	agent
+Inputs:
+	seq_t *sq: sequence
+Outputs:
+	SEQ_WAITING or SEQ_DONE
+-----------------------------------------------------------------------------*/
+static int startupSeqFunc(seq_t *sq)
+{
+	int i;
+
+	SEQ_BEGIN(sq);
+
+	// Optionally give Asterisk a while to come up (we used to just bail out)
+	seqStep(sq, "asterisk", startupWaitMs);
+	if (startupWaitMs)
+		SEQ_WAIT_UNTIL(sq, access(astSocket, F_OK)==0);
+	if (access(astSocket, F_OK) != 0)
+	{
+		fprintf(stderr, "\nAsterisk needs to be running first!  Exiting\n\n");
+		exit(-1);
+	}
+
+	// initialize wiringPi and setup pins
+	seqStep(sq, "gpio", 0);
+	wiringPiSetup();
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (channels[i].enabled && !channels[i].cosSerial)
+			pinMode(channels[i].cosPin, INPUT);
+		if (dutyPttPin(i)>=0)
+			pinMode(dutyPttPin(i), INPUT);
+	}
+	pinMode(networkStatusPin, OUTPUT);
+	digitalWrite(networkStatusPin, LOW);
+	pinMode(shutdownSwitchPin, INPUT);
+	pullUpDnControl(shutdownSwitchPin, PUD_UP) ;
+	if (networkStatusOn)
+	{
+		flapLedTimer=evloopAddTimer(0, 0, flapLedHandler, NULL);
+		channelSetFlapHandler(flapAlarm);
+	}
+	repeatInit();
+
+	// Talk to asterisk over its control socket
+	seqStep(sq, "connect", startupWaitMs ? startupWaitMs : 5000);
+	SEQ_WAIT_UNTIL(sq, astctlConnect(astSocket)==0);
+	if (SEQ_TIMED_OUT(sq))
+	{
+		fprintf(stderr, "\nCan't connect to %s!  Exiting\n\n", astSocket);
+		exit(-1);
+	}
+	mqttState("asterisk", "up");
+	if (networkStatusOn)
+		amiSetChangeHandler(wifiLightHandler);
+	amiStart();
+
+	seqStep(sq, "unkey", 0);
+
+	// Initialize change detection vars.  COS already high doesn't key us.
+	for (i=0; i<MAX_CHANNELS; i++)
+		channels[i].cosLevel=cosRead(i);
+
+	// Unkey asterisk (same as what a reconnect does in the idle state)
+	channelReconnect(evloopNowUs());
+
+	printf("COSmon running\n");
+	evloopAddTimer(LoopDelayMs, LoopDelayMs, cosLoopHandler, NULL);
+	serialStart();
+	audioStart();
+
+	SEQ_END(sq);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	reconnectSeqFunc
+Synopsis:
+	Asterisk went away (restart, crash...).  Keep trying to reconnect with
+	back-off and when it comes back, tell it what state COS is in.  COS
+	keeps being polled the whole time.
+Author:
+	agent
+Inputs:
+	seq_t *sq: sequence
+Outputs:
+	SEQ_WAITING or SEQ_DONE
+-----------------------------------------------------------------------------*/
+static int reconnectSeqFunc(seq_t *sq)
+{
+	static uint32_t backoffMs;
+
+	SEQ_BEGIN(sq);
+
+	backoffMs=RECONNECT_MIN_MS;
+	for (;;)
+	{
+		seqStep(sq, "backoff", 0);
+		SEQ_SLEEP(sq, backoffMs);
+
+		seqStep(sq, "connect", 0);
+		if (astctlConnect(astSocket)==0)
+			break;
+
+		backoffMs*=2;
+		if (backoffMs>RECONNECT_MAX_MS)
+			backoffMs=RECONNECT_MAX_MS;
+	}
+
+	// Asterisk doesn't remember us
+	seqStep(sq, "resync", 0);
+	printf("Reconnected to Asterisk\n");
+	mqttState("asterisk", "up");
+	repeatAsteriskUp();
+	channelReconnect(evloopNowUs());
+
+	SEQ_END(sq);
+}
+
+static void asteriskLost(void)
+{
+	mqttState("asterisk", "down");
+	if (!seqRunning(&shutdownSeq) && !seqRunning(&reconnectSeq))
+	{
+		repeatAsteriskDown();
+		seqStart(&reconnectSeq);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	shutdownSeqFunc
+Synopsis:
+	Shutdown switch was held.  Stop Asterisk, give things a few seconds to
+	settle and power off.  COS keeps being handled until the very end.
+Author:
+	agent
+Inputs:
+	seq_t *sq: sequence
+Outputs:
+	SEQ_WAITING or SEQ_DONE
+-----------------------------------------------------------------------------*/
+static int shutdownSeqFunc(seq_t *sq)
+{
+	static pid_t pid;
+
+	SEQ_BEGIN(sq);
+
+	// Turn of network light as acknokwledge
+	seqStep(sq, "astdn", astdnTimeoutMs);
+	repeatRestore();
+	digitalWrite(networkStatusPin, HIGH);
+	printf("Shutting down!\n");
+	lcdMessage("Shutting down");
+	pid=seqSpawn("/usr/local/sbin/astdn.sh");
+	SEQ_WAIT_UNTIL(sq, seqChildExited(pid));
+
+	seqStep(sq, "settle", 0);
+	SEQ_SLEEP(sq, SHUTDOWN_SETTLE_MS);
+
+	seqStep(sq, "poweroff", 0);
+	seqSpawn("/usr/bin/poweroff");
+	evloopStop();
+
+	SEQ_END(sq);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	signalHandler
+Synopsis:
+	Signals arrive through a signalfd on the event loop so we can do real
+	work (printing, unkeying) without async-signal-safety worries.
+	SIGUSR1 dumps the metrics, SIGINT/SIGTERM unkey and exit.
+Author:
+	agent
+Inputs:
+	standard evloop read handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void signalHandler(int fd, const uint8_t *data, ssize_t len, void *ctx)
+{
+	const struct signalfd_siginfo *si=(const struct signalfd_siginfo *)data;
+	int i;
+
+	(void)fd;
+	(void)ctx;
+
+	if (len<(ssize_t)sizeof(*si))
+		return;
+
+	if (si->ssi_signo==SIGUSR1)
+		metricsDump(stdout);
+	else
+	{
+		printf("COSmon exiting\n");
+		boostRestore();
+		wifiPsRestore();
+		qosRestore();
+		repeatRestore();
+		for (i=0; i<MAX_CHANNELS; i++)
+		{
+			if (channels[i].enabled)
+				astctlCommand(channels[i].unkeyCmd);
+		}
+		evloopStop();
+	}
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////
 /*-----------------------------------------------------------------------------
 Function:
@@ -125,159 +542,126 @@ Synopsis:
 Author:
 	John Gedde
 Inputs:
-	None	
+	-c file: config file instead of /etc/COSmon.conf (bench runs, fixtures)
 Outputs:
 	return val to caller
 -----------------------------------------------------------------------------*/
-int main(void)
+int main(int argc, char *argv[])
 {
-	bool 			LastCOSState;
-	bool 			CurrCOSState;
-	uint16_t 		netCheckDivisor;
-	uint16_t 		ExtCOSPin;
-	uint16_t 		TimeoutCountCOS;
-	uint16_t 		TimeoutCount;	
-	uint16_t	 	LoopDelayMs;
-	uint32_t		TimeoutMs;
-	float 			tempval;
-	bool 			networkStatusOn;
 	bool 			shutdownSwitchEnable;
-	bool			COStimeoutEnable;
-	uint16_t 		shutdownSwitchPin;
-	uint16_t		SDswitchActivateCount;
-	uint16_t		SDswitchPressedCount;
-		
-	initIni("/etc/COSmon.conf");
+	const char		*backendName;
+	const char		*confFile=DEFAULT_CONF_FILE;
+	sigset_t		sigMask;
+	int				sigFd;
+	int				i, opt;
+
+	while ((opt=getopt(argc, argv, "c:h"))!=-1)
+	{
+		switch (opt)
+		{
+			case 'c': confFile=optarg; break;
+			default:
+				fprintf(stderr, "usage: COSmon [-c config file]\n");
+				return RETVAL_ILLEGALARG;
+		}
+	}
+
+	initIni(confFile);
 	
-	ExtCOSPin=				iniparser_getint(ini, "gpio:gpio_COS", DEFAULT_EXTCOS_GPIO);
 	networkStatusPin=		iniparser_getint(ini, "gpio:gpio_network", DEFAULT_NETWORK_GPIO);
 	shutdownSwitchPin=		iniparser_getint(ini, "gpio:gpio_shutdown", DEFAULT_SHUTDOWN_GPIO);
 	networkStatusOn=		iniparser_getboolean(ini, "functions:enable_network_status_LED", 0);
 	shutdownSwitchEnable=	iniparser_getboolean(ini, "functions:enable_shutdown_switch", 0);
 	LoopDelayMs=			iniparser_getint(ini, "COS settings:COS_poll_loop_interval_ms", DEFAULT_LOOP_DELAY);
-	TimeoutMs=				iniparser_getint(ini, "COS settings:COS_timeout_ms", DEFAULT_COS_TIMEOUT_MS);
-	COStimeoutEnable=		iniparser_getboolean(ini, "COS settings:COS_timeout_enable", 1);
 	netCheckDivisor=		iniparser_getint(ini, "COS settings:network_check_divisor", DEFAULT_NET_CHECK_DIVISOR);
 	SDswitchActivateCount=	iniparser_getint(ini, "COS settings:shutdown_switch_activate_count", DEFAULT_SD_ACTIVATE_COUNT);
+	backendName=			iniparser_getstring(ini, "event loop:backend", DEFAULT_EVLOOP_BACKEND);
+	startupWaitMs=			iniparser_getint(ini, "COS settings:asterisk_startup_wait_ms", DEFAULT_STARTUP_WAIT_MS);
+	astdnTimeoutMs=			iniparser_getint(ini, "COS settings:shutdown_astdn_timeout_ms", DEFAULT_ASTDN_TIMEOUT_MS);
+	astSocket=				iniparser_getstring(ini, "COS settings:asterisk_socket", ASTCTL_SOCKET);
 
-	const char KeyCmd[]="asterisk -rx \"susb tune menu-support K\"";
-	const char UnkeyCmd[]="asterisk -rx \"susb tune menu-support k\"";
-	
-	unsigned int loopCount=0;
-	
-	if (access("/var/run/asterisk.ctl", F_OK) != 0)
-	{
-		fprintf(stderr, "\nAsterisk needs to be running first!  Exiting\n\n");
+	if (evloopInit(strcmp(backendName, "io_uring")==0 ? EVLOOP_BACKEND_IO_URING : EVLOOP_BACKEND_EPOLL)<0)
 		exit(-1);
-	}
 		
 	// Printf Config
 	printf("\nCOSmon version %s\n", strVersion);
 	printf("Config:\n");
-	printf("\tCOS GPIO number: %u\n", ExtCOSPin);
-	if (COStimeoutEnable==0)
-		printf("\tCOS timeout disabled\n");
-	else	
-		printf("\tCOS timeout (ms): %u\n", TimeoutMs);
+	shmstateInit();
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		channelInit(&channels[i], i);
+		if (channels[i].cosSerial && serialInit(i)<0)
+		{
+			channels[i].enabled=false;
+			shmstateBegin()->channel[i].enabled=false;
+			shmstateEnd();
+		}
+		dutyInit(i, evloopNowUs());
+		if (!channels[i].enabled)
+			continue;
+		if (channels[i].cosSerial)
+			printf("\tChannel %d COS serial port: %s\n", i+1, serialDevice(i));
+		else
+			printf("\tChannel %d COS GPIO number: %d\n", i+1, channels[i].cosPin);
+		if (channels[i].timeoutUs==CHANNEL_NEVER_US)
+			printf("\tChannel %d COS timeout disabled\n", i+1);
+		else
+			printf("\tChannel %d COS timeout (ms): %llu\n", i+1, (unsigned long long)channels[i].timeoutUs/1000);
+		printf("\tChannel %d attack / hang / lockout (ms): %llu / %llu / %llu\n", i+1,
+				(unsigned long long)channels[i].attackUs/1000, (unsigned long long)channels[i].hangUs/1000,
+				(unsigned long long)channels[i].lockoutUs/1000);
+		if (channels[i].tokensPerUs>0.0)
+			printf("\tChannel %d command governor: burst %.0f, %.0f per minute\n", i+1,
+					channels[i].tokensMax, channels[i].tokensPerUs*60e6);
+		pipelinePrint(&channels[i]);
+		periodicInit(i);
+		if (serialPttWired(i))
+			printf("\tChannel %d PTT sense: serial port\n", i+1);
+		else if (dutyPttPin(i)>=0)
+			printf("\tChannel %d PTT sense GPIO number: %d\n", i+1, dutyPttPin(i));
+		if (audioInit(i)==0)
+			printf("\tChannel %d audio capture: enabled\n", i+1);
+	}
 	printf("\tCOS check loop delay (ms): %u\n", LoopDelayMs);	
 	printf("\tShutdown switch: %s\n", (shutdownSwitchEnable ? "ENABLED" : "DISABLED"));
 	printf("\tNetwork connected Indicator: %s\n", (networkStatusOn ? "ENABLED" : "DISABLED"));
 	printf("\tNetwork status GPIO number: %u\n", networkStatusPin);
 	printf("\tShutdwon switch GPIO number: %d\n", shutdownSwitchPin);
 	printf("\tNetwork check divisor: %u\n", netCheckDivisor);
+	printf("\tEvent loop backend: %s\n", evloopBackendName());
+	printf("\tAsterisk control socket: %s\n", astSocket);
+	boostInit();
+	wifiPsInit();
+	qosInit();
+	amiInit();
+	calibInit();
+	lcdInit();
+	soakInit();
+	promInit();
 	printf("\n");
+	mqttInit();
 
-	// Compute timeout count
-	tempval=(float)TimeoutMs/(float)LoopDelayMs;
-	tempval += 0.5;
-	TimeoutCountCOS=(int)tempval;
+	// [soak] runs the soak test instead of talking to Asterisk
+	if (soakEnabled())
+		return soakRun(LoopDelayMs);
 
-	// Initialize so we don't get an immediate timeout on startup.
-	TimeoutCount=-1;
+	// Signals come in through the event loop
+	sigemptyset(&sigMask);
+	sigaddset(&sigMask, SIGUSR1);
+	sigaddset(&sigMask, SIGINT);
+	sigaddset(&sigMask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigMask, NULL);
+	sigFd=signalfd(-1, &sigMask, SFD_NONBLOCK | SFD_CLOEXEC);
+	evloopAddReader(sigFd, sizeof(struct signalfd_siginfo), signalHandler, NULL);
 
-	// initialize wiringPi and setup pins
-	wiringPiSetup();
-	pinMode(ExtCOSPin, INPUT);
-	pinMode(networkStatusPin, OUTPUT);
-	digitalWrite(networkStatusPin, LOW);
-	pinMode(shutdownSwitchPin, INPUT);
-	pullUpDnControl(shutdownSwitchPin, PUD_UP) ;
+	seqInit(&startupSeq, "startup", startupSeqFunc, NULL);
+	seqInit(&reconnectSeq, "reconnect", reconnectSeqFunc, NULL);
+	seqInit(&shutdownSeq, "shutdown", shutdownSeqFunc, NULL);
+	astctlSetDisconnectHandler(asteriskLost);
 
-	printf("COSmon running\n");
-
-	// Initialize change detection vars
-	LastCOSState=digitalRead(ExtCOSPin);
-	
-	// Unkey asterisk
-	system(UnkeyCmd);
-
-	for(;;)  // forever
-	{
-		CurrCOSState=digitalRead(ExtCOSPin);
-		
-		// check for change is COS pin state
-		if (LastCOSState!=CurrCOSState)
-		{
-			// Something has changed...
-			// (we only do something when COS changes so we don't continually
-			// call asterisk for no reason every time throgh the loop.
-			// this seems to cause loading issues.)
-
-			// Read COS pin state
-			if (CurrCOSState==HIGH)
-			{
-				// Key asterisk
-				system(KeyCmd);
-				TimeoutCount = TimeoutCountCOS;
-			}
-			else
-			{
-				// Unkey asterisk
-				system(UnkeyCmd);
-			}
-			LastCOSState=CurrCOSState;
-		}
-		else if (COStimeoutEnable)
-		{
-			// Nothing has changed.  Check for COS stuck high.
-			if (TimeoutCount>0 && CurrCOSState==HIGH)
-				TimeoutCount--;
-			else if (TimeoutCount==0)
-			{
-				// Timeout has been reached, unkey the node.  Only once...  When count=0.  
-				printf("COS Timeout\n");
-				system(UnkeyCmd);
-				TimeoutCount=-1;
-			}
-		}
-		
-		// Handle shutdown switch.  Needs to be pressed for SDswitchActivateCount times through the loop
-		if (digitalRead(shutdownSwitchPin)==LOW)	// Active low
-		{
-			SDswitchPressedCount++;
-			if (SDswitchPressedCount>SDswitchActivateCount)
-			{
-				// Turn of network light as acknokwledge
-				digitalWrite(networkStatusPin, HIGH);
-				printf("Shutting down!\n");
-				system("/usr/local/sbin/astdn.sh");
-				delay(5000);
-				system("/usr/bin/poweroff");
-				break;
-			}
-			
-		}
-		else
-			SDswitchPressedCount=0;
-		
-		
-		// if enabled check network status, but only netCheckDivisor times through the main loop
-		if ((loopCount++ % netCheckDivisor)==0 && networkStatusOn)  
-			wifiLightHandler();
-		delay(LoopDelayMs);
-	}
+	seqStart(&startupSeq);
+	evloopRun();
 	
-	// ......Can't actually get here....
 	// Close out ini
 	iniparser_freedict(ini);
 
@@ -0,0 +1,625 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  ami.c
+*
+*  Synopsis:	Asterisk Manager Interface client.  Logs in over TCP, subscribes
+*				to events and keeps an event driven view of the node: whether
+*				its IAX2 registration is up and which nodes are linked (from
+*				app_rpt's RPT_ALINKS).  One RptStatus / IAXregistry round trip
+*				after login seeds the view, after that it only changes on
+*				events.  The view goes to the network LED, shared state, MQTT
+*				and metrics.  Reconnects with back-off if Asterisk goes away.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <iniparser.h>
+
+#include "ami.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+#include "mqtt.h"
+#include "shmstate.h"
+
+#define AMI_READ_BUF			4096
+#define AMI_LINE_LEN			512
+#define AMI_CMD_LEN				256
+#define AMI_MAX_LINKS			SHMSTATE_LINKS
+#define AMI_NODE_LEN			SHMSTATE_NODE_LEN
+#define AMI_RECONNECT_MIN_MS	1000
+#define AMI_RECONNECT_MAX_MS	30000
+#define AMI_CONNECT_TIMEOUT_MS	5000
+#define AMI_MAX_ADDRS			4
+#define DEFAULT_AMI_HOST		"127.0.0.1"
+#define DEFAULT_AMI_PORT		"5038"
+#define DEFAULT_AMI_USER		"admin"
+
+// The fields of one AMI message (event or response) we care about
+typedef struct
+{
+	char		event[32];
+	char		response[16];
+	char		actionId[16];
+	char		status[32];				// Registry Status: / RegistryEntry State:
+	char		channelType[16];
+	char		node[16];
+	char		variable[32];
+	char		value[AMI_LINE_LEN];	// Value: / EventValue:
+	char		alinks[AMI_LINE_LEN];	// Var: RPT_ALINKS=... in RptStatus output
+	char		message[64];
+} amiMsg_t;
+
+static bool			enabled=false;
+static bool			ledRegistered=false;	// network LED shows registration, not IP
+static char			host[64];
+static char			port[8];
+static char			user[32];
+static char			secret[64];
+static char			node[16];				// our node, "" = any
+static struct sockaddr_storage addrs[AMI_MAX_ADDRS];	// host:port, resolved once by amiInit()
+static socklen_t	addrLens[AMI_MAX_ADDRS];
+static int			numAddrs=0;
+static int			tryAddr=0;				// the one being connected to
+static int			amiFd=-1;
+static bool			connecting=false;		// amiFd is a poller waiting for the connect
+static int			reconnectTimer=-1;
+static uint32_t		backoffMs=AMI_RECONNECT_MIN_MS;
+static bool			loggedIn=false;
+static char			line[AMI_LINE_LEN];
+static int			lineLen=0;
+static amiMsg_t		msg;
+
+static bool			registered=false;
+static int			numLinks=0;
+static char			links[AMI_MAX_LINKS][AMI_NODE_LEN];
+static void			(*changeHandler)(void)=NULL;
+
+static metric_t		*mConnected;
+static metric_t		*mRegistered;
+static metric_t		*mLinks;
+static metric_t		*mLinksKeyed;
+static metric_t		*mEvents;
+static metric_t		*mLinkChanges;
+static metric_t		*mRegChanges;
+static metric_t		*mDisconnects;
+
+static void amiConnectHandler(int fd, uint32_t events, void *ctx);
+
+
+/*-----------------------------------------------------------------------------
+	Publishing the view
+-----------------------------------------------------------------------------*/
+static void amiPublish(void)
+{
+	cosmonShared_t *sh;
+	char list[AMI_MAX_LINKS*AMI_NODE_LEN];
+	int i, len=0;
+
+	sh=shmstateBegin();
+	sh->amiConnected=	loggedIn;
+	sh->registered=		registered;
+	sh->numLinks=		numLinks;
+	memcpy(sh->links, links, sizeof(sh->links));
+	shmstateEnd();
+
+	list[0]='\0';
+	for (i=0; i<numLinks && i<AMI_MAX_LINKS; i++)
+		len+=snprintf(list+len, sizeof(list)-len, "%s%s", i ? "," : "", links[i]);
+	mqttState("registered", registered ? "yes" : "no");
+	mqttState("links", list);
+
+	metricsSet(mConnected, loggedIn);
+	metricsSet(mRegistered, registered);
+	metricsSet(mLinks, numLinks);
+
+	if (changeHandler)
+		changeHandler();
+}
+
+static void amiSetRegistered(bool reg)
+{
+	if (reg==registered)
+		return;
+	printf("Node %s\n", reg ? "registered" : "not registered");
+	registered=reg;
+	metricsInc(mRegChanges);
+	amiPublish();
+}
+
+static bool amiHasLink(char (*list)[AMI_NODE_LEN], int n, const char *id)
+{
+	int i;
+
+	for (i=0; i<n && i<AMI_MAX_LINKS; i++)
+	{
+		if (strcmp(list[i], id)==0)
+			return true;
+	}
+	return false;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	amiSetLinks
+Synopsis:
+	Takes a new RPT_ALINKS value, e.g. "2,2001TU,2002RK": the number of
+	links, then each node with its mode (T transceive, R monitor,
+	C connecting) and whether it's keyed (K/U).  Logs what changed.
+Author:
+	agent
+Inputs:
+	const char *alinks: RPT_ALINKS value
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void amiSetLinks(const char *alinks)
+{
+	char buf[AMI_LINE_LEN];
+	char newLinks[AMI_MAX_LINKS][AMI_NODE_LEN];
+	char *tok, *save;
+	int n=0, keyed=0, count, len, i;
+	bool changed;
+
+	snprintf(buf, sizeof(buf), "%s", alinks);
+	tok=strtok_r(buf, ",", &save);
+	if (tok==NULL)
+		return;
+	count=atoi(tok);
+
+	memset(newLinks, 0, sizeof(newLinks));
+	while ((tok=strtok_r(NULL, ",", &save))!=NULL)
+	{
+		// Node number is everything before the mode / keyed letters
+		len=strlen(tok);
+		if (len>2)
+		{
+			if (tok[len-1]=='K')
+				keyed++;
+			tok[len-2]='\0';
+		}
+		if (n<AMI_MAX_LINKS)
+			snprintf(newLinks[n], AMI_NODE_LEN, "%s", tok);
+		n++;
+	}
+	if (count<n)
+		count=n;
+	metricsSet(mLinksKeyed, keyed);
+
+	changed=(count!=numLinks);
+	for (i=0; i<n && i<AMI_MAX_LINKS; i++)
+	{
+		if (!amiHasLink(links, numLinks, newLinks[i]))
+		{
+			printf("Node %s linked\n", newLinks[i]);
+			metricsInc(mLinkChanges);
+			changed=true;
+		}
+	}
+	for (i=0; i<numLinks && i<AMI_MAX_LINKS; i++)
+	{
+		if (!amiHasLink(newLinks, n, links[i]))
+		{
+			printf("Node %s unlinked\n", links[i]);
+			metricsInc(mLinkChanges);
+			changed=true;
+		}
+	}
+	if (!changed)
+		return;
+
+	memcpy(links, newLinks, sizeof(links));
+	numLinks=count;
+	amiPublish();
+}
+
+/*-----------------------------------------------------------------------------
+	Connection
+-----------------------------------------------------------------------------*/
+static void amiSend(const char *action)
+{
+	if (amiFd>=0)
+		evloopWrite(amiFd, action, strlen(action));
+}
+
+// Ask for the current state, events keep it up to date from there
+static void amiSync(void)
+{
+	char cmd[AMI_CMD_LEN];
+
+	amiSend("Action: IAXregistry\r\nActionID: reg\r\n\r\n");
+	if (node[0])
+	{
+		snprintf(cmd, sizeof(cmd), "Action: RptStatus\r\nCommand: XStat\r\nNode: %s\r\nActionID: xstat\r\n\r\n", node);
+		amiSend(cmd);
+	}
+}
+
+static void amiDisconnect(void)
+{
+	if (amiFd>=0)
+	{
+		evloopRemove(amiFd);
+		close(amiFd);
+		amiFd=-1;
+	}
+	connecting=false;
+	lineLen=0;
+	memset(&msg, 0, sizeof(msg));
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	amiLost
+Synopsis:
+	Connection failed, dropped or login refused.  With Asterisk gone the
+	node is neither registered nor linked.  Back off and try again.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void amiLost(void)
+{
+	amiDisconnect();
+	if (loggedIn)
+	{
+		fprintf(stderr, "Lost connection to Asterisk manager\n");
+		metricsInc(mDisconnects);
+		loggedIn=false;
+		registered=false;
+		numLinks=0;
+		memset(links, 0, sizeof(links));
+		amiPublish();
+	}
+
+	tryAddr=0;
+	evloopArmTimer(reconnectTimer, backoffMs, 0);
+	backoffMs*=2;
+	if (backoffMs>AMI_RECONNECT_MAX_MS)
+		backoffMs=AMI_RECONNECT_MAX_MS;
+}
+
+// Value of a "Key: Value" line into field if the key matches
+static bool amiField(const char *key, const char *val, const char *want, char *field, size_t size)
+{
+	if (strcasecmp(key, want)!=0)
+		return false;
+	snprintf(field, size, "%s", val);
+	return true;
+}
+
+static void amiLine(char *l)
+{
+	char *val=strstr(l, ": ");
+
+	if (val==NULL)
+		return;			// banner
+	*val='\0';
+	val+=2;
+
+	if (amiField(l, val, "Event", msg.event, sizeof(msg.event)) ||
+		amiField(l, val, "Response", msg.response, sizeof(msg.response)) ||
+		amiField(l, val, "ActionID", msg.actionId, sizeof(msg.actionId)) ||
+		amiField(l, val, "Status", msg.status, sizeof(msg.status)) ||
+		amiField(l, val, "State", msg.status, sizeof(msg.status)) ||
+		amiField(l, val, "ChannelType", msg.channelType, sizeof(msg.channelType)) ||
+		amiField(l, val, "Node", msg.node, sizeof(msg.node)) ||
+		amiField(l, val, "Variable", msg.variable, sizeof(msg.variable)) ||
+		amiField(l, val, "Value", msg.value, sizeof(msg.value)) ||
+		amiField(l, val, "EventValue", msg.value, sizeof(msg.value)) ||
+		amiField(l, val, "Message", msg.message, sizeof(msg.message)))
+		return;
+
+	if (strcasecmp(l, "Var")==0 && strncmp(val, "RPT_ALINKS=", 11)==0)
+		snprintf(msg.alinks, sizeof(msg.alinks), "%s", val+11);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	amiMessage
+Synopsis:
+	One complete message (blank line seen).  Login response, the state
+	query responses, and the events that change the view.
+Author:
+	agent
+Inputs:
+	None (uses msg)
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void amiMessage(void)
+{
+	bool ourNode=(node[0]=='\0' || msg.node[0]=='\0' || strcmp(msg.node, node)==0);
+
+	if (strcmp(msg.actionId, "login")==0)
+	{
+		if (strcasecmp(msg.response, "Success")!=0)
+		{
+			fprintf(stderr, "Asterisk manager login failed: %s\n", msg.message);
+			backoffMs=AMI_RECONNECT_MAX_MS;
+			amiLost();
+			return;
+		}
+		printf("Logged in to Asterisk manager\n");
+		loggedIn=true;
+		backoffMs=AMI_RECONNECT_MIN_MS;
+		amiPublish();
+		amiSync();
+		return;
+	}
+	if (strcmp(msg.actionId, "xstat")==0 && msg.alinks[0])
+	{
+		amiSetLinks(msg.alinks);
+		return;
+	}
+	if (msg.event[0]=='\0')
+		return;
+
+	metricsInc(mEvents);
+	if (strcasecmp(msg.event, "Registry")==0 && (msg.channelType[0]=='\0' || strcasecmp(msg.channelType, "IAX2")==0))
+		amiSetRegistered(strcasecmp(msg.status, "Registered")==0);
+	else if (strcasecmp(msg.event, "RegistryEntry")==0)
+		amiSetRegistered(strcasecmp(msg.status, "Registered")==0);
+	else if (strcasecmp(msg.event, "RPT_ALINKS")==0 && ourNode)
+		amiSetLinks(msg.value);
+	else if (strcasecmp(msg.event, "VarSet")==0 && strcmp(msg.variable, "RPT_ALINKS")==0)
+		amiSetLinks(msg.value);
+	else if (strcasecmp(msg.event, "FullyBooted")==0)
+		amiSync();
+}
+
+static void amiReadHandler(int fd, const uint8_t *data, ssize_t len, void *ctx)
+{
+	ssize_t i;
+
+	(void)fd;
+	(void)ctx;
+	if (len<=0)
+	{
+		amiLost();
+		return;
+	}
+
+	for (i=0; i<len; i++)
+	{
+		if (data[i]=='\r')
+			continue;
+		if (data[i]!='\n')
+		{
+			if (lineLen<AMI_LINE_LEN-1)			// long lines get cut short
+				line[lineLen++]=data[i];
+			continue;
+		}
+
+		line[lineLen]='\0';
+		if (lineLen==0)
+		{
+			amiMessage();
+			memset(&msg, 0, sizeof(msg));
+		}
+		else
+			amiLine(line);
+		lineLen=0;
+	}
+}
+
+// Connected: read from here on and log in.  The login response arrives on the loop.
+static int amiLogin(int fd)
+{
+	char login[AMI_CMD_LEN];
+
+	if (evloopAddReader(fd, AMI_READ_BUF, amiReadHandler, NULL)<0)
+		return -1;
+	amiFd=fd;
+	tryAddr=0;
+
+	// Events: on for everything, we pick out what we need
+	snprintf(login, sizeof(login), "Action: Login\r\nUsername: %s\r\nSecret: %s\r\nEvents: on\r\nActionID: login\r\n\r\n",
+			 user, secret);
+	amiSend(login);
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	amiConnect
+Synopsis:
+	Starts a non-blocking connect to the first of host's addresses from
+	tryAddr on that doesn't fail straight away.  The connect finishes in
+	amiConnectHandler(); the reconnect timer doubles as its time limit so
+	a host that doesn't answer can't hold things up.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	0 if connected or connecting, -1 on failure
+-----------------------------------------------------------------------------*/
+static int amiConnect(void)
+{
+	int fd;
+
+	for (; tryAddr<numAddrs; tryAddr++)
+	{
+		fd=socket(addrs[tryAddr].ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd<0)
+			continue;
+		if (connect(fd, (struct sockaddr *)&addrs[tryAddr], addrLens[tryAddr])==0)
+		{
+			if (amiLogin(fd)==0)
+				return 0;
+		}
+		else if (errno==EINPROGRESS && evloopAddPoller(fd, EPOLLOUT, amiConnectHandler, NULL)==0)
+		{
+			amiFd=fd;
+			connecting=true;
+			evloopArmTimer(reconnectTimer, AMI_CONNECT_TIMEOUT_MS, 0);
+			return 0;
+		}
+		close(fd);
+	}
+	return -1;
+}
+
+// Writable: the connect is done one way or the other
+static void amiConnectHandler(int fd, uint32_t events, void *ctx)
+{
+	int err=0;
+	socklen_t len=sizeof(err);
+
+	(void)events;
+	(void)ctx;
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len)<0)
+		err=errno;
+
+	evloopArmTimer(reconnectTimer, 0, 0);
+	evloopRemove(fd);
+	amiFd=-1;
+	connecting=false;
+	if (err==0 && amiLogin(fd)==0)
+		return;
+
+	// Next address, if there is one, before backing off
+	close(fd);
+	tryAddr++;
+	if (amiConnect()<0)
+		amiLost();
+}
+
+static void amiReconnectHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	if (connecting)
+	{
+		// Connect timed out
+		amiDisconnect();
+		tryAddr++;
+	}
+	if (amiConnect()<0)
+		amiLost();
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	amiInit
+Synopsis:
+	Reads [ami] and looks up the host.  Connecting waits for amiStart(),
+	once Asterisk is up.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void amiInit(void)
+{
+	struct addrinfo hints, *res, *ai;
+
+	enabled=iniparser_getboolean(ini, "ami:enable", 0);
+	if (!enabled)
+		return;
+
+	snprintf(host, sizeof(host), "%s",		iniparser_getstring(ini, "ami:host", DEFAULT_AMI_HOST));
+	snprintf(port, sizeof(port), "%s",		iniparser_getstring(ini, "ami:port", DEFAULT_AMI_PORT));
+	snprintf(user, sizeof(user), "%s",		iniparser_getstring(ini, "ami:username", DEFAULT_AMI_USER));
+	snprintf(secret, sizeof(secret), "%s",	iniparser_getstring(ini, "ami:secret", ""));
+	snprintf(node, sizeof(node), "%s",		iniparser_getstring(ini, "ami:node", ""));
+	ledRegistered=iniparser_getboolean(ini, "ami:network_led_registered", 0);
+
+	// Once, here: a lookup on the loop could block it for seconds
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family=AF_UNSPEC;
+	hints.ai_socktype=SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res)!=0)
+	{
+		fprintf(stderr, "Asterisk manager: can't resolve %s:%s, AMI disabled\n", host, port);
+		enabled=false;
+		return;
+	}
+	for (ai=res; ai && numAddrs<AMI_MAX_ADDRS; ai=ai->ai_next)
+	{
+		memcpy(&addrs[numAddrs], ai->ai_addr, ai->ai_addrlen);
+		addrLens[numAddrs++]=ai->ai_addrlen;
+	}
+	freeaddrinfo(res);
+
+	mConnected=		metricsRegister("cosmon_ami_connected", "Logged in to the Asterisk manager", METRIC_GAUGE);
+	mRegistered=	metricsRegister("cosmon_node_registered", "Node's IAX2 registration is up", METRIC_GAUGE);
+	mLinks=			metricsRegister("cosmon_node_links", "Nodes linked to this one", METRIC_GAUGE);
+	mLinksKeyed=	metricsRegister("cosmon_node_links_keyed", "Linked nodes currently keyed", METRIC_GAUGE);
+	mEvents=		metricsRegister("cosmon_ami_events_total", "Asterisk manager events received", METRIC_COUNTER);
+	mLinkChanges=	metricsRegister("cosmon_node_link_changes_total", "Nodes linked or unlinked", METRIC_COUNTER);
+	mRegChanges=	metricsRegister("cosmon_node_registration_changes_total", "Registration went up or down", METRIC_COUNTER);
+	mDisconnects=	metricsRegister("cosmon_ami_disconnects_total", "Asterisk manager connection drops", METRIC_COUNTER);
+
+	reconnectTimer=evloopAddTimer(0, 0, amiReconnectHandler, NULL);
+	printf("\tAsterisk manager: %s:%s%s%s%s\n", host, port, node[0] ? ", node " : "", node,
+		   ledRegistered ? ", LED shows registration" : "");
+}
+
+void amiStart(void)
+{
+	if (enabled && amiFd<0 && amiConnect()<0)
+		amiLost();
+}
+
+bool amiRegistered(void)
+{
+	return registered;
+}
+
+int amiLinks(void)
+{
+	return numLinks;
+}
+
+// Network LED: with network_led_registered it waits for the registration too
+bool amiLedUp(void)
+{
+	return !enabled || !ledRegistered || registered;
+}
+
+// Called whenever registration or links change
+void amiSetChangeHandler(void (*handler)(void))
+{
+	changeHandler=handler;
+}
@@ -0,0 +1,45 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  ami.h
+*
+*  Synopsis:	Header file for ami.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _AMI
+#define _AMI
+
+#include <stdbool.h>
+
+void amiInit(void);
+void amiStart(void);
+bool amiRegistered(void);
+int  amiLinks(void);
+bool amiLedUp(void);
+void amiSetChangeHandler(void (*handler)(void));
+
+#endif
@@ -0,0 +1,219 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  astctl.c
+*
+*  Synopsis:	Persistent connection to Asterisk's remote console socket
+*				(the same one "asterisk -rx" uses).  Commands are written as
+*				NUL terminated strings through the event loop instead of
+*				fork/exec'ing an asterisk binary for every COS edge.
+*				While the socket is down commands are dropped; whoever
+*				reconnects is expected to resend the current state.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "astctl.h"
+#include "evloop.h"
+#include "metrics.h"
+
+#define ASTCTL_READ_BUF		1024
+
+static int			astFd=-1;
+static void			(*disconnectHandler)(void)=NULL;
+static void			(*cmdSink)(const char *cmd, evloopWriteDone_t done, void *ctx)=NULL;
+static metric_t		*mCommands;
+static metric_t		*mDropped;
+static metric_t		*mDisconnects;
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	astctlReadHandler
+Synopsis:
+	Asterisk sends a banner and the output of each command.  We don't need
+	any of it, but we have to drain it and notice when the socket closes.
+Author:
+	agent
+Inputs:
+	standard evloop read handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void astctlReadHandler(int fd, const uint8_t *data, ssize_t len, void *ctx)
+{
+	(void)fd;
+	(void)data;
+	(void)ctx;
+
+	if (len>0)
+		return;
+
+	fprintf(stderr, "Lost connection to Asterisk\n");
+	metricsInc(mDisconnects);
+	astctlDisconnect();
+	if (disconnectHandler)
+		disconnectHandler();
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	astctlConnect
+Synopsis:
+	Connects to the Asterisk control socket and registers it with the loop.
+Author:
+	agent
+Inputs:
+	const char *sockPath: path of asterisk.ctl
+Outputs:
+	0 on success, -1 on failure
+-----------------------------------------------------------------------------*/
+int astctlConnect(const char *sockPath)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (mCommands==NULL)
+	{
+		mCommands=		metricsRegister("cosmon_asterisk_commands_total", "Commands sent to Asterisk", METRIC_COUNTER);
+		mDropped=		metricsRegister("cosmon_asterisk_dropped_commands_total", "Commands dropped because Asterisk was not connected", METRIC_COUNTER);
+		mDisconnects=	metricsRegister("cosmon_asterisk_disconnects_total", "Asterisk control socket disconnects", METRIC_COUNTER);
+	}
+
+	if (astFd>=0)
+		return 0;
+
+	fd=socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd<0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strncpy(addr.sun_path, sockPath, sizeof(addr.sun_path)-1);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))<0)
+	{
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	if (evloopAddReader(fd, ASTCTL_READ_BUF, astctlReadHandler, NULL)<0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	astFd=fd;
+	return 0;
+}
+
+void astctlDisconnect(void)
+{
+	if (astFd<0)
+		return;
+	evloopRemove(astFd);
+	close(astFd);
+	astFd=-1;
+}
+
+bool astctlConnected(void)
+{
+	return astFd>=0;
+}
+
+// Called when Asterisk goes away (not on astctlDisconnect())
+void astctlSetDisconnectHandler(void (*handler)(void))
+{
+	disconnectHandler=handler;
+}
+
+// Soak test: commands go to sink() instead of Asterisk, it calls done()
+void astctlSetSink(void (*sink)(const char *cmd, evloopWriteDone_t done, void *ctx))
+{
+	cmdSink=sink;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	astctlCommand
+Synopsis:
+	Sends one CLI command to Asterisk.  Queued on the event loop so several
+	commands in one pass go out as one batch.
+Author:
+	agent
+Inputs:
+	const char *cmd: CLI command, e.g. "susb tune menu-support K"
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void astctlCommand(const char *cmd)
+{
+	astctlCommandNotify(cmd, NULL, NULL);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	astctlCommandNotify
+Synopsis:
+	Same as astctlCommand() but done() is called once the command has been
+	handed to Asterisk.  Not called if the command was dropped.
+Author:
+	agent
+Inputs:
+	const char *cmd: CLI command
+	evloopWriteDone_t done: completion callback
+	void *ctx: passed back to done()
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void astctlCommandNotify(const char *cmd, evloopWriteDone_t done, void *ctx)
+{
+	if (cmdSink)
+	{
+		metricsInc(mCommands);
+		cmdSink(cmd, done, ctx);
+		return;
+	}
+
+	if (astFd<0)
+	{
+		metricsInc(mDropped);
+		return;
+	}
+
+	// Asterisk splits commands on the terminating NUL, so send it too
+	metricsInc(mCommands);
+	evloopWriteNotify(astFd, cmd, strlen(cmd)+1, done, ctx);
+}
@@ -0,0 +1,50 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  astctl.h
+*
+*  Synopsis:	Header file for astctl.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _ASTCTL
+#define _ASTCTL
+
+#include <stdbool.h>
+
+#include "evloop.h"
+
+#define ASTCTL_SOCKET		"/var/run/asterisk.ctl"
+
+int  astctlConnect(const char *sockPath);
+void astctlDisconnect(void);
+bool astctlConnected(void);
+void astctlSetDisconnectHandler(void (*handler)(void));
+void astctlCommand(const char *cmd);
+void astctlCommandNotify(const char *cmd, evloopWriteDone_t done, void *ctx);
+void astctlSetSink(void (*sink)(const char *cmd, evloopWriteDone_t done, void *ctx));
+
+#endif
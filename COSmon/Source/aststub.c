@@ -0,0 +1,664 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  aststub.c
+*
+*  Synopsis:	Asterisk stand-in for testing COSmon's command path on any
+*				machine.  Serves the remote console socket (NUL terminated
+*				CLI commands, what astctl.c talks to) and optionally AMI on a
+*				TCP port (enough of it for ami.c), logs every command with a
+*				timestamp, and injects faults on request: slow command
+*				processing, error replies, silently dropped commands,
+*				disconnects, restarts (socket gone for a while), replies in
+*				small pieces and a tiny receive buffer so COSmon's writes
+*				come up short.  Not part of COSmon itself: make aststub.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define STUB_MAX_CONNS			8
+#define STUB_BUF				4096
+#define STUB_CHUNK_GAP_US		1000			// between the pieces of a reply
+#define DEFAULT_STUB_SOCKET		"/tmp/aststub.ctl"
+#define DEFAULT_STUB_NODE		"1999"
+
+typedef struct
+{
+	int			fd;						// -1 = free
+	bool		ami;
+	int			id;
+	char		buf[STUB_BUF+1];		// NUL terminated for strstr()
+	size_t		len;
+	uint64_t	holdUs;					// "busy" with the last command until then
+	uint64_t	lastUs;					// last command, for the gap in the log
+	uint32_t	cmds;
+} stubConn_t;
+
+typedef struct
+{
+	uint64_t	commands;
+	uint64_t	dropped;
+	uint64_t	errors;
+	uint64_t	disconnects;
+	uint64_t	gapSumUs;
+	uint64_t	gapMinUs;
+	uint64_t	gapMaxUs;
+	uint64_t	gaps;
+} stubStats_t;
+
+// Options
+static const char	*sockPath=DEFAULT_STUB_SOCKET;
+static int			amiPort=0;				// 0 = no AMI
+static const char	*node=DEFAULT_STUB_NODE;
+static uint32_t		delayMs=0;
+static uint32_t		jitterMs=0;
+static uint32_t		errorPct=0;
+static uint32_t		dropPct=0;
+static uint32_t		disconnectEvery=0;		// commands, 0 = never
+static uint32_t		restartMs=0;			// with disconnectEvery: socket gone this long
+static uint32_t		chunkBytes=0;			// 0 = replies in one write
+static int			rcvBuf=0;
+
+static stubConn_t	conns[STUB_MAX_CONNS];
+static int			ctlListenFd=-1;
+static int			amiListenFd=-1;
+static uint64_t		restartUs=0;			// listeners come back then
+static int			nextId=1;
+static uint32_t		restarts=0;
+static stubStats_t	ctlStats;
+static stubStats_t	amiStats;
+static uint64_t		startUs;
+static volatile sig_atomic_t quit=0;
+
+
+static uint64_t stubNowUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
+
+static bool stubChance(uint32_t pct)
+{
+	return pct && (uint32_t)(rand()%100)<pct;
+}
+
+static void stubQuit(int sig)
+{
+	(void)sig;
+	quit=1;
+}
+
+// Seconds since start, then the connection
+static void stubLog(const stubConn_t *c, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void stubLog(const stubConn_t *c, const char *fmt, ...)
+{
+	uint64_t t=stubNowUs()-startUs;
+	va_list ap;
+
+	printf("%6llu.%06llu ", (unsigned long long)t/1000000, (unsigned long long)t%1000000);
+	if (c)
+		printf("[%s %d] ", c->ami ? "ami" : "ctl", c->id);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	stubSend
+Synopsis:
+	Writes a reply, in chunkBytes pieces with a short gap between them if
+	asked to, so the client has to put it back together.
+Author:
+	agent
+Inputs:
+	stubConn_t *c: connection
+	const char *data: reply
+	size_t len: its length
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void stubSend(stubConn_t *c, const char *data, size_t len)
+{
+	size_t n;
+	ssize_t ret;
+
+	while (len>0)
+	{
+		n=(chunkBytes && len>chunkBytes) ? chunkBytes : len;
+		ret=send(c->fd, data, n, MSG_NOSIGNAL);
+		if (ret<=0)
+			return;
+		data+=ret;
+		len-=ret;
+		if (len>0 && chunkBytes)
+			usleep(STUB_CHUNK_GAP_US);
+	}
+}
+
+static void stubClose(stubConn_t *c, stubStats_t *st)
+{
+	stubLog(c, "disconnect after %u commands", c->cmds);
+	close(c->fd);
+	c->fd=-1;
+	st->disconnects++;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	stubListen
+Synopsis:
+	(Re)creates the console socket and, if wanted, the AMI port.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	0 on success, -1 on failure
+-----------------------------------------------------------------------------*/
+static int stubListen(void)
+{
+	struct sockaddr_un addr;
+	struct sockaddr_in in;
+	int one=1;
+
+	ctlListenFd=socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	strncpy(addr.sun_path, sockPath, sizeof(addr.sun_path)-1);
+	unlink(sockPath);
+	if (ctlListenFd<0 || bind(ctlListenFd, (struct sockaddr *)&addr, sizeof(addr))<0 || listen(ctlListenFd, 4)<0)
+	{
+		fprintf(stderr, "aststub: %s: %s\n", sockPath, strerror(errno));
+		return -1;
+	}
+
+	if (amiPort==0)
+		return 0;
+	amiListenFd=socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	setsockopt(amiListenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&in, 0, sizeof(in));
+	in.sin_family=		AF_INET;
+	in.sin_port=		htons(amiPort);
+	in.sin_addr.s_addr=	htonl(INADDR_LOOPBACK);
+	if (amiListenFd<0 || bind(amiListenFd, (struct sockaddr *)&in, sizeof(in))<0 || listen(amiListenFd, 4)<0)
+	{
+		fprintf(stderr, "aststub: AMI port %d: %s\n", amiPort, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+// Asterisk restart: every connection dropped, sockets gone for restartMs
+static void stubRestart(void)
+{
+	int i;
+
+	for (i=0; i<STUB_MAX_CONNS; i++)
+	{
+		if (conns[i].fd>=0)
+			stubClose(&conns[i], conns[i].ami ? &amiStats : &ctlStats);
+	}
+	close(ctlListenFd);
+	unlink(sockPath);
+	ctlListenFd=-1;
+	if (amiListenFd>=0)
+		close(amiListenFd);
+	amiListenFd=-1;
+	restarts++;
+	restartUs=stubNowUs()+(uint64_t)restartMs*1000;
+	stubLog(NULL, "restart, back in %u ms", restartMs);
+}
+
+static void stubAccept(int listenFd, bool ami)
+{
+	stubConn_t *c=NULL;
+	int fd;
+	int i;
+
+	fd=accept(listenFd, NULL, NULL);
+	if (fd<0)
+		return;
+	for (i=0; i<STUB_MAX_CONNS && c==NULL; i++)
+	{
+		if (conns[i].fd<0)
+			c=&conns[i];
+	}
+	if (c==NULL)
+	{
+		close(fd);
+		return;
+	}
+
+	memset(c, 0, sizeof(*c));
+	c->fd=	fd;
+	c->ami=	ami;
+	c->id=	nextId++;
+	if (rcvBuf)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+	stubLog(c, "connect");
+
+	// Same greetings as the real thing
+	if (ami)
+		stubSend(c, "Asterisk Call Manager/1.1\r\n", 27);
+	else
+		stubSend(c, "aststub/0/Asterisk\0", 19);
+}
+
+// Pulls one header's value out of an AMI message
+static void stubHeader(const char *msg, const char *name, char *out, size_t outLen)
+{
+	const char *p=msg;
+	size_t nameLen=strlen(name);
+	size_t n;
+
+	out[0]='\0';
+	while (p && *p)
+	{
+		if (strncasecmp(p, name, nameLen)==0 && p[nameLen]==':')
+		{
+			p+=nameLen+1;
+			while (*p==' ')
+				p++;
+			n=strcspn(p, "\r\n");
+			if (n>=outLen)
+				n=outLen-1;
+			memcpy(out, p, n);
+			out[n]='\0';
+			return;
+		}
+		p=strchr(p, '\n');
+		if (p)
+			p++;
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	stubAmi
+Synopsis:
+	Answers one AMI action: just enough of Login, IAXregistry, RptStatus,
+	Ping and Logoff for ami.c.
+Author:
+	agent
+Inputs:
+	stubConn_t *c: connection
+	const char *msg: the action, headers separated by CRLF
+	bool error: inject an error reply
+Outputs:
+	false if the connection was closed
+-----------------------------------------------------------------------------*/
+static bool stubAmi(stubConn_t *c, const char *msg, bool error)
+{
+	char action[64], id[64], reply[512];
+
+	stubHeader(msg, "Action", action, sizeof(action));
+	stubHeader(msg, "ActionID", id, sizeof(id));
+
+	if (error)
+		snprintf(reply, sizeof(reply), "Response: Error\r\nActionID: %s\r\nMessage: Injected error\r\n\r\n", id);
+	else if (strcasecmp(action, "Login")==0)
+		snprintf(reply, sizeof(reply), "Response: Success\r\nActionID: %s\r\nMessage: Authentication accepted\r\n\r\n"
+				 "Event: FullyBooted\r\nPrivilege: system,all\r\nStatus: Fully Booted\r\n\r\n", id);
+	else if (strcasecmp(action, "IAXregistry")==0)
+		snprintf(reply, sizeof(reply), "Response: Success\r\nActionID: %s\r\nEventList: start\r\n\r\n"
+				 "Event: RegistryEntry\r\nActionID: %s\r\nHost: register.allstarlink.org\r\nState: Registered\r\n\r\n"
+				 "Event: RegistrationsComplete\r\nActionID: %s\r\n\r\n", id, id, id);
+	else if (strcasecmp(action, "RptStatus")==0)
+		snprintf(reply, sizeof(reply), "Response: Success\r\nActionID: %s\r\nNode: %s\r\nVar: RPT_ALINKS=0\r\n\r\n", id, node);
+	else if (strcasecmp(action, "Ping")==0)
+		snprintf(reply, sizeof(reply), "Response: Success\r\nActionID: %s\r\nPing: Pong\r\n\r\n", id);
+	else if (strcasecmp(action, "Logoff")==0)
+	{
+		snprintf(reply, sizeof(reply), "Response: Goodbye\r\nActionID: %s\r\nMessage: Thanks for all the fish.\r\n\r\n", id);
+		stubSend(c, reply, strlen(reply));
+		stubClose(c, &amiStats);
+		return false;
+	}
+	else
+		snprintf(reply, sizeof(reply), "Response: Error\r\nActionID: %s\r\nMessage: Invalid/unknown command\r\n\r\n", id);
+
+	stubSend(c, reply, strlen(reply));
+	return true;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	stubCommand
+Synopsis:
+	One command (console) or action (AMI) off a connection: logged, then
+	dropped, failed or answered, then the connection is busy for the delay
+	and maybe gets cut off.
+Author:
+	agent
+Inputs:
+	stubConn_t *c: connection
+	const char *msg: NUL terminated command / action
+Outputs:
+	false if the connection was closed
+-----------------------------------------------------------------------------*/
+static bool stubCommand(stubConn_t *c, const char *msg)
+{
+	stubStats_t *st=c->ami ? &amiStats : &ctlStats;
+	uint64_t now=stubNowUs();
+	uint64_t gap=c->cmds ? now-c->lastUs : 0;
+	char oneLine[STUB_BUF+1];
+	char reply[512];
+	const char *q;
+	char *p;
+	bool drop, error;
+
+	// AMI headers on one line in the log
+	for (p=oneLine, q=msg; *q && p<oneLine+STUB_BUF; q++)
+	{
+		if (*q!='\r')
+			*p++=(*q=='\n' ? '|' : *q);
+	}
+	*p='\0';
+	drop=stubChance(dropPct);
+	error=!drop && stubChance(errorPct);
+	stubLog(c, "+%llu ms \"%s\"%s", (unsigned long long)gap/1000, oneLine, drop ? " DROPPED" : (error ? " ERROR" : ""));
+
+	st->commands++;
+	if (c->cmds)
+	{
+		st->gapSumUs+=gap;
+		if (st->gaps==0 || gap<st->gapMinUs)
+			st->gapMinUs=gap;
+		if (gap>st->gapMaxUs)
+			st->gapMaxUs=gap;
+		st->gaps++;
+	}
+	c->cmds++;
+	c->lastUs=now;
+	c->holdUs=now+(uint64_t)delayMs*1000+(jitterMs ? (uint64_t)(rand()%jitterMs)*1000 : 0);
+
+	if (drop)
+		st->dropped++;
+	else if (error)
+		st->errors++;
+
+	if (c->ami && !drop)
+	{
+		if (!stubAmi(c, msg, error))
+			return false;
+	}
+	else if (error)
+	{
+		snprintf(reply, sizeof(reply), "No such command '%.200s' (type 'core show help' for other possible commands)\n", msg);
+		stubSend(c, reply, strlen(reply));
+	}
+
+	if (disconnectEvery && c->cmds%disconnectEvery==0)
+	{
+		if (restartMs)
+			stubRestart();
+		else
+			stubClose(c, st);
+		return false;
+	}
+	return true;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	stubProcess
+Synopsis:
+	Runs the complete commands sitting in a connection's buffer, one per
+	delay: a slow Asterisk leaves the rest in the socket.
+Author:
+	agent
+Inputs:
+	stubConn_t *c: connection
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void stubProcess(stubConn_t *c, uint64_t now)
+{
+	char msg[STUB_BUF+1];
+	const char *end;
+	size_t msgLen, used;
+
+	while (c->fd>=0 && now>=c->holdUs && c->len>0)
+	{
+		if (c->ami)
+		{
+			end=strstr(c->buf, "\r\n\r\n");
+			if (end==NULL)
+				break;
+			msgLen=end-c->buf;
+			used=msgLen+4;
+		}
+		else
+		{
+			end=memchr(c->buf, '\0', c->len);
+			if (end==NULL)
+				break;
+			msgLen=end-c->buf;
+			used=msgLen+1;
+		}
+		memcpy(msg, c->buf, msgLen);
+		msg[msgLen]='\0';
+		memmove(c->buf, c->buf+used, c->len-used);
+		c->len-=used;
+		c->buf[c->len]='\0';
+
+		if (!stubCommand(c, msg))
+			return;
+		now=stubNowUs();
+	}
+
+	// full and no end in sight
+	if (c->fd>=0 && c->len>=STUB_BUF)
+	{
+		stubLog(c, "%zu bytes without a complete command, discarded", c->len);
+		c->len=0;
+		c->buf[0]='\0';
+	}
+}
+
+static void stubRead(stubConn_t *c)
+{
+	ssize_t n;
+
+	n=recv(c->fd, c->buf+c->len, STUB_BUF-c->len, 0);
+	if (n>0)
+	{
+		c->len+=n;
+		c->buf[c->len]='\0';
+		return;
+	}
+	if (n<0 && (errno==EINTR || errno==EAGAIN))
+		return;
+	stubLog(c, "closed by COSmon");
+	close(c->fd);
+	c->fd=-1;
+}
+
+static void stubPrintStats(const char *name, const stubStats_t *st)
+{
+	printf("\t%s: %llu commands, %llu dropped, %llu errors, %llu disconnects", name,
+		   (unsigned long long)st->commands, (unsigned long long)st->dropped,
+		   (unsigned long long)st->errors, (unsigned long long)st->disconnects);
+	if (st->gaps)
+		printf(", gap min / avg / max %.1f / %.1f / %.1f ms", st->gapMinUs/1000.0,
+			   st->gapSumUs/1000.0/st->gaps, st->gapMaxUs/1000.0);
+	printf("\n");
+}
+
+static void stubUsage(void)
+{
+	fprintf(stderr,
+		"usage: aststub [options]\n"
+		"\t-u path\t\tconsole socket (default %s)\n"
+		"\t-a port\t\talso serve AMI on 127.0.0.1:port\n"
+		"\t-n node\t\tnode number in AMI replies (default %s)\n"
+		"\t-d ms\t\ttake this long over every command\n"
+		"\t-j ms\t\tplus up to this much at random\n"
+		"\t-e pct\t\tanswer this many commands with an error\n"
+		"\t-x pct\t\tsilently drop this many commands\n"
+		"\t-k n\t\tdisconnect after every n commands on a connection\n"
+		"\t-r ms\t\twith -k, restart instead: sockets gone for ms\n"
+		"\t-p bytes\twrite replies in pieces of this size\n"
+		"\t-b bytes\treceive buffer size, so the client's writes come up short\n"
+		"\t-s seed\t\trandom seed\n",
+		DEFAULT_STUB_SOCKET, DEFAULT_STUB_NODE);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pollfd pfds[STUB_MAX_CONNS+2];
+	stubConn_t *map[STUB_MAX_CONNS+2];
+	unsigned int seed=1;
+	uint64_t now, wakeUs;
+	int timeoutMs, n, i, opt;
+
+	while ((opt=getopt(argc, argv, "u:a:n:d:j:e:x:k:r:p:b:s:h"))!=-1)
+	{
+		switch (opt)
+		{
+			case 'u': sockPath=optarg; break;
+			case 'a': amiPort=atoi(optarg); break;
+			case 'n': node=optarg; break;
+			case 'd': delayMs=atoi(optarg); break;
+			case 'j': jitterMs=atoi(optarg); break;
+			case 'e': errorPct=atoi(optarg); break;
+			case 'x': dropPct=atoi(optarg); break;
+			case 'k': disconnectEvery=atoi(optarg); break;
+			case 'r': restartMs=atoi(optarg); break;
+			case 'p': chunkBytes=atoi(optarg); break;
+			case 'b': rcvBuf=atoi(optarg); break;
+			case 's': seed=atoi(optarg); break;
+			default: stubUsage();
+		}
+	}
+	srand(seed);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGINT, stubQuit);
+	signal(SIGTERM, stubQuit);
+	signal(SIGPIPE, SIG_IGN);
+	for (i=0; i<STUB_MAX_CONNS; i++)
+		conns[i].fd=-1;
+
+	startUs=stubNowUs();
+	if (stubListen()<0)
+		return 1;
+	stubLog(NULL, "listening on %s%s", sockPath, amiPort ? " and AMI" : "");
+
+	while (!quit)
+	{
+		now=stubNowUs();
+		if (ctlListenFd<0 && now>=restartUs)
+		{
+			if (stubListen()<0)
+				return 1;
+			stubLog(NULL, "back up");
+		}
+
+		// Work through whatever is due, then sleep until the next thing is
+		wakeUs=UINT64_MAX;
+		n=0;
+		if (ctlListenFd>=0)
+		{
+			pfds[n].fd=ctlListenFd;
+			pfds[n].events=POLLIN;
+			map[n++]=NULL;
+		}
+		else
+			wakeUs=restartUs;
+		if (amiListenFd>=0)
+		{
+			pfds[n].fd=amiListenFd;
+			pfds[n].events=POLLIN;
+			map[n++]=NULL;
+		}
+		for (i=0; i<STUB_MAX_CONNS; i++)
+		{
+			if (conns[i].fd>=0)
+				stubProcess(&conns[i], now);
+			if (conns[i].fd<0)
+				continue;
+			if (now<conns[i].holdUs)
+			{
+				// busy: leave it in the socket
+				if (conns[i].holdUs<wakeUs)
+					wakeUs=conns[i].holdUs;
+				pfds[n].events=0;
+			}
+			else
+				pfds[n].events=(conns[i].len<STUB_BUF ? POLLIN : 0);
+			pfds[n].fd=conns[i].fd;
+			map[n++]=&conns[i];
+		}
+
+		timeoutMs=(wakeUs==UINT64_MAX ? -1 : (int)((wakeUs-now+999)/1000));
+		if (poll(pfds, n, timeoutMs)<=0)
+			continue;
+
+		for (i=0; i<n; i++)
+		{
+			if (pfds[i].revents==0)
+				continue;
+			if (map[i])
+			{
+				if (map[i]->fd==pfds[i].fd)
+					stubRead(map[i]);
+			}
+			else if (pfds[i].fd==ctlListenFd)
+				stubAccept(ctlListenFd, false);
+			else if (pfds[i].fd==amiListenFd)
+				stubAccept(amiListenFd, true);
+		}
+	}
+
+	printf("\naststub: %u restarts\n", restarts);
+	stubPrintStats("console", &ctlStats);
+	if (amiPort)
+		stubPrintStats("AMI", &amiStats);
+	unlink(sockPath);
+	return 0;
+}
@@ -0,0 +1,413 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  audio.c
+*
+*  Synopsis:	FOB audio capture and analyzer fan-out.  One capture thread per
+*				channel reads 20 ms blocks from ALSA (dsnoop so chan_simpleusb
+*				keeps working, or an snd-aloop device) or from a raw file
+*				("file:/path", S16_LE mono) straight into the channel's audio
+*				ring.  Each analyzer gets its own thread and ring cursor and
+*				reads the blocks in place, so another analyzer costs its own
+*				compute and nothing else.  Nothing here runs on the event loop
+*				thread.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+#include <iniparser.h>
+
+#include "audio.h"
+#include "audioring.h"
+#include "channel.h"
+#include "deadcarrier.h"
+#include "databurst.h"
+#include "latency.h"
+#include "levels.h"
+#include "recorder.h"
+#include "calib.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+typedef struct
+{
+	int					idx;
+	const char			*name;
+	audioBlockFunc_t	block;
+	audioDoneFunc_t		done;
+	audioCursor_t		cursor;
+	const audioSlot_t	*slot;				// block being analysed
+	pthread_t			thread;
+	metric_t			*mOverruns;
+	metric_t			*mTorn;
+	metric_t			*mCpu;
+} audioAnalyzer_t;
+
+typedef struct
+{
+	int				idx;
+	bool			enabled;
+	char			device[AUDIO_DEVICE_LEN];
+	unsigned int	rate;
+	unsigned int	blockFrames;
+	bool			realtime;			// file input: pace at the sample rate
+	audioRing_t		*ring;
+	pthread_t		thread;
+	audioAnalyzer_t	analyzers[AUDIO_MAX_ANALYZERS];
+	int				numAnalyzers;
+	metric_t		*mBlocks;
+} audioChannel_t;
+
+static audioChannel_t	audioChannels[MAX_CHANNELS];
+static __thread audioAnalyzer_t	*curAnalyzer;		// the one this thread runs
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioInit
+Synopsis:
+	Reads a channel's audio config, creates its ring and lets the analyzers
+	hook themselves in.  Channel 1 uses [audio], channel 2 its own
+	[channel 2] capture_device.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+Outputs:
+	0 if audio is enabled for the channel, -1 if not
+-----------------------------------------------------------------------------*/
+int audioInit(int idx)
+{
+	audioChannel_t *ac=&audioChannels[idx];
+	char key[METRICS_NAME_LEN];
+
+	memset(ac, 0, sizeof(*ac));
+	ac->idx=idx;
+
+	if (!iniparser_getboolean(ini, "audio:enable", 0) || !channels[idx].enabled)
+		return -1;
+
+	if (idx==0)
+		snprintf(key, sizeof(key), "audio:capture_device");
+	else
+		snprintf(key, sizeof(key), "channel %d:capture_device", idx+1);
+	snprintf(ac->device, sizeof(ac->device), "%s",
+			 iniparser_getstring(ini, key, idx ? "" : AUDIO_DEFAULT_DEVICE));
+	if (ac->device[0]=='\0')
+		return -1;
+
+	ac->rate=		iniparser_getint(ini, "audio:sample_rate", AUDIO_DEFAULT_RATE);
+	ac->realtime=	iniparser_getboolean(ini, "audio:file_realtime", 1);
+	ac->blockFrames=ac->rate*AUDIO_BLOCK_MS/1000;
+
+	ac->ring=audioRingCreate(idx, ac->rate, ac->blockFrames);
+	if (ac->ring==NULL)
+	{
+		fprintf(stderr, "Channel %d: no audio ring (sample rate too high?), audio disabled\n", idx+1);
+		return -1;
+	}
+
+	snprintf(key, sizeof(key), "cosmon_audio_blocks_total{channel=\"%d\"}", idx+1);
+	ac->mBlocks=metricsRegister(key, "Audio blocks captured (20 ms each)", METRIC_COUNTER);
+	ac->enabled=true;
+
+	deadCarrierInit(idx, ac->rate, ac->blockFrames);
+	dataBurstInit(idx, ac->rate, ac->blockFrames);
+	latencyInit(idx, ac->rate, ac->blockFrames);
+	levelsInit(idx, ac->rate);
+	recorderInit(idx, ac->rate, ac->blockFrames);
+	calibAudioInit(idx);
+	return 0;
+}
+
+bool audioEnabled(int idx)
+{
+	return audioChannels[idx].enabled;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioAddAnalyzer
+Synopsis:
+	Registers an analyzer on a channel's audio.  block() is called on the
+	analyzer's own thread for every block, done() (optional) when file
+	input runs out.  Init time only, before audioStart().
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	const char *name: short name for metrics (must be a literal / static)
+	audioBlockFunc_t block: per block callback
+	audioDoneFunc_t done: end of input callback or NULL
+Outputs:
+	0 on success, -1 if the channel has no audio or too many analyzers
+-----------------------------------------------------------------------------*/
+int audioAddAnalyzer(int idx, const char *name, audioBlockFunc_t block, audioDoneFunc_t done)
+{
+	audioChannel_t *ac=&audioChannels[idx];
+	audioAnalyzer_t *an;
+	char mname[METRICS_NAME_LEN];
+
+	if (!ac->enabled || ac->numAnalyzers>=AUDIO_MAX_ANALYZERS)
+		return -1;
+
+	an=&ac->analyzers[ac->numAnalyzers++];
+	an->idx=idx;
+	an->name=name;
+	an->block=block;
+	an->done=done;
+	snprintf(mname, sizeof(mname), "cosmon_audio_overruns_total{channel=\"%d\",analyzer=\"%s\"}", idx+1, name);
+	an->mOverruns=metricsRegister(mname, "Audio blocks an analyzer lost by falling behind", METRIC_COUNTER);
+	snprintf(mname, sizeof(mname), "cosmon_audio_torn_total{channel=\"%d\",analyzer=\"%s\"}", idx+1, name);
+	an->mTorn=metricsRegister(mname, "Audio blocks overwritten while an analyzer was reading them (also overruns)", METRIC_COUNTER);
+	snprintf(mname, sizeof(mname), "cosmon_audio_cpu_us_total{channel=\"%d\",analyzer=\"%s\"}", idx+1, name);
+	an->mCpu=metricsRegister(mname, "CPU time an analyzer spent on audio blocks", METRIC_COUNTER);
+	return 0;
+}
+
+// For the analyzer: were the samples it just read still its block?
+bool audioBlockIntact(void)
+{
+	return audioRingIntact(&curAnalyzer->cursor, curAnalyzer->slot);
+}
+
+static void *audioAnalyzerThread(void *arg)
+{
+	audioAnalyzer_t *an=(audioAnalyzer_t *)arg;
+	const audioSlot_t *slot;
+	uint64_t overruns=0;
+	struct timespec t0, t1;
+	uint64_t captureUs;
+	bool valid;
+
+	curAnalyzer=an;
+	for (;;)
+	{
+		slot=audioRingNext(&an->cursor, 1000);
+		if (slot==NULL)
+		{
+			if (__atomic_load_n(&an->cursor.ring->eof, __ATOMIC_ACQUIRE))
+				break;
+			continue;
+		}
+		// Sequence checked before (already lapped, don't even look) and
+		// after (lapped while reading, the analyzer's own check caught it)
+		an->slot=slot;
+		captureUs=slot->captureUs;
+		valid=audioRingIntact(&an->cursor, slot);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+		an->block(an->idx, valid ? slot->samples : NULL, slot->frames, captureUs, valid);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+		metricsAdd(an->mCpu, (t1.tv_sec-t0.tv_sec)*1000000LL+(t1.tv_nsec-t0.tv_nsec)/1000);
+		if (!audioRingDone(&an->cursor, slot))
+			metricsInc(an->mTorn);
+		if (an->cursor.overruns!=overruns)
+		{
+			metricsAdd(an->mOverruns, an->cursor.overruns-overruns);
+			overruns=an->cursor.overruns;
+		}
+	}
+
+	if (an->done)
+		an->done(an->idx);
+	return NULL;
+}
+
+// Offline file runs only: hold the writer back so no analyzer gets lapped
+static void audioWaitForAnalyzers(audioChannel_t *ac)
+{
+	struct timespec ts={0, 1000000L};
+	uint64_t w=ac->ring->writeSeq;
+	int i;
+
+	for (i=0; i<ac->numAnalyzers; i++)
+	{
+		while (w-__atomic_load_n(&ac->analyzers[i].cursor.next, __ATOMIC_RELAXED)>=AUDIORING_SLOTS-1)
+			nanosleep(&ts, NULL);
+	}
+}
+
+static void *audioFileThread(audioChannel_t *ac)
+{
+	int16_t *buf;
+	FILE *fp;
+	struct timespec next;
+	uint64_t blocks=0;
+
+	fp=fopen(ac->device+5, "rb");
+	if (fp==NULL)
+	{
+		fprintf(stderr, "Channel %d: can't open %s\n", ac->idx+1, ac->device+5);
+		audioRingFinish(ac->ring);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (;;)
+	{
+		if (!ac->realtime)
+			audioWaitForAnalyzers(ac);
+		buf=audioRingClaim(ac->ring);
+		if (fread(buf, sizeof(int16_t), ac->blockFrames, fp)!=ac->blockFrames)
+			break;
+		audioRingPublish(ac->ring, ac->blockFrames, evloopNowUs());
+		metricsInc(ac->mBlocks);
+		blocks++;
+		if (ac->realtime)
+		{
+			next.tv_nsec+=AUDIO_BLOCK_MS*1000000L;
+			if (next.tv_nsec>=1000000000L)
+			{
+				next.tv_nsec-=1000000000L;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+	}
+
+	printf("Channel %d: end of %s after %.1f s of audio\n", ac->idx+1, ac->device+5,
+		   blocks*AUDIO_BLOCK_MS/1000.0);
+	fclose(fp);
+	audioRingFinish(ac->ring);
+	return NULL;
+}
+
+static void *audioAlsaThread(audioChannel_t *ac)
+{
+	snd_pcm_t *pcm;
+	snd_pcm_sframes_t n, avail;
+	uint64_t now;
+	int err;
+
+	err=snd_pcm_open(&pcm, ac->device, SND_PCM_STREAM_CAPTURE, 0);
+	if (err<0)
+	{
+		fprintf(stderr, "Channel %d: can't open %s: %s\n", ac->idx+1, ac->device, snd_strerror(err));
+		return NULL;
+	}
+	// mono S16, 100 ms of buffering in ALSA is plenty
+	err=snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, ac->rate, 1, 100000);
+	if (err<0)
+	{
+		fprintf(stderr, "Channel %d: %s: %s\n", ac->idx+1, ac->device, snd_strerror(err));
+		snd_pcm_close(pcm);
+		return NULL;
+	}
+
+	for (;;)
+	{
+		// straight into the ring, nobody copies it after this
+		n=snd_pcm_readi(pcm, audioRingClaim(ac->ring), ac->blockFrames);
+		if (n<0)
+		{
+			// overrun etc.  Recover and carry on.
+			if (snd_pcm_recover(pcm, n, 1)<0)
+			{
+				fprintf(stderr, "Channel %d: capture failed: %s\n", ac->idx+1, snd_strerror(n));
+				break;
+			}
+			continue;
+		}
+		if ((unsigned int)n==ac->blockFrames)
+		{
+			// The block was complete avail frames ago, however late we woke up to read it
+			avail=snd_pcm_avail(pcm);
+			now=evloopNowUs();
+			if (avail>0)
+				now-=(uint64_t)avail*1000000/ac->rate;
+			audioRingPublish(ac->ring, n, now);
+			metricsInc(ac->mBlocks);
+		}
+	}
+
+	snd_pcm_close(pcm);
+	return NULL;
+}
+
+static void *audioCaptureThread(void *arg)
+{
+	audioChannel_t *ac=(audioChannel_t *)arg;
+
+	if (strncmp(ac->device, "file:", 5)==0)
+		return audioFileThread(ac);
+	return audioAlsaThread(ac);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioStart
+Synopsis:
+	Starts the analyzer threads, then the capture thread, for every channel
+	with audio enabled.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void audioStart(void)
+{
+	audioChannel_t *ac;
+	audioAnalyzer_t *an;
+	int i, a;
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		ac=&audioChannels[i];
+		if (!ac->enabled)
+			continue;
+
+		for (a=0; a<ac->numAnalyzers; a++)
+		{
+			an=&ac->analyzers[a];
+			audioCursorInit(&an->cursor, ac->ring);
+			if (pthread_create(&an->thread, NULL, audioAnalyzerThread, an)!=0)
+			{
+				fprintf(stderr, "Channel %d: can't start %s\n", i+1, an->name);
+				continue;
+			}
+			pthread_detach(an->thread);
+		}
+
+		if (pthread_create(&ac->thread, NULL, audioCaptureThread, ac)!=0)
+		{
+			fprintf(stderr, "Channel %d: can't start audio capture\n", i+1);
+			ac->enabled=false;
+			continue;
+		}
+		pthread_detach(ac->thread);
+	}
+	latencyStart();
+}
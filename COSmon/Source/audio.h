@@ -0,0 +1,61 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  audio.h
+*
+*  Synopsis:	Header file for audio.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _AUDIO
+#define _AUDIO
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AUDIO_BLOCK_MS			20
+#define AUDIO_DEFAULT_RATE		48000
+#define AUDIO_DEFAULT_DEVICE	"dsnoop:CARD=Device"	// CM108 FOBs show up as "Device"
+#define AUDIO_DEVICE_LEN		128
+#define AUDIO_MAX_ANALYZERS		8		// per channel
+
+// Analyzer callbacks, called on the analyzer's own thread.  The samples are
+// read in place from the capture ring, so the writer can lap a slow
+// analyzer mid-block: work out what you need from them, then check
+// audioBlockIntact() before keeping any of it.  valid false means the
+// block was gone before the call; samples is NULL, drop it.  captureUs is
+// when the block was complete (evloopNowUs() clock), not when the
+// analyzer got round to it.
+typedef void (*audioBlockFunc_t)(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid);
+typedef void (*audioDoneFunc_t)(int idx);
+
+int  audioInit(int idx);
+bool audioEnabled(int idx);
+int  audioAddAnalyzer(int idx, const char *name, audioBlockFunc_t block, audioDoneFunc_t done);
+bool audioBlockIntact(void);
+void audioStart(void);
+
+#endif
@@ -0,0 +1,265 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  audioring.c
+*
+*  Synopsis:	Single writer, many reader ring of 20 ms audio blocks in
+*				POSIX shared memory (/dev/shm/COSmon.audio1 etc).  The capture
+*				stage reads straight into a slot and publishes it; every
+*				analyzer reads the slots in place with its own cursor, in this
+*				process or another one.  Nobody copies audio and the writer
+*				never waits: a reader that falls more than a ring behind
+*				loses blocks and is told how many.
+*
+*				Same trick as shmstate.c for torn reads: the writer marks a
+*				slot before overwriting it, the reader checks the slot still
+*				holds its block after it's done with the samples.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "audioring.h"
+
+static void *audioRingMap(int idx, bool create)
+{
+	char name[32];
+	int fd;
+	void *p;
+
+	snprintf(name, sizeof(name), AUDIORING_NAME_FMT, idx+1);
+	fd=shm_open(name, create ? O_CREAT | O_RDWR : O_RDONLY, 0644);
+	if (fd<0)
+		return NULL;
+	if (create && ftruncate(fd, sizeof(audioRing_t))<0)
+	{
+		close(fd);
+		return NULL;
+	}
+	p=mmap(NULL, sizeof(audioRing_t), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return p==MAP_FAILED ? NULL : p;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioRingCreate
+Synopsis:
+	Creates (or re-uses) and maps a channel's ring.  Writer side.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	unsigned int rate: sample rate
+	unsigned int blockFrames: samples per block (<= AUDIORING_MAX_FRAMES)
+Outputs:
+	the ring or NULL on failure
+-----------------------------------------------------------------------------*/
+audioRing_t *audioRingCreate(int idx, unsigned int rate, unsigned int blockFrames)
+{
+	audioRing_t *ring;
+
+	if (blockFrames>AUDIORING_MAX_FRAMES)
+		return NULL;
+
+	ring=(audioRing_t *)audioRingMap(idx, true);
+	if (ring==NULL)
+	{
+		perror("audio ring");
+		return NULL;
+	}
+
+	memset(ring, 0, sizeof(*ring));
+	ring->rate=rate;
+	ring->blockFrames=blockFrames;
+	__atomic_store_n(&ring->version, AUDIORING_VERSION, __ATOMIC_RELEASE);
+	return ring;
+}
+
+// Reader side, for programs other than COSmon
+const audioRing_t *audioRingOpen(int idx)
+{
+	const audioRing_t *ring=(const audioRing_t *)audioRingMap(idx, false);
+
+	if (ring!=NULL && __atomic_load_n(&ring->version, __ATOMIC_ACQUIRE)!=AUDIORING_VERSION)
+	{
+		munmap((void *)ring, sizeof(*ring));
+		return NULL;
+	}
+	return ring;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioRingClaim
+Synopsis:
+	Hands the writer the next slot's sample buffer to capture into.  The
+	slot is marked as being written first so a reader still on the old
+	block notices.
+Author:
+	agent
+Inputs:
+	audioRing_t *ring: ring
+Outputs:
+	buffer for ring->blockFrames samples
+-----------------------------------------------------------------------------*/
+int16_t *audioRingClaim(audioRing_t *ring)
+{
+	audioSlot_t *slot=&ring->slot[ring->writeSeq % AUDIORING_SLOTS];
+
+	__atomic_store_n(&slot->seq, AUDIORING_SEQ_WRITING, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return slot->samples;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioRingPublish
+Synopsis:
+	Makes the claimed slot visible to readers and wakes them up.
+Author:
+	agent
+Inputs:
+	audioRing_t *ring: ring
+	unsigned int frames: samples captured into the slot
+	uint64_t captureUs: when the block was complete
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void audioRingPublish(audioRing_t *ring, unsigned int frames, uint64_t captureUs)
+{
+	uint64_t w=ring->writeSeq;
+	audioSlot_t *slot=&ring->slot[w % AUDIORING_SLOTS];
+
+	slot->frames=frames;
+	slot->captureUs=captureUs;
+	__atomic_store_n(&slot->seq, w, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->writeSeq, w+1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->wake, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &ring->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// No more blocks are coming (end of file input)
+void audioRingFinish(audioRing_t *ring)
+{
+	__atomic_store_n(&ring->eof, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->wake, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &ring->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// A new reader starts with the next block published
+void audioCursorInit(audioCursor_t *cur, const audioRing_t *ring)
+{
+	cur->ring=ring;
+	cur->next=__atomic_load_n(&ring->writeSeq, __ATOMIC_ACQUIRE);
+	cur->overruns=0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioRingNext
+Synopsis:
+	Waits for the cursor's next block.  Read the samples in place, then
+	call audioRingDone().  If the writer lapped the cursor it skips ahead
+	to the oldest block that is still safe and counts the ones lost.
+Author:
+	agent
+Inputs:
+	audioCursor_t *cur: reader's cursor
+	int timeoutMs: how long to wait, 0 to not wait
+Outputs:
+	the slot, or NULL on timeout / end of input
+-----------------------------------------------------------------------------*/
+const audioSlot_t *audioRingNext(audioCursor_t *cur, int timeoutMs)
+{
+	const audioRing_t *ring=cur->ring;
+	struct timespec ts={timeoutMs/1000, (timeoutMs%1000)*1000000L};
+	uint32_t wake;
+	uint64_t w;
+
+	for (;;)
+	{
+		wake=__atomic_load_n(&ring->wake, __ATOMIC_ACQUIRE);
+		w=__atomic_load_n(&ring->writeSeq, __ATOMIC_ACQUIRE);
+		if (cur->next<w)
+			break;
+		if (__atomic_load_n(&ring->eof, __ATOMIC_ACQUIRE) || timeoutMs==0)
+			return NULL;
+		if (syscall(SYS_futex, &ring->wake, FUTEX_WAIT, wake, &ts, NULL, 0)<0 && errno==ETIMEDOUT)
+			return NULL;
+	}
+
+	// Block w is going into slot (w-SLOTS) right now, so w-SLOTS+1 is the oldest left
+	if (w-cur->next>=AUDIORING_SLOTS)
+	{
+		cur->overruns+=w-AUDIORING_SLOTS+1-cur->next;
+		__atomic_store_n(&cur->next, w-AUDIORING_SLOTS+1, __ATOMIC_RELAXED);
+	}
+	return &ring->slot[cur->next % AUDIORING_SLOTS];
+}
+
+// Is the slot still holding the cursor's block?  Samples read before this
+// says yes are good, the writer hadn't started on the slot yet.
+bool audioRingIntact(const audioCursor_t *cur, const audioSlot_t *slot)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED)==cur->next;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	audioRingDone
+Synopsis:
+	Finishes with a block from audioRingNext() and moves the cursor on.
+Author:
+	agent
+Inputs:
+	audioCursor_t *cur: reader's cursor
+	const audioSlot_t *slot: slot from audioRingNext()
+Outputs:
+	false if the writer overwrote the block while it was being read (the
+	results for it should be thrown away)
+-----------------------------------------------------------------------------*/
+bool audioRingDone(audioCursor_t *cur, const audioSlot_t *slot)
+{
+	bool intact=audioRingIntact(cur, slot);
+
+	if (!intact)
+		cur->overruns++;
+	__atomic_store_n(&cur->next, cur->next+1, __ATOMIC_RELAXED);	// the writer may look at it
+	return intact;
+}
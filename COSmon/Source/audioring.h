@@ -0,0 +1,87 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  audioring.h
+*
+*  Synopsis:	Header file for audioring.c.  The segment layout is shared
+*				with other programs, bump AUDIORING_VERSION if it changes.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _AUDIORING
+#define _AUDIORING
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AUDIORING_NAME_FMT		"/COSmon.audio%d"	// channel number, 1 based
+#define AUDIORING_VERSION		1
+#define AUDIORING_SLOTS			64					// 1.28 s of 20 ms blocks
+#define AUDIORING_MAX_FRAMES	960					// 20 ms at 48 kHz
+#define AUDIORING_SEQ_WRITING	UINT64_MAX			// slot is being overwritten
+
+// One 20 ms block.  Cache line aligned so the writer filling one slot
+// doesn't bounce the line a reader is working on.
+typedef struct
+{
+	uint64_t		seq;				// block number held here
+	uint64_t		captureUs;			// CLOCK_MONOTONIC when the block was complete
+	uint32_t		frames;
+	uint32_t		pad;
+	int16_t			samples[AUDIORING_MAX_FRAMES];	// mono S16
+} __attribute__((aligned(64))) audioSlot_t;
+
+typedef struct
+{
+	uint32_t		version;			// AUDIORING_VERSION
+	uint32_t		rate;
+	uint32_t		blockFrames;
+	uint32_t		eof;				// writer is finished (file input)
+	uint64_t		writeSeq;			// blocks published, block n lives in slot n % AUDIORING_SLOTS
+	uint32_t		wake;				// futex, bumped on every publish
+	uint32_t		pad;
+	audioSlot_t		slot[AUDIORING_SLOTS];
+} audioRing_t;
+
+// A reader's position.  Each reader has its own, the writer never waits.
+typedef struct
+{
+	const audioRing_t	*ring;
+	uint64_t			next;			// next block to read
+	uint64_t			overruns;		// blocks lost because the writer lapped us
+} audioCursor_t;
+
+audioRing_t *audioRingCreate(int idx, unsigned int rate, unsigned int blockFrames);
+const audioRing_t *audioRingOpen(int idx);
+int16_t *audioRingClaim(audioRing_t *ring);
+void audioRingPublish(audioRing_t *ring, unsigned int frames, uint64_t captureUs);
+void audioRingFinish(audioRing_t *ring);
+void audioCursorInit(audioCursor_t *cur, const audioRing_t *ring);
+const audioSlot_t *audioRingNext(audioCursor_t *cur, int timeoutMs);
+bool audioRingIntact(const audioCursor_t *cur, const audioSlot_t *slot);
+bool audioRingDone(audioCursor_t *cur, const audioSlot_t *slot);
+
+#endif
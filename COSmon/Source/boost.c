@@ -0,0 +1,310 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  boost.c
+*
+*  Synopsis:	Keeps the CPU awake and clocked up while any channel's COS is up
+*				(and for hang_ms after), so the first few hundred ms of a QSO
+*				don't run at the lowest clock out of the deepest idle state.
+*				Holds a /dev/cpu_dma_latency PM QoS request and optionally
+*				raises every cpufreq policy's scaling_min_freq.  Those are
+*				written directly, one value per write(), not through the event
+*				loop's write queue (it would merge an off / on pair into one
+*				write, which both reject).
+*
+*				ab_test = 1 only boosts every other COS up, so the command
+*				latency histograms (boost on / off) and the boosted time show
+*				what it buys and what it costs on a given node.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <iniparser.h>
+
+#include "boost.h"
+#include "channel.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define BOOST_QOS_DEVICE			"/dev/cpu_dma_latency"
+#define BOOST_QOS_RELEASE			2000000000		// kernel's default, i.e. no constraint
+#define BOOST_POLICY_GLOB			"/sys/devices/system/cpu/cpufreq/policy*"
+#define BOOST_MAX_POLICIES			8
+#define BOOST_FREQ_LEN				16
+#define DEFAULT_BOOST_HANG_MS		2000
+#define DEFAULT_BOOST_LATENCY_US	0
+
+typedef struct
+{
+	int			fd;							// scaling_min_freq
+	char		normal[BOOST_FREQ_LEN];		// as we found it
+	char		boost[BOOST_FREQ_LEN];
+} boostPolicy_t;
+
+static struct
+{
+	bool			enabled;
+	bool			boosted;
+	bool			abTest;
+	bool			abSkip;					// this COS up isn't boosted (ab_test)
+	bool			held;					// some channel's COS is up, or hang running
+	uint32_t		cosMask;
+	int32_t			latencyUs;
+	int				qosFd;
+	boostPolicy_t	policies[BOOST_MAX_POLICIES];
+	int				numPolicies;
+	int				hangTimer;
+	uint32_t		hangMs;
+	uint64_t		boostStartUs;
+
+	metric_t		*mBoosts;
+	metric_t		*mBoostedMs;
+	metric_t		*mActive;
+	metric_t		*mLatencyOn;
+	metric_t		*mLatencyOff;
+} bst={ .qosFd=-1 };
+
+
+// One value per write(): cpu_dma_latency takes exactly 4 bytes and sysfs one value per
+// store, so these can't go through evloopWrite(), which merges back to back writes to an
+// fd.  Neither ever blocks.
+static void boostWrite(int fd, const void *buf, size_t len, const char *what)
+{
+	if (write(fd, buf, len)!=(ssize_t)len)
+		perror(what);
+}
+
+static void boostSet(bool on)
+{
+	int32_t qos=on ? bst.latencyUs : BOOST_QOS_RELEASE;
+	uint64_t now=evloopNowUs();
+	boostPolicy_t *p;
+	int i;
+
+	if (on==bst.boosted)
+		return;
+	bst.boosted=on;
+
+	if (bst.qosFd>=0)
+		boostWrite(bst.qosFd, &qos, sizeof(qos), "cpu_dma_latency");
+	for (i=0; i<bst.numPolicies; i++)
+	{
+		p=&bst.policies[i];
+		if (on)
+			boostWrite(p->fd, p->boost, strlen(p->boost), "scaling_min_freq");
+		else
+			boostWrite(p->fd, p->normal, strlen(p->normal), "scaling_min_freq");
+	}
+
+	if (on)
+	{
+		bst.boostStartUs=now;
+		metricsInc(bst.mBoosts);
+	}
+	else
+		metricsAdd(bst.mBoostedMs, (now-bst.boostStartUs)/1000);
+	metricsSet(bst.mActive, on);
+}
+
+// hang_ms after the last COS went down
+static void boostHangHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	bst.held=false;
+	boostSet(false);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	boostCos
+Synopsis:
+	COS edge on a channel.  Called before the channel acts on it so the
+	boost goes out ahead of the key command.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	bool cos: new COS level
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void boostCos(int idx, bool cos)
+{
+	if (!bst.enabled)
+		return;
+
+	if (cos)
+		bst.cosMask|=1u<<idx;
+	else
+		bst.cosMask&=~(1u<<idx);
+
+	if (bst.cosMask)
+	{
+		evloopArmTimer(bst.hangTimer, 0, 0);
+		if (!bst.held)
+		{
+			// new activity, not a COS flicker inside the hang
+			bst.held=true;
+			if (bst.abTest)
+				bst.abSkip=!bst.abSkip;
+		}
+		if (!bst.abSkip)
+			boostSet(true);
+	}
+	else if (bst.held)
+		evloopArmTimer(bst.hangTimer, bst.hangMs ? bst.hangMs : 1, 0);
+}
+
+// Key / unkey command latency, filed under whether we were boosted
+void boostCommandLatency(uint64_t us)
+{
+	if (bst.enabled)
+		metricsObserve(bst.boosted ? bst.mLatencyOn : bst.mLatencyOff, us);
+}
+
+// Exiting: put things back
+void boostRestore(void)
+{
+	int32_t qos=BOOST_QOS_RELEASE;
+	int i;
+
+	if (!bst.enabled || !bst.boosted)
+		return;
+	if (bst.qosFd>=0)
+		boostWrite(bst.qosFd, &qos, sizeof(qos), "cpu_dma_latency");
+	for (i=0; i<bst.numPolicies; i++)
+		boostWrite(bst.policies[i].fd, bst.policies[i].normal, strlen(bst.policies[i].normal), "scaling_min_freq");
+	bst.boosted=false;
+}
+
+// Opens a policy's scaling_min_freq and works out the boost value, -1 if unusable
+static int boostAddPolicy(const char *dir, int minKhz)
+{
+	boostPolicy_t *p=&bst.policies[bst.numPolicies];
+	char path[128], max[BOOST_FREQ_LEN]={ 0 };
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/cpuinfo_max_freq", dir);
+	fd=open(path, O_RDONLY | O_CLOEXEC);
+	if (fd<0)
+		return -1;
+	n=read(fd, max, sizeof(max)-1);
+	close(fd);
+	if (n<=0)
+		return -1;
+	max[strcspn(max, "\n")]='\0';
+
+	snprintf(path, sizeof(path), "%s/scaling_min_freq", dir);
+	p->fd=open(path, O_RDWR | O_CLOEXEC);
+	if (p->fd<0)
+		return -1;
+	n=read(p->fd, p->normal, sizeof(p->normal)-1);
+	if (n<=0)
+	{
+		close(p->fd);
+		return -1;
+	}
+	p->normal[strcspn(p->normal, "\n")]='\0';
+
+	// never above what the CPU can do
+	if (minKhz<0 || minKhz>atoi(max))
+		snprintf(p->boost, sizeof(p->boost), "%s", max);
+	else
+		snprintf(p->boost, sizeof(p->boost), "%d", minKhz);
+	bst.numPolicies++;
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	boostInit
+Synopsis:
+	Reads [boost], opens the PM QoS device and the cpufreq policies.
+	Needs root, like the GPIOs.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void boostInit(void)
+{
+	glob_t g;
+	size_t i;
+	int minKhz;
+
+	if (!iniparser_getboolean(ini, "boost:enable", 0))
+		return;
+
+	bst.latencyUs=	iniparser_getint(ini, "boost:dma_latency_us", DEFAULT_BOOST_LATENCY_US);
+	bst.hangMs=		iniparser_getint(ini, "boost:hang_ms", DEFAULT_BOOST_HANG_MS);
+	bst.abTest=		iniparser_getboolean(ini, "boost:ab_test", 0);
+	minKhz=			iniparser_getint(ini, "boost:cpufreq_min_khz", 0);
+
+	if (bst.latencyUs>=0)
+	{
+		// The request lasts as long as this fd is open, it starts out as no constraint
+		bst.qosFd=open(BOOST_QOS_DEVICE, O_RDWR | O_CLOEXEC);
+		if (bst.qosFd<0)
+			perror(BOOST_QOS_DEVICE);
+	}
+
+	if (minKhz!=0 && glob(BOOST_POLICY_GLOB, 0, NULL, &g)==0)
+	{
+		for (i=0; i<g.gl_pathc && bst.numPolicies<BOOST_MAX_POLICIES; i++)
+		{
+			if (boostAddPolicy(g.gl_pathv[i], minKhz)<0)
+				fprintf(stderr, "boost: can't use %s\n", g.gl_pathv[i]);
+		}
+		globfree(&g);
+	}
+
+	if (bst.qosFd<0 && bst.numPolicies==0)
+	{
+		fprintf(stderr, "boost: nothing to boost, disabled\n");
+		return;
+	}
+
+	bst.hangTimer=evloopAddTimer(0, 0, boostHangHandler, NULL);
+	bst.mBoosts=		metricsRegister("cosmon_boost_total", "Times the CPU was boosted for COS", METRIC_COUNTER);
+	bst.mBoostedMs=		metricsRegister("cosmon_boost_ms_total", "Time spent boosted (ms)", METRIC_COUNTER);
+	bst.mActive=		metricsRegister("cosmon_boost_active", "1 while the CPU is boosted", METRIC_GAUGE);
+	bst.mLatencyOn=		metricsRegister("cosmon_boost_command_us{boost=\"on\"}", "Key / unkey command latency by boost state", METRIC_HISTOGRAM);
+	bst.mLatencyOff=	metricsRegister("cosmon_boost_command_us{boost=\"off\"}", "Key / unkey command latency by boost state", METRIC_HISTOGRAM);
+	bst.enabled=true;
+	printf("\tCPU boost while COS is up: PM QoS %s, %d cpufreq policies%s\n", bst.qosFd>=0 ? "yes" : "no",
+		   bst.numPolicies, bst.abTest ? " (A/B test)" : "");
+}
@@ -0,0 +1,436 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  calib.c
+*
+*  Synopsis:	COS filter calibration.  For learn_s it records every COS pulse
+*				and the dropout gap after it, and with FOB audio how long after
+*				the audio goes quiet COS drops (the squelch close delay).  Then
+*				it replays the recording through the attack / hang filter for
+*				a grid of settings, counts the key and unkey commands each
+*				would have sent, and recommends the pair with (close to) the
+*				fewest commands that keeps the attack, the added key latency,
+*				under max_attack_ms.  Prints the distributions and the whole
+*				trade-off table; optionally applies the result.  Passive: the
+*				channels run on their configured settings while it learns.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iniparser.h>
+
+#include "calib.h"
+#include "audio.h"
+#include "channel.h"
+#include "evloop.h"
+#include "ini.h"
+#include "levels.h"
+#include "metrics.h"
+
+#define CALIB_MAX_PULSES		16384		// per channel, learning stops early when full
+#define CALIB_BINS				18			// log2 ms bins: <1, 1-2, 2-4 ... 65536+
+#define CALIB_SPEECH_DB			-50.0		// same as levels.c
+#define CALIB_CHURN_SLACK		1.05		// within 5% of the fewest commands is as good
+#define DEFAULT_CALIB_LEARN_S	3600
+#define DEFAULT_CALIB_MAX_ATTACK_MS	200
+#define DEFAULT_CALIB_MAX_HANG_MS	1500
+
+static const uint32_t attackGrid[]={0, 10, 20, 30, 50, 75, 100, 150, 200, 300, 500};
+static const uint32_t hangGrid[]={0, 50, 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000};
+#define NUM_ATTACK		(sizeof(attackGrid)/sizeof(attackGrid[0]))
+#define NUM_HANG		(sizeof(hangGrid)/sizeof(hangGrid[0]))
+
+typedef struct
+{
+	bool		learning;
+	uint64_t	startUs;
+	uint64_t	edgeUs;					// last edge
+	bool		cos;
+	int			numPulses;
+	uint32_t	pulseMs[CALIB_MAX_PULSES];	// COS high
+	uint32_t	gapMs[CALIB_MAX_PULSES];	// COS low after it, UINT32_MAX = still low
+	uint64_t	lastSpeechUs;			// written by the analyzer thread
+	uint32_t	closeBins[CALIB_BINS];	// squelch close delay
+	uint32_t	numClose;
+
+	metric_t	*mPulses;
+	metric_t	*mAttack;
+	metric_t	*mHang;
+	metric_t	*mPoll;
+} calib_t;
+
+static calib_t		calibs[MAX_CHANNELS];
+static bool			enabled=false;
+static bool			apply;
+static uint32_t		maxAttackMs, maxHangMs;
+
+
+static int calibBin(uint32_t ms)
+{
+	int b=0;
+
+	while (ms && b<CALIB_BINS-1)
+	{
+		ms>>=1;
+		b++;
+	}
+	return b;
+}
+
+// Lower edge of a bin in ms
+static uint32_t calibBinMs(int b)
+{
+	return b ? 1u<<(b-1) : 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	calibEdge
+Synopsis:
+	Every COS change on a channel, with the edge time.  The calibrate stage
+	of the COS pipeline.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	bool cos: new COS level
+	uint64_t now: edge time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void calibEdge(int idx, bool cos, uint64_t now)
+{
+	calib_t *c=&calibs[idx];
+	uint64_t speech;
+	uint32_t ms;
+
+	if (!enabled || !c->learning)
+		return;
+
+	ms=(now-c->edgeUs)/1000;
+	if (cos && c->edgeUs && c->numPulses>0)
+		c->gapMs[c->numPulses-1]=ms;
+	else if (!cos && c->cos)
+	{
+		c->pulseMs[c->numPulses]=ms;
+		c->gapMs[c->numPulses]=UINT32_MAX;
+		c->numPulses++;
+		metricsInc(c->mPulses);
+
+		// Audio went quiet during this pulse, COS followed this much later
+		speech=__atomic_load_n(&c->lastSpeechUs, __ATOMIC_RELAXED);
+		if (speech>c->edgeUs && speech<=now)
+		{
+			c->closeBins[calibBin((now-speech)/1000)]++;
+			c->numClose++;
+		}
+		if (c->numPulses>=CALIB_MAX_PULSES)
+		{
+			printf("Channel %d calibration: recording full, stopping early\n", idx+1);
+			c->learning=false;
+		}
+	}
+	c->edgeUs=now;
+	c->cos=cos;
+}
+
+// FOB audio block: remember when it was last louder than the speech floor
+static void calibBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid)
+{
+	levelsStats_t st={0};
+	double rms;
+
+	if (!valid)
+		return;
+	levelsBlockStats(samples, n, &st);
+	if (!audioBlockIntact())
+		return;
+	rms=sqrt((double)st.sumSq/n);
+	if (rms>0.0 && 20.0*log10(rms/32768.0)>CALIB_SPEECH_DB)
+		__atomic_store_n(&calibs[idx].lastSpeechUs, captureUs, __ATOMIC_RELAXED);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	calibChurn
+Synopsis:
+	Replays the recording through the channel state machine's attack and
+	hang logic: a pulse shorter than the attack from idle never keys, a
+	gap shorter than the hang never unkeys.
+Author:
+	agent
+Inputs:
+	const calib_t *c: recording
+	uint32_t attackMs, hangMs: filter settings
+	int *suppressed: pulses that didn't key
+Outputs:
+	key + unkey commands sent
+-----------------------------------------------------------------------------*/
+static int calibChurn(const calib_t *c, uint32_t attackMs, uint32_t hangMs, int *suppressed)
+{
+	bool keyed=false;
+	int cmds=0, i;
+
+	*suppressed=0;
+	for (i=0; i<c->numPulses; i++)
+	{
+		if (!keyed)
+		{
+			if (c->pulseMs[i]<attackMs)
+			{
+				(*suppressed)++;
+				continue;
+			}
+			keyed=true;
+			cmds++;
+		}
+		if (c->gapMs[i]>=hangMs)
+		{
+			keyed=false;
+			cmds++;
+		}
+	}
+	return cmds;
+}
+
+// Value below which pct % of the samples fall
+static uint32_t calibPercentile(const uint32_t *v, int n, int pct)
+{
+	uint32_t bins[CALIB_BINS]={0};
+	int i, valid=0, want, seen=0;
+
+	for (i=0; i<n; i++)
+	{
+		if (v[i]!=UINT32_MAX)
+		{
+			bins[calibBin(v[i])]++;
+			valid++;
+		}
+	}
+	want=(valid*pct+99)/100;
+	for (i=0; i<CALIB_BINS; i++)
+	{
+		seen+=bins[i];
+		if (seen>=want)
+			return calibBinMs(i+1);
+	}
+	return calibBinMs(CALIB_BINS);
+}
+
+static void calibHistogram(const char *what, const uint32_t *v, int n)
+{
+	uint32_t bins[CALIB_BINS]={0};
+	int i;
+
+	for (i=0; i<n; i++)
+	{
+		if (v[i]!=UINT32_MAX)
+			bins[calibBin(v[i])]++;
+	}
+	printf("\t%s (ms):", what);
+	for (i=0; i<CALIB_BINS; i++)
+	{
+		if (bins[i])
+			printf(" %u+:%u", calibBinMs(i), bins[i]);
+	}
+	printf("\n");
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	calibReport
+Synopsis:
+	End of learning for a channel: distributions, the commands per hour
+	table for every attack / hang pair, and the recommendation.  Poll
+	interval recommended at half the shortest filter time so the filter
+	isn't made coarser by the polling (serial COS doesn't poll).
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void calibReport(int idx, uint64_t now)
+{
+	calib_t *c=&calibs[idx];
+	channel_t *ch=&channels[idx];
+	double hours=(now-c->startUs)/3.6e9;
+	int churn[NUM_ATTACK][NUM_HANG];
+	int best=-1, a, h, cmds, ignored;
+	uint32_t bestA=0, bestH=0, pollMs, shortest;
+	bool found=false;
+
+	c->learning=false;
+	printf("Channel %d calibration, %.2f hours, %d COS pulses:\n", idx+1, hours, c->numPulses);
+	if (c->numPulses==0)
+		return;
+
+	calibHistogram("COS pulse widths", c->pulseMs, c->numPulses);
+	calibHistogram("Dropout gaps", c->gapMs, c->numPulses);
+	printf("\tPulses p10/p50/p90 < %u/%u/%u ms, gaps p10/p50/p90 < %u/%u/%u ms\n",
+		   calibPercentile(c->pulseMs, c->numPulses, 10), calibPercentile(c->pulseMs, c->numPulses, 50),
+		   calibPercentile(c->pulseMs, c->numPulses, 90), calibPercentile(c->gapMs, c->numPulses, 10),
+		   calibPercentile(c->gapMs, c->numPulses, 50), calibPercentile(c->gapMs, c->numPulses, 90));
+	if (c->numClose)
+	{
+		printf("\tSquelch close delay after audio (ms):");
+		for (a=0; a<CALIB_BINS; a++)
+		{
+			if (c->closeBins[a])
+				printf(" %u+:%u", calibBinMs(a), c->closeBins[a]);
+		}
+		printf("\n");
+	}
+
+	// Trade-off table, commands per hour
+	printf("\tCommands/hour  hang ms:");
+	for (h=0; h<(int)NUM_HANG; h++)
+		printf(" %5u", hangGrid[h]);
+	printf("\n");
+	for (a=0; a<(int)NUM_ATTACK; a++)
+	{
+		printf("\t  attack %4u ms:      ", attackGrid[a]);
+		for (h=0; h<(int)NUM_HANG; h++)
+		{
+			churn[a][h]=calibChurn(c, attackGrid[a], hangGrid[h], &ignored);
+			printf(" %5.0f", churn[a][h]/hours);
+			if (attackGrid[a]<=maxAttackMs && hangGrid[h]<=maxHangMs && (best<0 || churn[a][h]<best))
+				best=churn[a][h];
+		}
+		printf("\n");
+	}
+
+	// Lowest attack, then lowest hang, that's about as quiet as the quietest
+	for (a=0; a<(int)NUM_ATTACK && !found && attackGrid[a]<=maxAttackMs; a++)
+	{
+		for (h=0; h<(int)NUM_HANG && !found && hangGrid[h]<=maxHangMs; h++)
+		{
+			if (churn[a][h]<=best*CALIB_CHURN_SLACK)
+			{
+				bestA=attackGrid[a];
+				bestH=hangGrid[h];
+				found=true;
+			}
+		}
+	}
+	shortest=bestA ? bestA : bestH;
+	if (bestH && bestH<shortest)
+		shortest=bestH;
+	pollMs=shortest ? shortest/2 : 10;
+	if (pollMs<10)
+		pollMs=10;
+	if (pollMs>100)
+		pollMs=100;
+
+	cmds=calibChurn(c, bestA, bestH, &ignored);
+	printf("\tRecommended: COS_attack_ms = %u, COS_hang_ms = %u, COS_poll_loop_interval_ms = %u (%.0f commands/hour, %d pulses ignored)\n",
+		   bestA, bestH, pollMs, cmds/hours, ignored);
+	metricsSet(c->mAttack, bestA);
+	metricsSet(c->mHang, bestH);
+	metricsSet(c->mPoll, pollMs);
+
+	if (apply)
+	{
+		printf("\tApplied attack / hang (poll interval needs a restart)\n");
+		ch->attackUs=(uint64_t)bestA*1000;
+		ch->hangUs=(uint64_t)bestH*1000;
+	}
+}
+
+static void calibLearnHandler(uint64_t expirations, void *ctx)
+{
+	uint64_t now=evloopNowUs();
+	int i;
+
+	(void)expirations;
+	(void)ctx;
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (channels[i].enabled)
+			calibReport(i, now);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	calibInit
+Synopsis:
+	Reads [calibrate] and starts learning on every enabled channel.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void calibInit(void)
+{
+	char name[METRICS_NAME_LEN];
+	uint32_t learnS;
+	calib_t *c;
+	int i;
+
+	if (!iniparser_getboolean(ini, "calibrate:enable", 0))
+		return;
+	learnS=			iniparser_getint(ini, "calibrate:learn_s", DEFAULT_CALIB_LEARN_S);
+	maxAttackMs=	iniparser_getint(ini, "calibrate:max_attack_ms", DEFAULT_CALIB_MAX_ATTACK_MS);
+	maxHangMs=		iniparser_getint(ini, "calibrate:max_hang_ms", DEFAULT_CALIB_MAX_HANG_MS);
+	apply=			iniparser_getboolean(ini, "calibrate:apply", 0);
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (!channels[i].enabled)
+			continue;
+		c=&calibs[i];
+		c->learning=true;
+		c->startUs=evloopNowUs();
+
+		snprintf(name, sizeof(name), "cosmon_calib_pulses_total{channel=\"%d\"}", i+1);
+		c->mPulses=metricsRegister(name, "COS pulses recorded for calibration", METRIC_COUNTER);
+		snprintf(name, sizeof(name), "cosmon_calib_attack_ms{channel=\"%d\"}", i+1);
+		c->mAttack=metricsRegister(name, "Recommended COS attack time", METRIC_GAUGE);
+		snprintf(name, sizeof(name), "cosmon_calib_hang_ms{channel=\"%d\"}", i+1);
+		c->mHang=metricsRegister(name, "Recommended COS hang time", METRIC_GAUGE);
+		snprintf(name, sizeof(name), "cosmon_calib_poll_ms{channel=\"%d\"}", i+1);
+		c->mPoll=metricsRegister(name, "Recommended COS poll interval", METRIC_GAUGE);
+	}
+	enabled=true;
+	evloopAddTimer(learnS*1000, 0, calibLearnHandler, NULL);
+	printf("\tCOS calibration: learning for %u s, attack up to %u ms, hang up to %u ms%s\n",
+		   learnS, maxAttackMs, maxHangMs, apply ? ", then applying" : "");
+}
+
+// With FOB audio the squelch close delay is measured too
+void calibAudioInit(int idx)
+{
+	if (iniparser_getboolean(ini, "calibrate:enable", 0))
+		audioAddAnalyzer(idx, "calibrate", calibBlock, NULL);
+}
@@ -0,0 +1,591 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  channel.c
+*
+*  Synopsis:	Per channel COS state machine.  All of the key / unkey / hang /
+*				timeout logic is one transition table indexed by
+*				[state][event]; dispatch is a table lookup and an action call,
+*				no if/else chains.  Timers are absolute deadlines so there are
+*				no loop counters to wrap or sentinel values to forget.
+*
+*				         COS on       COS off      timer        reconnect     dead carrier
+*				IDLE     PENDING_KEY  -            -            resend unkey  -
+*				PENDING  -            IDLE         KEYED (key)  resend unkey  TIMED_OUT
+*				KEYED    -            HANG         TIMED_OUT    resend key    TIMED_OUT (unkey)
+*				HANG     KEYED        -            IDLE (unkey) resend key    -
+*				TIMED_OUT -           LOCKED_OUT   -            resend unkey  -
+*				LOCKED_OUT TIMED_OUT  -            IDLE         resend unkey  -
+*				An APRS / digital burst (databurst.c) takes PENDING_KEY or
+*				KEYED (with an unkey) to DATA until COS drops (IDLE) or
+*				someone talks after it (PENDING_KEY).
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iniparser.h>
+
+#include "channel.h"
+#include "astctl.h"
+#include "evloop.h"
+#include "ini.h"
+#include "shmstate.h"
+#include "mqtt.h"
+#include "serialcos.h"
+#include "boost.h"
+#include "periodic.h"
+#include "pipeline.h"
+
+// This is where COS will come into the Rasppi
+#define DEFAULT_EXTCOS_GPIO		29 		// GPIO.29 (pin 40)
+#define DEFAULT_KEY_CMD			"susb tune menu-support K"
+#define DEFAULT_UNKEY_CMD		"susb tune menu-support k"
+#define DEFAULT_COS_TIMEOUT_MS	150000
+#define DEFAULT_ATTACK_MS		0
+#define DEFAULT_HANG_MS			0
+#define DEFAULT_LOCKOUT_MS		0
+#define DEFAULT_CMD_BURST		20			// commands
+#define DEFAULT_CMD_RATE		60			// per minute, after the burst
+#define DEFAULT_FLAP_HOLD_MS	30000
+
+typedef enum
+{
+	A_INVALID=0,		// table hole, caught by channelInit()
+	A_NONE,
+	A_ARM_ATTACK,
+	A_DISARM,
+	A_KEY,
+	A_REKEY,
+	A_ARM_HANG,
+	A_UNKEY,
+	A_TIMEOUT,
+	A_DEAD_CARRIER,
+	A_ARM_LOCKOUT,
+	A_ACK,
+	A_RESEND_KEY,
+	A_RESEND_UNKEY,
+	A_FLAP,
+	A_FLAP_UNKEY,
+	A_ARM_FLAP,
+	A_FLAP_END,
+	A_DATA,
+	A_DATA_UNKEY,
+	A_NUM_ACTIONS
+} chAction_t;
+
+typedef struct
+{
+	uint8_t		next;
+	uint8_t		action;
+} chTransition_t;
+
+typedef void (*chActionFunc_t)(channel_t *ch, uint64_t now);
+
+channel_t channels[MAX_CHANNELS];
+
+static const char *stateNames[CH_NUM_STATES]=
+	{"idle", "pending-key", "keyed", "hang", "timed-out", "locked-out", "flapping", "data"};
+
+static void (*flapHandler)(int idx, bool flapping)=NULL;
+
+#define T(s, a)		{ CH_##s, A_##a }
+
+static const chTransition_t chTable[CH_NUM_STATES][CH_NUM_EVENTS]=
+{
+	//					EV_COS_ON					EV_COS_OFF					EV_TIMER					EV_ACK				EV_RECONNECT	EV_DEAD_CARRIER			EV_FLAPPING				EV_DATA_BURST			EV_DATA_END
+	[CH_IDLE]=			{ T(PENDING_KEY, ARM_ATTACK),	T(IDLE, NONE),				T(IDLE, NONE),				T(IDLE, ACK),		T(IDLE, RESEND_UNKEY),	T(IDLE, NONE),			T(FLAPPING, FLAP),		T(IDLE, NONE),			T(IDLE, NONE) },
+	[CH_PENDING_KEY]=	{ T(PENDING_KEY, NONE),		T(IDLE, DISARM),			T(KEYED, KEY),				T(PENDING_KEY, ACK),T(PENDING_KEY, RESEND_UNKEY),	T(TIMED_OUT, DISARM),	T(FLAPPING, FLAP),		T(DATA, DATA),			T(PENDING_KEY, NONE) },
+	[CH_KEYED]=			{ T(KEYED, NONE),			T(HANG, ARM_HANG),			T(TIMED_OUT, TIMEOUT),		T(KEYED, ACK),		T(KEYED, RESEND_KEY),	T(TIMED_OUT, DEAD_CARRIER),	T(FLAPPING, FLAP_UNKEY),	T(DATA, DATA_UNKEY),	T(KEYED, NONE) },
+	[CH_HANG]=			{ T(KEYED, REKEY),			T(HANG, NONE),				T(IDLE, UNKEY),				T(HANG, ACK),		T(HANG, RESEND_KEY),	T(HANG, NONE),			T(FLAPPING, FLAP_UNKEY),	T(HANG, NONE),			T(HANG, NONE) },
+	[CH_TIMED_OUT]=		{ T(TIMED_OUT, NONE),		T(LOCKED_OUT, ARM_LOCKOUT),	T(TIMED_OUT, NONE),			T(TIMED_OUT, ACK),	T(TIMED_OUT, RESEND_UNKEY),	T(TIMED_OUT, NONE),		T(TIMED_OUT, NONE),		T(TIMED_OUT, NONE),		T(TIMED_OUT, NONE) },
+	[CH_LOCKED_OUT]=	{ T(TIMED_OUT, DISARM),		T(LOCKED_OUT, NONE),		T(IDLE, DISARM),			T(LOCKED_OUT, ACK),	T(LOCKED_OUT, RESEND_UNKEY),	T(LOCKED_OUT, NONE),	T(LOCKED_OUT, NONE),	T(LOCKED_OUT, NONE),	T(LOCKED_OUT, NONE) },
+	[CH_FLAPPING]=		{ T(FLAPPING, ARM_FLAP),	T(FLAPPING, ARM_FLAP),		T(IDLE, FLAP_END),			T(FLAPPING, ACK),	T(FLAPPING, RESEND_UNKEY),	T(FLAPPING, NONE),	T(FLAPPING, NONE),		T(FLAPPING, NONE),		T(FLAPPING, NONE) },
+	[CH_DATA]=			{ T(DATA, NONE),			T(IDLE, NONE),				T(DATA, NONE),				T(DATA, ACK),		T(DATA, RESEND_UNKEY),	T(DATA, NONE),			T(FLAPPING, FLAP),		T(DATA, NONE),			T(PENDING_KEY, ARM_ATTACK) },
+};
+
+_Static_assert(sizeof(chTable)/sizeof(chTable[0])==CH_NUM_STATES, "transition table missing a state");
+_Static_assert(sizeof(chTable[0])/sizeof(chTable[0][0])==CH_NUM_EVENTS, "transition table missing an event");
+_Static_assert(A_NUM_ACTIONS<=256 && CH_NUM_STATES<=256, "table entries are uint8_t");
+
+
+/*-----------------------------------------------------------------------------
+	Actions
+-----------------------------------------------------------------------------*/
+static void chAckHandler(ssize_t result, void *ctx)
+{
+	if (result>0)
+		channelEvent((channel_t *)ctx, EV_ACK, evloopNowUs());
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	chSpendToken
+Synopsis:
+	Command governor.  Every command the state machine sends (so after the
+	attack / hang filtering) takes a token from the channel's bucket, which
+	refills at command_rate_per_min up to command_burst.  Running dry means
+	COS is flapping far faster than anyone talks: EV_FLAPPING once the
+	current event is done.  The flapping unkey itself is always sent.
+Author:
+	agent
+Inputs:
+	channel_t *ch: channel
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void chSpendToken(channel_t *ch, uint64_t now)
+{
+	if (ch->tokensPerUs<=0.0)
+		return;
+	ch->tokens+=(now-ch->tokensUs)*ch->tokensPerUs;
+	if (ch->tokens>ch->tokensMax)
+		ch->tokens=ch->tokensMax;
+	ch->tokensUs=now;
+
+	ch->tokens-=1.0;
+	if (ch->tokens<1.0 && ch->state!=CH_FLAPPING)
+		ch->flapTrip=true;
+}
+
+static void sendCmd(channel_t *ch, const char *cmd, uint64_t now)
+{
+	ch->cmdSentUs=now;
+	chSpendToken(ch, now);
+	astctlCommandNotify(cmd, chAckHandler, ch);
+}
+
+static void actNone(channel_t *ch, uint64_t now)
+{
+	(void)ch;
+	(void)now;
+}
+
+static void actInvalid(channel_t *ch, uint64_t now)
+{
+	(void)now;
+	fprintf(stderr, "Channel %d: invalid transition from %s\n", ch->idx+1, stateNames[ch->state]);
+}
+
+// Longer if an interference blip is due right now
+static void actArmAttack(channel_t *ch, uint64_t now)
+{
+	ch->deadlineUs=now+ch->attackUs+periodicHoldUs(ch->idx, now);
+}
+
+static void actDisarm(channel_t *ch, uint64_t now)
+{
+	(void)now;
+	ch->deadlineUs=CHANNEL_NEVER_US;
+}
+
+// With the timeout disabled there's no timer at all, not one far off
+static void chArmTimeout(channel_t *ch, uint64_t now)
+{
+	ch->deadlineUs=(ch->timeoutUs==CHANNEL_NEVER_US ? CHANNEL_NEVER_US : now+ch->timeoutUs);
+}
+
+static void actKey(channel_t *ch, uint64_t now)
+{
+	sendCmd(ch, ch->keyCmd, now);
+	chArmTimeout(ch, now);
+}
+
+// Back from hang, still keyed.  Timeout starts over like it always has.
+static void actRekey(channel_t *ch, uint64_t now)
+{
+	chArmTimeout(ch, now);
+}
+
+static void actArmHang(channel_t *ch, uint64_t now)
+{
+	ch->deadlineUs=now+ch->hangUs;
+}
+
+static void actUnkey(channel_t *ch, uint64_t now)
+{
+	sendCmd(ch, ch->unkeyCmd, now);
+	ch->deadlineUs=CHANNEL_NEVER_US;
+}
+
+static void actTimeout(channel_t *ch, uint64_t now)
+{
+	printf("COS Timeout (channel %d)\n", ch->idx+1);
+	metricsInc(ch->mTimeouts);
+	actUnkey(ch, now);
+}
+
+// Same as a timeout, just much sooner: COS is up but nobody is talking
+static void actDeadCarrier(channel_t *ch, uint64_t now)
+{
+	printf("Dead carrier (channel %d)\n", ch->idx+1);
+	metricsInc(ch->mDeadCarriers);
+	actUnkey(ch, now);
+}
+
+static void actArmLockout(channel_t *ch, uint64_t now)
+{
+	ch->deadlineUs=now+ch->lockoutUs;
+}
+
+static void actAck(channel_t *ch, uint64_t now)
+{
+	metricsObserve(ch->mAckLatency, now-ch->cmdSentUs);
+	boostCommandLatency(now-ch->cmdSentUs);
+}
+
+static void actResendKey(channel_t *ch, uint64_t now)
+{
+	sendCmd(ch, ch->keyCmd, now);
+}
+
+static void actResendUnkey(channel_t *ch, uint64_t now)
+{
+	sendCmd(ch, ch->unkeyCmd, now);
+}
+
+static void actFlap(channel_t *ch, uint64_t now)
+{
+	printf("Channel %d: COS flapping, holding it unkeyed\n", ch->idx+1);
+	metricsInc(ch->mFlaps);
+	ch->deadlineUs=now+ch->flapHoldUs;
+	if (flapHandler)
+		flapHandler(ch->idx, true);
+}
+
+static void actFlapUnkey(channel_t *ch, uint64_t now)
+{
+	actFlap(ch, now);
+	sendCmd(ch, ch->unkeyCmd, now);
+}
+
+// Still flapping, hold it longer
+static void actArmFlap(channel_t *ch, uint64_t now)
+{
+	metricsInc(ch->mFlapEdges);
+	ch->deadlineUs=now+ch->flapHoldUs;
+}
+
+// COS has stayed put for the hold time.  If it stayed up, that's a key.
+static void actFlapEnd(channel_t *ch, uint64_t now)
+{
+	printf("Channel %d: COS settled, back in service\n", ch->idx+1);
+	ch->deadlineUs=CHANNEL_NEVER_US;
+	if (flapHandler)
+		flapHandler(ch->idx, false);
+	if (ch->cosLevel)
+		channelEvent(ch, EV_COS_ON, now);
+}
+
+// APRS / digital burst: no key, or cut short if the attack time let it through
+static void actData(channel_t *ch, uint64_t now)
+{
+	(void)now;
+	metricsInc(ch->mDataBursts);
+	ch->deadlineUs=CHANNEL_NEVER_US;
+}
+
+static void actDataUnkey(channel_t *ch, uint64_t now)
+{
+	actData(ch, now);
+	sendCmd(ch, ch->unkeyCmd, now);
+}
+
+static const chActionFunc_t chActions[A_NUM_ACTIONS]=
+{
+	[A_INVALID]=		actInvalid,
+	[A_NONE]=			actNone,
+	[A_ARM_ATTACK]=		actArmAttack,
+	[A_DISARM]=			actDisarm,
+	[A_KEY]=			actKey,
+	[A_REKEY]=			actRekey,
+	[A_ARM_HANG]=		actArmHang,
+	[A_UNKEY]=			actUnkey,
+	[A_TIMEOUT]=		actTimeout,
+	[A_DEAD_CARRIER]=	actDeadCarrier,
+	[A_ARM_LOCKOUT]=	actArmLockout,
+	[A_ACK]=			actAck,
+	[A_RESEND_KEY]=		actResendKey,
+	[A_RESEND_UNKEY]=	actResendUnkey,
+	[A_FLAP]=			actFlap,
+	[A_FLAP_UNKEY]=		actFlapUnkey,
+	[A_ARM_FLAP]=		actArmFlap,
+	[A_FLAP_END]=		actFlapEnd,
+	[A_DATA]=			actData,
+	[A_DATA_UNKEY]=		actDataUnkey,
+};
+
+/*-----------------------------------------------------------------------------
+Function:
+	channelEvent
+Synopsis:
+	Runs one event through a channel's state machine.
+Author:
+	agent
+Inputs:
+	channel_t *ch: channel
+	chEvent_t ev: event
+	uint64_t now: current time (evloopNowUs())
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void channelEvent(channel_t *ch, chEvent_t ev, uint64_t now)
+{
+	const chTransition_t *t=&chTable[ch->state][ev];
+	cosmonShared_t *sh;
+	char key[32];
+
+	__atomic_store_n(&ch->state, t->next, __ATOMIC_RELAXED);		// audio analyzers read it
+	chActions[t->action](ch, now);
+	metricsSet(ch->mState, ch->state);
+
+	snprintf(key, sizeof(key), "ch%d/state", ch->idx+1);
+	mqttState(key, stateNames[ch->state]);
+	snprintf(key, sizeof(key), "ch%d/cos", ch->idx+1);
+	mqttState(key, ch->cosLevel ? "1" : "0");
+
+	sh=shmstateBegin();
+	sh->channel[ch->idx].state=ch->state;
+	sh->channel[ch->idx].cos=ch->cosLevel;
+	shmstateEnd();
+
+	if (ch->flapTrip)
+	{
+		ch->flapTrip=false;
+		channelEvent(ch, EV_FLAPPING, now);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	channelPoll
+Synopsis:
+	Feeds the latest COS reading to a channel: level changes go down the
+	channel's pipeline (which ends in the state machine) and the channel's
+	timer fires when its deadline has passed.
+Author:
+	agent
+Inputs:
+	channel_t *ch: channel
+	bool cos: current COS level
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void channelPoll(channel_t *ch, bool cos, uint64_t now)
+{
+	// (we only do something when COS changes so we don't continually
+	// call asterisk for no reason every time throgh the loop.)
+	if (cos!=ch->cosLevel)
+		pipelineEdge(ch, cos, now);
+
+	if (now>=ch->deadlineUs)
+		channelEvent(ch, EV_TIMER, now);
+}
+
+// Asterisk came back, every channel tells it where it stands
+void channelReconnect(uint64_t now)
+{
+	int i;
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (channels[i].enabled)
+			channelEvent(&channels[i], EV_RECONNECT, now);
+	}
+}
+
+// Told when a channel starts and stops being held for flapping
+void channelSetFlapHandler(void (*handler)(int idx, bool flapping))
+{
+	flapHandler=handler;
+}
+
+bool channelKeyed(const channel_t *ch)
+{
+	return ch->state==CH_KEYED || ch->state==CH_HANG;
+}
+
+const char *channelStateName(chState_t state)
+{
+	return state<CH_NUM_STATES ? stateNames[state] : "?";
+}
+
+/*-----------------------------------------------------------------------------
+	Config.  Channel 1 uses the original [gpio] / [COS settings] keys,
+	channel 2 has its own [channel 2] section and inherits any timing it
+	doesn't set from [COS settings].
+-----------------------------------------------------------------------------*/
+static int chGetInt(int idx, const char *key, int def)
+{
+	char fullKey[64];
+
+	snprintf(fullKey, sizeof(fullKey), "COS settings:%s", key);
+	def=iniparser_getint(ini, fullKey, def);
+	if (idx==0)
+		return def;
+
+	snprintf(fullKey, sizeof(fullKey), "channel %d:%s", idx+1, key);
+	return iniparser_getint(ini, fullKey, def);
+}
+
+static bool chGetBool(int idx, const char *key, bool def)
+{
+	char fullKey[64];
+
+	snprintf(fullKey, sizeof(fullKey), "COS settings:%s", key);
+	def=iniparser_getboolean(ini, fullKey, def);
+	if (idx==0)
+		return def;
+
+	snprintf(fullKey, sizeof(fullKey), "channel %d:%s", idx+1, key);
+	return iniparser_getboolean(ini, fullKey, def);
+}
+
+static const char *chGetString(int idx, const char *key, const char *def)
+{
+	char fullKey[64];
+
+	if (idx==0)
+		snprintf(fullKey, sizeof(fullKey), "COS settings:%s", key);
+	else
+		snprintf(fullKey, sizeof(fullKey), "channel %d:%s", idx+1, key);
+	return iniparser_getstring(ini, fullKey, def);
+}
+
+static void chRegisterMetrics(channel_t *ch)
+{
+	char name[METRICS_NAME_LEN];
+
+	snprintf(name, sizeof(name), "cosmon_cos_transitions_total{channel=\"%d\"}", ch->idx+1);
+	ch->mTransitions=metricsRegister(name, "COS state changes seen", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_cos_timeouts_total{channel=\"%d\"}", ch->idx+1);
+	ch->mTimeouts=metricsRegister(name, "COS stuck high timeouts", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_cos_dead_carriers_total{channel=\"%d\"}", ch->idx+1);
+	ch->mDeadCarriers=metricsRegister(name, "Keyed channels dropped for a dead carrier", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_channel_state{channel=\"%d\"}", ch->idx+1);
+	ch->mState=metricsRegister(name, "Channel state (0 idle, 1 pending-key, 2 keyed, 3 hang, 4 timed-out, 5 locked-out, 6 flapping, 7 data)", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_command_ack_us{channel=\"%d\"}", ch->idx+1);
+	ch->mAckLatency=metricsRegister(name, "Time from key/unkey decision to command handed to Asterisk", METRIC_HISTOGRAM);
+	snprintf(name, sizeof(name), "cosmon_cos_flapping_total{channel=\"%d\"}", ch->idx+1);
+	ch->mFlaps=metricsRegister(name, "Times the command governor held the channel for flapping", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_cos_flapping_edges_total{channel=\"%d\"}", ch->idx+1);
+	ch->mFlapEdges=metricsRegister(name, "COS changes ignored while held for flapping", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_cos_data_bursts_total{channel=\"%d\"}", ch->idx+1);
+	ch->mDataBursts=metricsRegister(name, "Transmissions kept off the node as data bursts", METRIC_COUNTER);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	channelInit
+Synopsis:
+	Reads a channel's config and puts it in the idle state.  Also checks
+	the transition table has no holes (once).
+Author:
+	agent
+Inputs:
+	channel_t *ch: channel
+	int idx: 0 based channel number
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void channelInit(channel_t *ch, int idx)
+{
+	char key[32];
+	int s, e;
+
+	for (s=0; s<CH_NUM_STATES; s++)
+	{
+		for (e=0; e<CH_NUM_EVENTS; e++)
+		{
+			if (chTable[s][e].action==A_INVALID || chTable[s][e].next>=CH_NUM_STATES)
+			{
+				fprintf(stderr, "Channel transition table hole at %s/%d\n", stateNames[s], e);
+				exit(-1);
+			}
+		}
+	}
+
+	memset(ch, 0, sizeof(*ch));
+	ch->idx=idx;
+	ch->state=CH_IDLE;
+	ch->deadlineUs=CHANNEL_NEVER_US;
+
+	if (idx==0)
+	{
+		ch->enabled=true;
+		ch->cosPin=iniparser_getint(ini, "gpio:gpio_COS", DEFAULT_EXTCOS_GPIO);
+	}
+	else
+	{
+		snprintf(key, sizeof(key), "channel %d:enable", idx+1);
+		ch->enabled=iniparser_getboolean(ini, key, 0);
+		snprintf(key, sizeof(key), "channel %d:gpio_COS", idx+1);
+		ch->cosPin=iniparser_getint(ini, key, -1);
+	}
+
+	snprintf(ch->keyCmd, sizeof(ch->keyCmd), "%s", chGetString(idx, "key_command", idx ? "" : DEFAULT_KEY_CMD));
+	snprintf(ch->unkeyCmd, sizeof(ch->unkeyCmd), "%s", chGetString(idx, "unkey_command", idx ? "" : DEFAULT_UNKEY_CMD));
+
+	ch->cosSerial=serialDevice(idx)[0]!='\0';
+#ifdef NO_WIRINGPI
+	if (!ch->cosSerial)
+		ch->cosPin=-1;			// no GPIO on this box
+#endif
+
+	if (ch->enabled && ((ch->cosPin<0 && !ch->cosSerial) || ch->keyCmd[0]=='\0' || ch->unkeyCmd[0]=='\0'))
+	{
+		fprintf(stderr, "Channel %d needs gpio_COS (or a serial device), key_command and unkey_command, disabled\n", idx+1);
+		ch->enabled=false;
+	}
+
+	ch->attackUs=	(uint64_t)chGetInt(idx, "COS_attack_ms", DEFAULT_ATTACK_MS)*1000;
+	ch->hangUs=		(uint64_t)chGetInt(idx, "COS_hang_ms", DEFAULT_HANG_MS)*1000;
+	ch->lockoutUs=	(uint64_t)chGetInt(idx, "COS_lockout_ms", DEFAULT_LOCKOUT_MS)*1000;
+	if (chGetBool(idx, "COS_timeout_enable", true))
+		ch->timeoutUs=(uint64_t)chGetInt(idx, "COS_timeout_ms", DEFAULT_COS_TIMEOUT_MS)*1000;
+	else
+		ch->timeoutUs=CHANNEL_NEVER_US;
+
+	ch->tokensMax=		chGetInt(idx, "command_burst", DEFAULT_CMD_BURST);
+	ch->tokensPerUs=	chGetInt(idx, "command_rate_per_min", DEFAULT_CMD_RATE)/60e6;
+	ch->flapHoldUs=		(uint64_t)chGetInt(idx, "flap_hold_ms", DEFAULT_FLAP_HOLD_MS)*1000;
+	ch->tokens=			ch->tokensMax;
+	ch->tokensUs=		evloopNowUs();
+
+	if (ch->enabled)
+		pipelineInit(ch, chGetString(idx, "cos_pipeline", PIPELINE_DEFAULT), chGetInt(idx, "cos_debounce_ms", 0),
+					 chGetBool(idx, "pipeline_timing", false));
+
+	if (ch->enabled)
+		chRegisterMetrics(ch);
+
+	shmstateBegin()->channel[idx].enabled=ch->enabled;
+	shmstateEnd();
+}
@@ -0,0 +1,116 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  channel.h
+*
+*  Synopsis:	Header file for channel.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _CHANNEL
+#define _CHANNEL
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "metrics.h"
+#include "shmstate.h"
+
+#define MAX_CHANNELS			SHMSTATE_CHANNELS
+#define CHANNEL_CMD_LEN			128
+#define CHANNEL_NEVER_US		(UINT64_MAX/2)		// "no timer", still safe to add now to
+
+typedef enum
+{
+	CH_IDLE=0,			// COS low, node unkeyed
+	CH_PENDING_KEY,		// COS high, waiting out the attack time
+	CH_KEYED,			// node keyed
+	CH_HANG,			// COS dropped, node still keyed for the hang time
+	CH_TIMED_OUT,		// COS stuck high too long, node unkeyed, waiting for COS to drop
+	CH_LOCKED_OUT,		// COS dropped after a timeout, ignoring it for the lockout time
+	CH_FLAPPING,		// too many commands, node unkeyed until COS stays put for a while
+	CH_DATA,			// COS up for an APRS / digital burst, node unkeyed
+	CH_NUM_STATES
+} chState_t;
+
+typedef enum
+{
+	EV_COS_ON=0,		// COS edge, low to high
+	EV_COS_OFF,			// COS edge, high to low
+	EV_TIMER,			// channel deadline reached
+	EV_ACK,				// last command was handed to Asterisk
+	EV_RECONNECT,		// Asterisk came back, it doesn't know our state
+	EV_DEAD_CARRIER,	// COS is up but the audio is an unmodulated carrier
+	EV_FLAPPING,		// command governor ran out of tokens
+	EV_DATA_BURST,		// the audio is a data burst, not a voice
+	EV_DATA_END,		// someone is talking after the burst
+	CH_NUM_EVENTS
+} chEvent_t;
+
+typedef struct
+{
+	int				idx;				// 0 based, shown 1 based
+	bool			enabled;
+	chState_t		state;
+	bool			cosLevel;			// last COS level seen
+	int				cosPin;
+	bool			cosSerial;			// COS from a serial port (serialcos.c), not cosPin
+	uint64_t		deadlineUs;			// EV_TIMER fires when now passes this
+	uint64_t		attackUs;
+	uint64_t		hangUs;
+	uint64_t		timeoutUs;			// CHANNEL_NEVER_US if timeout disabled
+	uint64_t		lockoutUs;
+	uint64_t		cmdSentUs;			// for ack latency
+	double			tokens;				// command governor bucket
+	uint64_t		tokensUs;			// last refill
+	double			tokensPerUs;		// 0 = governor off
+	double			tokensMax;
+	uint64_t		flapHoldUs;
+	bool			flapTrip;			// bucket ran dry, EV_FLAPPING next
+	char			keyCmd[CHANNEL_CMD_LEN];
+	char			unkeyCmd[CHANNEL_CMD_LEN];
+
+	metric_t		*mTransitions;
+	metric_t		*mTimeouts;
+	metric_t		*mDeadCarriers;
+	metric_t		*mState;
+	metric_t		*mAckLatency;
+	metric_t		*mFlaps;
+	metric_t		*mFlapEdges;
+	metric_t		*mDataBursts;
+} channel_t;
+
+extern channel_t channels[MAX_CHANNELS];
+
+void channelInit(channel_t *ch, int idx);
+void channelEvent(channel_t *ch, chEvent_t ev, uint64_t now);
+void channelPoll(channel_t *ch, bool cos, uint64_t now);
+void channelReconnect(uint64_t now);
+void channelSetFlapHandler(void (*handler)(int idx, bool flapping));
+bool channelKeyed(const channel_t *ch);
+const char *channelStateName(chState_t state);
+
+#endif
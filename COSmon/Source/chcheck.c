@@ -0,0 +1,515 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  chcheck.c
+*
+*  Synopsis:	Bounded model check of the channel state machine (channel.c).
+*				Links the real channel.c against stand-ins for everything it
+*				talks to, then drives every sequence of inputs up to a depth:
+*				COS edges, time passing (with the timer firing on the way like
+*				the main loop does), command acks, Asterisk reconnects and,
+*				while COS is up, the audio analyzers' dead carrier / data
+*				burst / data end.  After every step it checks:
+*				  - never keyed once COS has been low for the hang time
+*				  - every key matched by an unkey: no key while keyed (bar a
+*				    reconnect resend), Asterisk keyed exactly when the state
+*				    machine thinks it is, and unkeyed once COS drops and the
+*				    timers run out
+*				  - timeouts respected: never keyed for the timeout with COS up
+*				    continuously, no key again until COS drops, none inside
+*				    the lockout
+*				and prints the first sequence that breaks one.  Runs a grid
+*				of attack / hang / lockout / timeout / governor settings, or
+*				the channels of a COSmon.conf with -c.  Not part of COSmon
+*				itself: make chcheck.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <iniparser.h>
+
+#include "channel.h"
+#include "astctl.h"
+#include "evloop.h"
+#include "ini.h"
+#include "shmstate.h"
+#include "mqtt.h"
+#include "serialcos.h"
+#include "boost.h"
+#include "periodic.h"
+#include "pipeline.h"
+
+#define CK_MAX_DEPTH			12
+#define CK_SETTLE_STEPS			16			// timer firings to get back to idle
+#define CK_DEFAULT_DEPTH		6
+#define CK_START_US				1000000ULL
+#define CK_TICK_US				40000ULL	// shorter than any grid timer
+#define CK_WAIT_US				700000ULL	// longer than all but the timeout
+#define CK_FLAP_HOLD_US			500000ULL
+
+typedef enum
+{
+	IN_COS=0,			// COS edge, whichever way it isn't
+	IN_DEADLINE,		// time passes to the channel's deadline
+	IN_TICK,			// a little time passes
+	IN_WAIT,			// a lot of time passes
+	IN_ACK,				// oldest outstanding command handed to Asterisk
+	IN_RECONNECT,
+	IN_DEAD_CARRIER,	// analyzer events, only while COS is up
+	IN_DATA_BURST,
+	IN_DATA_END,
+	IN_SETTLE,			// end of a sequence: COS down, timers run out
+	IN_NUM
+} ckInput_t;
+
+typedef struct
+{
+	channel_t	ch;
+	uint64_t	now;
+	bool		cos;				// what the radio is doing
+	uint64_t	cosSinceUs;			// last COS edge
+	bool		astKeyed;			// what Asterisk was last told
+	uint64_t	keyUs;				// when it was keyed
+	bool		timedOut;			// timed out during this COS high
+	uint64_t	lockoutUntilUs;
+	int			acksDue;
+} ckWorld_t;
+
+typedef struct
+{
+	ckInput_t	in;
+	uint64_t	now;
+	chState_t	state;
+	bool		astKeyed;
+} ckStep_t;
+
+static const char *inputNames[IN_NUM]=
+	{"cos", "deadline", "tick", "wait", "ack", "reconnect", "dead-carrier", "data-burst", "data-end", "settle"};
+
+dictionary *ini=NULL;
+
+static FILE *out;
+static int maxDepth=CK_DEFAULT_DEPTH;
+static ckWorld_t *cur;					// the world the stand-ins act on
+static bool reconnecting;
+static evloopWriteDone_t ackDone;
+static const char *violation;
+static ckStep_t path[CK_MAX_DEPTH+1];
+static uint64_t nodes;
+
+
+/*-----------------------------------------------------------------------------
+	Stand-ins for what channel.c links against
+-----------------------------------------------------------------------------*/
+void astctlCommandNotify(const char *cmd, evloopWriteDone_t done, void *ctx)
+{
+	(void)ctx;
+	ackDone=done;
+	cur->acksDue++;
+
+	if (strcmp(cmd, cur->ch.keyCmd)==0)
+	{
+		if (cur->astKeyed && !reconnecting)
+			violation="key sent while already keyed";
+		else if (cur->timedOut && cur->cos)
+			violation="keyed again without COS dropping after a timeout";
+		else if (cur->now<cur->lockoutUntilUs)
+			violation="keyed inside the lockout";
+		if (!cur->astKeyed)
+			cur->keyUs=cur->now;
+		cur->astKeyed=true;
+	}
+	else
+		cur->astKeyed=false;
+}
+
+uint64_t evloopNowUs(void)
+{
+	return cur->now;
+}
+
+void mqttState(const char *key, const char *value)
+{
+	(void)key;
+	(void)value;
+}
+
+cosmonShared_t *shmstateBegin(void)
+{
+	static cosmonShared_t shared;
+
+	return &shared;
+}
+
+void shmstateEnd(void)
+{
+}
+
+const char *serialDevice(int idx)
+{
+	(void)idx;
+	return "";
+}
+
+void boostCommandLatency(uint64_t us)
+{
+	(void)us;
+}
+
+uint64_t periodicHoldUs(int idx, uint64_t now)
+{
+	(void)idx;
+	(void)now;
+	return 0;
+}
+
+int pipelineInit(channel_t *ch, const char *stages, uint32_t debounceMs, bool timing)
+{
+	(void)ch;
+	(void)stages;
+	(void)debounceMs;
+	(void)timing;
+	return 0;
+}
+
+// Just the fsm stage, the other stages have their own timing
+void pipelineEdge(channel_t *ch, bool cos, uint64_t now)
+{
+	ch->cosLevel=cos;
+	channelEvent(ch, cos ? EV_COS_ON : EV_COS_OFF, now);
+}
+
+
+/*-----------------------------------------------------------------------------
+	The model
+-----------------------------------------------------------------------------*/
+// One pass of the main loop at w->now
+static void ckPoll(ckWorld_t *w)
+{
+	channelPoll(&w->ch, w->cos, w->now);
+}
+
+// Time passes to until, the main loop firing the timer on the way
+static void ckAdvance(ckWorld_t *w, uint64_t until)
+{
+	int n;
+
+	for (n=0; n<CK_SETTLE_STEPS && w->ch.deadlineUs<=until; n++)
+	{
+		if (w->ch.deadlineUs>w->now)
+			w->now=w->ch.deadlineUs;
+		ckPoll(w);
+	}
+	if (n==CK_SETTLE_STEPS)
+		violation="timer keeps firing without time passing";
+	w->now=until;
+	ckPoll(w);
+}
+
+static void ckCos(ckWorld_t *w, bool cos)
+{
+	w->cos=cos;
+	w->cosSinceUs=w->now;
+	if (!cos && w->timedOut)
+	{
+		w->timedOut=false;
+		w->lockoutUntilUs=w->now+w->ch.lockoutUs;
+	}
+	ckPoll(w);
+}
+
+static bool ckCheck(const ckWorld_t *w)
+{
+	uint64_t since;
+
+	if (violation)
+		return false;
+	if (w->astKeyed!=channelKeyed(&w->ch))
+		violation=w->astKeyed ? "Asterisk keyed, state machine isn't" : "state machine keyed, Asterisk isn't";
+	else if (w->astKeyed && !w->cos && w->now-w->cosSinceUs>=w->ch.hangUs)
+		violation="still keyed with COS low past the hang time";
+	else if (w->astKeyed && w->cos && w->ch.timeoutUs!=CHANNEL_NEVER_US)
+	{
+		since=(w->keyUs>w->cosSinceUs ? w->keyUs : w->cosSinceUs);
+		if (w->now-since>=w->ch.timeoutUs)
+			violation="keyed past the timeout with COS up";
+	}
+	return violation==NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	ckApply
+Synopsis:
+	Applies one input to a world.  Inputs that can't happen from here
+	(acking with nothing outstanding, a deadline that isn't set, analyzer
+	events with COS down) are refused so the search doesn't repeat itself.
+Author:
+	agent
+Inputs:
+	ckWorld_t *w: world, changed in place
+	ckInput_t in: input
+Outputs:
+	bool: false if the input can't happen from here
+-----------------------------------------------------------------------------*/
+static bool ckApply(ckWorld_t *w, ckInput_t in)
+{
+	int n;
+
+	cur=w;
+	switch (in)
+	{
+		case IN_COS:
+			ckCos(w, !w->cos);
+			break;
+		case IN_DEADLINE:
+			if (w->ch.deadlineUs==CHANNEL_NEVER_US || w->ch.deadlineUs<=w->now)
+				return false;
+			ckAdvance(w, w->ch.deadlineUs);
+			break;
+		case IN_TICK:
+			ckAdvance(w, w->now+CK_TICK_US);
+			break;
+		case IN_WAIT:
+			ckAdvance(w, w->now+CK_WAIT_US);
+			break;
+		case IN_ACK:
+			if (w->acksDue==0 || ackDone==NULL)
+				return false;
+			w->acksDue--;
+			ackDone(1, &w->ch);
+			break;
+		case IN_RECONNECT:
+			reconnecting=true;
+			channelEvent(&w->ch, EV_RECONNECT, w->now);
+			reconnecting=false;
+			break;
+		case IN_DEAD_CARRIER:
+		case IN_DATA_BURST:
+		case IN_DATA_END:
+			if (!w->cos)
+				return false;
+			channelEvent(&w->ch, in==IN_DEAD_CARRIER ? EV_DEAD_CARRIER : in==IN_DATA_BURST ? EV_DATA_BURST : EV_DATA_END, w->now);
+			break;
+		case IN_SETTLE:
+			if (w->cos)
+				ckCos(w, false);
+			for (n=0; n<CK_SETTLE_STEPS && w->ch.deadlineUs!=CHANNEL_NEVER_US && ckCheck(w); n++)
+				ckAdvance(w, w->ch.deadlineUs>w->now ? w->ch.deadlineUs : w->now);
+			if (!ckCheck(w))
+				break;
+			if (w->ch.deadlineUs!=CHANNEL_NEVER_US)
+				violation="timer never settles";
+			else if (w->astKeyed)
+				violation="key never matched by an unkey";
+			else if (w->ch.state!=CH_IDLE)
+				violation="doesn't get back to idle";
+			break;
+		default:
+			return false;
+	}
+
+	if (w->ch.state==CH_TIMED_OUT && w->cos)
+		w->timedOut=true;
+	return true;
+}
+
+static void ckReport(const char *config, int depth)
+{
+	int i;
+
+	fprintf(out, "FAIL %s: %s\n", config, violation);
+	for (i=0; i<=depth; i++)
+	{
+		fprintf(out, "\t%8.3f s  %-13s -> %-12s %s\n", (path[i].now-CK_START_US)/1e6,
+				inputNames[path[i].in], channelStateName(path[i].state),
+				path[i].astKeyed ? "keyed" : "unkeyed");
+	}
+}
+
+// Depth first over every input sequence, settling at every node
+static bool ckExplore(const ckWorld_t *w, int depth, const char *config)
+{
+	ckWorld_t next;
+	int in;
+
+	for (in=0; in<IN_NUM; in++)
+	{
+		next=*w;
+		if (!ckApply(&next, in))
+			continue;
+		nodes++;
+		path[depth].in=in;
+		path[depth].now=next.now;
+		path[depth].state=next.ch.state;
+		path[depth].astKeyed=next.astKeyed;
+		if (!ckCheck(&next))
+		{
+			ckReport(config, depth);
+			return false;
+		}
+		if (in!=IN_SETTLE && depth+1<maxDepth && !ckExplore(&next, depth+1, config))
+			return false;
+	}
+	return true;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	ckRun
+Synopsis:
+	Checks one channel configuration from idle with COS down.
+Author:
+	agent
+Inputs:
+	const channel_t *ch: channel, as channelInit() left it plus any
+		timing changes
+	const char *config: description for the report
+Outputs:
+	bool: true if no sequence broke anything
+-----------------------------------------------------------------------------*/
+static bool ckRun(const channel_t *ch, const char *config)
+{
+	ckWorld_t w;
+	uint64_t before=nodes;
+	bool ok;
+
+	memset(&w, 0, sizeof(w));
+	w.ch=*ch;
+	w.now=CK_START_US;
+	w.cosSinceUs=CK_START_US;
+	w.ch.tokens=w.ch.tokensMax;
+	w.ch.tokensUs=CK_START_US;
+	violation=NULL;
+
+	ok=ckExplore(&w, 0, config);
+	if (ok)
+		fprintf(out, "ok   %s: %llu sequences\n", config, (unsigned long long)(nodes-before));
+	return ok;
+}
+
+static bool ckGrid(const channel_t *base)
+{
+	static const uint64_t attack[]={0, 100000}, hang[]={0, 300000}, lockout[]={0, 200000};
+	static const uint64_t timeout[]={1000000, CHANNEL_NEVER_US};
+	static const int burst[]={0, 3};
+	channel_t ch;
+	char config[128];
+	unsigned a, h, l, t, b;
+	bool ok=true;
+
+	for (a=0; a<2; a++)
+	for (h=0; h<2; h++)
+	for (l=0; l<2; l++)
+	for (t=0; t<2; t++)
+	for (b=0; b<2; b++)
+	{
+		ch=*base;
+		ch.attackUs=attack[a];
+		ch.hangUs=hang[h];
+		ch.lockoutUs=lockout[l];
+		ch.timeoutUs=timeout[t];
+		ch.tokensMax=burst[b];
+		ch.tokensPerUs=(burst[b] ? 60/60e6 : 0.0);
+		ch.flapHoldUs=CK_FLAP_HOLD_US;
+		snprintf(config, sizeof(config), "attack %3llu hang %3llu lockout %3llu timeout %4s governor %s",
+				 (unsigned long long)ch.attackUs/1000, (unsigned long long)ch.hangUs/1000,
+				 (unsigned long long)ch.lockoutUs/1000, t ? "off" : "1000", b ? "3+60/min" : "off");
+		ok&=ckRun(&ch, config);
+	}
+	return ok;
+}
+
+static void ckUsage(void)
+{
+	fprintf(stderr,
+		"usage: chcheck [options]\n"
+		"\t-d depth\tinputs per sequence (default %d, max %d)\n"
+		"\t-c file\t\tcheck the channels in this COSmon.conf instead of the built in grid\n",
+		CK_DEFAULT_DEPTH, CK_MAX_DEPTH);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	static ckWorld_t boot;
+	const char *confFile=NULL;
+	channel_t ch;
+	char config[32];
+	bool ok=true;
+	int i, opt;
+
+	while ((opt=getopt(argc, argv, "d:c:h"))!=-1)
+	{
+		switch (opt)
+		{
+			case 'd': maxDepth=atoi(optarg); break;
+			case 'c': confFile=optarg; break;
+			default: ckUsage();
+		}
+	}
+	if (maxDepth<1 || maxDepth>CK_MAX_DEPTH)
+		ckUsage();
+
+	// channel.c chatters on stdout for every timeout and flap
+	out=fdopen(dup(STDOUT_FILENO), "w");
+	if (out==NULL || freopen("/dev/null", "w", stdout)==NULL)
+		return 1;
+	setvbuf(out, NULL, _IOLBF, 0);
+
+	ini=iniparser_load(confFile ? confFile : "/dev/null");
+	if (ini==NULL)
+		return 1;
+	boot.now=CK_START_US;
+	cur=&boot;
+
+	fprintf(out, "Checking the channel state machine, %d inputs deep\n", maxDepth);
+	if (confFile)
+	{
+		for (i=0; i<MAX_CHANNELS; i++)
+		{
+			channelInit(&ch, i);
+			if (!ch.enabled)
+				continue;
+			snprintf(config, sizeof(config), "channel %d", i+1);
+			ok&=ckRun(&ch, config);
+		}
+	}
+	else
+	{
+		channelInit(&ch, 0);
+		ok=ckGrid(&ch);
+	}
+
+	fprintf(out, "%s, %llu sequences\n", ok ? "All good" : "FAILED", (unsigned long long)nodes);
+	return ok ? 0 : 1;
+}
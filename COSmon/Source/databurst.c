@@ -0,0 +1,442 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  databurst.c
+*
+*  Synopsis:	Data burst classifier.  On shared frequencies the HT opens
+*				squelch for APRS packets and digital (DMR, P25...) bursts,
+*				and every one of them would key the node.  Each 20 ms block of
+*				FOB audio gets Goertzel levels in seven bands over 2.5 ms
+*				sub-blocks, and is data when it is loud enough, its envelope
+*				is steady (a modem, not a voice) and either nearly all of it
+*				sits on the Bell 202 tones (1200 / 1700 / 2200 Hz bands:
+*				AFSK) or the spectrum is flat (digital modulation through an
+*				FM receiver sounds like noise).  detect_ms of data starting
+*				within window_ms of COS coming up and the channel is vetoed:
+*				not keyed, or unkeyed if it already was.  release_ms of
+*				voice-like audio in the same transmission (a voice over after
+*				the packet) lets it key.
+*
+*				Runs on its own audio analyzer thread, handing detections to
+*				the event loop through an eventfd like deadcarrier.c.  With
+*				dry_run set COS is ignored and bursts are only counted: run it
+*				over recorded packets for the hit rate and over recorded
+*				speech for the false positives.  The defaults were tuned on
+*				the synthetic files mkfixtures.py makes, not on recordings;
+*				accuracy on real audio hasn't been measured.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <iniparser.h>
+
+#include "databurst.h"
+#include "audio.h"
+#include "channel.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define DB_NUM_BANDS				7
+#define DB_SUBBLOCKS				8		// 2.5 ms each, ~400 Hz Goertzel bins
+#define DB_EVENT_START				1ULL	// eventfd counts starts in the low half,
+#define DB_EVENT_END				(1ULL<<32)	// ends in the high half
+#define DB_FLOOR_DB					-120.0
+#define DEFAULT_DB_DETECT_MS		60
+#define DEFAULT_DB_WINDOW_MS		1000
+#define DEFAULT_DB_RELEASE_MS		300
+#define DEFAULT_DB_LEVEL_DB			-40.0
+#define DEFAULT_DB_AFSK_RATIO		0.7
+#define DEFAULT_DB_FLATNESS			0.6
+#define DEFAULT_DB_ENVELOPE			0.2
+
+// 1200 / 2200 Hz are the Bell 202 mark and space tones, 1700 is between them
+static const double dbBandHz[DB_NUM_BANDS]={500.0, 900.0, 1200.0, 1700.0, 2200.0, 2700.0, 3100.0};
+#define DB_AFSK_FIRST				2
+#define DB_AFSK_LAST				4
+
+typedef enum
+{
+	DB_QUIET=0,
+	DB_VOICE,
+	DB_AFSK,
+	DB_NOISE
+} dbClass_t;
+
+typedef struct
+{
+	bool			enabled;
+	double			coeff[DB_NUM_BANDS];	// Goertzel 2cos(w)
+	uint32_t		dataMs;					// data in a row
+	uint32_t		liveMs;					// voice in a row
+	uint32_t		quietMs;
+	uint32_t		txMs;					// since COS came up
+	bool			burst;					// vetoing this transmission
+	int				eventFd;
+
+	metric_t		*mBursts;
+	metric_t		*mAnalysed;
+	metric_t		*mAfskBlocks;
+	metric_t		*mNoiseBlocks;
+	metric_t		*mProcessNs;
+} dataBurst_t;
+
+static dataBurst_t	bursts[MAX_CHANNELS];
+static uint32_t		detectMs=DEFAULT_DB_DETECT_MS;
+static uint32_t		releaseMs=DEFAULT_DB_RELEASE_MS;
+static uint32_t		windowMs=DEFAULT_DB_WINDOW_MS;
+static double		levelDb=DEFAULT_DB_LEVEL_DB;
+static double		afskRatio=DEFAULT_DB_AFSK_RATIO;
+static double		flatness=DEFAULT_DB_FLATNESS;
+static double		envelope=DEFAULT_DB_ENVELOPE;
+static bool			dryRun=false;
+
+static void dataBurstBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid);
+static void dataBurstReport(int idx);
+
+
+static uint64_t dbNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dataBurstHandler
+Synopsis:
+	Loop side of the eventfd.  Starts and ends are counted separately; the
+	current flag says which came last so a quick start / end pair isn't
+	lost or run backwards.
+Author:
+	agent
+Inputs:
+	standard evloop read handler args, data is the eventfd count
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void dataBurstHandler(int fd, const uint8_t *data, ssize_t len, void *ctx)
+{
+	channel_t *ch=(channel_t *)ctx;
+	uint64_t count, now=evloopNowUs();
+	bool starts, ends;
+
+	(void)fd;
+	if (len!=sizeof(count))
+		return;
+	memcpy(&count, data, sizeof(count));
+	starts=(count & 0xFFFFFFFFULL)!=0;
+	ends=(count>>32)!=0;
+
+	if (__atomic_load_n(&bursts[ch->idx].burst, __ATOMIC_ACQUIRE))
+	{
+		if (ends)
+			channelEvent(ch, EV_DATA_END, now);
+		if (starts)
+			channelEvent(ch, EV_DATA_BURST, now);
+	}
+	else
+	{
+		if (starts)
+			channelEvent(ch, EV_DATA_BURST, now);
+		if (ends)
+			channelEvent(ch, EV_DATA_END, now);
+	}
+}
+
+static void dataBurstSignal(int idx, uint64_t what)
+{
+	if (dryRun)
+		return;
+	if (write(bursts[idx].eventFd, &what, sizeof(what))<0)
+		fprintf(stderr, "Channel %d: data burst eventfd write failed\n", idx+1);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dataBurstInit
+Synopsis:
+	Reads [data burst] and sets up a channel's classifier.  Called from the
+	main thread before the audio threads start.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	unsigned int rate: sample rate
+	unsigned int blockFrames: samples per block
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void dataBurstInit(int idx, unsigned int rate, unsigned int blockFrames)
+{
+	dataBurst_t *db=&bursts[idx];
+	char name[METRICS_NAME_LEN];
+	int b;
+
+	(void)blockFrames;
+	memset(db, 0, sizeof(*db));
+	db->eventFd=-1;
+	if (!iniparser_getboolean(ini, "data burst:enable", 0))
+		return;
+
+	detectMs=	iniparser_getint(ini, "data burst:detect_ms", DEFAULT_DB_DETECT_MS);
+	releaseMs=	iniparser_getint(ini, "data burst:release_ms", DEFAULT_DB_RELEASE_MS);
+	windowMs=	iniparser_getint(ini, "data burst:window_ms", DEFAULT_DB_WINDOW_MS);
+	levelDb=	iniparser_getdouble(ini, "data burst:level_threshold_db", DEFAULT_DB_LEVEL_DB);
+	afskRatio=	iniparser_getdouble(ini, "data burst:afsk_ratio", DEFAULT_DB_AFSK_RATIO);
+	flatness=	iniparser_getdouble(ini, "data burst:flatness", DEFAULT_DB_FLATNESS);
+	envelope=	iniparser_getdouble(ini, "data burst:envelope_variation", DEFAULT_DB_ENVELOPE);
+	dryRun=		iniparser_getboolean(ini, "data burst:dry_run", 0);
+
+	for (b=0; b<DB_NUM_BANDS; b++)
+		db->coeff[b]=2.0*cos(2.0*M_PI*dbBandHz[b]/rate);
+
+	if (!dryRun)
+	{
+		db->eventFd=eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (db->eventFd<0 || evloopAddReader(db->eventFd, sizeof(uint64_t), dataBurstHandler, &channels[idx])<0)
+		{
+			fprintf(stderr, "Channel %d: can't set up data burst classifier\n", idx+1);
+			if (db->eventFd>=0)
+				close(db->eventFd);
+			return;
+		}
+	}
+
+	snprintf(name, sizeof(name), "cosmon_data_bursts_total{channel=\"%d\"}", idx+1);
+	db->mBursts=metricsRegister(name, "APRS / digital bursts kept off the node", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_data_burst_afsk_blocks_total{channel=\"%d\"}", idx+1);
+	db->mAfskBlocks=metricsRegister(name, "Audio blocks that looked like AFSK", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_data_burst_noise_blocks_total{channel=\"%d\"}", idx+1);
+	db->mNoiseBlocks=metricsRegister(name, "Audio blocks that looked like digital noise", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_data_burst_analysed_total{channel=\"%d\"}", idx+1);
+	db->mAnalysed=metricsRegister(name, "Audio blocks the data burst classifier looked at", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_data_burst_process_ns_total{channel=\"%d\"}", idx+1);
+	db->mProcessNs=metricsRegister(name, "CPU time spent in the data burst classifier", METRIC_COUNTER);
+
+	db->enabled=true;
+	audioAddAnalyzer(idx, "databurst", dataBurstBlock, dataBurstReport);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dataBurstClassify
+Synopsis:
+	Quiet, voice, AFSK or digital noise, for one block.
+Author:
+	agent
+Inputs:
+	const dataBurst_t *db: channel's classifier
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples
+Outputs:
+	class of the block
+-----------------------------------------------------------------------------*/
+static dbClass_t dataBurstClassify(const dataBurst_t *db, const int16_t *samples, unsigned int n)
+{
+	double s1[DB_NUM_BANDS], s2[DB_NUM_BANDS], power[DB_NUM_BANDS]={0};
+	double subRms[DB_SUBBLOCKS];
+	double x, s0, subSq, sumSq=0.0, total=0.0, logSum=0.0, mean, var=0.0, afsk=0.0;
+	unsigned int i, j, sub;
+	int b, k=0;
+
+	// Goertzel over short sub-blocks, powers summed
+	sub=n/DB_SUBBLOCKS;
+	for (i=0; i+sub<=n && k<DB_SUBBLOCKS; i+=sub, k++)
+	{
+		memset(s1, 0, sizeof(s1));
+		memset(s2, 0, sizeof(s2));
+		subSq=0.0;
+		for (j=i; j<i+sub; j++)
+		{
+			x=samples[j]/32768.0;
+			subSq+=x*x;
+			for (b=0; b<DB_NUM_BANDS; b++)
+			{
+				s0=x+db->coeff[b]*s1[b]-s2[b];
+				s2[b]=s1[b];
+				s1[b]=s0;
+			}
+		}
+		for (b=0; b<DB_NUM_BANDS; b++)
+			power[b]+=(s1[b]*s1[b]+s2[b]*s2[b]-db->coeff[b]*s1[b]*s2[b])/((double)sub*sub);
+		subRms[k]=sqrt(subSq/sub);
+		sumSq+=subSq;
+	}
+	if (k==0 || 10.0*log10(sumSq/(sub*k)+1e-12)<levelDb)
+		return DB_QUIET;
+
+	// A modem's envelope hardly moves, a voice's does
+	mean=0.0;
+	for (i=0; i<(unsigned int)k; i++)
+		mean+=subRms[i];
+	mean/=k;
+	for (i=0; i<(unsigned int)k; i++)
+		var+=(subRms[i]-mean)*(subRms[i]-mean);
+	if (mean<=0.0 || sqrt(var/k)/mean>envelope)
+		return DB_VOICE;
+
+	for (b=0; b<DB_NUM_BANDS; b++)
+	{
+		total+=power[b];
+		logSum+=log(fmax(power[b], 1e-12));
+		if (b>=DB_AFSK_FIRST && b<=DB_AFSK_LAST)
+			afsk+=power[b];
+	}
+	if (total<=0.0)
+		return DB_QUIET;
+	if (afsk/total>=afskRatio)
+		return DB_AFSK;
+
+	// Spectral flatness: geometric over arithmetic mean, 1 for white noise
+	if (exp(logSum/DB_NUM_BANDS)/(total/DB_NUM_BANDS)>=flatness)
+		return DB_NOISE;
+	return DB_VOICE;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dataBurstBlock
+Synopsis:
+	Classifies one block and tracks the burst.  Analyzer thread only.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples
+	uint64_t captureUs: when the block was complete
+	bool valid: false if the block was lost before the call
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void dataBurstBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid)
+{
+	dataBurst_t *db=&bursts[idx];
+	uint64_t startNs;
+	dbClass_t cls;
+	bool cos;
+
+	(void)captureUs;
+	if (!db->enabled || n==0 || !valid)
+		return;
+	startNs=dbNowNs();
+	metricsInc(db->mAnalysed);
+	cls=dataBurstClassify(db, samples, n);
+	if (!audioBlockIntact())
+		return;
+
+	cos=dryRun || __atomic_load_n(&channels[idx].cosLevel, __ATOMIC_RELAXED);
+	if (!cos)
+	{
+		// COS dropping ends the veto in the state machine
+		db->dataMs=db->liveMs=db->quietMs=db->txMs=0;
+		__atomic_store_n(&db->burst, false, __ATOMIC_RELEASE);
+		metricsAdd(db->mProcessNs, dbNowNs()-startNs);
+		return;
+	}
+
+	// (without COS a pause starts a new transmission)
+	if (dryRun && db->quietMs>=releaseMs)
+		db->txMs=0;
+	db->txMs+=AUDIO_BLOCK_MS;
+
+	switch (cls)
+	{
+		case DB_AFSK:
+		case DB_NOISE:
+			metricsInc(cls==DB_AFSK ? db->mAfskBlocks : db->mNoiseBlocks);
+			db->dataMs+=AUDIO_BLOCK_MS;
+			db->liveMs=db->quietMs=0;
+			break;
+
+		case DB_VOICE:
+			db->liveMs+=AUDIO_BLOCK_MS;
+			db->dataMs=db->quietMs=0;
+			break;
+
+		case DB_QUIET:
+			db->quietMs+=AUDIO_BLOCK_MS;
+			db->dataMs=0;
+			break;
+	}
+
+	// Packets come at the start of a transmission.  Later on it is more
+	// likely a hissy "s" in the middle of someone's over.
+	if (!db->burst && db->dataMs>=detectMs && db->txMs-db->dataMs<windowMs)
+	{
+		metricsInc(db->mBursts);
+		__atomic_store_n(&db->burst, true, __ATOMIC_RELEASE);
+		dataBurstSignal(idx, DB_EVENT_START);
+	}
+	else if (db->burst && (db->liveMs>=releaseMs || (dryRun && db->quietMs>=releaseMs)))
+	{
+		// Someone talking after the packet.  (Without COS, silence ends it too.)
+		__atomic_store_n(&db->burst, false, __ATOMIC_RELEASE);
+		dataBurstSignal(idx, DB_EVENT_END);
+	}
+	metricsAdd(db->mProcessNs, dbNowNs()-startNs);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dataBurstReport
+Synopsis:
+	Prints bursts found, block classes and CPU cost against the amount of
+	audio analysed.  Used at the end of a file run with dry_run set.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void dataBurstReport(int idx)
+{
+	dataBurst_t *db=&bursts[idx];
+	uint64_t blocks;
+	double seconds;
+
+	if (!db->enabled || db->mAnalysed==NULL || db->mBursts==NULL || db->mAfskBlocks==NULL ||
+		db->mNoiseBlocks==NULL || db->mProcessNs==NULL)
+		return;
+
+	blocks=db->mAnalysed->count;
+	seconds=blocks*AUDIO_BLOCK_MS/1000.0;
+	printf("Channel %d data bursts: %llu bursts, %.1f%% AFSK / %.1f%% noise blocks in %.1f s of audio, %.1f us per block\n",
+		   idx+1, (unsigned long long)db->mBursts->count,
+		   blocks ? 100.0*db->mAfskBlocks->count/blocks : 0.0,
+		   blocks ? 100.0*db->mNoiseBlocks->count/blocks : 0.0,
+		   seconds, blocks ? db->mProcessNs->count/1000.0/blocks : 0.0);
+}
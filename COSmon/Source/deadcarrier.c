@@ -0,0 +1,302 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  deadcarrier.c
+*
+*  Synopsis:	Dead carrier detector.  A stuck transmitter with no modulation
+*				keeps COS high but the FOB audio goes flat: very little energy
+*				and nothing changing from one block to the next.  Each 20 ms
+*				block gets an RMS level and a handful of Goertzel band levels;
+*				a block is "dead" when it is quiet AND its spectrum hardly
+*				moved since the last block.  Enough dead time while COS is up
+*				and the channel gets the timeout treatment in seconds instead
+*				of waiting out COS_timeout_ms.
+*
+*				Runs on its own audio analyzer thread.  The trip is handed to the event
+*				loop through an eventfd so the state machine only ever runs on
+*				the loop thread.
+*
+*				With dry_run set COS is ignored and trips are only counted.
+*				Feed it recorded speech from a file and the trip count is the
+*				false positive rate.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <iniparser.h>
+
+#include "deadcarrier.h"
+#include "audio.h"
+#include "channel.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define DC_NUM_BANDS				4
+#define DC_SUBBLOCKS				8		// 2.5 ms each at 20 ms blocks
+#define DEFAULT_DC_ENERGY_DB		-45.0
+#define DEFAULT_DC_FLUX_DB			6.0
+#define DEFAULT_DC_MS				5000
+#define DC_LIVE_PENALTY_MS			200		// a live block takes this much off the dead time
+#define DC_FLOOR_DB					-120.0
+
+// Spread over the voice band.  CTCSS and hum are below all of them.
+static const double dcBandHz[DC_NUM_BANDS]={300.0, 700.0, 1500.0, 2500.0};
+
+typedef struct
+{
+	bool			enabled;
+	unsigned int	blockFrames;
+	double			coeff[DC_NUM_BANDS];	// Goertzel 2cos(w)
+	double			prevDb[DC_NUM_BANDS];
+	bool			havePrev;
+	uint32_t		deadMs;
+	bool			tripped;				// once per COS assertion
+	int				eventFd;
+
+	metric_t		*mTrips;
+	metric_t		*mAnalysed;
+	metric_t		*mDeadBlocks;
+} deadCarrier_t;
+
+static deadCarrier_t	detectors[MAX_CHANNELS];
+static double			energyDb=DEFAULT_DC_ENERGY_DB;
+static double			fluxDb=DEFAULT_DC_FLUX_DB;
+static uint32_t			tripMs=DEFAULT_DC_MS;
+static bool				dryRun=false;
+
+static void deadCarrierBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid);
+static void deadCarrierReport(int idx);
+
+
+static double toDb(double power)
+{
+	return power>0.0 ? fmax(10.0*log10(power), DC_FLOOR_DB) : DC_FLOOR_DB;
+}
+
+// Loop side of the eventfd: the audio thread says this channel's carrier is dead
+static void deadCarrierTripHandler(int fd, const uint8_t *data, ssize_t len, void *ctx)
+{
+	channel_t *ch=(channel_t *)ctx;
+
+	(void)fd;
+	(void)data;
+	if (len<=0)
+		return;
+	channelEvent(ch, EV_DEAD_CARRIER, evloopNowUs());
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	deadCarrierInit
+Synopsis:
+	Reads [dead carrier] and sets up a channel's detector.  Called from the
+	main thread before the audio threads start.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	unsigned int rate: sample rate
+	unsigned int blockFrames: samples per block
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void deadCarrierInit(int idx, unsigned int rate, unsigned int blockFrames)
+{
+	deadCarrier_t *dc=&detectors[idx];
+	char name[METRICS_NAME_LEN];
+	int b;
+
+	memset(dc, 0, sizeof(*dc));
+	dc->eventFd=-1;
+	if (!iniparser_getboolean(ini, "dead carrier:enable", 0))
+		return;
+
+	energyDb=	iniparser_getdouble(ini, "dead carrier:energy_threshold_db", DEFAULT_DC_ENERGY_DB);
+	fluxDb=		iniparser_getdouble(ini, "dead carrier:flux_threshold_db", DEFAULT_DC_FLUX_DB);
+	tripMs=		iniparser_getint(ini, "dead carrier:dead_carrier_ms", DEFAULT_DC_MS);
+	dryRun=		iniparser_getboolean(ini, "dead carrier:dry_run", 0);
+
+	dc->blockFrames=blockFrames;
+	for (b=0; b<DC_NUM_BANDS; b++)
+		dc->coeff[b]=2.0*cos(2.0*M_PI*dcBandHz[b]/rate);
+
+	if (!dryRun)
+	{
+		dc->eventFd=eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (dc->eventFd<0 || evloopAddReader(dc->eventFd, sizeof(uint64_t), deadCarrierTripHandler, &channels[idx])<0)
+		{
+			fprintf(stderr, "Channel %d: can't set up dead carrier detector\n", idx+1);
+			if (dc->eventFd>=0)
+				close(dc->eventFd);
+			return;
+		}
+	}
+
+	snprintf(name, sizeof(name), "cosmon_dead_carrier_trips_total{channel=\"%d\"}", idx+1);
+	dc->mTrips=metricsRegister(name, "Dead carriers detected", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_dead_carrier_blocks_total{channel=\"%d\"}", idx+1);
+	dc->mDeadBlocks=metricsRegister(name, "Audio blocks that looked like an unmodulated carrier", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_dead_carrier_analysed_total{channel=\"%d\"}", idx+1);
+	dc->mAnalysed=metricsRegister(name, "Audio blocks the dead carrier detector looked at", METRIC_COUNTER);
+
+	dc->enabled=true;
+	audioAddAnalyzer(idx, "deadcarrier", deadCarrierBlock, deadCarrierReport);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	deadCarrierBlock
+Synopsis:
+	Analyses one block of audio.  Analyzer thread only.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples
+	uint64_t captureUs: when the block was complete
+	bool valid: false if the block was lost before the call
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void deadCarrierBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid)
+{
+	deadCarrier_t *dc=&detectors[idx];
+	double s1[DC_NUM_BANDS], s2[DC_NUM_BANDS], power[DC_NUM_BANDS]={0};
+	double x, s0, sumSq=0.0, flux=0.0, bandDb;
+	uint64_t one=1;
+	unsigned int i, j, sub;
+	int b;
+	bool cos, dead;
+
+	(void)captureUs;
+	if (!dc->enabled || n==0 || !valid)
+		return;
+	metricsInc(dc->mAnalysed);
+
+	// Goertzel over short sub-blocks, powers averaged.  One bin over the
+	// whole block is so narrow that plain hiss jumps around by several dB
+	// from block to block and looks "live".
+	sub=n/DC_SUBBLOCKS;
+	for (i=0; i+sub<=n; i+=sub)
+	{
+		memset(s1, 0, sizeof(s1));
+		memset(s2, 0, sizeof(s2));
+		for (j=i; j<i+sub; j++)
+		{
+			x=samples[j]/32768.0;
+			sumSq+=x*x;
+			for (b=0; b<DC_NUM_BANDS; b++)
+			{
+				s0=x+dc->coeff[b]*s1[b]-s2[b];
+				s2[b]=s1[b];
+				s1[b]=s0;
+			}
+		}
+		for (b=0; b<DC_NUM_BANDS; b++)
+			power[b]+=(s1[b]*s1[b]+s2[b]*s2[b]-dc->coeff[b]*s1[b]*s2[b])/((double)sub*sub);
+	}
+	if (!audioBlockIntact())
+		return;
+
+	// Spectral flux: mean change of the band levels since the last block
+	for (b=0; b<DC_NUM_BANDS; b++)
+	{
+		bandDb=toDb(power[b]/DC_SUBBLOCKS);
+		if (dc->havePrev)
+			flux+=fabs(bandDb-dc->prevDb[b]);
+		dc->prevDb[b]=bandDb;
+	}
+	flux/=DC_NUM_BANDS;
+	dead=dc->havePrev && toDb(sumSq/(sub*DC_SUBBLOCKS))<energyDb && flux<fluxDb;
+	dc->havePrev=true;
+
+	cos=dryRun || __atomic_load_n(&channels[idx].cosLevel, __ATOMIC_RELAXED);
+	if (!cos)
+	{
+		dc->deadMs=0;
+		dc->tripped=false;
+		return;
+	}
+
+	// Leaky: a click or a breath doesn't restart the count, real speech does
+	if (dead)
+	{
+		metricsInc(dc->mDeadBlocks);
+		dc->deadMs+=AUDIO_BLOCK_MS;
+	}
+	else
+		dc->deadMs=dc->deadMs>DC_LIVE_PENALTY_MS ? dc->deadMs-DC_LIVE_PENALTY_MS : 0;
+
+	if (dc->deadMs<tripMs || dc->tripped)
+		return;
+
+	metricsInc(dc->mTrips);
+	if (dryRun)
+	{
+		// no COS to drop, start counting again
+		dc->deadMs=0;
+		return;
+	}
+	dc->tripped=true;
+	if (write(dc->eventFd, &one, sizeof(one))<0)
+		fprintf(stderr, "Channel %d: dead carrier eventfd write failed\n", idx+1);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	deadCarrierReport
+Synopsis:
+	Prints the trip count against the amount of audio analysed.  Used at
+	the end of a file run with dry_run set: on recorded speech every trip
+	is a false positive.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void deadCarrierReport(int idx)
+{
+	deadCarrier_t *dc=&detectors[idx];
+	double seconds;
+
+	if (!dc->enabled || dc->mAnalysed==NULL || dc->mTrips==NULL || dc->mDeadBlocks==NULL)
+		return;
+
+	seconds=dc->mAnalysed->count*AUDIO_BLOCK_MS/1000.0;
+	printf("Channel %d dead carrier: %llu trips, %.1f%% dead blocks in %.1f s of audio (%.2f trips/hour)\n",
+		   idx+1, (unsigned long long)dc->mTrips->count,
+		   dc->mAnalysed->count ? 100.0*dc->mDeadBlocks->count/dc->mAnalysed->count : 0.0,
+		   seconds, seconds>0.0 ? dc->mTrips->count*3600.0/seconds : 0.0);
+}
@@ -0,0 +1,261 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  dutycycle.c
+*
+*  Synopsis:	HT transmit duty cycle governor.  Baofengs used as a repeater
+*				transmitter overheat and fold back power.  We watch each
+*				radio's PTT line, keep how long it transmitted over a sliding
+*				window (bucketed, O(1) per update) and when it goes over the
+*				thermal budget ask Asterisk to stop keying it until it has
+*				cooled down.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <iniparser.h>
+
+#include "dutycycle.h"
+#include "channel.h"
+#include "astctl.h"
+#include "shmstate.h"
+#include "ini.h"
+#include "mqtt.h"
+#include "serialcos.h"
+#include "wifips.h"
+
+#define DEFAULT_WINDOW_S		600			// 10 minutes
+#define DEFAULT_MAX_PERCENT		50.0
+#define DEFAULT_RELEASE_PERCENT	40.0
+
+static dutyGovernor_t	governors[MAX_CHANNELS];
+static char				throttleCmd[CHANNEL_CMD_LEN];
+static char				releaseCmd[CHANNEL_CMD_LEN];
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	dutyWindowInit
+Synopsis:
+	Sets up an empty sliding window.
+Author:
+	agent
+Inputs:
+	dutyWindow_t *w: window
+	uint32_t windowMs: window length
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void dutyWindowInit(dutyWindow_t *w, uint32_t windowMs, uint64_t now)
+{
+	memset(w, 0, sizeof(*w));
+	w->bucketUs=(uint64_t)windowMs*1000/DUTY_BUCKETS;
+	if (w->bucketUs==0)
+		w->bucketUs=1;
+	w->bucketStartUs=now;
+	w->lastUs=now;
+}
+
+// Brings the window up to now.  Bounded by DUTY_BUCKETS steps whatever the gap.
+static void dutyWindowAdvance(dutyWindow_t *w, uint64_t now)
+{
+	uint64_t end, fill;
+	int i;
+
+	if (now<w->lastUs)
+		return;
+
+	// Nothing happened for more than a whole window, every bucket is the same
+	if (now-w->bucketStartUs>=w->bucketUs*DUTY_BUCKETS)
+	{
+		fill=w->on ? w->bucketUs : 0;
+		for (i=0; i<DUTY_BUCKETS; i++)
+			w->onUs[i]=fill;
+		w->head=0;
+		w->bucketStartUs=now-(now-w->bucketStartUs)%w->bucketUs;
+		w->onUs[0]=0;
+		w->sumUs=fill*(DUTY_BUCKETS-1);
+		w->lastUs=w->bucketStartUs;
+	}
+
+	while (now>=w->bucketStartUs+w->bucketUs)
+	{
+		end=w->bucketStartUs+w->bucketUs;
+		if (w->on)
+		{
+			w->onUs[w->head]+=end-w->lastUs;
+			w->sumUs+=end-w->lastUs;
+		}
+		w->lastUs=end;
+
+		// oldest bucket falls out of the window and becomes the new current one
+		w->head=(w->head+1)%DUTY_BUCKETS;
+		w->sumUs-=w->onUs[w->head];
+		w->onUs[w->head]=0;
+		w->bucketStartUs=end;
+	}
+
+	if (w->on)
+	{
+		w->onUs[w->head]+=now-w->lastUs;
+		w->sumUs+=now-w->lastUs;
+	}
+	w->lastUs=now;
+}
+
+void dutyWindowUpdate(dutyWindow_t *w, bool on, uint64_t now)
+{
+	dutyWindowAdvance(w, now);
+	w->on=on;
+}
+
+float dutyWindowPercent(dutyWindow_t *w, uint64_t now)
+{
+	dutyWindowAdvance(w, now);
+	return 100.0f*(float)w->sumUs/(float)(w->bucketUs*DUTY_BUCKETS);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dutyInit
+Synopsis:
+	Reads the governor config for a channel.  Channel 1's PTT sense pin is
+	[gpio] gpio_PTT, channel 2's is [channel 2] gpio_PTT.  Budget and
+	commands come from [duty cycle].
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void dutyInit(int idx, uint64_t now)
+{
+	dutyGovernor_t *g=&governors[idx];
+	char key[32];
+	char name[METRICS_NAME_LEN];
+
+	memset(g, 0, sizeof(*g));
+
+	if (idx==0)
+		g->pttPin=iniparser_getint(ini, "gpio:gpio_PTT", -1);
+	else
+	{
+		snprintf(key, sizeof(key), "channel %d:gpio_PTT", idx+1);
+		g->pttPin=iniparser_getint(ini, key, -1);
+	}
+
+#ifdef NO_WIRINGPI
+	g->pttPin=-1;
+#endif
+	if (serialPttWired(idx))
+		g->pttPin=-1;			// PTT sense comes from the serial port instead
+
+	g->enabled=iniparser_getboolean(ini, "duty cycle:enable", 0) && (g->pttPin>=0 || serialPttWired(idx)) && channels[idx].enabled;
+	if (!g->enabled)
+		return;
+
+	dutyWindowInit(&g->window, iniparser_getint(ini, "duty cycle:window_s", DEFAULT_WINDOW_S)*1000, now);
+	g->maxPercent=		iniparser_getdouble(ini, "duty cycle:max_percent", DEFAULT_MAX_PERCENT);
+	g->releasePercent=	iniparser_getdouble(ini, "duty cycle:release_percent", DEFAULT_RELEASE_PERCENT);
+	snprintf(throttleCmd, sizeof(throttleCmd), "%s", iniparser_getstring(ini, "duty cycle:throttle_command", ""));
+	snprintf(releaseCmd, sizeof(releaseCmd), "%s", iniparser_getstring(ini, "duty cycle:release_command", ""));
+
+	snprintf(name, sizeof(name), "cosmon_tx_duty_percent{channel=\"%d\"}", idx+1);
+	g->mDuty=metricsRegister(name, "Transmit duty cycle over the governor window", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_tx_throttled{channel=\"%d\"}", idx+1);
+	g->mThrottled=metricsRegister(name, "1 while the duty cycle governor is holding the transmitter off", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_tx_throttles_total{channel=\"%d\"}", idx+1);
+	g->mThrottles=metricsRegister(name, "Times the duty cycle governor tripped", METRIC_COUNTER);
+}
+
+int dutyPttPin(int idx)
+{
+	return governors[idx].enabled ? governors[idx].pttPin : -1;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	dutyPoll
+Synopsis:
+	Feeds the PTT line to the governor and throttles / releases the
+	transmitter with some hysteresis.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	bool ptt: PTT line state (true = transmitting)
+	uint64_t now: current time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void dutyPoll(int idx, bool ptt, uint64_t now)
+{
+	dutyGovernor_t *g=&governors[idx];
+	cosmonShared_t *sh;
+	float percent;
+	char key[32];
+
+	if (!g->enabled)
+		return;
+
+	if (ptt!=g->window.on)
+	{
+		dutyWindowUpdate(&g->window, ptt, now);
+		wifiPsActivity(WIFIPS_SRC_PTT(idx), ptt);
+	}
+	percent=dutyWindowPercent(&g->window, now);
+	metricsSet(g->mDuty, percent);
+
+	if (!g->throttled && percent>g->maxPercent)
+	{
+		printf("Channel %d transmitter duty cycle %.0f%%, throttling\n", idx+1, percent);
+		g->throttled=true;
+		metricsInc(g->mThrottles);
+		if (throttleCmd[0])
+			astctlCommand(throttleCmd);
+	}
+	else if (g->throttled && percent<g->releasePercent)
+	{
+		printf("Channel %d transmitter duty cycle %.0f%%, released\n", idx+1, percent);
+		g->throttled=false;
+		if (releaseCmd[0])
+			astctlCommand(releaseCmd);
+	}
+	metricsSet(g->mThrottled, g->throttled);
+	snprintf(key, sizeof(key), "ch%d/tx_throttled", idx+1);
+	mqttState(key, g->throttled ? "1" : "0");
+
+	sh=shmstateBegin();
+	sh->channel[idx].ptt=ptt;
+	sh->channel[idx].txDutyPercent=percent;
+	sh->channel[idx].txThrottled=g->throttled;
+	shmstateEnd();
+}
@@ -0,0 +1,77 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  dutycycle.h
+*
+*  Synopsis:	Header file for dutycycle.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _DUTYCYCLE
+#define _DUTYCYCLE
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "metrics.h"
+
+#define DUTY_BUCKETS		60			// window resolution
+
+// Sliding window transmit time accumulator
+typedef struct
+{
+	uint64_t	bucketUs;				// window length / DUTY_BUCKETS
+	uint64_t	bucketStartUs;			// start of the current bucket
+	uint32_t	onUs[DUTY_BUCKETS];		// transmit time per bucket
+	int			head;					// current bucket
+	uint64_t	sumUs;					// total of onUs[]
+	bool		on;
+	uint64_t	lastUs;					// last time we accounted up to
+} dutyWindow_t;
+
+// Per transmitter governor
+typedef struct
+{
+	bool			enabled;
+	int				pttPin;
+	dutyWindow_t	window;
+	float			maxPercent;			// throttle above this
+	float			releasePercent;		// and un-throttle below this
+	bool			throttled;
+	metric_t		*mDuty;
+	metric_t		*mThrottled;
+	metric_t		*mThrottles;
+} dutyGovernor_t;
+
+void dutyWindowInit(dutyWindow_t *w, uint32_t windowMs, uint64_t now);
+void dutyWindowUpdate(dutyWindow_t *w, bool on, uint64_t now);
+float dutyWindowPercent(dutyWindow_t *w, uint64_t now);
+
+void dutyInit(int idx, uint64_t now);
+int  dutyPttPin(int idx);
+void dutyPoll(int idx, bool ptt, uint64_t now);
+
+#endif
@@ -0,0 +1,1390 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  evloop.c
+*
+*  Synopsis:	Single threaded event loop for COSmon.  Every fd COSmon cares
+*				about (timers, the Asterisk socket, signals...) is registered
+*				here and dispatched from one place.
+*
+*				Two backends:
+*				epoll:		epoll_wait() then one read() per ready fd and one
+*							write() per queued batch.
+*				io_uring:	(build with IO_URING=1) every source has a poll
+*							posted with its read linked behind it, so data
+*							arrives with the completion without spinning on
+*							non-blocking fds, and queued writes go out in the
+*							same io_uring_enter() that waits for the next
+*							event.  One syscall per wake-up in the common case.
+*
+*				Writes queued with evloopWrite() are flushed in a batch just
+*				before the loop goes back to sleep.  When a stream socket
+*				only takes part of a batch, the rest (and anything queued for
+*				it after) waits in a backlog until the socket is writable, so
+*				a command is never cut in half.
+*
+*				Stats (wake-ups, syscalls, timer wake-up latency) go to the
+*				metrics registry so the two backends can be compared on a
+*				running node.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#ifdef USE_IO_URING
+#include <poll.h>
+#include <liburing.h>
+#endif
+
+#include "evloop.h"
+#include "metrics.h"
+
+typedef enum
+{
+	SRC_FREE=0,
+	SRC_READER,
+	SRC_POLLER,
+	SRC_TIMER,
+	SRC_WRITER			// epoll: EPOLLOUT for a backlog on an fd nobody else watches
+} srcKind_t;
+
+typedef struct
+{
+	srcKind_t				kind;
+	int						fd;
+	bool					closing;		// removed, waiting for io_uring to let go of it
+	bool					posted;			// io_uring: a read is posted
+	bool					wantOut;		// epoll: also watching EPOLLOUT for a backlog
+	uint32_t				events;
+	uint8_t					*buf;
+	size_t					bufSize;
+	evloopReadHandler_t		readHandler;
+	evloopPollHandler_t		pollHandler;
+	evloopTimerHandler_t	timerHandler;
+	void					*ctx;
+	uint64_t				timerExpiryUs;	// when the timer is next due
+	uint64_t				timerPeriodUs;
+	uint64_t				timerBuf;
+} evSource_t;
+
+typedef struct
+{
+	int					fd;
+	uint16_t			offset;
+	uint16_t			len;
+	evloopWriteDone_t	done;
+	void				*ctx;
+} evWrite_t;
+
+typedef struct
+{
+	uint8_t		data[EVLOOP_WRITE_ARENA];
+	size_t		used;
+	evWrite_t	queue[EVLOOP_MAX_WRITES];
+	int			count;
+	int			inFlight;		// io_uring writes not completed yet
+} evArena_t;
+
+typedef struct
+{
+	evloopWriteDone_t	done;
+	void				*ctx;
+	size_t				len;			// the whole write, for done()
+	size_t				end;			// offset in data just past its last byte
+} evWaiter_t;
+
+typedef struct
+{
+	bool			used;
+	bool			closing;			// io_uring: dropped, write still in flight
+	bool			busy;				// io_uring: a write of data[] is in flight
+	int				fd;
+	uint8_t			data[EVLOOP_WRITE_ARENA];
+	size_t			len;
+	evWaiter_t		waiters[EVLOOP_MAX_WRITES];
+	int				nWaiters;
+	evSource_t		*writer;			// epoll: our own source when fd isn't one
+} __attribute__((aligned(8))) evBacklog_t;	// low 3 bits of io_uring user data are a tag
+
+static evSource_t		sources[EVLOOP_MAX_SOURCES];
+static evArena_t		arenas[2];
+static evBacklog_t		backlogs[EVLOOP_MAX_BACKLOGS];
+static int				arenaIdx=0;
+static evloopBackend_t	backend=EVLOOP_BACKEND_EPOLL;
+static volatile bool	running=false;
+static int				epollFd=-1;
+static bool				flushing=false;		// epollFlushWrites() running, done() may queue more
+static bool				virtualClock=false;	// soak test drives the clock
+static uint64_t			virtualNowUs;
+
+static metric_t			*mWakeups;
+static metric_t			*mSyscalls;
+static metric_t			*mWakeLatency;
+static metric_t			*mWritesQueued;
+static metric_t			*mWritesDropped;
+
+#ifdef USE_IO_URING
+#define URING_ENTRIES		256
+#define UD_READ				0
+#define UD_POLL				1
+#define UD_WRITE			2
+#define UD_IGNORE			3		// with a source / backlog: its linked poll
+#define UD_BACKLOG			4
+#define UD_MASK				7		// sources and backlogs are 8 byte aligned
+#define UD_TAG(p, t)		((void *)((uintptr_t)(p) | (t)))
+
+static struct io_uring	ring;
+#endif
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopNowUs
+Synopsis:
+	Monotonic time in microseconds.  Everything in COSmon that measures or
+	schedules time goes through here.  Once evloopSetVirtualTime() has been
+	called it returns the virtual time instead (soak test).
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	microseconds since some fixed point
+-----------------------------------------------------------------------------*/
+uint64_t evloopNowUs(void)
+{
+	struct timespec ts;
+
+	if (virtualClock)
+		return __atomic_load_n(&virtualNowUs, __ATOMIC_RELAXED);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+}
+
+// From here on evloopNowUs() is whatever the soak test says it is
+void evloopSetVirtualTime(uint64_t us)
+{
+	__atomic_store_n(&virtualNowUs, us, __ATOMIC_RELAXED);
+	virtualClock=true;
+}
+
+static evSource_t *findSource(int fd)
+{
+	int i;
+
+	for (i=0; i<EVLOOP_MAX_SOURCES; i++)
+	{
+		if (sources[i].kind!=SRC_FREE && sources[i].kind!=SRC_WRITER && !sources[i].closing && sources[i].fd==fd)
+			return &sources[i];
+	}
+	return NULL;
+}
+
+static evSource_t *allocSource(int fd, srcKind_t kind)
+{
+	int i;
+
+	for (i=0; i<EVLOOP_MAX_SOURCES; i++)
+	{
+		if (sources[i].kind==SRC_FREE)
+		{
+			memset(&sources[i], 0, sizeof(sources[i]));
+			sources[i].fd=fd;
+			sources[i].kind=kind;
+			return &sources[i];
+		}
+	}
+	fprintf(stderr, "evloop: too many sources\n");
+	return NULL;
+}
+
+static void freeSource(evSource_t *s)
+{
+	if (s->kind==SRC_READER)
+		free(s->buf);
+	s->buf=NULL;
+	s->kind=SRC_FREE;
+}
+
+/*-----------------------------------------------------------------------------
+	Common dispatch.  Both backends end up here.
+-----------------------------------------------------------------------------*/
+static void dispatchTimer(evSource_t *s, uint64_t expirations)
+{
+	uint64_t now=evloopNowUs();
+
+	if (now>s->timerExpiryUs)
+		metricsObserve(mWakeLatency, now-s->timerExpiryUs);
+	s->timerExpiryUs+=s->timerPeriodUs*expirations;
+	s->timerHandler(expirations, s->ctx);
+}
+
+static void dispatchRead(evSource_t *s, ssize_t len)
+{
+	if (s->kind==SRC_TIMER)
+	{
+		if (len==sizeof(s->timerBuf))
+			dispatchTimer(s, s->timerBuf);
+	}
+	else
+		s->readHandler(s->fd, s->buf, len, s->ctx);
+}
+
+// Tell the writers in queue[first..first+n-1] how their (coalesced) write went
+static void writesDone(evArena_t *a, int first, int n, ssize_t result)
+{
+	int k;
+	evWrite_t *w;
+
+	if (result<(ssize_t)0)
+		metricsInc(mWritesDropped);
+
+	for (k=first; k<first+n; k++)
+	{
+		w=&a->queue[k];
+		if (w->done)
+			w->done(result<0 ? result : (ssize_t)w->len, w->ctx);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+	Write backlog
+-----------------------------------------------------------------------------*/
+static void backlogKick(evBacklog_t *b);
+static void backlogFree(evBacklog_t *b);
+
+static evBacklog_t *findBacklog(int fd)
+{
+	int i;
+
+	for (i=0; i<EVLOOP_MAX_BACKLOGS; i++)
+	{
+		if (backlogs[i].used && !backlogs[i].closing && backlogs[i].fd==fd)
+			return &backlogs[i];
+	}
+	return NULL;
+}
+
+static evBacklog_t *newBacklog(int fd)
+{
+	int i;
+
+	for (i=0; i<EVLOOP_MAX_BACKLOGS; i++)
+	{
+		if (!backlogs[i].used)
+		{
+			backlogs[i].used=true;
+			backlogs[i].closing=false;
+			backlogs[i].busy=false;
+			backlogs[i].fd=fd;
+			backlogs[i].len=0;
+			backlogs[i].nWaiters=0;
+			backlogs[i].writer=NULL;
+			return &backlogs[i];
+		}
+	}
+	return NULL;
+}
+
+// Adds (the unsent part of) one write, whole is its full length for done()
+static int backlogAppend(evBacklog_t *b, const void *data, size_t len, size_t whole,
+						 evloopWriteDone_t done, void *ctx)
+{
+	evWaiter_t *w;
+
+	if (b->len+len>sizeof(b->data) || b->nWaiters>=EVLOOP_MAX_WRITES)
+		return -1;
+	memcpy(&b->data[b->len], data, len);
+	b->len+=len;
+	w=&b->waiters[b->nWaiters++];
+	w->done=done;
+	w->ctx=ctx;
+	w->len=whole;
+	w->end=b->len;
+	return 0;
+}
+
+// n bytes went out: move the rest up and tell the writers that are done
+static void backlogSent(evBacklog_t *b, size_t n)
+{
+	evWaiter_t fin[EVLOOP_MAX_WRITES];
+	int k, nFin;
+
+	for (nFin=0; nFin<b->nWaiters && b->waiters[nFin].end<=n; nFin++)
+		fin[nFin]=b->waiters[nFin];
+	memmove(b->waiters, &b->waiters[nFin], (b->nWaiters-nFin)*sizeof(b->waiters[0]));
+	b->nWaiters-=nFin;
+	for (k=0; k<b->nWaiters; k++)
+		b->waiters[k].end-=n;
+	memmove(b->data, &b->data[n], b->len-n);
+	b->len-=n;
+
+	// done() may queue more, so only now
+	for (k=0; k<nFin; k++)
+	{
+		if (fin[k].done)
+			fin[k].done(fin[k].len, fin[k].ctx);
+	}
+}
+
+static void backlogFail(evBacklog_t *b, ssize_t err)
+{
+	int k, n=b->nWaiters;
+	evWaiter_t fin[EVLOOP_MAX_WRITES];
+
+	memcpy(fin, b->waiters, n*sizeof(fin[0]));
+	b->nWaiters=0;
+	b->len=0;
+	if (n)
+		metricsInc(mWritesDropped);
+	for (k=0; k<n; k++)
+	{
+		if (fin[k].done)
+			fin[k].done(err, fin[k].ctx);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	writesDefer
+Synopsis:
+	A write of queue[first..first+n-1] only got sent bytes out.  Writers
+	that made it are told, the rest go to the fd's backlog (the first of
+	them minus what was sent) to finish when the fd is writable.
+Author:
+	agent
+Inputs:
+	evArena_t *a: arena the writes are in
+	int first: first queue entry
+	int n: number of entries
+	size_t sent: bytes written
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void writesDefer(evArena_t *a, int first, int n, size_t sent)
+{
+	evBacklog_t *b;
+	evWrite_t *w;
+	size_t skip;
+	int k;
+
+	b=findBacklog(a->queue[first].fd);
+	if (b==NULL)
+		b=newBacklog(a->queue[first].fd);
+
+	for (k=first; k<first+n; k++)
+	{
+		w=&a->queue[k];
+		if (sent>=w->len)
+		{
+			sent-=w->len;
+			if (w->done)
+				w->done(w->len, w->ctx);
+			continue;
+		}
+
+		skip=sent;
+		sent=0;
+		if (b && backlogAppend(b, &a->data[w->offset+skip], w->len-skip, w->len, w->done, w->ctx)==0)
+			continue;
+
+		// Nowhere to keep it, and nothing after it may overtake it either
+		writesDone(a, k, 1, -ENOBUFS);
+		b=NULL;
+	}
+
+	b=findBacklog(a->queue[first].fd);
+	if (b && b->len)
+		backlogKick(b);
+	else if (b)
+		backlogFree(b);
+}
+
+// Everything queued for fd goes after its backlog
+static void writesToBacklog(evBacklog_t *b, evArena_t *a, int first, int n)
+{
+	evWrite_t *w;
+	int k;
+
+	for (k=first; k<first+n; k++)
+	{
+		w=&a->queue[k];
+		if (backlogAppend(b, &a->data[w->offset], w->len, w->len, w->done, w->ctx)<0)
+			writesDone(a, k, 1, -ENOBUFS);
+	}
+	backlogKick(b);
+}
+
+// fd is being closed: nothing queued for it may land on whatever reuses the number
+static void writesDrop(int fd)
+{
+	evBacklog_t *b;
+	evWrite_t *w;
+	int i, k;
+
+	for (i=0; i<2; i++)
+	{
+		for (k=0; k<arenas[i].count; k++)
+		{
+			w=&arenas[i].queue[k];
+			if (w->fd!=fd)
+				continue;
+			w->fd=-1;
+			metricsInc(mWritesDropped);
+			if (w->done)
+				w->done(-ECANCELED, w->ctx);
+		}
+	}
+
+	b=findBacklog(fd);
+	if (b==NULL)
+		return;
+	backlogFail(b, -ECANCELED);
+	backlogFree(b);
+}
+
+/*-----------------------------------------------------------------------------
+	epoll backend
+-----------------------------------------------------------------------------*/
+static void epollWatchOut(evBacklog_t *b, bool on)
+{
+	evSource_t *s=findSource(b->fd);
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	if (s)
+	{
+		// Reader / poller on the same fd: add EPOLLOUT to what it watches
+		if (s->wantOut==on)
+			return;
+		s->wantOut=on;
+		ev.events=(s->kind==SRC_POLLER ? s->events : EPOLLIN) | (on ? EPOLLOUT : 0);
+		ev.data.ptr=s;
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, b->fd, &ev);
+	}
+	else if (on && b->writer==NULL)
+	{
+		b->writer=allocSource(b->fd, SRC_WRITER);
+		if (b->writer==NULL)
+			return;
+		ev.events=EPOLLOUT;
+		ev.data.ptr=b->writer;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, b->fd, &ev)<0)
+		{
+			freeSource(b->writer);
+			b->writer=NULL;
+		}
+	}
+	else if (!on && b->writer)
+	{
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, b->fd, NULL);
+		freeSource(b->writer);
+		b->writer=NULL;
+	}
+	else
+		return;
+	metricsInc(mSyscalls);
+}
+
+// fd is writable again
+static void epollFlushBacklog(int fd)
+{
+	evBacklog_t *b=findBacklog(fd);
+	ssize_t n;
+
+	if (b==NULL)
+		return;
+	n=write(fd, b->data, b->len);
+	metricsInc(mSyscalls);
+	if (n<0 && errno!=EAGAIN && errno!=EINTR)
+		backlogFail(b, -errno);
+	else if (n>0)
+		backlogSent(b, n);
+
+	b=findBacklog(fd);				// done() callbacks may have dropped it
+	if (b && b->len==0)
+		backlogFree(b);
+}
+
+static void epollFlushWrites(evArena_t *a)
+{
+	evBacklog_t *b;
+	int i, j;
+	ssize_t n;
+	size_t len;
+
+	flushing=true;
+	for (i=0; i<a->count; i=j)
+	{
+		if (a->queue[i].fd<0)		// dropped, its fd was closed
+		{
+			j=i+1;
+			continue;
+		}
+
+		// coalesce back to back writes to the same fd into one syscall
+		len=a->queue[i].len;
+		for (j=i+1; j<a->count && a->queue[j].fd==a->queue[i].fd; j++)
+			len+=a->queue[j].len;
+
+		b=findBacklog(a->queue[i].fd);
+		if (b)
+		{
+			writesToBacklog(b, a, i, j-i);
+			continue;
+		}
+
+		n=write(a->queue[i].fd, &a->data[a->queue[i].offset], len);
+		metricsInc(mSyscalls);
+		if (n<0 && errno!=EAGAIN)
+			writesDone(a, i, j-i, -errno);
+		else if (n!=(ssize_t)len)
+			writesDefer(a, i, j-i, n<0 ? 0 : n);
+		else
+			writesDone(a, i, j-i, n);
+	}
+	a->count=0;
+	a->used=0;
+	flushing=false;
+}
+
+static void epollRunOnce(void)
+{
+	struct epoll_event evs[EVLOOP_MAX_SOURCES];
+	evSource_t *s;
+	ssize_t n;
+	int i, nev;
+
+	epollFlushWrites(&arenas[arenaIdx]);
+
+	nev=epoll_wait(epollFd, evs, EVLOOP_MAX_SOURCES, -1);
+	metricsInc(mSyscalls);
+	if (nev<0)
+		return;
+	metricsInc(mWakeups);
+
+	for (i=0; i<nev; i++)
+	{
+		s=evs[i].data.ptr;
+		if (s->kind==SRC_FREE)		// removed by an earlier handler this pass
+			continue;
+
+		// Backlog first, then whatever the source itself was waiting for
+		if ((s->wantOut || s->kind==SRC_WRITER) && (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+		{
+			epollFlushBacklog(s->fd);
+			if (s->kind==SRC_FREE || s->kind==SRC_WRITER)
+				continue;
+			if (s->kind!=SRC_POLLER || !(s->events & EPOLLOUT))
+				evs[i].events&=~EPOLLOUT;
+			if (evs[i].events==0)
+				continue;
+		}
+
+		if (s->kind==SRC_POLLER)
+		{
+			s->pollHandler(s->fd, evs[i].events, s->ctx);
+			continue;
+		}
+
+		if (s->kind==SRC_TIMER)
+			n=read(s->fd, &s->timerBuf, sizeof(s->timerBuf));
+		else
+			n=read(s->fd, s->buf, s->bufSize);
+		metricsInc(mSyscalls);
+
+		if (n<0 && (errno==EAGAIN || errno==EINTR))
+			continue;
+		dispatchRead(s, n<0 ? -errno : n);
+	}
+}
+
+#ifdef USE_IO_URING
+/*-----------------------------------------------------------------------------
+	io_uring backend
+-----------------------------------------------------------------------------*/
+static struct io_uring_sqe *uringGetSqe(void)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe=io_uring_get_sqe(&ring);
+	if (sqe==NULL)
+	{
+		// SQ ring full, push what we have and try again
+		io_uring_submit(&ring);
+		metricsInc(mSyscalls);
+		sqe=io_uring_get_sqe(&ring);
+	}
+	return sqe;
+}
+
+// Room for a linked pair, a link can't be split across submissions
+static void uringReserve(unsigned int n)
+{
+	if (io_uring_sq_space_left(&ring)<n)
+	{
+		io_uring_submit(&ring);
+		metricsInc(mSyscalls);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	uringPostRead
+Synopsis:
+	Posts a POLLIN poll with the read linked behind it.  Every fd on the
+	loop is non-blocking, so a read posted by itself completes -EAGAIN at
+	once and reposting it would spin.  The poll makes a completion only if
+	it fails (cancelled), so data still arrives with one completion.
+Author:
+	agent
+Inputs:
+	evSource_t *s: reader or timer
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void uringPostRead(evSource_t *s)
+{
+	struct io_uring_sqe *sqe;
+
+	uringReserve(2);
+	sqe=uringGetSqe();
+	io_uring_prep_poll_add(sqe, s->fd, POLLIN);
+	io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS);
+	io_uring_sqe_set_data(sqe, UD_TAG(s, UD_IGNORE));
+
+	sqe=uringGetSqe();
+	if (s->kind==SRC_TIMER)
+		io_uring_prep_read(sqe, s->fd, &s->timerBuf, sizeof(s->timerBuf), 0);
+	else
+		io_uring_prep_read(sqe, s->fd, s->buf, s->bufSize, 0);
+	io_uring_sqe_set_data(sqe, UD_TAG(s, UD_READ));
+	s->posted=true;
+}
+
+// Same for a backlog: POLLOUT, then write what's in it
+static void uringPostBacklog(evBacklog_t *b)
+{
+	struct io_uring_sqe *sqe;
+
+	uringReserve(2);
+	sqe=uringGetSqe();
+	io_uring_prep_poll_add(sqe, b->fd, POLLOUT);
+	io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS);
+	io_uring_sqe_set_data(sqe, UD_TAG(b, UD_IGNORE));
+
+	sqe=uringGetSqe();
+	io_uring_prep_write(sqe, b->fd, b->data, b->len, 0);
+	io_uring_sqe_set_data(sqe, UD_TAG(b, UD_BACKLOG));
+	b->busy=true;
+}
+
+static void uringCancelBacklog(evBacklog_t *b)
+{
+	struct io_uring_sqe *sqe=uringGetSqe();
+
+	io_uring_prep_cancel(sqe, UD_TAG(b, UD_IGNORE), 0);
+	io_uring_sqe_set_data(sqe, UD_TAG(NULL, UD_IGNORE));
+}
+
+static void uringPostPoll(evSource_t *s)
+{
+	struct io_uring_sqe *sqe=uringGetSqe();
+
+	io_uring_prep_poll_multishot(sqe, s->fd, s->events);
+	io_uring_sqe_set_data(sqe, UD_TAG(s, UD_POLL));
+}
+
+static void uringCancel(evSource_t *s)
+{
+	struct io_uring_sqe *sqe=uringGetSqe();
+
+	// A read is linked behind its poll, cancelling the poll fails the read too
+	io_uring_prep_cancel(sqe, UD_TAG(s, s->kind==SRC_POLLER ? UD_POLL : UD_IGNORE), 0);
+	io_uring_sqe_set_data(sqe, UD_TAG(NULL, UD_IGNORE));
+}
+
+static void uringQueueWrites(evArena_t *a, int idx)
+{
+	struct io_uring_sqe *sqe;
+	int i, j;
+	size_t len;
+
+	evBacklog_t *b;
+
+	for (i=0; i<a->count; i=j)
+	{
+		if (a->queue[i].fd<0)		// dropped, its fd was closed
+		{
+			j=i+1;
+			continue;
+		}
+
+		len=a->queue[i].len;
+		for (j=i+1; j<a->count && a->queue[j].fd==a->queue[i].fd; j++)
+			len+=a->queue[j].len;
+
+		b=findBacklog(a->queue[i].fd);
+		if (b)
+		{
+			writesToBacklog(b, a, i, j-i);
+			continue;
+		}
+
+		// user data carries arena, first queue entry and entry count
+		sqe=uringGetSqe();
+		io_uring_prep_write(sqe, a->queue[i].fd, &a->data[a->queue[i].offset], len, 0);
+		io_uring_sqe_set_data(sqe, UD_TAG((uintptr_t)((idx | (i<<1) | ((j-i)<<8))<<3), UD_WRITE));
+		a->inFlight++;
+	}
+	a->count=0;
+	if (a->inFlight==0)
+		a->used=0;
+}
+
+static void uringHandleCqe(struct io_uring_cqe *cqe)
+{
+	uintptr_t ud=(uintptr_t)io_uring_cqe_get_data(cqe);
+	evSource_t *s=(evSource_t *)(ud & ~(uintptr_t)UD_MASK);
+	evBacklog_t *b=(evBacklog_t *)(ud & ~(uintptr_t)UD_MASK);
+	evArena_t *a;
+	int k, first, n;
+	size_t len=0;
+
+	switch (ud & UD_MASK)
+	{
+		case UD_WRITE:
+			a=&arenas[(ud>>3) & 1];
+			first=(ud>>4) & 0x7f;
+			n=(ud>>11) & 0xff;
+			for (k=first; k<first+n; k++)
+				len+=a->queue[k].len;
+			if (cqe->res==-EAGAIN)
+				writesDefer(a, first, n, 0);
+			else if (cqe->res>=0 && (size_t)cqe->res<len)
+				writesDefer(a, first, n, cqe->res);
+			else
+				writesDone(a, first, n, cqe->res);
+			if (--a->inFlight==0)
+				a->used=0;
+			break;
+
+		case UD_BACKLOG:
+			b->busy=false;
+			if (b->closing)
+			{
+				b->used=false;
+				break;
+			}
+			if (cqe->res<0 && cqe->res!=-EAGAIN && cqe->res!=-EINTR)
+				backlogFail(b, cqe->res);
+			else if (cqe->res>0)
+				backlogSent(b, cqe->res);
+			// done() callbacks may have dropped it
+			if (b->used && !b->closing && !b->busy)
+			{
+				if (b->len)
+					uringPostBacklog(b);
+				else
+					b->used=false;
+			}
+			break;
+
+		case UD_READ:
+			s->posted=false;
+			if (s->closing)
+			{
+				freeSource(s);
+				break;
+			}
+			if (cqe->res==-EAGAIN || cqe->res==-EINTR)
+			{
+				uringPostRead(s);		// waits on the poll again, doesn't spin
+				break;
+			}
+			dispatchRead(s, cqe->res);
+			// handler may have removed it (and the slot been reused); otherwise keep the read posted
+			if (s->kind!=SRC_FREE && !s->closing && !s->posted && cqe->res>0)
+				uringPostRead(s);
+			break;
+
+		case UD_POLL:
+			if (s->closing)
+			{
+				if (!(cqe->flags & IORING_CQE_F_MORE))
+					freeSource(s);
+				break;
+			}
+			if (cqe->res>0)
+				s->pollHandler(s->fd, cqe->res, s->ctx);
+			if (s->kind==SRC_POLLER && !s->closing && !(cqe->flags & IORING_CQE_F_MORE))
+				uringPostPoll(s);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void uringRunOnce(void)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head;
+	unsigned count=0;
+	evArena_t *a=&arenas[arenaIdx];
+
+	if (a->count)
+	{
+		uringQueueWrites(a, arenaIdx);
+		arenaIdx^=1;	// new writes go to the other arena while these are in flight
+	}
+
+	// Submit everything queued and wait for at least one completion, one syscall
+	if (io_uring_submit_and_wait(&ring, 1)<0)
+		return;
+	metricsInc(mSyscalls);
+	metricsInc(mWakeups);
+
+	io_uring_for_each_cqe(&ring, head, cqe)
+	{
+		uringHandleCqe(cqe);
+		count++;
+	}
+	io_uring_cq_advance(&ring, count);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	uringDrain
+Synopsis:
+	On the way out: sends what the last handlers queued and waits until every
+	write in either arena has completed, otherwise the exit unkey can still be
+	in the ring when the process goes.  Every fd is non-blocking, so writes
+	complete (short or -EAGAIN at worst) without waiting on the peer.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void uringDrain(void)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head;
+	unsigned count;
+	evArena_t *a=&arenas[arenaIdx];
+
+	if (a->count)
+	{
+		uringQueueWrites(a, arenaIdx);
+		arenaIdx^=1;
+	}
+
+	while (arenas[0].inFlight || arenas[1].inFlight)
+	{
+		if (io_uring_submit_and_wait(&ring, 1)<0)
+			break;
+		metricsInc(mSyscalls);
+
+		count=0;
+		io_uring_for_each_cqe(&ring, head, cqe)
+		{
+			uringHandleCqe(cqe);
+			count++;
+		}
+		io_uring_cq_advance(&ring, count);
+	}
+}
+#endif
+
+// Get a backlog going out once its fd is writable
+static void backlogKick(evBacklog_t *b)
+{
+#ifdef USE_IO_URING
+	if (backend==EVLOOP_BACKEND_IO_URING)
+	{
+		if (!b->busy)
+			uringPostBacklog(b);
+		return;
+	}
+#endif
+	epollWatchOut(b, true);
+}
+
+static void backlogFree(evBacklog_t *b)
+{
+#ifdef USE_IO_URING
+	if (backend==EVLOOP_BACKEND_IO_URING)
+	{
+		// The posted write still points at data[], keep the slot till it's back
+		if (b->busy)
+		{
+			b->closing=true;
+			uringCancelBacklog(b);
+			return;
+		}
+		b->used=false;
+		return;
+	}
+#endif
+	epollWatchOut(b, false);
+	b->used=false;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopInit
+Synopsis:
+	Sets up the event loop with the requested backend.  If io_uring is asked
+	for but not compiled in (or the kernel refuses it) we fall back to epoll.
+Author:
+	agent
+Inputs:
+	evloopBackend_t be: backend to use
+Outputs:
+	0 on success, -1 on failure
+-----------------------------------------------------------------------------*/
+int evloopInit(evloopBackend_t be)
+{
+	mWakeups=		metricsRegister("cosmon_evloop_wakeups_total", "Event loop wake-ups", METRIC_COUNTER);
+	mSyscalls=		metricsRegister("cosmon_evloop_syscalls_total", "Syscalls made by the event loop", METRIC_COUNTER);
+	mWakeLatency=	metricsRegister("cosmon_evloop_timer_latency_us", "Timer wake-up latency", METRIC_HISTOGRAM);
+	mWritesQueued=	metricsRegister("cosmon_evloop_writes_queued_total", "Writes queued for batching", METRIC_COUNTER);
+	mWritesDropped=	metricsRegister("cosmon_evloop_writes_dropped_total", "Queued writes that failed or were short", METRIC_COUNTER);
+
+	backend=EVLOOP_BACKEND_EPOLL;
+
+	if (be==EVLOOP_BACKEND_IO_URING)
+	{
+#ifdef USE_IO_URING
+		if (io_uring_queue_init(URING_ENTRIES, &ring, 0)==0)
+		{
+			backend=EVLOOP_BACKEND_IO_URING;
+			return 0;
+		}
+		fprintf(stderr, "evloop: io_uring init failed, using epoll\n");
+#else
+		fprintf(stderr, "evloop: built without io_uring support, using epoll\n");
+#endif
+	}
+
+	epollFd=epoll_create1(EPOLL_CLOEXEC);
+	if (epollFd<0)
+	{
+		perror("epoll_create1");
+		return -1;
+	}
+	return 0;
+}
+
+const char *evloopBackendName(void)
+{
+	return backend==EVLOOP_BACKEND_IO_URING ? "io_uring" : "epoll";
+}
+
+static int registerSource(evSource_t *s)
+{
+	struct epoll_event ev;
+
+#ifdef USE_IO_URING
+	if (backend==EVLOOP_BACKEND_IO_URING)
+	{
+		if (s->kind==SRC_POLLER)
+			uringPostPoll(s);
+		else
+			uringPostRead(s);
+		return 0;
+	}
+#endif
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events=(s->kind==SRC_POLLER) ? s->events : EPOLLIN;
+	ev.data.ptr=s;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, s->fd, &ev)<0)
+	{
+		perror("epoll_ctl");
+		freeSource(s);
+		return -1;
+	}
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopAddReader
+Synopsis:
+	Registers an fd whose data the loop reads on the handler's behalf.
+Author:
+	agent
+Inputs:
+	int fd: file descriptor (should be non-blocking)
+	size_t bufSize: max bytes handed over per call
+	evloopReadHandler_t handler: called with the data
+	void *ctx: passed back to the handler
+Outputs:
+	0 on success, -1 on failure
+-----------------------------------------------------------------------------*/
+int evloopAddReader(int fd, size_t bufSize, evloopReadHandler_t handler, void *ctx)
+{
+	evSource_t *s=allocSource(fd, SRC_READER);
+
+	if (s==NULL)
+		return -1;
+	s->buf=malloc(bufSize);
+	if (s->buf==NULL)
+	{
+		s->kind=SRC_FREE;
+		return -1;
+	}
+	s->bufSize=bufSize;
+	s->readHandler=handler;
+	s->ctx=ctx;
+	return registerSource(s);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopAddPoller
+Synopsis:
+	Registers an fd that the handler services itself (listening sockets,
+	third party libraries...).  Only readiness is reported.
+Author:
+	agent
+Inputs:
+	int fd: file descriptor
+	uint32_t events: EPOLLIN / EPOLLOUT mask
+	evloopPollHandler_t handler: called on readiness
+	void *ctx: passed back to the handler
+Outputs:
+	0 on success, -1 on failure
+-----------------------------------------------------------------------------*/
+int evloopAddPoller(int fd, uint32_t events, evloopPollHandler_t handler, void *ctx)
+{
+	evSource_t *s=allocSource(fd, SRC_POLLER);
+
+	if (s==NULL)
+		return -1;
+	s->events=events;
+	s->pollHandler=handler;
+	s->ctx=ctx;
+	return registerSource(s);
+}
+
+int evloopModPoller(int fd, uint32_t events)
+{
+	evSource_t *s=findSource(fd);
+	struct epoll_event ev;
+
+	if (s==NULL || s->kind!=SRC_POLLER)
+		return -1;
+	if (s->events==events)
+		return 0;
+	s->events=events;
+
+#ifdef USE_IO_URING
+	if (backend==EVLOOP_BACKEND_IO_URING)
+	{
+		struct io_uring_sqe *sqe=uringGetSqe();
+
+		// liburing 2.2+ takes the user data as __u64 here, unlike everywhere else
+		io_uring_prep_poll_update(sqe, (__u64)(uintptr_t)UD_TAG(s, UD_POLL),
+								  (__u64)(uintptr_t)UD_TAG(s, UD_POLL), events,
+								  IORING_POLL_UPDATE_EVENTS);
+		io_uring_sqe_set_data(sqe, UD_TAG(NULL, UD_IGNORE));
+		return 0;
+	}
+#endif
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events=events | (s->wantOut ? EPOLLOUT : 0);
+	ev.data.ptr=s;
+	metricsInc(mSyscalls);
+	return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopRemove
+Synopsis:
+	Stops watching an fd.  The caller still owns (and closes) the fd.
+	Writes still queued for it are dropped, their done() gets -ECANCELED.
+Author:
+	agent
+Inputs:
+	int fd: file descriptor
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void evloopRemove(int fd)
+{
+	evSource_t *s;
+
+	writesDrop(fd);
+	s=findSource(fd);
+	if (s==NULL)
+		return;
+
+#ifdef USE_IO_URING
+	if (backend==EVLOOP_BACKEND_IO_URING)
+	{
+		// The posted read/poll owns the buffer until its completion comes back
+		if (s->kind==SRC_POLLER || s->posted)
+		{
+			s->closing=true;
+			uringCancel(s);
+		}
+		else
+			freeSource(s);
+		return;
+	}
+#endif
+
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+	freeSource(s);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopAddTimer
+Synopsis:
+	Creates a timerfd and registers it.  periodMs of 0 gives a one-shot timer
+	that can be re-armed with evloopArmTimer().  firstMs of 0 leaves it
+	disarmed.
+Author:
+	agent
+Inputs:
+	uint32_t firstMs: time to first expiry
+	uint32_t periodMs: period after that, 0 for one-shot
+	evloopTimerHandler_t handler: called on expiry
+	void *ctx: passed back to the handler
+Outputs:
+	timer fd or -1 on failure
+-----------------------------------------------------------------------------*/
+int evloopAddTimer(uint32_t firstMs, uint32_t periodMs, evloopTimerHandler_t handler, void *ctx)
+{
+	evSource_t *s;
+	int fd;
+
+	fd=timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd<0)
+	{
+		perror("timerfd_create");
+		return -1;
+	}
+
+	s=allocSource(fd, SRC_TIMER);
+	if (s==NULL)
+	{
+		close(fd);
+		return -1;
+	}
+	s->timerHandler=handler;
+	s->ctx=ctx;
+	if (registerSource(s)<0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	evloopArmTimer(fd, firstMs, periodMs);
+	return fd;
+}
+
+void evloopArmTimer(int fd, uint32_t firstMs, uint32_t periodMs)
+{
+	evSource_t *s=findSource(fd);
+	struct itimerspec its;
+
+	if (s==NULL || s->kind!=SRC_TIMER)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec=firstMs/1000;
+	its.it_value.tv_nsec=(firstMs%1000)*1000000L;
+	its.it_interval.tv_sec=periodMs/1000;
+	its.it_interval.tv_nsec=(periodMs%1000)*1000000L;
+
+	s->timerExpiryUs=evloopNowUs()+(uint64_t)firstMs*1000;
+	s->timerPeriodUs=(uint64_t)periodMs*1000;
+	timerfd_settime(fd, 0, &its, NULL);
+	metricsInc(mSyscalls);
+}
+
+void evloopRemoveTimer(int fd)
+{
+	evloopRemove(fd);
+	close(fd);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopWrite
+Synopsis:
+	Queues a write.  Queued writes are flushed together right before the loop
+	waits for the next event, so a burst of commands costs one syscall with
+	epoll (same fd) or none at all with io_uring.
+Author:
+	agent
+Inputs:
+	int fd: file descriptor
+	const void *buf: data (copied)
+	size_t len: data length
+Outputs:
+	0 if queued, -1 if the batch is full and the data was written directly
+-----------------------------------------------------------------------------*/
+int evloopWrite(int fd, const void *buf, size_t len)
+{
+	return evloopWriteNotify(fd, buf, len, NULL, NULL);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopWriteNotify
+Synopsis:
+	Same as evloopWrite() but calls done() once the write has actually been
+	made (from the loop, after the batch is flushed).
+Author:
+	agent
+Inputs:
+	int fd: file descriptor
+	const void *buf: data (copied)
+	size_t len: data length
+	evloopWriteDone_t done: completion callback, may be NULL
+	void *ctx: passed back to done()
+Outputs:
+	0 if queued, -1 if the batch is full and the data was written directly
+-----------------------------------------------------------------------------*/
+int evloopWriteNotify(int fd, const void *buf, size_t len, evloopWriteDone_t done, void *ctx)
+{
+	evArena_t *a=&arenas[arenaIdx];
+	evBacklog_t *b;
+	evWrite_t *w;
+	ssize_t n;
+
+	metricsInc(mWritesQueued);
+
+	// epoll: out of room, send the batch now and start a new one
+	if (backend==EVLOOP_BACKEND_EPOLL && !flushing && len<=EVLOOP_WRITE_ARENA &&
+		(a->count>=EVLOOP_MAX_WRITES || a->used+len>EVLOOP_WRITE_ARENA))
+		epollFlushWrites(a);
+
+	// Other arena still has io_uring writes in flight, or we're out of room.  Write it now,
+	// after the backlog if there is one.
+	if (a->inFlight || a->count>=EVLOOP_MAX_WRITES || a->used+len>EVLOOP_WRITE_ARENA)
+	{
+		b=findBacklog(fd);
+		if (b==NULL)
+		{
+			n=write(fd, buf, len);
+			metricsInc(mSyscalls);
+			if (n==(ssize_t)len || (n<0 && errno!=EAGAIN))
+			{
+				if (n<0)
+					metricsInc(mWritesDropped);
+				if (done)
+					done(n<0 ? -errno : n, ctx);
+				return -1;
+			}
+			if (n<0)
+				n=0;
+			buf=(const uint8_t *)buf+n;
+			b=newBacklog(fd);
+		}
+		else
+			n=0;
+
+		if (b && backlogAppend(b, buf, len-n, len, done, ctx)==0)
+		{
+			backlogKick(b);
+			return -1;
+		}
+		if (b && b->len==0)
+			backlogFree(b);
+		metricsInc(mWritesDropped);
+		if (done)
+			done(-ENOBUFS, ctx);
+		return -1;
+	}
+
+	w=&a->queue[a->count++];
+	w->fd=fd;
+	w->offset=a->used;
+	w->len=len;
+	w->done=done;
+	w->ctx=ctx;
+	memcpy(&a->data[a->used], buf, len);
+	a->used+=len;
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	evloopRun
+Synopsis:
+	Runs the loop until evloopStop() is called, then flushes queued writes.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void evloopRun(void)
+{
+	running=true;
+	while (running)
+	{
+#ifdef USE_IO_URING
+		if (backend==EVLOOP_BACKEND_IO_URING)
+		{
+			uringRunOnce();
+			continue;
+		}
+#endif
+		epollRunOnce();
+	}
+
+	// Don't lose anything queued by the last handlers (unkey on the way out...)
+#ifdef USE_IO_URING
+	if (backend==EVLOOP_BACKEND_IO_URING)
+		uringDrain();
+#endif
+	// done() callbacks may have queued more (and with epoll, this is all of it)
+	epollFlushWrites(&arenas[arenaIdx]);
+}
+
+void evloopStop(void)
+{
+	running=false;
+}
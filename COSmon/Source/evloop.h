@@ -0,0 +1,81 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  evloop.h
+*
+*  Synopsis:	Header file for evloop.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _EVLOOP
+#define _EVLOOP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define EVLOOP_MAX_SOURCES		32
+#define EVLOOP_WRITE_ARENA		8192	// bytes of queued writes per loop iteration
+#define EVLOOP_MAX_WRITES		64		// queued writes per loop iteration
+#define EVLOOP_MAX_BACKLOGS		4		// fds with unsent write tails at once
+
+typedef enum
+{
+	EVLOOP_BACKEND_EPOLL=0,
+	EVLOOP_BACKEND_IO_URING
+} evloopBackend_t;
+
+// Reader sources: the loop does the read() and hands over the data.
+//   len>0: data, len==0: end of file, len<0: -errno
+typedef void (*evloopReadHandler_t)(int fd, const uint8_t *data, ssize_t len, void *ctx);
+
+// Poll sources: the loop only reports readiness, the handler does its own I/O.
+typedef void (*evloopPollHandler_t)(int fd, uint32_t events, void *ctx);
+
+// Timers: expirations is how many periods elapsed since the last call.
+typedef void (*evloopTimerHandler_t)(uint64_t expirations, void *ctx);
+
+// Queued write completion: result is bytes written or -errno.
+typedef void (*evloopWriteDone_t)(ssize_t result, void *ctx);
+
+int  evloopInit(evloopBackend_t backend);
+const char *evloopBackendName(void);
+int  evloopAddReader(int fd, size_t bufSize, evloopReadHandler_t handler, void *ctx);
+int  evloopAddPoller(int fd, uint32_t events, evloopPollHandler_t handler, void *ctx);
+int  evloopModPoller(int fd, uint32_t events);
+void evloopRemove(int fd);
+int  evloopAddTimer(uint32_t firstMs, uint32_t periodMs, evloopTimerHandler_t handler, void *ctx);
+void evloopArmTimer(int fd, uint32_t firstMs, uint32_t periodMs);
+void evloopRemoveTimer(int fd);
+int  evloopWrite(int fd, const void *buf, size_t len);
+int  evloopWriteNotify(int fd, const void *buf, size_t len, evloopWriteDone_t done, void *ctx);
+void evloopRun(void);
+void evloopStop(void);
+uint64_t evloopNowUs(void);
+void evloopSetVirtualTime(uint64_t us);
+
+#endif
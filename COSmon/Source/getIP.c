@@ -51,7 +51,7 @@
 #include <ifaddrs.h>
 #include <fcntl.h>
 #include <pthread.h>
-#include <wiringPi.h>
+#include "gpio.h"
 #include <ctype.h>
 #include <iniparser.h>
 
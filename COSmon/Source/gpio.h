@@ -0,0 +1,79 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  gpio.h
+*
+*  Synopsis:	wiringPi, or stand-ins for it when built with NO_WIRINGPI for
+*				boxes without a GPIO header (x86 mini-PCs).  Channels there get
+*				COS from a serial port (serialcos.c), the stand-ins read as idle:
+*				shutdown switch (active low) not pressed, LEDs go nowhere.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _GPIO
+#define _GPIO
+
+#ifndef NO_WIRINGPI
+#include <wiringPi.h>
+#else
+
+#define LOW			0
+#define HIGH		1
+#define INPUT		0
+#define OUTPUT		1
+#define PUD_UP		2
+
+static inline int wiringPiSetup(void)
+{
+	return 0;
+}
+
+static inline void pinMode(int pin, int mode)
+{
+	(void)pin;
+	(void)mode;
+}
+
+static inline void pullUpDnControl(int pin, int pud)
+{
+	(void)pin;
+	(void)pud;
+}
+
+static inline int digitalRead(int pin)
+{
+	(void)pin;
+	return HIGH;
+}
+
+static inline void digitalWrite(int pin, int value)
+{
+	(void)pin;
+	(void)value;
+}
+
+#endif
+#endif
@@ -35,11 +35,11 @@
 ****************************************************************************/ 
 
 #ifndef _LCDINI
-#define LCDINI
+#define _LCDINI
 
 #include <iniparser.h>
 
-dictionary *ini;
+extern dictionary *ini;
 
 void initIni(const char *pName);
 const char* iniparser_getstring_16(const dictionary *d, const char* key, const char* def);
@@ -0,0 +1,440 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  latency.c
+*
+*  Synopsis:	Audio path latency probe.  Every interval_s a short chirp is
+*				played on the FOB output; the capture side (an RF loop or a
+*				cable back to the FOB input, or snd-aloop on a plain Linux box)
+*				is cross-correlated against it to find when it came back.
+*				Reports round trip latency and jitter next to the COS command
+*				latency so the whole budget is in one place.
+*
+*				Both ends are timed on CLOCK_MONOTONIC: the play side from
+*				snd_pcm_delay() when the chirp is queued, the capture side
+*				from the audio ring's block timestamps.  Correlation runs at
+*				8 kHz to keep it cheap; resolution is one 125 us sample.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+#include <iniparser.h>
+
+#include "latency.h"
+#include "audio.h"
+#include "channel.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define LAT_RATE				8000	// correlation sample rate
+#define LAT_BLOCK				(LAT_RATE*AUDIO_BLOCK_MS/1000)
+#define LAT_CHIRP_MS			100
+#define LAT_CHIRP_LEN			(LAT_RATE*LAT_CHIRP_MS/1000)
+#define LAT_CHIRP_LO_HZ			500.0
+#define LAT_CHIRP_HI_HZ			3000.0	// stays clear of the 4 kHz Nyquist
+#define LAT_MAX_LATENCY_MS		2000
+#define LAT_SLACK_MS			20		// search a little before the chirp went out
+#define LAT_BUF_BLOCKS			((LAT_MAX_LATENCY_MS+LAT_SLACK_MS+LAT_CHIRP_MS)/AUDIO_BLOCK_MS+8)
+#define LAT_SEARCH_LEN			((LAT_MAX_LATENCY_MS+LAT_SLACK_MS)*LAT_RATE/1000)
+#define LAT_MIN_CORRELATION		0.5		// normalised peak needed to call it found
+#define LAT_HISTORY				16		// results the jitter is taken over
+#define DEFAULT_LAT_DEVICE		"plug:dmix:CARD=Device"
+#define DEFAULT_LAT_INTERVAL_S	10
+#define DEFAULT_LAT_MAX_MS		1000
+#define DEFAULT_LAT_LEVEL_DB	-12.0
+
+typedef struct
+{
+	bool			enabled;
+	int				idx;
+	unsigned int	rate;
+	unsigned int	decim;				// capture rate / LAT_RATE
+	char			device[AUDIO_DEVICE_LEN];
+	uint32_t		intervalS;
+	uint32_t		maxLatencyMs;
+	double			level;
+	pthread_t		thread;
+
+	// chirp template at LAT_RATE
+	float			tmpl[LAT_CHIRP_LEN];
+	double			tmplNorm;
+
+	// decimated capture history, LAT_BLOCK samples per ring block
+	float			hist[LAT_BUF_BLOCKS*LAT_BLOCK];
+	uint64_t		lastBlockStartUs;
+	uint64_t		blocks;
+	float			scratch[LAT_SEARCH_LEN+LAT_CHIRP_LEN];
+
+	uint64_t		emitUs;				// set by the play thread, 0 if no probe pending
+	double			results[LAT_HISTORY];
+	int				numResults;
+
+	metric_t		*mRoundTrip;
+	metric_t		*mRoundTripMs;
+	metric_t		*mJitterMs;
+	metric_t		*mProbes;
+	metric_t		*mMisses;
+} latencyProbe_t;
+
+static latencyProbe_t	probe;
+
+static void latencyBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid);
+
+
+// Linear chirp with a Hann taper so the correlation peak is clean
+static double chirpSample(unsigned int i, unsigned int len, unsigned int rate)
+{
+	double t=(double)i/rate, dur=(double)len/rate;
+	double k=(LAT_CHIRP_HI_HZ-LAT_CHIRP_LO_HZ)/dur;
+
+	return sin(2.0*M_PI*(LAT_CHIRP_LO_HZ*t+0.5*k*t*t))*0.5*(1.0-cos(2.0*M_PI*i/len));
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	latencyInit
+Synopsis:
+	Reads [latency probe] and hooks the probe onto its channel's audio.
+	Only one channel is probed at a time.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	unsigned int rate: capture sample rate
+	unsigned int blockFrames: capture samples per block
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void latencyInit(int idx, unsigned int rate, unsigned int blockFrames)
+{
+	latencyProbe_t *lp=&probe;
+	char name[METRICS_NAME_LEN];
+	unsigned int i;
+
+	if (!iniparser_getboolean(ini, "latency probe:enable", 0) ||
+		iniparser_getint(ini, "latency probe:channel", 1)!=idx+1)
+		return;
+
+	if (rate%LAT_RATE!=0 || blockFrames!=rate/LAT_RATE*LAT_BLOCK)
+	{
+		fprintf(stderr, "Latency probe needs a sample rate that is a multiple of %d\n", LAT_RATE);
+		return;
+	}
+
+	memset(lp, 0, sizeof(*lp));
+	lp->idx=idx;
+	lp->rate=rate;
+	lp->decim=rate/LAT_RATE;
+	snprintf(lp->device, sizeof(lp->device), "%s",
+			 iniparser_getstring(ini, "latency probe:playback_device", DEFAULT_LAT_DEVICE));
+	lp->intervalS=		iniparser_getint(ini, "latency probe:interval_s", DEFAULT_LAT_INTERVAL_S);
+	lp->maxLatencyMs=	iniparser_getint(ini, "latency probe:max_latency_ms", DEFAULT_LAT_MAX_MS);
+	lp->level=			pow(10.0, iniparser_getdouble(ini, "latency probe:level_db", DEFAULT_LAT_LEVEL_DB)/20.0);
+	if (lp->maxLatencyMs>LAT_MAX_LATENCY_MS)
+		lp->maxLatencyMs=LAT_MAX_LATENCY_MS;
+	if (lp->intervalS<1)
+		lp->intervalS=1;
+
+	for (i=0; i<LAT_CHIRP_LEN; i++)
+	{
+		lp->tmpl[i]=chirpSample(i, LAT_CHIRP_LEN, LAT_RATE);
+		lp->tmplNorm+=lp->tmpl[i]*lp->tmpl[i];
+	}
+	lp->tmplNorm=sqrt(lp->tmplNorm);
+
+	snprintf(name, sizeof(name), "cosmon_audio_roundtrip_us{channel=\"%d\"}", idx+1);
+	lp->mRoundTrip=metricsRegister(name, "Audio round trip, FOB output to FOB input", METRIC_HISTOGRAM);
+	snprintf(name, sizeof(name), "cosmon_audio_roundtrip_ms{channel=\"%d\"}", idx+1);
+	lp->mRoundTripMs=metricsRegister(name, "Last audio round trip", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_audio_roundtrip_jitter_ms{channel=\"%d\"}", idx+1);
+	lp->mJitterMs=metricsRegister(name, "Standard deviation of the last 16 audio round trips", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_latency_probes_total{channel=\"%d\"}", idx+1);
+	lp->mProbes=metricsRegister(name, "Latency probe chirps played", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_latency_probe_misses_total{channel=\"%d\"}", idx+1);
+	lp->mMisses=metricsRegister(name, "Latency probe chirps that never came back", METRIC_COUNTER);
+
+	if (audioAddAnalyzer(idx, "latency", latencyBlock, NULL)==0)
+		lp->enabled=true;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	latencyReport
+Synopsis:
+	Records one round trip and prints it with the rest of the budget.
+Author:
+	agent
+Inputs:
+	latencyProbe_t *lp: probe
+	double ms: round trip
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void latencyReport(latencyProbe_t *lp, double ms)
+{
+	const metric_t *ack=channels[lp->idx].mAckLatency;
+	double mean=0.0, var=0.0;
+	int i, n;
+
+	lp->results[lp->numResults++ % LAT_HISTORY]=ms;
+	n=lp->numResults<LAT_HISTORY ? lp->numResults : LAT_HISTORY;
+	for (i=0; i<n; i++)
+		mean+=lp->results[i];
+	mean/=n;
+	for (i=0; i<n; i++)
+		var+=(lp->results[i]-mean)*(lp->results[i]-mean);
+
+	metricsObserve(lp->mRoundTrip, (uint64_t)(ms*1000.0));
+	metricsSet(lp->mRoundTripMs, ms);
+	metricsSet(lp->mJitterMs, sqrt(var/n));
+
+	printf("Channel %d latency: audio round trip %.1f ms (jitter %.1f ms), COS command hand-off avg %.2f ms\n",
+		   lp->idx+1, ms, sqrt(var/n),
+		   ack && ack->count ? ack->sumUs/1000.0/ack->count : 0.0);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	latencySearch
+Synopsis:
+	Cross-correlates the capture history against the chirp, from just
+	before it was played to max_latency_ms after.
+Author:
+	agent
+Inputs:
+	latencyProbe_t *lp: probe
+	uint64_t emitUs: when the chirp's first sample left the FOB
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void latencySearch(latencyProbe_t *lp, uint64_t emitUs)
+{
+	const uint64_t histLen=LAT_BUF_BLOCKS*LAT_BLOCK;
+	uint64_t newest=lp->blocks*LAT_BLOCK;	// one past the newest sample
+	int64_t start;
+	unsigned int lags, len, i, lag, best=0;
+	double energy=0.0, c, bestC=0.0, ms;
+	float *x=lp->scratch;
+
+	// Absolute sample number of emitUs-slack, counting back from the newest block
+	start=(int64_t)newest-LAT_BLOCK-
+		  ((int64_t)lp->lastBlockStartUs-(int64_t)emitUs+LAT_SLACK_MS*1000)*LAT_RATE/1000000;
+	lags=(lp->maxLatencyMs+LAT_SLACK_MS)*LAT_RATE/1000;
+	len=lags+LAT_CHIRP_LEN;
+	if (start<0 || (uint64_t)start+histLen<newest || (uint64_t)start+len>newest)
+	{
+		metricsInc(lp->mMisses);
+		return;
+	}
+
+	for (i=0; i<len; i++)
+		x[i]=lp->hist[(start+i)%histLen];
+
+	// Normalised cross-correlation, running window energy
+	for (i=0; i<LAT_CHIRP_LEN; i++)
+		energy+=x[i]*x[i];
+	for (lag=0; lag<lags; lag++)
+	{
+		if (energy>1e-12)
+		{
+			c=0.0;
+			for (i=0; i<LAT_CHIRP_LEN; i++)
+				c+=lp->tmpl[i]*x[lag+i];
+			c/=lp->tmplNorm*sqrt(energy);
+			if (c>bestC)
+			{
+				bestC=c;
+				best=lag;
+			}
+		}
+		energy+=x[lag+LAT_CHIRP_LEN]*x[lag+LAT_CHIRP_LEN]-x[lag]*x[lag];
+	}
+
+	if (bestC<LAT_MIN_CORRELATION)
+	{
+		printf("Channel %d latency: chirp not found (best match %.2f)\n", lp->idx+1, bestC);
+		metricsInc(lp->mMisses);
+		return;
+	}
+
+	ms=((double)best*1000.0/LAT_RATE)-LAT_SLACK_MS;
+	latencyReport(lp, ms);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	latencyBlock
+Synopsis:
+	Analyzer callback.  Decimates each block into the history and runs the
+	search once enough audio after a chirp has come in.  A lost or torn
+	block is zeros in the history, keeping the rest of it in time.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples
+	uint64_t captureUs: when the block was complete
+	bool valid: false if the block was lost before the call
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void latencyBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid)
+{
+	latencyProbe_t *lp=&probe;
+	float *out=&lp->hist[(lp->blocks%LAT_BUF_BLOCKS)*LAT_BLOCK];
+	uint64_t emitUs;
+	unsigned int i, j;
+	float sum;
+	bool intact;
+
+	(void)idx;
+	if (n!=lp->decim*LAT_BLOCK)
+		return;
+
+	// Box filter and decimate.  Crude, but the chirp is well below 4 kHz.
+	for (i=0; i<LAT_BLOCK && valid; i++)
+	{
+		sum=0.0f;
+		for (j=0; j<lp->decim; j++)
+			sum+=samples[i*lp->decim+j];
+		out[i]=sum/(32768.0f*lp->decim);
+	}
+	intact=valid && audioBlockIntact();
+	if (!intact)
+		memset(out, 0, LAT_BLOCK*sizeof(out[0]));
+
+	// When the block was captured, not when we woke up: a late wake-up
+	// would read as extra latency.  A torn block's time can't be trusted.
+	if (intact)
+		lp->lastBlockStartUs=captureUs-AUDIO_BLOCK_MS*1000;
+	else
+		lp->lastBlockStartUs+=AUDIO_BLOCK_MS*1000;
+	lp->blocks++;
+
+	emitUs=__atomic_load_n(&lp->emitUs, __ATOMIC_ACQUIRE);
+	if (emitUs==0 || lp->lastBlockStartUs+AUDIO_BLOCK_MS*1000<emitUs+(lp->maxLatencyMs+LAT_CHIRP_MS+AUDIO_BLOCK_MS)*1000ULL)
+		return;
+
+	__atomic_store_n(&lp->emitUs, 0, __ATOMIC_RELEASE);
+	latencySearch(lp, emitUs);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	latencyPlayThread
+Synopsis:
+	Keeps the FOB output running with silence (so its buffering doesn't
+	change between probes) and slips a chirp in every interval_s.
+Author:
+	agent
+Inputs:
+	void *arg: latencyProbe_t
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void *latencyPlayThread(void *arg)
+{
+	latencyProbe_t *lp=(latencyProbe_t *)arg;
+	unsigned int blockFrames=lp->rate*AUDIO_BLOCK_MS/1000;
+	unsigned int chirpFrames=lp->rate*LAT_CHIRP_MS/1000;
+	unsigned int chirpBlocks=(chirpFrames+blockFrames-1)/blockFrames;
+	int16_t *silence, *chirp;
+	snd_pcm_t *pcm;
+	snd_pcm_sframes_t delay, n;
+	uint64_t nextProbeUs, now;
+	unsigned int i;
+	int err;
+
+	err=snd_pcm_open(&pcm, lp->device, SND_PCM_STREAM_PLAYBACK, 0);
+	if (err>=0)
+		err=snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, lp->rate, 1, 100000);
+	if (err<0)
+	{
+		fprintf(stderr, "Latency probe: can't play on %s: %s\n", lp->device, snd_strerror(err));
+		return NULL;
+	}
+
+	silence=calloc(blockFrames, sizeof(int16_t));
+	chirp=calloc(chirpBlocks*blockFrames, sizeof(int16_t));
+	for (i=0; i<chirpFrames; i++)
+		chirp[i]=(int16_t)(chirpSample(i, chirpFrames, lp->rate)*lp->level*32767.0);
+
+	nextProbeUs=evloopNowUs()+lp->intervalS*1000000ULL;
+	for (;;)
+	{
+		now=evloopNowUs();
+		if (now>=nextProbeUs && __atomic_load_n(&lp->emitUs, __ATOMIC_ACQUIRE)==0)
+		{
+			// The chirp goes out once everything already queued has played
+			if (snd_pcm_delay(pcm, &delay)<0)
+				delay=0;
+			__atomic_store_n(&lp->emitUs, now+(uint64_t)delay*1000000/lp->rate, __ATOMIC_RELEASE);
+			metricsInc(lp->mProbes);
+			for (i=0; i<chirpBlocks; i++)
+			{
+				n=snd_pcm_writei(pcm, chirp+i*blockFrames, blockFrames);
+				if (n<0)
+					snd_pcm_recover(pcm, n, 1);
+			}
+			nextProbeUs=now+lp->intervalS*1000000ULL;
+			continue;
+		}
+
+		n=snd_pcm_writei(pcm, silence, blockFrames);
+		if (n<0 && snd_pcm_recover(pcm, n, 1)<0)
+		{
+			fprintf(stderr, "Latency probe: playback failed: %s\n", snd_strerror(n));
+			break;
+		}
+	}
+
+	free(silence);
+	free(chirp);
+	snd_pcm_close(pcm);
+	return NULL;
+}
+
+// Starts the play side, the capture side is already an audio analyzer
+void latencyStart(void)
+{
+	if (!probe.enabled)
+		return;
+	if (pthread_create(&probe.thread, NULL, latencyPlayThread, &probe)!=0)
+	{
+		fprintf(stderr, "Latency probe: can't start play thread\n");
+		return;
+	}
+	pthread_detach(probe.thread);
+}
@@ -0,0 +1,617 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  lcd.c
+*
+*  Synopsis:	HD44780 character LCD on a PCF8574 I2C backpack: IP address,
+*				channel state, Asterisk links and COS timeouts.  The event loop
+*				only copies a few words of status on a timer and wakes the LCD
+*				thread when they change; the thread renders a frame, diffs it
+*				against what the display already shows and sends just the
+*				changed runs of cells (a cursor move then the characters), all
+*				of it batched into as few I2C transactions as the adapter
+*				allows.  No I2C ever happens on the COS path.
+*
+*				Works on a real I2C adapter (one plain write per frame) and on
+*				SMBus-only ones such as i2c-stub (32 byte I2C block writes, the
+*				PCF8574 takes the command byte as just another output byte).
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <iniparser.h>
+
+#include "lcd.h"
+#include "ini.h"
+#include "getIP.h"
+#include "evloop.h"
+#include "metrics.h"
+#include "channel.h"
+#include "astctl.h"
+#include "ami.h"
+
+#define DEFAULT_LCD_BUS			1
+#define DEFAULT_LCD_ADDRESS		0x27
+#define DEFAULT_LCD_COLS		16
+#define DEFAULT_LCD_ROWS		2
+#define DEFAULT_LCD_REFRESH_MS	100
+#define DEFAULT_LCD_IP_CHECK_S	5
+#define LCD_MAX_COLS			40
+#define LCD_MAX_ROWS			4
+#define LCD_MSG_LEN				(LCD_MAX_COLS+1)
+#define LCD_NO_CHANNEL			0xFF		// lcdStatus_t state of a disabled channel
+#define LCD_RETRY_S				5			// display not answering, try the init again this often
+#define LCD_BUF_LEN				1024		// every cell of a 40x4 frame plus a cursor move per row
+
+// PCF8574 outputs on the usual backpack.  D4-D7 are the top nibble.
+#define PCF_RS					0x01
+#define PCF_EN					0x04
+#define PCF_BACKLIGHT			0x08
+
+// HD44780 instructions
+#define HD_CLEAR				0x01
+#define HD_ENTRY_INC			0x06
+#define HD_DISPLAY_ON			0x0C
+#define HD_FUNCTION_4BIT_2LINE	0x28
+#define HD_SET_DDRAM			0x80
+
+typedef enum
+{
+	LCD_XFER_I2C=0,			// one plain write() per frame
+	LCD_XFER_BLOCK,			// SMBus I2C block writes, 33 bytes each
+	LCD_XFER_BYTE			// SMBus send byte, one at a time
+} lcdXfer_t;
+
+static const char *const lcdXferNames[]={ "I2C", "SMBus block", "SMBus byte" };
+
+// What the display shows, copied by the event loop.  Compared with memcmp(),
+// so always memset() first.
+typedef struct
+{
+	uint8_t		state[MAX_CHANNELS];		// chState_t or LCD_NO_CHANNEL
+	uint64_t	timeouts[MAX_CHANNELS];
+	int			links;
+	bool		astUp;
+} lcdStatus_t;
+
+// Indexed by chState_t
+static const char *const lcdStateNames[CH_NUM_STATES]=
+	{ "IDLE", "ATTACK", "KEYED", "HANG", "TIMEOUT", "LOCKOUT", "FLAP", "DATA" };
+static const char lcdStateCodes[CH_NUM_STATES]=
+	{ '-', 'a', 'K', 'H', 'T', 'L', 'F', 'D' };
+
+static struct
+{
+	bool			enabled;
+	int				fd;
+	lcdXfer_t		xfer;
+	int				cols;
+	int				rows;
+	uint8_t			backlight;
+	uint32_t		ipCheckTicks;
+	uint32_t		ticks;
+	lcdStatus_t		lastStatus;			// event loop only: last one handed over
+
+	pthread_t		thread;
+	pthread_mutex_t	lock;				// never held across I2C
+	pthread_cond_t	wake;
+	lcdStatus_t		status;				// under lock
+	bool			pending;			// under lock: status / message changed
+	bool			ipDue;				// under lock: time to look up the IP again
+	char			message[LCD_MSG_LEN];	// under lock
+
+	// LCD thread only
+	char			shown[LCD_MAX_ROWS][LCD_MAX_COLS];
+	uint8_t			buf[LCD_BUF_LEN];
+	size_t			bufLen;
+
+	metric_t		*mUpdates;
+	metric_t		*mCells;
+	metric_t		*mBytes;
+	metric_t		*mXfers;
+	metric_t		*mBusTime;
+	metric_t		*mErrors;
+} lcd={ .lock=PTHREAD_MUTEX_INITIALIZER, .wake=PTHREAD_COND_INITIALIZER, .fd=-1 };
+
+
+// Queues one 4 bit half of an HD44780 byte: the data with EN high, then EN
+// low to latch it.  Each I2C byte takes ~90 us at 100 kHz, longer than the
+// 37 us the controller needs per byte, so no delays are needed between them.
+static void lcdNibble(uint8_t nibble, uint8_t rs)
+{
+	uint8_t b=(nibble & 0xF0) | rs | lcd.backlight;
+
+	if (lcd.bufLen+2>sizeof(lcd.buf))
+		return;
+	lcd.buf[lcd.bufLen++]=b | PCF_EN;
+	lcd.buf[lcd.bufLen++]=b;
+}
+
+static void lcdByte(uint8_t val, uint8_t rs)
+{
+	lcdNibble(val, rs);
+	lcdNibble(val<<4, rs);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	lcdFlush
+Synopsis:
+	Sends everything queued by lcdNibble() / lcdByte() to the backpack in as
+	few transactions as the adapter can do.  The PCF8574 has no registers:
+	every byte it receives goes straight to its outputs, so the command byte
+	of an SMBus write is just the first byte of the batch.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	0 on success, -1 if the display didn't take it
+-----------------------------------------------------------------------------*/
+static int lcdFlush(void)
+{
+	struct i2c_smbus_ioctl_data args;
+	union i2c_smbus_data data;
+	struct timespec t0, t1;
+	size_t off=0, n, chunk;
+	int err=0;
+
+	if (lcd.bufLen==0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (lcd.xfer==LCD_XFER_I2C)
+	{
+		if (write(lcd.fd, lcd.buf, lcd.bufLen)!=(ssize_t)lcd.bufLen)
+			err=-1;
+		metricsInc(lcd.mXfers);
+	}
+	else
+	{
+		chunk=lcd.xfer==LCD_XFER_BLOCK ? I2C_SMBUS_BLOCK_MAX : 0;
+		while (off<lcd.bufLen && err==0)
+		{
+			n=lcd.bufLen-off-1;
+			if (n>chunk)
+				n=chunk;
+			args.read_write=I2C_SMBUS_WRITE;
+			args.command=lcd.buf[off];
+			if (n>0)
+			{
+				data.block[0]=n;
+				memcpy(&data.block[1], &lcd.buf[off+1], n);
+				args.size=I2C_SMBUS_I2C_BLOCK_DATA;
+				args.data=&data;
+			}
+			else
+			{
+				args.size=I2C_SMBUS_BYTE;
+				args.data=NULL;
+			}
+			err=ioctl(lcd.fd, I2C_SMBUS, &args)<0 ? -1 : 0;
+			off+=n+1;
+			metricsInc(lcd.mXfers);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	metricsAdd(lcd.mBytes, lcd.bufLen);
+	metricsObserve(lcd.mBusTime, (t1.tv_sec-t0.tv_sec)*1000000ull+(t1.tv_nsec-t0.tv_nsec)/1000);
+	lcd.bufLen=0;
+	if (err<0)
+		metricsInc(lcd.mErrors);
+	return err;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	lcdReset
+Synopsis:
+	HD44780 4 bit initialisation.  The controller could be in 8 bit mode
+	(just powered up) or half way through a 4 bit byte (COSmon restarted
+	in the middle of an update); three 0x3 nibbles get it into 8 bit mode
+	from either, then 0x2 switches to 4 bit.  Sleeps, so LCD thread only.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	0 on success, -1 if the display didn't answer
+-----------------------------------------------------------------------------*/
+static int lcdReset(void)
+{
+	static const uint8_t wake[]=			{ 0x30, 0x30, 0x30, 0x20 };
+	static const unsigned int wakeUs[]=		{ 4500, 150, 150, 150 };
+	unsigned int i;
+
+	usleep(50000);
+	lcd.bufLen=0;
+	for (i=0; i<sizeof(wake); i++)
+	{
+		lcdNibble(wake[i], 0);
+		if (lcdFlush()<0)
+			return -1;
+		usleep(wakeUs[i]);
+	}
+
+	lcdByte(HD_FUNCTION_4BIT_2LINE, 0);
+	lcdByte(HD_DISPLAY_ON, 0);
+	lcdByte(HD_ENTRY_INC, 0);
+	lcdByte(HD_CLEAR, 0);
+	if (lcdFlush()<0)
+		return -1;
+	usleep(2000);
+
+	memset(lcd.shown, ' ', sizeof(lcd.shown));
+	return 0;
+}
+
+// Copies s into a frame row, no NUL, cut at the display width
+static void lcdPut(char *row, int col, const char *s)
+{
+	while (*s && col<lcd.cols)
+		row[col++]=*s++;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	lcdRender
+Synopsis:
+	Lays out a frame.  16x2:
+		192.168.1.20
+		KEYED     L2 TO1
+	The state is spelled out with one channel, one letter per channel with
+	more (- idle, a attack, K keyed, H hang, T timed out, L lockout,
+	F flapping, D data).  L is the Asterisk link count ("!AST" while
+	Asterisk is down), TO the COS timeouts since start-up.  A 4 line display
+	gets a line per channel on lines 3 and 4.  A message (shutting down...)
+	replaces the status line.
+Author:
+	agent
+Inputs:
+	const lcdStatus_t *st: status from the event loop
+	const char *ip: IP address or ""
+	const char *message: message or ""
+	char frame[][LCD_MAX_COLS]: where to render
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void lcdRender(const lcdStatus_t *st, const char *ip, const char *message, char frame[LCD_MAX_ROWS][LCD_MAX_COLS])
+{
+	char left[MAX_CHANNELS+1], right[32], line[LCD_MSG_LEN];
+	uint64_t timeouts=0;
+	int i, n=0, last=0, statusRow, row, col;
+
+	memset(frame, ' ', LCD_MAX_ROWS*LCD_MAX_COLS);
+	statusRow=lcd.rows>1 ? 1 : 0;
+	if (lcd.rows>1)
+		lcdPut(frame[0], 0, ip[0] ? ip : "No network");
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (st->state[i]==LCD_NO_CHANNEL)
+			continue;
+		left[n++]=lcdStateCodes[st->state[i]];
+		timeouts+=st->timeouts[i];
+		last=i;
+	}
+	left[n]='\0';
+
+	if (message[0])
+	{
+		lcdPut(frame[statusRow], 0, message);
+		return;
+	}
+
+	if (st->astUp)
+		snprintf(right, sizeof(right), "L%d TO%llu", st->links, (unsigned long long)timeouts);
+	else
+		snprintf(right, sizeof(right), "!AST TO%llu", (unsigned long long)timeouts);
+	lcdPut(frame[statusRow], 0, n==1 ? lcdStateNames[st->state[last]] : left);
+
+	// Right aligned, over the end of the state if it has to, with a space
+	col=lcd.cols-(int)strlen(right);
+	if (col<1)
+		col=1;
+	frame[statusRow][col-1]=' ';
+	lcdPut(frame[statusRow], col, right);
+
+	row=2;
+	for (i=0; i<MAX_CHANNELS && row<lcd.rows; i++)
+	{
+		if (st->state[i]==LCD_NO_CHANNEL)
+			continue;
+		snprintf(line, sizeof(line), "Ch%d %-8s TO%llu", i+1, lcdStateNames[st->state[i]],
+				 (unsigned long long)st->timeouts[i]);
+		lcdPut(frame[row++], 0, line);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	lcdUpdate
+Synopsis:
+	Sends the cells of frame that differ from what's on the display.  Each
+	run of changed cells is a cursor move and the characters (the cursor
+	moves on by itself); runs one unchanged cell apart are joined, rewriting
+	the cell costs the same 4 bytes as another cursor move.  All of it goes
+	out in one lcdFlush().
+Author:
+	agent
+Inputs:
+	char frame[][LCD_MAX_COLS]: new frame
+Outputs:
+	0 on success, -1 if the display didn't take it
+-----------------------------------------------------------------------------*/
+static int lcdUpdate(char frame[LCD_MAX_ROWS][LCD_MAX_COLS])
+{
+	const uint8_t rowAddr[LCD_MAX_ROWS]={ 0x00, 0x40, (uint8_t)lcd.cols, (uint8_t)(0x40+lcd.cols) };
+	int row, col, end, c;
+	uint64_t cells=0;
+
+	lcd.bufLen=0;
+	for (row=0; row<lcd.rows; row++)
+	{
+		col=0;
+		while (col<lcd.cols)
+		{
+			if (frame[row][col]==lcd.shown[row][col])
+			{
+				col++;
+				continue;
+			}
+
+			end=col+1;
+			for (c=end; c<lcd.cols && c<=end+1; c++)
+			{
+				if (frame[row][c]!=lcd.shown[row][c])
+					end=c+1;
+			}
+
+			lcdByte(HD_SET_DDRAM | (rowAddr[row]+col), 0);
+			cells+=end-col;
+			for (; col<end; col++)
+				lcdByte(frame[row][col], PCF_RS);
+		}
+	}
+
+	if (lcd.bufLen==0)
+		return 0;
+	if (lcdFlush()<0)
+		return -1;
+	memcpy(lcd.shown, frame, sizeof(lcd.shown));
+	metricsInc(lcd.mUpdates);
+	metricsAdd(lcd.mCells, cells);
+	return 0;
+}
+
+static void *lcdThread(void *arg)
+{
+	lcdStatus_t st;
+	char frame[LCD_MAX_ROWS][LCD_MAX_COLS];
+	char ip[17]="";
+	char message[LCD_MSG_LEN];
+	bool ready=false, complained=false, ipDue;
+
+	(void)arg;
+	for (;;)
+	{
+		pthread_mutex_lock(&lcd.lock);
+		while (ready && !lcd.pending)
+			pthread_cond_wait(&lcd.wake, &lcd.lock);
+		st=lcd.status;
+		ipDue=lcd.ipDue;
+		memcpy(message, lcd.message, sizeof(message));
+		lcd.pending=false;
+		lcd.ipDue=false;
+		pthread_mutex_unlock(&lcd.lock);
+
+		// Display missing or unplugged: keep trying, it may come back
+		if (!ready && lcdReset()<0)
+		{
+			if (!complained)
+				fprintf(stderr, "LCD: display not answering, retrying every %d s\n", LCD_RETRY_S);
+			complained=true;
+			sleep(LCD_RETRY_S);
+			continue;
+		}
+		ready=true;
+		complained=false;
+
+		if (ipDue)
+			getIPaddress(ip);
+		lcdRender(&st, ip, message, frame);
+		if (lcdUpdate(frame)<0)
+			ready=false;
+	}
+	return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	lcdTickHandler
+Synopsis:
+	Event loop side, every refresh_ms: copies the status and wakes the LCD
+	thread if any of it changed (or the IP is due a look).  A few loads and
+	a memcmp(); the lock is only ever held for copies.
+Author:
+	agent
+Inputs:
+	standard evloop timer handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void lcdTickHandler(uint64_t expirations, void *ctx)
+{
+	lcdStatus_t st;
+	bool ipDue;
+	int i;
+
+	(void)ctx;
+	memset(&st, 0, sizeof(st));
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		st.state[i]=channels[i].enabled ? channels[i].state : LCD_NO_CHANNEL;
+		if (channels[i].enabled && channels[i].mTimeouts)
+			st.timeouts[i]=__atomic_load_n(&channels[i].mTimeouts->count, __ATOMIC_RELAXED);
+	}
+	st.links=amiLinks();
+	st.astUp=astctlConnected();
+
+	lcd.ticks+=expirations;
+	ipDue=lcd.ticks>=lcd.ipCheckTicks;
+	if (ipDue)
+		lcd.ticks=0;
+	if (!ipDue && memcmp(&st, &lcd.lastStatus, sizeof(st))==0)
+		return;
+	lcd.lastStatus=st;
+
+	pthread_mutex_lock(&lcd.lock);
+	lcd.status=st;
+	lcd.ipDue|=ipDue;
+	lcd.pending=true;
+	pthread_cond_signal(&lcd.wake);
+	pthread_mutex_unlock(&lcd.lock);
+}
+
+// Shows msg on the status line instead of the status, "" or NULL to go back
+void lcdMessage(const char *msg)
+{
+	if (!lcd.enabled)
+		return;
+	pthread_mutex_lock(&lcd.lock);
+	snprintf(lcd.message, sizeof(lcd.message), "%s", msg ? msg : "");
+	lcd.pending=true;
+	pthread_cond_signal(&lcd.wake);
+	pthread_mutex_unlock(&lcd.lock);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	lcdInit
+Synopsis:
+	Reads [lcd], opens the I2C bus and works out how to batch writes on it,
+	then starts the LCD thread and the status timer.  The display itself is
+	initialised by the thread.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void lcdInit(void)
+{
+	char dev[32];
+	unsigned long funcs=0;
+	int bus, addr, refreshMs, err;
+	sigset_t allSigs, oldSigs;
+
+	if (!iniparser_getboolean(ini, "lcd:enable", 0))
+		return;
+
+	bus=		iniparser_getint(ini, "lcd:bus", DEFAULT_LCD_BUS);
+	addr=		iniparser_getint(ini, "lcd:address", DEFAULT_LCD_ADDRESS);
+	lcd.cols=	iniparser_getint(ini, "lcd:cols", DEFAULT_LCD_COLS);
+	lcd.rows=	iniparser_getint(ini, "lcd:rows", DEFAULT_LCD_ROWS);
+	refreshMs=	iniparser_getint(ini, "lcd:refresh_ms", DEFAULT_LCD_REFRESH_MS);
+	lcd.backlight=iniparser_getboolean(ini, "lcd:backlight", 1) ? PCF_BACKLIGHT : 0;
+	if (lcd.cols<1 || lcd.cols>LCD_MAX_COLS)
+		lcd.cols=DEFAULT_LCD_COLS;
+	if (lcd.rows<1 || lcd.rows>LCD_MAX_ROWS)
+		lcd.rows=DEFAULT_LCD_ROWS;
+	if (refreshMs<10)
+		refreshMs=10;
+	lcd.ipCheckTicks=iniparser_getint(ini, "lcd:ip_check_s", DEFAULT_LCD_IP_CHECK_S)*1000/refreshMs;
+	if (lcd.ipCheckTicks<1)
+		lcd.ipCheckTicks=1;
+
+	snprintf(dev, sizeof(dev), "/dev/i2c-%d", bus);
+	lcd.fd=open(dev, O_RDWR | O_CLOEXEC);
+	if (lcd.fd<0 || ioctl(lcd.fd, I2C_SLAVE, addr)<0 || ioctl(lcd.fd, I2C_FUNCS, &funcs)<0)
+	{
+		fprintf(stderr, "LCD: can't use %s address 0x%02x, disabled\n", dev, addr);
+		if (lcd.fd>=0)
+			close(lcd.fd);
+		return;
+	}
+	if (funcs & I2C_FUNC_I2C)
+		lcd.xfer=LCD_XFER_I2C;
+	else if (funcs & I2C_FUNC_SMBUS_WRITE_I2C_BLOCK)
+		lcd.xfer=LCD_XFER_BLOCK;
+	else if (funcs & I2C_FUNC_SMBUS_WRITE_BYTE)
+		lcd.xfer=LCD_XFER_BYTE;
+	else
+	{
+		fprintf(stderr, "LCD: %s can't write, disabled\n", dev);
+		close(lcd.fd);
+		return;
+	}
+
+	lcd.mUpdates=	metricsRegister("cosmon_lcd_updates_total", "LCD frames that changed something", METRIC_COUNTER);
+	lcd.mCells=		metricsRegister("cosmon_lcd_cells_total", "LCD cells rewritten", METRIC_COUNTER);
+	lcd.mBytes=		metricsRegister("cosmon_lcd_i2c_bytes_total", "Bytes sent to the LCD backpack", METRIC_COUNTER);
+	lcd.mXfers=		metricsRegister("cosmon_lcd_i2c_transactions_total", "I2C transactions to the LCD backpack", METRIC_COUNTER);
+	lcd.mBusTime=	metricsRegister("cosmon_lcd_i2c_us", "Time on the I2C bus per LCD write", METRIC_HISTOGRAM);
+	lcd.mErrors=	metricsRegister("cosmon_lcd_errors_total", "LCD writes the display didn't take", METRIC_COUNTER);
+
+	// The thread draws a first frame (IP, no channels yet) as soon as the
+	// display is up, the first tick fills in the rest
+	memset(lcd.status.state, LCD_NO_CHANNEL, sizeof(lcd.status.state));
+	lcd.ipDue=true;
+	if (evloopAddTimer(refreshMs, refreshMs, lcdTickHandler, NULL)<0)
+	{
+		close(lcd.fd);
+		return;
+	}
+
+	// Signals are for the event loop's signalfd, not this thread
+	sigfillset(&allSigs);
+	pthread_sigmask(SIG_BLOCK, &allSigs, &oldSigs);
+	err=pthread_create(&lcd.thread, NULL, lcdThread, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldSigs, NULL);
+	if (err!=0)
+	{
+		fprintf(stderr, "LCD: can't start, disabled\n");
+		close(lcd.fd);
+		return;
+	}
+	pthread_detach(lcd.thread);
+	lcd.enabled=true;
+	printf("\tLCD: %dx%d on %s address 0x%02x (%s writes)\n", lcd.cols, lcd.rows, dev, addr, lcdXferNames[lcd.xfer]);
+}
@@ -0,0 +1,357 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  levels.c
+*
+*  Synopsis:	FOB input level meter.  RMS, peak, crest factor, clipping
+*				and DC offset for every 20 ms block on the capture stream,
+*				published every 100 ms to the shared state and metrics.  After
+*				a few seconds of received speech it says which way to turn the
+*				HT's volume knob.
+*
+*				The block statistics are one pass over the samples, eight at a
+*				time with NEON on the Pi (SSE2 on a PC), plain C otherwise.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <iniparser.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "levels.h"
+#include "audio.h"
+#include "channel.h"
+#include "ini.h"
+#include "metrics.h"
+#include "shmstate.h"
+
+#define LEVELS_PUBLISH_BLOCKS		5		// 100 ms
+#define LEVELS_SPEECH_DB			-50.0	// blocks louder than this (with COS up) count as speech
+#define LEVELS_CLIP_FRACTION		0.001	// more clipped samples than this is too hot
+#define LEVELS_DEADBAND_DB			3.0		// closer than this to the target is fine
+#define LEVELS_FLOOR_DB				-120.0
+#define DEFAULT_LEVELS_TARGET_DBFS	-20.0
+#define DEFAULT_LEVELS_RECOMMEND_S	5
+
+typedef struct
+{
+	bool			enabled;
+	levelsStats_t	pub;				// accumulating for the next publish
+	unsigned int	pubFrames;
+	unsigned int	pubBlocks;
+	levelsStats_t	speech;				// accumulating for the next recommendation
+	uint64_t		speechFrames;
+	uint32_t		clippedTotal;
+
+	metric_t		*mRms;
+	metric_t		*mPeak;
+	metric_t		*mCrest;
+	metric_t		*mDc;
+	metric_t		*mClipped;
+	metric_t		*mAdjust;
+} levels_t;
+
+static levels_t		levels[MAX_CHANNELS];
+static double		targetDbfs=DEFAULT_LEVELS_TARGET_DBFS;
+static unsigned int	recommendS=DEFAULT_LEVELS_RECOMMEND_S;
+static unsigned int	sampleRate=AUDIO_DEFAULT_RATE;
+
+static void levelsBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid);
+
+
+static double toDbfs(double x)
+{
+	return x>0.0 ? fmax(20.0*log10(x/32768.0), LEVELS_FLOOR_DB) : LEVELS_FLOOR_DB;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	levelsBlockStats
+Synopsis:
+	Sum, sum of squares, peak and clip count of a block, added to st.
+Author:
+	agent
+Inputs:
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples (<= AUDIORING_MAX_FRAMES)
+	levelsStats_t *st: accumulated into
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void levelsBlockStats(const int16_t *samples, unsigned int n, levelsStats_t *st)
+{
+	unsigned int i=0;
+	uint32_t a;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	int64x2_t sum2=vdupq_n_s64(0);
+	uint64x2_t sq2=vdupq_n_u64(0);
+	uint16x8_t peak8=vdupq_n_u16(0), clip8=vdupq_n_u16(0), lim8=vdupq_n_u16(LEVELS_CLIP);
+	uint16_t lanes[8];
+	int16x8_t x;
+	uint16x8_t ax;
+	int k;
+
+	for (; i+8<=n; i+=8)
+	{
+		x=vld1q_s16(samples+i);
+		sum2=vpadalq_s32(sum2, vpaddlq_s16(x));
+		sq2=vpadalq_u32(sq2, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(x), vget_low_s16(x))));
+		sq2=vpadalq_u32(sq2, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(x), vget_high_s16(x))));
+		ax=vreinterpretq_u16_s16(vqabsq_s16(x));				// saturates, -32768 -> 32767
+		peak8=vmaxq_u16(peak8, ax);
+		clip8=vsubq_u16(clip8, vcgeq_u16(ax, lim8));			// true is 0xffff, i.e. -1
+	}
+	st->sum+=vgetq_lane_s64(sum2, 0)+vgetq_lane_s64(sum2, 1);
+	st->sumSq+=vgetq_lane_u64(sq2, 0)+vgetq_lane_u64(sq2, 1);
+	vst1q_u16(lanes, peak8);
+	for (k=0; k<8; k++)
+		if (lanes[k]>st->peak)
+			st->peak=lanes[k];
+	vst1q_u16(lanes, clip8);
+	for (k=0; k<8; k++)
+		st->clipped+=lanes[k];
+#elif defined(__SSE2__)
+	const __m128i zero=_mm_setzero_si128(), ones=_mm_set1_epi16(1), lim=_mm_set1_epi16(LEVELS_CLIP-1);
+	__m128i sum4=zero, sq2=zero, peak8=zero, clip8=zero, x, ax, sq;
+	int32_t sums[4];
+	uint64_t sqs[2];
+	int16_t lanes[8];
+	int k;
+
+	for (; i+8<=n; i+=8)
+	{
+		x=_mm_loadu_si128((const __m128i *)(samples+i));
+		sum4=_mm_add_epi32(sum4, _mm_madd_epi16(x, ones));
+		sq=_mm_madd_epi16(x, x);								// pairs of squares, fits unsigned 32 bits
+		sq2=_mm_add_epi64(sq2, _mm_unpacklo_epi32(sq, zero));
+		sq2=_mm_add_epi64(sq2, _mm_unpackhi_epi32(sq, zero));
+		ax=_mm_max_epi16(x, _mm_subs_epi16(zero, x));			// |x|, saturates like NEON
+		peak8=_mm_max_epi16(peak8, ax);
+		clip8=_mm_sub_epi16(clip8, _mm_cmpgt_epi16(ax, lim));
+	}
+	_mm_storeu_si128((__m128i *)sums, sum4);
+	_mm_storeu_si128((__m128i *)sqs, sq2);
+	st->sum+=(int64_t)sums[0]+sums[1]+sums[2]+sums[3];
+	st->sumSq+=sqs[0]+sqs[1];
+	_mm_storeu_si128((__m128i *)lanes, peak8);
+	for (k=0; k<8; k++)
+		if ((uint32_t)lanes[k]>st->peak)
+			st->peak=lanes[k];
+	_mm_storeu_si128((__m128i *)lanes, clip8);
+	for (k=0; k<8; k++)
+		st->clipped+=(uint16_t)lanes[k];
+#endif
+
+	// Whatever the vector loop left (all of it without SIMD)
+	for (; i<n; i++)
+	{
+		st->sum+=samples[i];
+		st->sumSq+=(int32_t)samples[i]*samples[i];
+		a=samples[i]<0 ? (samples[i]==-32768 ? 32767 : -samples[i]) : samples[i];
+		if (a>st->peak)
+			st->peak=a;
+		if (a>=LEVELS_CLIP)
+			st->clipped++;
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	levelsInit
+Synopsis:
+	Reads [levels] and hooks the meter onto a channel's audio.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	unsigned int rate: sample rate
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void levelsInit(int idx, unsigned int rate)
+{
+	levels_t *lv=&levels[idx];
+	char name[METRICS_NAME_LEN];
+
+	memset(lv, 0, sizeof(*lv));
+	if (!iniparser_getboolean(ini, "levels:enable", 0))
+		return;
+
+	targetDbfs=	iniparser_getdouble(ini, "levels:target_dbfs", DEFAULT_LEVELS_TARGET_DBFS);
+	recommendS=	iniparser_getint(ini, "levels:recommend_s", DEFAULT_LEVELS_RECOMMEND_S);
+	sampleRate=	rate;
+
+	snprintf(name, sizeof(name), "cosmon_audio_rms_dbfs{channel=\"%d\"}", idx+1);
+	lv->mRms=metricsRegister(name, "FOB input RMS level", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_audio_peak_dbfs{channel=\"%d\"}", idx+1);
+	lv->mPeak=metricsRegister(name, "FOB input peak level", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_audio_crest_db{channel=\"%d\"}", idx+1);
+	lv->mCrest=metricsRegister(name, "FOB input crest factor (peak over RMS)", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_audio_dc_offset{channel=\"%d\"}", idx+1);
+	lv->mDc=metricsRegister(name, "FOB input DC offset, fraction of full scale", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_audio_clipped_samples_total{channel=\"%d\"}", idx+1);
+	lv->mClipped=metricsRegister(name, "FOB input samples at or near full scale", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_audio_level_adjust_db{channel=\"%d\"}", idx+1);
+	lv->mAdjust=metricsRegister(name, "Recommended HT volume change, 0 when levels are fine", METRIC_GAUGE);
+
+	if (audioAddAnalyzer(idx, "levels", levelsBlock, NULL)==0)
+		lv->enabled=true;
+}
+
+// Every 100 ms: gauges and shared state
+static void levelsPublish(int idx, levels_t *lv)
+{
+	const levelsStats_t *st=&lv->pub;
+	double rms=sqrt((double)st->sumSq/lv->pubFrames);
+	double rmsDb=toDbfs(rms), peakDb=toDbfs(st->peak), dc=(double)st->sum/lv->pubFrames/32768.0;
+	cosmonShared_t *sh;
+
+	lv->clippedTotal+=st->clipped;
+	metricsSet(lv->mRms, round(rmsDb*10.0)/10.0);		// 0.1 dB is plenty, saves metric churn
+	metricsSet(lv->mPeak, round(peakDb*10.0)/10.0);
+	metricsSet(lv->mCrest, round((peakDb-rmsDb)*10.0)/10.0);
+	metricsSet(lv->mDc, round(dc*1000.0)/1000.0);
+	if (st->clipped)
+		metricsAdd(lv->mClipped, st->clipped);
+
+	sh=shmstateBegin();
+	sh->channel[idx].levelRmsDb=rmsDb;
+	sh->channel[idx].levelPeakDb=peakDb;
+	sh->channel[idx].levelDcOffset=dc;
+	sh->channel[idx].levelClipped=lv->clippedTotal;
+	shmstateEnd();
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	levelsRecommend
+Synopsis:
+	After recommend_s of received speech: how far is the speech level from
+	target_dbfs, and is it clipping.  Clipping always wins.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	levels_t *lv: channel's meter
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void levelsRecommend(int idx, levels_t *lv)
+{
+	const levelsStats_t *st=&lv->speech;
+	double rmsDb=toDbfs(sqrt((double)st->sumSq/lv->speechFrames));
+	double clipFrac=(double)st->clipped/lv->speechFrames;
+	double adjust=targetDbfs-rmsDb;
+	cosmonShared_t *sh;
+
+	if (clipFrac>LEVELS_CLIP_FRACTION)
+		adjust=fmin(adjust, -LEVELS_DEADBAND_DB);
+	else if (fabs(adjust)<LEVELS_DEADBAND_DB)
+		adjust=0.0;
+	adjust=round(adjust);
+
+	printf("Channel %d levels: speech %.1f dBFS, peak %.1f dBFS, %.2f%% clipped: ", idx+1,
+		   rmsDb, toDbfs(st->peak), clipFrac*100.0);
+	if (adjust>0.0)
+		printf("turn the HT volume up about %.0f dB\n", adjust);
+	else if (adjust<0.0)
+		printf("turn the HT volume down about %.0f dB\n", -adjust);
+	else
+		printf("OK\n");
+
+	metricsSet(lv->mAdjust, adjust);
+	sh=shmstateBegin();
+	sh->channel[idx].levelAdjustDb=adjust;
+	shmstateEnd();
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	levelsBlock
+Synopsis:
+	Analyzer callback.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples
+	uint64_t captureUs: when the block was complete
+	bool valid: false if the block was lost before the call
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void levelsBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid)
+{
+	levels_t *lv=&levels[idx];
+	levelsStats_t st={0};
+
+	(void)captureUs;
+	if (!valid)
+		return;
+	levelsBlockStats(samples, n, &st);
+	if (!audioBlockIntact())
+		return;					// half of it was the next block
+
+	lv->pub.sum+=st.sum;
+	lv->pub.sumSq+=st.sumSq;
+	lv->pub.clipped+=st.clipped;
+	if (st.peak>lv->pub.peak)
+		lv->pub.peak=st.peak;
+	lv->pubFrames+=n;
+	if (++lv->pubBlocks>=LEVELS_PUBLISH_BLOCKS)
+	{
+		levelsPublish(idx, lv);
+		memset(&lv->pub, 0, sizeof(lv->pub));
+		lv->pubFrames=0;
+		lv->pubBlocks=0;
+	}
+
+	// Only received speech counts toward the recommendation
+	if (!__atomic_load_n(&channels[idx].cosLevel, __ATOMIC_RELAXED) ||
+		toDbfs(sqrt((double)st.sumSq/n))<LEVELS_SPEECH_DB)
+		return;
+
+	lv->speech.sumSq+=st.sumSq;
+	lv->speech.clipped+=st.clipped;
+	if (st.peak>lv->speech.peak)
+		lv->speech.peak=st.peak;
+	lv->speechFrames+=n;
+	if (lv->speechFrames>=(uint64_t)recommendS*sampleRate)
+	{
+		levelsRecommend(idx, lv);
+		memset(&lv->speech, 0, sizeof(lv->speech));
+		lv->speechFrames=0;
+	}
+}
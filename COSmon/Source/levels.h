@@ -0,0 +1,51 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  levels.h
+*
+*  Synopsis:	Header file for levels.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _LEVELS
+#define _LEVELS
+
+#include <stdint.h>
+
+#define LEVELS_CLIP				32700	// |sample| at or above this counts as clipped
+
+typedef struct
+{
+	int64_t		sum;				// for DC offset
+	uint64_t	sumSq;
+	uint32_t	peak;				// largest |sample|
+	uint32_t	clipped;
+} levelsStats_t;
+
+void levelsBlockStats(const int16_t *samples, unsigned int n, levelsStats_t *st);
+void levelsInit(int idx, unsigned int rate);
+
+#endif
@@ -0,0 +1,192 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  metrics.c
+*
+*  Synopsis:	Fixed-size registry of counters, gauges and latency histograms.
+*				Everything is allocated statically at registration time so
+*				updating a metric on the COS path never allocates or locks.
+*				Updates are atomic so audio and serial threads can use them too.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "metrics.h"
+
+// Upper bound of each histogram bucket in microseconds.  Last one is +Inf.
+const uint32_t metricsBucketUs[METRICS_HIST_BUCKETS]=
+	{100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, UINT32_MAX};
+
+static metric_t metricTable[METRICS_MAX];
+static int 		metricCount=0;
+static uint32_t	metricVersion=0;		// bumped every time any value changes
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	metricsRegister
+Synopsis:
+	Adds a metric to the registry.  Call at init time only (not thread safe).
+Author:
+	agent
+Inputs:
+	const char *name: metric name, optionally with labels
+	const char *help: one line description (must be a literal / static)
+	metricType_t type: counter, gauge or histogram
+Outputs:
+	pointer to the metric or NULL if the table is full
+-----------------------------------------------------------------------------*/
+metric_t *metricsRegister(const char *name, const char *help, metricType_t type)
+{
+	metric_t *m;
+
+	if (metricCount>=METRICS_MAX)
+	{
+		fprintf(stderr, "metrics: table full, %s not registered\n", name);
+		return NULL;
+	}
+
+	m=&metricTable[metricCount++];
+	memset(m, 0, sizeof(*m));
+	snprintf(m->name, sizeof(m->name), "%s", name);
+	m->help=help;
+	m->type=type;
+
+	return m;
+}
+
+void metricsInc(metric_t *m)
+{
+	metricsAdd(m, 1);
+}
+
+void metricsAdd(metric_t *m, uint64_t n)
+{
+	if (m==NULL)
+		return;
+	__atomic_add_fetch(&m->count, n, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&metricVersion, 1, __ATOMIC_RELEASE);
+}
+
+void metricsSet(metric_t *m, double value)
+{
+	if (m==NULL || m->gauge==value)
+		return;
+	m->gauge=value;
+	__atomic_add_fetch(&metricVersion, 1, __ATOMIC_RELEASE);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	metricsObserve
+Synopsis:
+	Records one latency sample in a histogram.
+Author:
+	agent
+Inputs:
+	metric_t *m: histogram metric
+	uint64_t usec: sample in microseconds
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void metricsObserve(metric_t *m, uint64_t usec)
+{
+	int i;
+
+	if (m==NULL)
+		return;
+
+	for (i=0; i<METRICS_HIST_BUCKETS-1; i++)
+	{
+		if (usec<=metricsBucketUs[i])
+			break;
+	}
+	__atomic_add_fetch(&m->buckets[i], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&m->sumUs, usec, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&m->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&metricVersion, 1, __ATOMIC_RELEASE);
+}
+
+uint32_t metricsVersion(void)
+{
+	return __atomic_load_n(&metricVersion, __ATOMIC_ACQUIRE);
+}
+
+int metricsCount(void)
+{
+	return metricCount;
+}
+
+const metric_t *metricsGet(int idx)
+{
+	if (idx<0 || idx>=metricCount)
+		return NULL;
+	return &metricTable[idx];
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	metricsDump
+Synopsis:
+	Prints every metric in a human readable form.  Called on SIGUSR1.
+Author:
+	agent
+Inputs:
+	FILE *fp: where to print
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void metricsDump(FILE *fp)
+{
+	int i;
+	const metric_t *m;
+
+	fprintf(fp, "COSmon metrics:\n");
+	for (i=0; i<metricCount; i++)
+	{
+		m=&metricTable[i];
+		switch (m->type)
+		{
+			case METRIC_COUNTER:
+				fprintf(fp, "\t%-60s %llu\n", m->name, (unsigned long long)m->count);
+				break;
+
+			case METRIC_GAUGE:
+				fprintf(fp, "\t%-60s %g\n", m->name, m->gauge);
+				break;
+
+			case METRIC_HISTOGRAM:
+				fprintf(fp, "\t%-60s n=%llu avg=%lluus\n", m->name, (unsigned long long)m->count,
+						(unsigned long long)(m->count ? m->sumUs/m->count : 0));
+				break;
+		}
+	}
+	fflush(fp);
+}
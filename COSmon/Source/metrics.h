@@ -0,0 +1,73 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  metrics.h
+*
+*  Synopsis:	Header file for metrics.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _METRICS
+#define _METRICS
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define METRICS_MAX				128		// max number of registered metrics
+#define METRICS_HIST_BUCKETS	12		// latency histogram buckets (last is +Inf)
+#define METRICS_NAME_LEN		80
+
+typedef enum
+{
+	METRIC_COUNTER=0,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM
+} metricType_t;
+
+typedef struct
+{
+	char 				name[METRICS_NAME_LEN];	// may carry labels, e.g. name{channel="1"}
+	const char 			*help;
+	metricType_t		type;
+	uint64_t			count;		// counter value, or histogram sample count
+	double				gauge;		// gauge value
+	uint64_t			sumUs;		// histogram sum (microseconds)
+	uint64_t			buckets[METRICS_HIST_BUCKETS];
+} metric_t;
+
+extern const uint32_t metricsBucketUs[METRICS_HIST_BUCKETS];
+
+metric_t *metricsRegister(const char *name, const char *help, metricType_t type);
+void metricsInc(metric_t *m);
+void metricsAdd(metric_t *m, uint64_t n);
+void metricsSet(metric_t *m, double value);
+void metricsObserve(metric_t *m, uint64_t usec);
+uint32_t metricsVersion(void);
+int metricsCount(void);
+const metric_t *metricsGet(int idx);
+void metricsDump(FILE *fp);
+
+#endif
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#############################################################################
+#  Copyright (c)2026 agent
+#
+#	COSmon is free software: you can redistribute it and/or modify
+#	it under the terms of the GNU Lesser General Public License as
+#	published by the Free Software Foundation, either version 3 of the
+#	License, or (at your option) any later version.
+#
+#	COSmon is distributed in the hope that it will be useful,
+#	but WITHOUT ANY WARRANTY; without even the implied warranty of
+#	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#	GNU Lesser General Public License for more details.
+#
+#	You should have received a copy of the GNU Lesser General Public
+#	License along with wiringPi.
+#	If not, see <http://www.gnu.org/licenses/>.
+#
+#	This file is part of COSmon:
+#	https://github.com/ IT AIN'T THERE YET
+#
+#  mkfixtures.py
+#
+#  Synopsis:	Synthetic audio fixtures for the [data burst] and [dead
+#				carrier] dry runs.  These are NOT on-air recordings, none
+#				were available.  The data burst defaults were tuned on these
+#				same files, so the counts below only show the detector does
+#				what it was tuned to do; how it does on real speech, APRS and
+#				DMR audio has not been measured.  Recordings off a real FOB
+#				are what to tune and score it on.  Writes raw S16_LE mono
+#				48 kHz files into the directory given (default .), same
+#				seeds so the same files every time:
+#				  afsk.raw     20 Bell 202 packets, 0.25-0.8 s, random twist
+#				               (+-6 dB), 1 s of silence between
+#				  digital.raw  20 4FSK-like bursts (random symbols at 4800
+#				               baud through a one pole low pass), 0.3-0.8 s
+#				  speech.raw   120 s of voice-like syllables (harmonic stacks
+#				               at 100-220 Hz under a half sine envelope) and
+#				               pauses
+#				  carrier.raw  12 s of an unmodulated carrier (noise floor
+#				               only)
+#
+#				Run COSmon over one of them with a copy of COSmon.conf set to
+#				  [audio]       enable = 1
+#				                capture_device = "file:/path/to/afsk.raw"
+#				                sample_rate = 48000
+#				                file_realtime = 0
+#				  [data burst]  enable = 1
+#				                dry_run = 1
+#				as ./COSmon -c /tmp/fixture.conf (Asterisk or aststub has to
+#				be up for it to start).  At end of file it prints a "data
+#				bursts:" line with the bursts found, the AFSK / noise block
+#				shares and CPU microseconds per block.  With the default
+#				settings: afsk 20 bursts, digital 20, speech 2, carrier 0.
+#
+#  Author:		agent
+#
+#############################################################################
+
+import array
+import math
+import os
+import random
+import struct
+import sys
+
+RATE = 48000
+
+def save(name, samples):
+	with open(name, 'wb') as f:
+		f.write(struct.pack('<%dh' % len(samples), *samples))
+
+def saveFloat(name, x):
+	# full scale floats (+-1.0) to S16_LE
+	with open(name, 'wb') as f:
+		array.array('h', [max(-32768, min(32767, int(v * 32767))) for v in x]).tofile(f)
+
+def silence(s):
+	return [random.gauss(0, 10 ** (-65 / 20)) for _ in range(int(RATE * s))]
+
+def normalize(x, peak):
+	m = max(abs(v) for v in x)
+	return [peak * v / m for v in x]
+
+def afsk(nbits, twistDb):
+	# Bell 202: mark 1200 Hz, space 2200 Hz, continuous phase, 1200 baud
+	spb = RATE / 1200
+	ph = 0
+	t = 0.0
+	out = []
+	g2 = 10 ** (twistDb / 20)
+	for _ in range(nbits):
+		b = random.getrandbits(1)
+		f = 1200 if b else 2200
+		g = 1.0 if b else g2
+		n = int(round(t + spb)) - int(round(t))
+		t += spb
+		for i in range(n):
+			ph += 2 * math.pi * f / RATE
+			out.append(g * math.sin(ph))
+	return out
+
+def mkSpeechCarrier():
+	random.seed(1)
+	sp = []
+	while len(sp) < RATE * 120:
+		if random.random() < 0.8:
+			# a syllable
+			f0 = random.uniform(100, 220)
+			n = int(RATE * random.uniform(0.12, 0.35))
+			a = random.uniform(0.05, 0.3)
+			for i in range(n):
+				env = math.sin(math.pi * i / n)
+				x = sum(math.sin(2 * math.pi * f0 * k * i / RATE) / k for k in range(1, 12))
+				sp.append(int(max(-32767, min(32767, a * env * x * 10000 + random.gauss(0, 30)))))
+		else:
+			# a pause
+			n = int(RATE * random.uniform(0.1, 0.8))
+			sp.extend(int(random.gauss(0, 30)) for _ in range(n))
+	save('speech.raw', sp)
+	save('carrier.raw', [int(random.gauss(0, 20)) for _ in range(RATE * 12)])
+
+def mkData():
+	random.seed(7)
+	x = []
+	for _ in range(20):
+		a = normalize(afsk(int(1200 * random.uniform(0.25, 0.8)), random.uniform(-6, 6)), 0.3)
+		x += silence(1.0) + [v + random.gauss(0, 0.005) for v in a]
+	x += silence(1.0)
+	saveFloat('afsk.raw', x)
+
+	x = []
+	for _ in range(20):
+		n = int(RATE * random.uniform(0.3, 0.8))
+		d = []
+		s = 0.0
+		lvl = 0
+		for i in range(n):
+			if i % 10 == 0:
+				lvl = random.choice([-3, -1, 1, 3])
+			s += 0.35 * ((lvl + random.gauss(0, 0.7)) - s)
+			d.append(s)
+		x += silence(1.0) + normalize(d, 0.25)
+	x += silence(1.0)
+	saveFloat('digital.raw', x)
+
+if __name__ == '__main__':
+	os.chdir(sys.argv[1] if len(sys.argv) > 1 else '.')
+	mkSpeechCarrier()
+	mkData()
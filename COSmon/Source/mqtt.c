@@ -0,0 +1,556 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  mqtt.c
+*
+*  Synopsis:	Publishes node status to an MQTT broker for the fleet
+*				dashboard.  libmosquitto runs on COSmon's event loop (its socket
+*				is just another poller, keepalives run off a timer), so a slow
+*				or dead broker can't hold up key / unkey.
+*
+*				State changes are coalesced: each key keeps only its latest
+*				value and everything that changed inside batch_ms goes out as
+*				one message on <prefix>/state.  While the broker is away (or
+*				has too many messages in flight) state messages wait in a
+*				bounded queue, oldest dropped first.  The metrics go out every
+*				counters_interval_s on <prefix>/metrics, skipped if they can't
+*				go right away.  <prefix>/online is the retained will.
+*
+*				Needs libmosquitto and make MQTT=1, otherwise it's a no-op.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <iniparser.h>
+#ifdef USE_MQTT
+#include <mosquitto.h>
+#endif
+
+#include "mqtt.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#ifdef USE_MQTT
+#define MQTT_MAX_KEYS				32
+#define MQTT_KEY_LEN				24
+#define MQTT_VALUE_LEN				24
+#define MQTT_TOPIC_LEN				128
+#define MQTT_MSG_LEN				1024		// state message (queue entry) size
+#define MQTT_METRICS_LEN			16384
+#define MQTT_QUEUE_LIMIT			4096
+#define MQTT_MAX_INFLIGHT			16			// handed to libmosquitto, not yet sent
+#define MQTT_MISC_MS				1000
+#define MQTT_RECONNECT_MIN_MS		1000
+#define MQTT_RECONNECT_MAX_MS		30000
+#define DEFAULT_MQTT_HOST			"127.0.0.1"
+#define DEFAULT_MQTT_PORT			1883
+#define DEFAULT_MQTT_KEEPALIVE		30
+#define DEFAULT_MQTT_BATCH_MS		250
+#define DEFAULT_MQTT_QUEUE			256
+#define DEFAULT_MQTT_COUNTERS_S		60
+
+typedef struct
+{
+	char		key[MQTT_KEY_LEN];
+	char		value[MQTT_VALUE_LEN];
+	uint32_t	changes;				// since the last batch
+	bool		dirty;
+} mqttField_t;
+
+typedef struct
+{
+	uint16_t	len;
+	char		payload[MQTT_MSG_LEN];
+} mqttQueued_t;
+
+static struct mosquitto	*mosq;
+static int				sockFd=-1;
+static bool				connected=false;
+static int				inflight=0;
+static int				batchTimer=-1;
+static bool				batchArmed=false;
+static int				reconnectTimer=-1;
+static uint32_t			backoffMs=MQTT_RECONNECT_MIN_MS;
+static int				qos;
+static uint32_t			batchMs;
+
+static mqttField_t		fields[MQTT_MAX_KEYS];
+static int				numFields=0;
+static mqttQueued_t		*queue;
+static unsigned int		queueMax, queueHead=0, queueLen=0;
+static char				metricsBuf[MQTT_METRICS_LEN];
+
+static char				topicState[MQTT_TOPIC_LEN];
+static char				topicMetrics[MQTT_TOPIC_LEN];
+static char				topicOnline[MQTT_TOPIC_LEN];
+
+static metric_t			*mPublished;
+static metric_t			*mDropped;
+static metric_t			*mQueued;
+static metric_t			*mDisconnects;
+
+static bool				enabled=false;
+
+static void mqttLost(void);
+#endif
+
+
+#ifdef USE_MQTT
+// Poll for writable only while libmosquitto has something to write
+static void mqttUpdatePoll(void)
+{
+	if (sockFd>=0)
+		evloopModPoller(sockFd, EPOLLIN | (mosquitto_want_write(mosq) ? EPOLLOUT : 0));
+}
+
+static bool mqttPublish(const char *topic, const char *payload, int len, bool retain)
+{
+	if (mosquitto_publish(mosq, NULL, topic, len, payload, qos, retain)!=MOSQ_ERR_SUCCESS)
+		return false;
+	inflight++;
+	metricsInc(mPublished);
+	mqttUpdatePoll();
+	return true;
+}
+
+// Sends queued state messages while the broker keeps up
+static void mqttDrain(void)
+{
+	mqttQueued_t *q;
+
+	while (connected && inflight<MQTT_MAX_INFLIGHT && queueLen)
+	{
+		q=&queue[queueHead];
+		if (!mqttPublish(topicState, q->payload, q->len, false))
+			break;
+		queueHead=(queueHead+1)%queueMax;
+		queueLen--;
+	}
+	metricsSet(mQueued, queueLen);
+}
+
+static void mqttSendState(const char *payload, int len)
+{
+	mqttQueued_t *q;
+
+	mqttDrain();
+	if (queueLen==0 && connected && inflight<MQTT_MAX_INFLIGHT && mqttPublish(topicState, payload, len, false))
+		return;
+
+	// Queue it.  Full queue: the oldest message goes.
+	if (queueLen==queueMax)
+	{
+		queueHead=(queueHead+1)%queueMax;
+		queueLen--;
+		metricsInc(mDropped);
+	}
+	q=&queue[(queueHead+queueLen)%queueMax];
+	q->len=len;
+	memcpy(q->payload, payload, len);
+	queueLen++;
+	metricsSet(mQueued, queueLen);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	mqttBatchHandler
+Synopsis:
+	batch_ms after the first change: one message with every key that
+	changed, its latest value, and how many times it changed if more
+	than once.
+Author:
+	agent
+Inputs:
+	standard evloop timer handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void mqttBatchHandler(uint64_t expirations, void *ctx)
+{
+	char msg[MQTT_MSG_LEN];
+	int len, i;
+
+	(void)expirations;
+	(void)ctx;
+	batchArmed=false;
+
+	len=snprintf(msg, sizeof(msg), "{\"time\":%lld", (long long)time(NULL));
+	for (i=0; i<numFields && len<(int)sizeof(msg); i++)
+	{
+		if (!fields[i].dirty)
+			continue;
+		len+=snprintf(msg+len, sizeof(msg)-len, ",\"%s\":\"%s\"", fields[i].key, fields[i].value);
+		if (fields[i].changes>1 && len<(int)sizeof(msg))
+			len+=snprintf(msg+len, sizeof(msg)-len, ",\"%s_changes\":%u", fields[i].key, fields[i].changes);
+		fields[i].dirty=false;
+		fields[i].changes=0;
+	}
+	if (len<(int)sizeof(msg))
+		len+=snprintf(msg+len, sizeof(msg)-len, "}");
+	if (len>=(int)sizeof(msg))
+	{
+		metricsInc(mDropped);
+		return;
+	}
+	mqttSendState(msg, len);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	mqttMetricsHandler
+Synopsis:
+	Every counters_interval_s: the whole metrics registry as one JSON
+	object.  Only current values matter so it's skipped, not queued, when
+	the broker isn't keeping up.
+Author:
+	agent
+Inputs:
+	standard evloop timer handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void mqttMetricsHandler(uint64_t expirations, void *ctx)
+{
+	const metric_t *m;
+	const char *c;
+	int len, i;
+
+	(void)expirations;
+	(void)ctx;
+	if (!connected || inflight>=MQTT_MAX_INFLIGHT)
+	{
+		metricsInc(mDropped);
+		return;
+	}
+
+	len=snprintf(metricsBuf, sizeof(metricsBuf), "{\"time\":%lld", (long long)time(NULL));
+	for (i=0; i<metricsCount() && len<(int)sizeof(metricsBuf)-METRICS_NAME_LEN*2; i++)
+	{
+		m=metricsGet(i);
+		// names carry labels with quotes in them
+		len+=snprintf(metricsBuf+len, sizeof(metricsBuf)-len, ",\"");
+		for (c=m->name; *c; c++)
+		{
+			if (*c=='"')
+				metricsBuf[len++]='\\';
+			metricsBuf[len++]=*c;
+		}
+		switch (m->type)
+		{
+			case METRIC_COUNTER:
+				len+=snprintf(metricsBuf+len, sizeof(metricsBuf)-len, "\":%llu", (unsigned long long)m->count);
+				break;
+			case METRIC_GAUGE:
+				len+=snprintf(metricsBuf+len, sizeof(metricsBuf)-len, "\":%g", m->gauge);
+				break;
+			case METRIC_HISTOGRAM:
+				len+=snprintf(metricsBuf+len, sizeof(metricsBuf)-len, "\":{\"count\":%llu,\"avg_us\":%llu}",
+							  (unsigned long long)m->count, (unsigned long long)(m->count ? m->sumUs/m->count : 0));
+				break;
+		}
+	}
+	if (len>=(int)sizeof(metricsBuf)-1)
+	{
+		metricsInc(mDropped);
+		return;
+	}
+	metricsBuf[len++]='}';
+	mqttPublish(topicMetrics, metricsBuf, len, false);
+}
+
+static void mqttPollHandler(int fd, uint32_t events, void *ctx)
+{
+	int rc=MOSQ_ERR_SUCCESS;
+
+	(void)fd;
+	(void)ctx;
+	if (events & EPOLLIN)
+		rc=mosquitto_loop_read(mosq, 1);
+	if (rc==MOSQ_ERR_SUCCESS && (events & EPOLLOUT))
+		rc=mosquitto_loop_write(mosq, 1);
+	if (rc==MOSQ_ERR_SUCCESS && (events & (EPOLLERR | EPOLLHUP)))
+		rc=MOSQ_ERR_CONN_LOST;
+
+	if (rc!=MOSQ_ERR_SUCCESS)
+		mqttLost();
+	else
+		mqttUpdatePoll();
+}
+
+// Keepalive pings and timeouts
+static void mqttMiscHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	if (sockFd<0)
+		return;
+	if (mosquitto_loop_misc(mosq)!=MOSQ_ERR_SUCCESS)
+		mqttLost();
+	else
+		mqttUpdatePoll();
+}
+
+static void mqttAttach(void)
+{
+	sockFd=mosquitto_socket(mosq);
+	if (sockFd<0 || evloopAddPoller(sockFd, EPOLLIN | EPOLLOUT, mqttPollHandler, NULL)<0)
+	{
+		sockFd=-1;
+		mqttLost();
+	}
+}
+
+static void mqttReconnectHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	if (mosquitto_reconnect_async(mosq)==MOSQ_ERR_SUCCESS)
+		mqttAttach();
+	else
+		mqttLost();
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	mqttLost
+Synopsis:
+	Connection failed or dropped.  Whatever libmosquitto still had is gone
+	(QoS 0, clean session), count it, back off and try again.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void mqttLost(void)
+{
+	if (sockFd>=0)
+	{
+		evloopRemove(sockFd);
+		sockFd=-1;
+	}
+	if (connected)
+	{
+		fprintf(stderr, "Lost connection to MQTT broker\n");
+		metricsInc(mDisconnects);
+		connected=false;
+	}
+	if (inflight)
+	{
+		metricsAdd(mDropped, inflight);
+		inflight=0;
+	}
+
+	evloopArmTimer(reconnectTimer, backoffMs, 0);
+	backoffMs*=2;
+	if (backoffMs>MQTT_RECONNECT_MAX_MS)
+		backoffMs=MQTT_RECONNECT_MAX_MS;
+}
+
+static void mqttOnConnect(struct mosquitto *m, void *obj, int rc)
+{
+	int i;
+
+	(void)m;
+	(void)obj;
+	if (rc!=0)
+	{
+		fprintf(stderr, "MQTT broker refused connection: %s\n", mosquitto_strerror(rc));
+		return;
+	}
+
+	printf("Connected to MQTT broker\n");
+	connected=true;
+	backoffMs=MQTT_RECONNECT_MIN_MS;
+	mqttPublish(topicOnline, "1", 1, true);
+
+	// The dashboard may have missed anything, give it everything once
+	for (i=0; i<numFields; i++)
+		fields[i].dirty=true;
+	if (numFields && !batchArmed)
+	{
+		evloopArmTimer(batchTimer, 1, 0);
+		batchArmed=true;
+	}
+	mqttDrain();
+}
+
+static void mqttOnPublish(struct mosquitto *m, void *obj, int mid)
+{
+	(void)m;
+	(void)obj;
+	(void)mid;
+	if (inflight>0)
+		inflight--;
+	mqttDrain();
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+Function:
+	mqttInit
+Synopsis:
+	Reads [mqtt], sets up the client and starts connecting (asynchronously,
+	use an IP address for host, a name means a blocking DNS lookup).
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void mqttInit(void)
+{
+#ifdef USE_MQTT
+	char host[64], prefix[MQTT_TOPIC_LEN-16], id[80];
+	const char *user;
+	uint32_t countersS;
+
+	if (!iniparser_getboolean(ini, "mqtt:enable", 0))
+		return;
+
+	gethostname(host, sizeof(host));
+	host[sizeof(host)-1]='\0';
+	snprintf(prefix, sizeof(prefix), "%s", iniparser_getstring(ini, "mqtt:topic_prefix", ""));
+	if (prefix[0]=='\0')
+		snprintf(prefix, sizeof(prefix), "cosmon/%s", host);
+	snprintf(topicState, sizeof(topicState), "%s/state", prefix);
+	snprintf(topicMetrics, sizeof(topicMetrics), "%s/metrics", prefix);
+	snprintf(topicOnline, sizeof(topicOnline), "%s/online", prefix);
+	snprintf(id, sizeof(id), "COSmon-%s", host);
+
+	qos=		iniparser_getint(ini, "mqtt:qos", 0);
+	batchMs=iniparser_getint(ini, "mqtt:batch_ms", DEFAULT_MQTT_BATCH_MS);
+	countersS=	iniparser_getint(ini, "mqtt:counters_interval_s", DEFAULT_MQTT_COUNTERS_S);
+	queueMax=	iniparser_getint(ini, "mqtt:queue_max", DEFAULT_MQTT_QUEUE);
+	if (queueMax<1)
+		queueMax=1;
+	else if (queueMax>MQTT_QUEUE_LIMIT)
+		queueMax=MQTT_QUEUE_LIMIT;
+	if (batchMs<1)
+		batchMs=1;
+
+	mPublished=		metricsRegister("cosmon_mqtt_published_total", "Messages handed to the MQTT client", METRIC_COUNTER);
+	mDropped=		metricsRegister("cosmon_mqtt_dropped_total", "MQTT messages dropped (queue full, lost in flight, skipped)", METRIC_COUNTER);
+	mQueued=		metricsRegister("cosmon_mqtt_queued", "MQTT state messages waiting for the broker", METRIC_GAUGE);
+	mDisconnects=	metricsRegister("cosmon_mqtt_disconnects_total", "MQTT broker disconnects", METRIC_COUNTER);
+
+	queue=calloc(queueMax, sizeof(mqttQueued_t));
+	mosquitto_lib_init();
+	mosq=mosquitto_new(id, true, NULL);
+	if (queue==NULL || mosq==NULL)
+	{
+		fprintf(stderr, "MQTT: out of memory\n");
+		return;
+	}
+	user=iniparser_getstring(ini, "mqtt:username", "");
+	if (user[0])
+		mosquitto_username_pw_set(mosq, user, iniparser_getstring(ini, "mqtt:password", ""));
+	mosquitto_will_set(mosq, topicOnline, 1, "0", qos, true);
+	mosquitto_connect_callback_set(mosq, mqttOnConnect);
+	mosquitto_publish_callback_set(mosq, mqttOnPublish);
+
+	batchTimer=		evloopAddTimer(0, 0, mqttBatchHandler, NULL);
+	reconnectTimer=	evloopAddTimer(0, 0, mqttReconnectHandler, NULL);
+	evloopAddTimer(MQTT_MISC_MS, MQTT_MISC_MS, mqttMiscHandler, NULL);
+	if (countersS)
+		evloopAddTimer(countersS*1000, countersS*1000, mqttMetricsHandler, NULL);
+	enabled=true;
+
+	if (mosquitto_connect_async(mosq, iniparser_getstring(ini, "mqtt:host", DEFAULT_MQTT_HOST),
+								iniparser_getint(ini, "mqtt:port", DEFAULT_MQTT_PORT),
+								iniparser_getint(ini, "mqtt:keepalive", DEFAULT_MQTT_KEEPALIVE))==MOSQ_ERR_SUCCESS)
+		mqttAttach();
+	else
+		mqttLost();
+#else
+	if (iniparser_getboolean(ini, "mqtt:enable", 0))
+		fprintf(stderr, "MQTT support not built in (make MQTT=1)\n");
+#endif
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	mqttState
+Synopsis:
+	Records a state change for the next batch.  Event loop thread only;
+	never does any I/O itself.
+Author:
+	agent
+Inputs:
+	const char *key: e.g. "ch1/state"
+	const char *value: e.g. "keyed"
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void mqttState(const char *key, const char *value)
+{
+#ifdef USE_MQTT
+	mqttField_t *f=NULL;
+	int i;
+
+	if (!enabled)
+		return;
+
+	for (i=0; i<numFields; i++)
+	{
+		if (strcmp(fields[i].key, key)==0)
+		{
+			f=&fields[i];
+			break;
+		}
+	}
+	if (f==NULL)
+	{
+		if (numFields>=MQTT_MAX_KEYS)
+			return;
+		f=&fields[numFields++];
+		snprintf(f->key, sizeof(f->key), "%s", key);
+	}
+	if (strcmp(f->value, value)==0)
+		return;
+
+	snprintf(f->value, sizeof(f->value), "%s", value);
+	f->dirty=true;
+	f->changes++;
+	if (!batchArmed)
+	{
+		evloopArmTimer(batchTimer, batchMs, 0);
+		batchArmed=true;
+	}
+#else
+	(void)key;
+	(void)value;
+#endif
+}
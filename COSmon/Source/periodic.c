@@ -0,0 +1,313 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  periodic.c
+*
+*  Synopsis:	Periodic interference detector.  Switching supplies (and the Pi
+*				itself) can blip COS at a steady rate, and with no attack time
+*				every blip is a key and an unkey command.  The gaps between
+*				short COS pulses go into a log spaced histogram (2% bins,
+*				halved as it fills so it follows changes); when most of them
+*				land on one period the detector locks.  While locked, a COS
+*				edge that arrives when the next blip is due gets held for
+*				max_pulse_ms on top of the attack time: a blip drops out within
+*				that and never keys, a real transmission keys that much later.
+*				Edges that aren't due are not delayed at all.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <iniparser.h>
+
+#include "periodic.h"
+#include "channel.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define PERIODIC_BINS			400			// 20 ms .. ~55 s
+#define PERIODIC_MIN_MS			20.0
+#define PERIODIC_BIN_RATIO		1.02
+#define PERIODIC_DECAY_VOTES	64			// halve the histogram after this many
+#define PERIODIC_PEAK_PERCENT	60			// of the votes on one period to lock
+#define PERIODIC_MAX_MISSES		8			// blips in a row not seen before unlocking
+#define DEFAULT_PERIODIC_PULSE_MS	60
+#define DEFAULT_PERIODIC_TOL_MS		25
+#define DEFAULT_PERIODIC_MIN_PULSES	8
+
+typedef struct
+{
+	bool		enabled;
+	uint64_t	onUs;					// current / last pulse started
+	bool		held;					// current pulse got the extra hold
+	uint64_t	lastBlipUs;				// start of the last short pulse
+	uint16_t	bins[PERIODIC_BINS];
+	uint32_t	votes;
+	bool		locked;
+	uint64_t	periodUs;
+
+	metric_t	*mLocked;
+	metric_t	*mPeriod;
+	metric_t	*mSuppressed;
+	metric_t	*mPassed;
+	metric_t	*mEdges;
+	metric_t	*mProcessNs;
+} periodic_t;
+
+static periodic_t	periodics[MAX_CHANNELS];
+static uint64_t		maxPulseUs;
+static uint64_t		tolUs;
+static uint32_t		minPulses;
+
+
+static uint64_t periodicNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+static int periodicBin(uint64_t us)
+{
+	double ms=us/1000.0;
+	int b;
+
+	if (ms<PERIODIC_MIN_MS)
+		return -1;
+	b=(int)(log(ms/PERIODIC_MIN_MS)/log(PERIODIC_BIN_RATIO));
+	return b<PERIODIC_BINS ? b : -1;
+}
+
+static uint64_t periodicBinUs(int b)
+{
+	return (uint64_t)(PERIODIC_MIN_MS*pow(PERIODIC_BIN_RATIO, b+0.5)*1000.0);
+}
+
+// dt is k periods (k>=1, not too many missed) give or take the tolerance
+static bool periodicDue(const periodic_t *p, uint64_t dt, uint64_t *k)
+{
+	uint64_t n=(dt+p->periodUs/2)/p->periodUs;
+	uint64_t expect=n*p->periodUs;
+
+	*k=n;
+	return n>=1 && n<=PERIODIC_MAX_MISSES && (dt>expect ? dt-expect : expect-dt)<=tolUs;
+}
+
+static void periodicUnlock(int idx, periodic_t *p)
+{
+	printf("Channel %d: periodic COS interference gone\n", idx+1);
+	p->locked=false;
+	p->votes=0;
+	memset(p->bins, 0, sizeof(p->bins));
+	metricsSet(p->mLocked, 0);
+	metricsSet(p->mPeriod, 0);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	periodicVote
+Synopsis:
+	One gap between short pulses.  While locked, gaps that are a whole
+	number of periods vote for the period and pull the estimate along.
+	Then looks for a peak (3 bins wide) holding most of the votes.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	periodic_t *p: detector
+	uint64_t dt: time since the last short pulse started
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void periodicVote(int idx, periodic_t *p, uint64_t dt)
+{
+	uint32_t sum, best=0;
+	uint64_t k;
+	int b, bestBin=0, i;
+
+	if (p->locked && periodicDue(p, dt, &k))
+	{
+		dt/=k;
+		p->periodUs+=((int64_t)dt-(int64_t)p->periodUs)/8;
+		metricsSet(p->mPeriod, p->periodUs/1000);
+	}
+
+	b=periodicBin(dt);
+	if (b<0)
+		return;
+	p->bins[b]++;
+	if (++p->votes>=PERIODIC_DECAY_VOTES)
+	{
+		p->votes=0;
+		for (i=0; i<PERIODIC_BINS; i++)
+		{
+			p->bins[i]/=2;
+			p->votes+=p->bins[i];
+		}
+	}
+	if (p->locked)
+		return;
+
+	for (i=1; i<PERIODIC_BINS-1; i++)
+	{
+		sum=p->bins[i-1]+p->bins[i]+p->bins[i+1];
+		if (sum>best)
+		{
+			best=sum;
+			bestBin=i;
+		}
+	}
+	if (best>=minPulses && best*100>=p->votes*PERIODIC_PEAK_PERCENT)
+	{
+		p->locked=true;
+		p->periodUs=periodicBinUs(bestBin);
+		printf("Channel %d: periodic COS interference every %llu ms, suppressing\n", idx+1,
+			   (unsigned long long)p->periodUs/1000);
+		metricsSet(p->mLocked, 1);
+		metricsSet(p->mPeriod, p->periodUs/1000);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	periodicEdge
+Synopsis:
+	Every COS change on a channel, with the edge time.  The periodic stage
+	of the COS pipeline, which has to come before fsm.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	bool cos: new COS level
+	uint64_t now: edge time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void periodicEdge(int idx, bool cos, uint64_t now)
+{
+	periodic_t *p=&periodics[idx];
+	uint64_t start;
+
+	if (!p->enabled)
+		return;
+	start=periodicNowNs();
+	metricsInc(p->mEdges);
+
+	if (cos)
+	{
+		p->onUs=now;
+		p->held=false;
+	}
+	else if (now-p->onUs<=maxPulseUs)
+	{
+		if (p->held)
+			metricsInc(p->mSuppressed);
+		if (p->lastBlipUs)
+			periodicVote(idx, p, p->onUs-p->lastBlipUs);
+		p->lastBlipUs=p->onUs;
+	}
+	else if (p->held)
+		metricsInc(p->mPassed);
+
+	metricsAdd(p->mProcessNs, periodicNowNs()-start);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	periodicHoldUs
+Synopsis:
+	Extra attack time for a COS edge that's just come up on an idle
+	channel: max_pulse_ms if a blip is due now, otherwise none.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	uint64_t now: edge time
+Outputs:
+	microseconds to add to the attack time
+-----------------------------------------------------------------------------*/
+uint64_t periodicHoldUs(int idx, uint64_t now)
+{
+	periodic_t *p=&periodics[idx];
+	uint64_t k;
+
+	if (!p->enabled || !p->locked)
+		return 0;
+	if (now-p->lastBlipUs>PERIODIC_MAX_MISSES*p->periodUs+tolUs)
+	{
+		periodicUnlock(idx, p);
+		return 0;
+	}
+	if (!periodicDue(p, now-p->lastBlipUs, &k))
+		return 0;
+	p->held=true;
+	return maxPulseUs;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	periodicInit
+Synopsis:
+	Reads [periodic interference] for a channel.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void periodicInit(int idx)
+{
+	periodic_t *p=&periodics[idx];
+	char name[METRICS_NAME_LEN];
+
+	memset(p, 0, sizeof(*p));
+	if (!iniparser_getboolean(ini, "periodic interference:enable", 0) || !channels[idx].enabled)
+		return;
+	maxPulseUs=	(uint64_t)iniparser_getint(ini, "periodic interference:max_pulse_ms", DEFAULT_PERIODIC_PULSE_MS)*1000;
+	tolUs=		(uint64_t)iniparser_getint(ini, "periodic interference:tolerance_ms", DEFAULT_PERIODIC_TOL_MS)*1000;
+	minPulses=	iniparser_getint(ini, "periodic interference:min_pulses", DEFAULT_PERIODIC_MIN_PULSES);
+
+	snprintf(name, sizeof(name), "cosmon_periodic_locked{channel=\"%d\"}", idx+1);
+	p->mLocked=metricsRegister(name, "Periodic COS interference detected", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_periodic_period_ms{channel=\"%d\"}", idx+1);
+	p->mPeriod=metricsRegister(name, "Period of the COS interference", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_periodic_suppressed_total{channel=\"%d\"}", idx+1);
+	p->mSuppressed=metricsRegister(name, "Interference COS pulses that didn't key the node", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_periodic_passed_total{channel=\"%d\"}", idx+1);
+	p->mPassed=metricsRegister(name, "Transmissions held because a blip was due, then keyed", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_periodic_edges_total{channel=\"%d\"}", idx+1);
+	p->mEdges=metricsRegister(name, "COS edges seen by the interference detector", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_periodic_process_ns_total{channel=\"%d\"}", idx+1);
+	p->mProcessNs=metricsRegister(name, "Time spent in the interference detector", METRIC_COUNTER);
+	p->enabled=true;
+	printf("\tChannel %d periodic interference suppression: pulses up to %llu ms\n", idx+1,
+		   (unsigned long long)maxPulseUs/1000);
+}
@@ -0,0 +1,306 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  pipeline.c
+*
+*  Synopsis:	Per channel COS edge pipeline.  Each channel's cos_pipeline names
+*				its stages in order: transforms that can hold an edge back
+*				(debounce), taps that watch it (periodic, calibrate, boost,
+*				wifips, journal) and the sink that acts on it (fsm: the state
+*				machine and so Asterisk).  The list is turned into a fixed
+*				array of stage numbers at start-up and run through a const
+*				table, so an edge costs no allocation and no lookups.
+*
+*				An edge a stage holds back isn't lost: the channel's COS level
+*				hasn't changed, so the next poll offers it again.  That is why
+*				debounce has to come first: a tap ahead of it would see the
+*				held edge again on every poll, and never see it go away if COS
+*				bounced back.  With pipeline_timing each stage's time is
+*				counted.
+*
+*				Not stages: the COS source (GPIO or serial line, read by
+*				channelPoll()), the command governor (it meters the commands
+*				the state machine sends, not edges, so it lives in channel.c)
+*				and the serial COS LED (follows the raw line in serialcos.c).
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "pipeline.h"
+#include "boost.h"
+#include "calib.h"
+#include "ini.h"
+#include "metrics.h"
+#include "periodic.h"
+#include "wifips.h"
+
+typedef enum
+{
+	PS_DEBOUNCE=0,
+	PS_PERIODIC,
+	PS_CALIBRATE,
+	PS_BOOST,
+	PS_WIFIPS,
+	PS_JOURNAL,
+	PS_FSM,
+	PS_NUM_STAGES
+} pipeStage_t;
+
+// false: stop here, the edge is offered again on the next poll
+typedef bool (*pipeStageFunc_t)(channel_t *ch, bool cos, uint64_t now);
+
+typedef struct
+{
+	uint8_t		stages[PIPELINE_MAX_STAGES];
+	int			numStages;
+	uint64_t	debounceUs;
+	uint64_t	lastEdgeUs;
+	bool		timing;
+	metric_t	*mStageNs[PIPELINE_MAX_STAGES];
+	metric_t	*mStageCalls[PIPELINE_MAX_STAGES];
+} pipeline_t;
+
+static pipeline_t	pipelines[MAX_CHANNELS];
+
+
+/*-----------------------------------------------------------------------------
+	Stages
+-----------------------------------------------------------------------------*/
+// Edges closer together than cos_debounce_ms wait for a later poll
+static bool pipeDebounce(channel_t *ch, bool cos, uint64_t now)
+{
+	pipeline_t *p=&pipelines[ch->idx];
+
+	(void)cos;
+	if (p->lastEdgeUs && now-p->lastEdgeUs<p->debounceUs)
+		return false;
+	p->lastEdgeUs=now;
+	return true;
+}
+
+static bool pipePeriodic(channel_t *ch, bool cos, uint64_t now)
+{
+	periodicEdge(ch->idx, cos, now);
+	return true;
+}
+
+static bool pipeCalibrate(channel_t *ch, bool cos, uint64_t now)
+{
+	calibEdge(ch->idx, cos, now);
+	return true;
+}
+
+static bool pipeBoost(channel_t *ch, bool cos, uint64_t now)
+{
+	(void)now;
+	boostCos(ch->idx, cos);
+	return true;
+}
+
+static bool pipeWifiPs(channel_t *ch, bool cos, uint64_t now)
+{
+	(void)now;
+	wifiPsActivity(WIFIPS_SRC_COS(ch->idx), cos);
+	return true;
+}
+
+static bool pipeJournal(channel_t *ch, bool cos, uint64_t now)
+{
+	printf("Channel %d COS %s at %llu.%06llu\n", ch->idx+1, cos ? "on" : "off",
+		   (unsigned long long)now/1000000, (unsigned long long)now%1000000);
+	return true;
+}
+
+// The edge is real: record it and run it through the state machine
+static bool pipeFsm(channel_t *ch, bool cos, uint64_t now)
+{
+	// the dead carrier detector reads this from the audio thread
+	__atomic_store_n(&ch->cosLevel, cos, __ATOMIC_RELAXED);
+	metricsInc(ch->mTransitions);
+	channelEvent(ch, cos ? EV_COS_ON : EV_COS_OFF, now);
+	return true;
+}
+
+static const struct
+{
+	const char		*name;
+	pipeStageFunc_t	func;
+	const char		*section;		// feature that only sees COS through this stage
+} stageTable[PS_NUM_STAGES]=
+{
+	[PS_DEBOUNCE]=	{ "debounce",	pipeDebounce,	NULL },
+	[PS_PERIODIC]=	{ "periodic",	pipePeriodic,	"periodic interference" },
+	[PS_CALIBRATE]=	{ "calibrate",	pipeCalibrate,	"calibrate" },
+	[PS_BOOST]=		{ "boost",		pipeBoost,		"boost" },
+	[PS_WIFIPS]=	{ "wifips",		pipeWifiPs,		"wifi power save" },
+	[PS_JOURNAL]=	{ "journal",	pipeJournal,	NULL },
+	[PS_FSM]=		{ "fsm",		pipeFsm,		NULL },
+};
+
+static uint64_t pipeNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	pipelineEdge
+Synopsis:
+	Runs a COS change through the channel's stages.  Called from
+	channelPoll() when the level read differs from the channel's.
+Author:
+	agent
+Inputs:
+	channel_t *ch: channel
+	bool cos: new COS level
+	uint64_t now: edge time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void pipelineEdge(channel_t *ch, bool cos, uint64_t now)
+{
+	pipeline_t *p=&pipelines[ch->idx];
+	uint64_t start, end;
+	bool more=true;
+	int i;
+
+	if (!p->timing)
+	{
+		for (i=0; i<p->numStages && more; i++)
+			more=stageTable[p->stages[i]].func(ch, cos, now);
+		return;
+	}
+
+	start=pipeNowNs();
+	for (i=0; i<p->numStages && more; i++)
+	{
+		more=stageTable[p->stages[i]].func(ch, cos, now);
+		end=pipeNowNs();
+		metricsAdd(p->mStageNs[i], end-start);
+		metricsInc(p->mStageCalls[i]);
+		start=end;
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	pipelineInit
+Synopsis:
+	Builds a channel's pipeline from its stage list.  fsm has to be last,
+	anything after it would see edges the channel had already acted on.
+	debounce, if there, has to be first (see above).  A feature that is
+	enabled but has no stage in the list never hears this channel's COS,
+	which gets a warning.
+Author:
+	agent
+Inputs:
+	channel_t *ch: channel
+	const char *stages: comma separated stage names
+	uint32_t debounceMs: for the debounce stage
+	bool timing: count time per stage
+Outputs:
+	0 on success, -1 if the list is bad (the default is used instead)
+-----------------------------------------------------------------------------*/
+int pipelineInit(channel_t *ch, const char *stages, uint32_t debounceMs, bool timing)
+{
+	pipeline_t *p=&pipelines[ch->idx];
+	char list[128], name[METRICS_NAME_LEN], *tok, *save;
+	bool present[PS_NUM_STAGES]={ false };
+	int s, i;
+
+	memset(p, 0, sizeof(*p));
+	p->debounceUs=(uint64_t)debounceMs*1000;
+	p->timing=timing;
+
+	snprintf(list, sizeof(list), "%s", stages);
+	for (tok=strtok_r(list, ", ", &save); tok; tok=strtok_r(NULL, ", ", &save))
+	{
+		for (s=0; s<PS_NUM_STAGES && strcasecmp(tok, stageTable[s].name)!=0; s++)
+			;
+		if (s==PS_NUM_STAGES || p->numStages>=PIPELINE_MAX_STAGES)
+		{
+			fprintf(stderr, "Channel %d: bad cos_pipeline stage \"%s\", using the default\n", ch->idx+1, tok);
+			return strcmp(stages, PIPELINE_DEFAULT)==0 ? -1 : pipelineInit(ch, PIPELINE_DEFAULT, debounceMs, timing);
+		}
+		if (s==PS_DEBOUNCE && p->numStages>0)
+		{
+			fprintf(stderr, "Channel %d: cos_pipeline has to start with debounce if it has one, using the default\n", ch->idx+1);
+			return strcmp(stages, PIPELINE_DEFAULT)==0 ? -1 : pipelineInit(ch, PIPELINE_DEFAULT, debounceMs, timing);
+		}
+		p->stages[p->numStages++]=s;
+		present[s]=true;
+	}
+	if (p->numStages==0 || p->stages[p->numStages-1]!=PS_FSM)
+	{
+		fprintf(stderr, "Channel %d: cos_pipeline has to end with fsm, using the default\n", ch->idx+1);
+		return strcmp(stages, PIPELINE_DEFAULT)==0 ? -1 : pipelineInit(ch, PIPELINE_DEFAULT, debounceMs, timing);
+	}
+
+	for (s=0; s<PS_NUM_STAGES; s++)
+	{
+		if (stageTable[s].section && !present[s])
+		{
+			snprintf(name, sizeof(name), "%s:enable", stageTable[s].section);
+			if (iniparser_getboolean(ini, name, 0))
+				fprintf(stderr, "Channel %d: [%s] is enabled but cos_pipeline has no %s stage, it won't see this channel's COS\n",
+						ch->idx+1, stageTable[s].section, stageTable[s].name);
+		}
+	}
+
+	if (timing)
+	{
+		for (i=0; i<p->numStages; i++)
+		{
+			snprintf(name, sizeof(name), "cosmon_pipeline_ns_total{channel=\"%d\",stage=\"%s\"}", ch->idx+1,
+					 stageTable[p->stages[i]].name);
+			p->mStageNs[i]=metricsRegister(name, "Time spent in a COS pipeline stage", METRIC_COUNTER);
+			snprintf(name, sizeof(name), "cosmon_pipeline_calls_total{channel=\"%d\",stage=\"%s\"}", ch->idx+1,
+					 stageTable[p->stages[i]].name);
+			p->mStageCalls[i]=metricsRegister(name, "Edges through a COS pipeline stage", METRIC_COUNTER);
+		}
+	}
+	return 0;
+}
+
+// Config line for a channel's pipeline
+void pipelinePrint(const channel_t *ch)
+{
+	const pipeline_t *p=&pipelines[ch->idx];
+	int i;
+
+	printf("\tChannel %d COS pipeline:", ch->idx+1);
+	for (i=0; i<p->numStages; i++)
+		printf("%s %s", i ? " ->" : "", stageTable[p->stages[i]].name);
+	printf("%s\n", p->timing ? " (timed)" : "");
+}
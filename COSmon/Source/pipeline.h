@@ -0,0 +1,48 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  pipeline.h
+*
+*  Synopsis:	Header file for pipeline.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _PIPELINE
+#define _PIPELINE
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "channel.h"
+
+#define PIPELINE_MAX_STAGES		8
+#define PIPELINE_DEFAULT		"periodic, calibrate, boost, wifips, fsm"
+
+int  pipelineInit(channel_t *ch, const char *stages, uint32_t debounceMs, bool timing);
+void pipelineEdge(channel_t *ch, bool cos, uint64_t now);
+void pipelinePrint(const channel_t *ch);
+
+#endif
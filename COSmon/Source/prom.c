@@ -0,0 +1,436 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  prom.c
+*
+*  Synopsis:	Prometheus /metrics endpoint.  A tiny HTTP/1.0 server on the
+*				event loop that answers GET /metrics with the text exposition
+*				format of everything in the metrics registry.
+*
+*				The response (headers and body) lives in one static buffer
+*				that is only re-rendered when metricsVersion() has moved since
+*				the last scrape, so a scrape is normally one write() and nothing
+*				here ever allocates.  The body is rendered first and the
+*				headers are then written in front of it, which is why the
+*				buffer starts with PROM_HDR_ROOM spare bytes.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iniparser.h>
+
+#include "prom.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define PROM_BUF_LEN			65536
+#define PROM_HDR_ROOM			128
+#define PROM_MAX_CLIENTS		4
+#define PROM_REQ_LEN			1024
+#define PROM_TIMEOUT_US			5000000ULL
+#define PROM_SWEEP_MS			1000
+#define DEFAULT_PROM_ADDRESS	"0.0.0.0"
+#define DEFAULT_PROM_PORT		9464
+
+typedef struct
+{
+	int			fd;						// -1: free
+	uint64_t	startUs;
+	char		req[PROM_REQ_LEN];
+	size_t		reqLen;
+	const char	*out;					// response left to send
+	size_t		outLen;
+} promClient_t;
+
+static int				listenFd=-1;
+static promClient_t		clients[PROM_MAX_CLIENTS];
+static char				respBuf[PROM_BUF_LEN];
+static size_t			bodyLen=0;
+static char				*resp;					// start of headers + body in respBuf
+static size_t			respLen=0;
+static uint32_t			renderedVersion;
+static int				renderedCount=-1;
+static int				familyOrder[METRICS_MAX];
+static int				sending=0;				// clients part way through respBuf
+
+
+// Length of the family name, i.e. up to the labels
+static int promFamilyLen(const char *name)
+{
+	const char *brace=strchr(name, '{');
+
+	return brace ? brace-name : (int)strlen(name);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	promGroupFamilies
+Synopsis:
+	The exposition format wants all series of a family together under one
+	HELP / TYPE, but per channel metrics get registered channel by channel.
+	Works out an output order that groups them.  Only when the registry
+	grew.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void promGroupFamilies(void)
+{
+	const metric_t *a, *b;
+	bool placed[METRICS_MAX]={ false };
+	int n=metricsCount(), k=0, i, j, len;
+
+	for (i=0; i<n; i++)
+	{
+		if (placed[i])
+			continue;
+		a=metricsGet(i);
+		len=promFamilyLen(a->name);
+		for (j=i; j<n; j++)
+		{
+			b=metricsGet(j);
+			if (!placed[j] && promFamilyLen(b->name)==len && strncmp(a->name, b->name, len)==0)
+			{
+				familyOrder[k++]=j;
+				placed[j]=true;
+			}
+		}
+	}
+	renderedCount=n;
+}
+
+// Appends to the body, false once the buffer is full
+static bool promAppend(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static bool promAppend(const char *fmt, ...)
+{
+	char *body=respBuf+PROM_HDR_ROOM;
+	size_t room=PROM_BUF_LEN-PROM_HDR_ROOM-bodyLen;
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n=vsnprintf(body+bodyLen, room, fmt, ap);
+	va_end(ap);
+	if (n<0 || (size_t)n>=room)
+		return false;
+	bodyLen+=n;
+	return true;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	promRender
+Synopsis:
+	Renders every metric into respBuf and puts the HTTP headers right in
+	front of the body.  Histograms buckets stay in microseconds, like the
+	metric names say.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void promRender(void)
+{
+	const metric_t *m, *prev=NULL;
+	const char *labels;
+	char hdr[PROM_HDR_ROOM];
+	uint64_t cum;
+	int i, b, len, hdrLen;
+	bool ok=true;
+
+	renderedVersion=metricsVersion();
+	if (renderedCount!=metricsCount())
+		promGroupFamilies();
+
+	bodyLen=0;
+	for (i=0; i<renderedCount && ok; i++)
+	{
+		m=metricsGet(familyOrder[i]);
+		len=promFamilyLen(m->name);
+		labels=m->name+len;			// "" or "{...}"
+
+		if (prev==NULL || promFamilyLen(prev->name)!=len || strncmp(prev->name, m->name, len)!=0)
+			ok=promAppend("# HELP %.*s %s\n# TYPE %.*s %s\n", len, m->name, m->help, len, m->name,
+						  m->type==METRIC_COUNTER ? "counter" : m->type==METRIC_GAUGE ? "gauge" : "histogram");
+		prev=m;
+
+		switch (m->type)
+		{
+			case METRIC_COUNTER:
+				ok=ok && promAppend("%s %llu\n", m->name, (unsigned long long)__atomic_load_n(&m->count, __ATOMIC_RELAXED));
+				break;
+
+			case METRIC_GAUGE:
+				ok=ok && promAppend("%s %g\n", m->name, m->gauge);
+				break;
+
+			case METRIC_HISTOGRAM:
+				// le goes in with whatever labels the metric already has
+				cum=0;
+				for (b=0; b<METRICS_HIST_BUCKETS && ok; b++)
+				{
+					cum+=__atomic_load_n(&m->buckets[b], __ATOMIC_RELAXED);
+					if (b==METRICS_HIST_BUCKETS-1)
+						ok=promAppend("%.*s_bucket{%.*s%sle=\"+Inf\"} %llu\n", len, m->name,
+									  labels[0] ? (int)strlen(labels)-2 : 0, labels+1, labels[0] ? "," : "",
+									  (unsigned long long)cum);
+					else
+						ok=promAppend("%.*s_bucket{%.*s%sle=\"%u\"} %llu\n", len, m->name,
+									  labels[0] ? (int)strlen(labels)-2 : 0, labels+1, labels[0] ? "," : "",
+									  metricsBucketUs[b], (unsigned long long)cum);
+				}
+				ok=ok && promAppend("%.*s_sum%s %llu\n%.*s_count%s %llu\n",
+									len, m->name, labels, (unsigned long long)__atomic_load_n(&m->sumUs, __ATOMIC_RELAXED),
+									len, m->name, labels, (unsigned long long)cum);
+				break;
+		}
+	}
+	if (!ok)
+		fprintf(stderr, "prom: response buffer full, metrics truncated\n");
+
+	hdrLen=snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+					"Content-Length: %zu\r\n\r\n", bodyLen);
+	resp=respBuf+PROM_HDR_ROOM-hdrLen;
+	memcpy(resp, hdr, hdrLen);
+	respLen=hdrLen+bodyLen;
+}
+
+static void promClose(promClient_t *c)
+{
+	if (c->out)
+		sending--;
+	evloopRemove(c->fd);
+	close(c->fd);
+	c->fd=-1;
+	c->out=NULL;
+}
+
+// Writes what it can, polls for the rest.  Closes when done.
+static void promSend(promClient_t *c)
+{
+	ssize_t n;
+
+	n=write(c->fd, c->out, c->outLen);
+	if (n<0 && errno!=EAGAIN)
+	{
+		promClose(c);
+		return;
+	}
+	if (n>0)
+	{
+		c->out+=n;
+		c->outLen-=n;
+	}
+	if (c->outLen==0)
+		promClose(c);
+	else
+		evloopModPoller(c->fd, EPOLLOUT);
+}
+
+static void promRespond(promClient_t *c)
+{
+	static const char notFound[]="HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+	static const char badRequest[]="HTTP/1.0 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+
+	if (strncmp(c->req, "GET /metrics ", 13)==0 || strncmp(c->req, "GET / ", 6)==0)
+	{
+		// Nobody else mid-send of the old copy: bring it up to date
+		if (sending==0 && (respLen==0 || metricsVersion()!=renderedVersion || metricsCount()!=renderedCount))
+			promRender();
+		c->out=resp;
+		c->outLen=respLen;
+	}
+	else if (strncmp(c->req, "GET ", 4)==0)
+	{
+		c->out=notFound;
+		c->outLen=sizeof(notFound)-1;
+	}
+	else
+	{
+		c->out=badRequest;
+		c->outLen=sizeof(badRequest)-1;
+	}
+	sending++;
+	promSend(c);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	promClientHandler
+Synopsis:
+	Reads the request up to the blank line, then sends the response.
+	Request bodies and keep-alive aren't supported, Prometheus doesn't
+	need them.
+Author:
+	agent
+Inputs:
+	standard evloop poll handler args, ctx is the promClient_t
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void promClientHandler(int fd, uint32_t events, void *ctx)
+{
+	promClient_t *c=ctx;
+	ssize_t n;
+
+	if (c->out)
+	{
+		if (events & (EPOLLERR | EPOLLHUP))
+			promClose(c);
+		else
+			promSend(c);
+		return;
+	}
+
+	n=read(fd, c->req+c->reqLen, sizeof(c->req)-1-c->reqLen);
+	if (n<=0)
+	{
+		if (n==0 || errno!=EAGAIN)
+			promClose(c);
+		return;
+	}
+	c->reqLen+=n;
+	c->req[c->reqLen]='\0';
+
+	if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+		promRespond(c);
+	else if (c->reqLen>=sizeof(c->req)-1)
+		promClose(c);
+}
+
+static void promAcceptHandler(int fd, uint32_t events, void *ctx)
+{
+	promClient_t *c=NULL;
+	int cfd, i;
+
+	(void)events;
+	(void)ctx;
+	cfd=accept(fd, NULL, NULL);
+	if (cfd<0)
+		return;
+	fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+
+	for (i=0; i<PROM_MAX_CLIENTS; i++)
+	{
+		if (clients[i].fd<0)
+		{
+			c=&clients[i];
+			break;
+		}
+	}
+	if (c==NULL || evloopAddPoller(cfd, EPOLLIN, promClientHandler, c)<0)
+	{
+		close(cfd);
+		return;
+	}
+	c->fd=cfd;
+	c->startUs=evloopNowUs();
+	c->reqLen=0;
+	c->out=NULL;
+}
+
+// Drops clients that have been hanging around too long
+static void promSweepHandler(uint64_t expirations, void *ctx)
+{
+	uint64_t now=evloopNowUs();
+	int i;
+
+	(void)expirations;
+	(void)ctx;
+	for (i=0; i<PROM_MAX_CLIENTS; i++)
+	{
+		if (clients[i].fd>=0 && now-clients[i].startUs>PROM_TIMEOUT_US)
+			promClose(&clients[i]);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	promInit
+Synopsis:
+	Reads [prometheus] and starts listening.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void promInit(void)
+{
+	struct sockaddr_in addr;
+	const char *address;
+	int port, one=1, i;
+
+	if (!iniparser_getboolean(ini, "prometheus:enable", 0))
+		return;
+
+	for (i=0; i<PROM_MAX_CLIENTS; i++)
+		clients[i].fd=-1;
+
+	address=	iniparser_getstring(ini, "prometheus:address", DEFAULT_PROM_ADDRESS);
+	port=		iniparser_getint(ini, "prometheus:port", DEFAULT_PROM_PORT);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family=AF_INET;
+	addr.sin_port=htons(port);
+	if (inet_pton(AF_INET, address, &addr.sin_addr)!=1)
+	{
+		fprintf(stderr, "prometheus: bad address %s\n", address);
+		return;
+	}
+
+	listenFd=socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd<0)
+		return;
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr))<0 || listen(listenFd, PROM_MAX_CLIENTS)<0 ||
+		evloopAddPoller(listenFd, EPOLLIN, promAcceptHandler, NULL)<0)
+	{
+		fprintf(stderr, "prometheus: can't listen on %s:%d\n", address, port);
+		close(listenFd);
+		listenFd=-1;
+		return;
+	}
+	evloopAddTimer(PROM_SWEEP_MS, PROM_SWEEP_MS, promSweepHandler, NULL);
+	printf("\tPrometheus metrics: http://%s:%d/metrics\n", address, port);
+}
@@ -0,0 +1,676 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  qos.c
+*
+*  Synopsis:	Puts the node's voice traffic ahead of bulk traffic on the wifi and
+*				wired interfaces.  Over rtnetlink it installs an HTB root shaped a
+*				little under the uplink (so the queue builds here, where we can
+*				order it, and not in the modem) with a voice class that always
+*				goes first and a default bulk class, u32 filters sending the IAX2
+*				ports to the voice class, and optionally pedit + csum actions
+*				setting the DSCP on them.  Re-applied whenever an interface comes
+*				up; class and queue stats are read back into metrics.
+*
+*				Requests are synchronous on their own socket: the kernel has
+*				answered before send() returns, so it never waits.  Link events
+*				come in on a second socket on the event loop.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/gen_stats.h>
+#include <linux/tc_act/tc_pedit.h>
+#include <linux/tc_act/tc_csum.h>
+#include <iniparser.h>
+
+#include "qos.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define QOS_MAX_IFACES			2
+#define QOS_MAX_PORTS			4
+#define QOS_MSG_LEN				1024
+#define QOS_BUF_LEN				16384
+#define QOS_ROOT				0x00010000		// 1:
+#define QOS_PARENT				0x00010001		// 1:1, the whole uplink
+#define QOS_VOICE				0x00010010		// 1:10
+#define QOS_BULK				0x00010020		// 1:20, default
+#define QOS_MTU					1600
+#define DEFAULT_QOS_PORTS		"4569"
+#define DEFAULT_QOS_UPLINK		10000			// kbit/s
+#define DEFAULT_QOS_VOICE		512				// kbit/s guaranteed to voice
+#define DEFAULT_QOS_DSCP		46				// EF
+#define DEFAULT_QOS_STATS_S		10
+
+typedef struct
+{
+	char		name[IFNAMSIZ];
+	int			ifindex;				// 0: not there
+	bool		up;
+	uint64_t	lastVoiceBytes, lastBulkBytes;
+	uint32_t	lastVoiceDrops, lastDrops;
+
+	metric_t	*mApplied;
+	metric_t	*mFailed;
+	metric_t	*mVoiceBytes;
+	metric_t	*mVoiceDrops;
+	metric_t	*mBulkBytes;
+	metric_t	*mDrops;
+	metric_t	*mBacklog;
+} qosIface_t;
+
+typedef struct
+{
+	struct nlmsghdr	nlh;
+	uint8_t			data[QOS_MSG_LEN];
+} qosMsg_t;
+
+static qosIface_t		ifaces[QOS_MAX_IFACES];
+static int				numIfaces=0;
+static int				reqFd=-1;				// requests and dumps
+static int				eventFd=-1;				// link notifications
+static uint32_t			seq=0;
+static uint16_t			ports[QOS_MAX_PORTS];
+static int				numPorts=0;
+static uint32_t			uplinkBps, voiceBps;	// bytes/s
+static int				dscp;
+static bool				marking;				// pedit / csum actions available
+
+
+/*-----------------------------------------------------------------------------
+	Netlink message building
+-----------------------------------------------------------------------------*/
+static struct tcmsg *qosStart(qosMsg_t *m, uint16_t type, uint16_t flags, int ifindex, uint32_t parent, uint32_t handle)
+{
+	struct tcmsg *tcm;
+
+	memset(m, 0, sizeof(*m));
+	m->nlh.nlmsg_len=NLMSG_LENGTH(sizeof(struct tcmsg));
+	m->nlh.nlmsg_type=type;
+	m->nlh.nlmsg_flags=NLM_F_REQUEST | flags;
+	m->nlh.nlmsg_seq=++seq;
+	tcm=NLMSG_DATA(&m->nlh);
+	tcm->tcm_family=AF_UNSPEC;
+	tcm->tcm_ifindex=ifindex;
+	tcm->tcm_parent=parent;
+	tcm->tcm_handle=handle;
+	return tcm;
+}
+
+static struct rtattr *qosPut(qosMsg_t *m, uint16_t type, const void *data, size_t len)
+{
+	struct rtattr *rta=(struct rtattr *)((uint8_t *)m+NLMSG_ALIGN(m->nlh.nlmsg_len));
+
+	rta->rta_type=type;
+	rta->rta_len=RTA_LENGTH(len);
+	if (len)
+		memcpy(RTA_DATA(rta), data, len);
+	m->nlh.nlmsg_len=NLMSG_ALIGN(m->nlh.nlmsg_len)+RTA_ALIGN(rta->rta_len);
+	return rta;
+}
+
+static void qosPutString(qosMsg_t *m, uint16_t type, const char *s)
+{
+	qosPut(m, type, s, strlen(s)+1);
+}
+
+static struct rtattr *qosNest(qosMsg_t *m, uint16_t type)
+{
+	return qosPut(m, type, NULL, 0);
+}
+
+static void qosNestEnd(qosMsg_t *m, struct rtattr *nest)
+{
+	nest->rta_len=(uint8_t *)m+m->nlh.nlmsg_len-(uint8_t *)nest;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	qosRequest
+Synopsis:
+	Sends one request and reads its ack.
+Author:
+	agent
+Inputs:
+	qosMsg_t *m: request (gets NLM_F_ACK added)
+Outputs:
+	0 or -errno from the kernel
+-----------------------------------------------------------------------------*/
+static int qosRequest(qosMsg_t *m)
+{
+	uint8_t buf[QOS_BUF_LEN];
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	ssize_t n;
+
+	m->nlh.nlmsg_flags|=NLM_F_ACK;
+	if (send(reqFd, m, m->nlh.nlmsg_len, 0)<0)
+		return -errno;
+
+	for (;;)
+	{
+		n=recv(reqFd, buf, sizeof(buf), 0);
+		if (n<0)
+			return -errno;
+		for (nlh=(struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh=NLMSG_NEXT(nlh, n))
+		{
+			if (nlh->nlmsg_seq!=m->nlh.nlmsg_seq || nlh->nlmsg_type!=NLMSG_ERROR)
+				continue;
+			err=NLMSG_DATA(nlh);
+			return err->error;
+		}
+	}
+}
+
+// tc works in 64 ns ticks: time to send burst bytes at rate
+static uint32_t qosTicks(uint32_t rateBps, uint32_t burst)
+{
+	return (uint32_t)((uint64_t)burst*1000000000ULL/rateBps/64);
+}
+
+static int qosAddClass(qosIface_t *ifc, uint32_t parent, uint32_t handle, uint32_t rateBps, uint32_t prio)
+{
+	struct tc_htb_opt opt;
+	struct rtattr *nest;
+	qosMsg_t m;
+	uint32_t burst=uplinkBps/1000+QOS_MTU;
+
+	memset(&opt, 0, sizeof(opt));
+	opt.rate.rate=rateBps;
+	opt.rate.linklayer=TC_LINKLAYER_ETHERNET;		// no rate tables needed
+	opt.ceil.rate=uplinkBps;
+	opt.ceil.linklayer=TC_LINKLAYER_ETHERNET;
+	opt.buffer=qosTicks(rateBps, burst);
+	opt.cbuffer=qosTicks(uplinkBps, burst);
+	opt.quantum=QOS_MTU;
+	opt.prio=prio;
+
+	qosStart(&m, RTM_NEWTCLASS, NLM_F_CREATE | NLM_F_EXCL, ifc->ifindex, parent, handle);
+	qosPutString(&m, TCA_KIND, "htb");
+	nest=qosNest(&m, TCA_OPTIONS);
+	qosPut(&m, TCA_HTB_PARMS, &opt, sizeof(opt));
+	qosNestEnd(&m, nest);
+	return qosRequest(&m);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	qosAddFilter
+Synopsis:
+	u32 filter: UDP with the given source or destination port goes to the
+	voice class, DSCP rewritten if marking.  Like tc's "match ip dport"
+	it assumes a 20 byte IP header.
+Author:
+	agent
+Inputs:
+	qosIface_t *ifc: interface
+	uint16_t port: UDP port
+	bool source: match the source port, else the destination
+	bool mark: add the pedit / csum actions
+Outputs:
+	0 or -errno
+-----------------------------------------------------------------------------*/
+static int qosAddFilter(qosIface_t *ifc, uint16_t port, bool source, bool mark)
+{
+	struct
+	{
+		struct tc_u32_sel	sel;
+		struct tc_u32_key	keys[2];
+	} u32;
+	struct
+	{
+		struct tc_pedit_sel	sel;
+		struct tc_pedit_key	key;
+	} pedit;
+	struct tc_csum csum;
+	struct rtattr *opts, *acts, *act, *actOpts;
+	struct tcmsg *tcm;
+	uint32_t classid=QOS_VOICE;
+	qosMsg_t m;
+
+	memset(&u32, 0, sizeof(u32));
+	u32.sel.flags=TC_U32_TERMINAL;
+	u32.sel.nkeys=2;
+	u32.keys[0].off=8;						// TTL, protocol, checksum
+	u32.keys[0].mask=htonl(0x00ff0000);
+	u32.keys[0].val=htonl(IPPROTO_UDP<<16);
+	u32.keys[1].off=20;						// UDP source, destination port
+	u32.keys[1].mask=htonl(source ? 0xffff0000 : 0x0000ffff);
+	u32.keys[1].val=htonl(source ? (uint32_t)port<<16 : port);
+
+	tcm=qosStart(&m, RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, ifc->ifindex, QOS_ROOT, 0);
+	tcm->tcm_info=TC_H_MAKE(1<<16, htons(ETH_P_IP));
+	qosPutString(&m, TCA_KIND, "u32");
+	opts=qosNest(&m, TCA_OPTIONS);
+	qosPut(&m, TCA_U32_CLASSID, &classid, sizeof(classid));
+	qosPut(&m, TCA_U32_SEL, &u32, sizeof(u32));
+
+	if (mark)
+	{
+		// TOS byte is the 2nd byte of the first word, keep the ECN bits
+		memset(&pedit, 0, sizeof(pedit));
+		pedit.sel.action=TC_ACT_PIPE;
+		pedit.sel.nkeys=1;
+		pedit.key.off=0;
+		pedit.key.mask=htonl(0xff03ffff);
+		pedit.key.val=htonl((uint32_t)(dscp<<2)<<16);
+		memset(&csum, 0, sizeof(csum));
+		csum.action=TC_ACT_OK;
+		csum.update_flags=TCA_CSUM_UPDATE_FLAG_IPV4HDR;
+
+		acts=qosNest(&m, TCA_U32_ACT);
+		act=qosNest(&m, 1);
+		qosPutString(&m, TCA_ACT_KIND, "pedit");
+		actOpts=qosNest(&m, TCA_ACT_OPTIONS);
+		qosPut(&m, TCA_PEDIT_PARMS, &pedit, sizeof(pedit));
+		qosNestEnd(&m, actOpts);
+		qosNestEnd(&m, act);
+		act=qosNest(&m, 2);
+		qosPutString(&m, TCA_ACT_KIND, "csum");
+		actOpts=qosNest(&m, TCA_ACT_OPTIONS);
+		qosPut(&m, TCA_CSUM_PARMS, &csum, sizeof(csum));
+		qosNestEnd(&m, actOpts);
+		qosNestEnd(&m, act);
+		qosNestEnd(&m, acts);
+	}
+	qosNestEnd(&m, opts);
+	return qosRequest(&m);
+}
+
+static void qosDelRoot(qosIface_t *ifc)
+{
+	qosMsg_t m;
+
+	qosStart(&m, RTM_DELQDISC, 0, ifc->ifindex, TC_H_ROOT, 0);
+	qosRequest(&m);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	qosApply
+Synopsis:
+	(Re)builds the whole setup on an interface.  Starts by deleting the
+	root qdisc so it can run any number of times.  If the kernel has no
+	pedit / csum actions, filters go in without DSCP marking.
+Author:
+	agent
+Inputs:
+	qosIface_t *ifc: interface
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void qosApply(qosIface_t *ifc)
+{
+	struct tc_htb_glob glob;
+	struct rtattr *nest;
+	qosMsg_t m;
+	int err, i;
+
+	qosDelRoot(ifc);
+
+	memset(&glob, 0, sizeof(glob));
+	glob.version=3;
+	glob.rate2quantum=10;
+	glob.defcls=QOS_BULK & 0xffff;
+	qosStart(&m, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, ifc->ifindex, TC_H_ROOT, QOS_ROOT);
+	qosPutString(&m, TCA_KIND, "htb");
+	nest=qosNest(&m, TCA_OPTIONS);
+	qosPut(&m, TCA_HTB_INIT, &glob, sizeof(glob));
+	qosNestEnd(&m, nest);
+
+	// Voice gets its rate first and first go at anything spare
+	if ((err=qosRequest(&m))<0 ||
+		(err=qosAddClass(ifc, QOS_ROOT, QOS_PARENT, uplinkBps, 0))<0 ||
+		(err=qosAddClass(ifc, QOS_PARENT, QOS_VOICE, voiceBps, 0))<0 ||
+		(err=qosAddClass(ifc, QOS_PARENT, QOS_BULK, uplinkBps-voiceBps, 1))<0)
+	{
+		fprintf(stderr, "Traffic priority: %s: %s\n", ifc->name, strerror(-err));
+		metricsInc(ifc->mFailed);
+		qosDelRoot(ifc);
+		return;
+	}
+
+	for (i=0; i<numPorts; i++)
+	{
+		err=qosAddFilter(ifc, ports[i], false, marking);
+		if (err<0 && marking)
+		{
+			fprintf(stderr, "Traffic priority: can't mark DSCP (%s), prioritising only\n", strerror(-err));
+			marking=false;
+			err=qosAddFilter(ifc, ports[i], false, false);
+		}
+		if (err>=0)
+			err=qosAddFilter(ifc, ports[i], true, marking);
+		if (err<0)
+		{
+			fprintf(stderr, "Traffic priority: %s: filter for port %u: %s\n", ifc->name, ports[i], strerror(-err));
+			metricsInc(ifc->mFailed);
+			qosDelRoot(ifc);
+			return;
+		}
+	}
+
+	printf("Traffic priority set up on %s\n", ifc->name);
+	metricsInc(ifc->mApplied);
+	ifc->lastVoiceBytes=ifc->lastBulkBytes=0;
+	ifc->lastVoiceDrops=ifc->lastDrops=0;
+}
+
+/*-----------------------------------------------------------------------------
+	Stats
+-----------------------------------------------------------------------------*/
+// Counters come back as totals, counts the change (from zero after a re-apply)
+static void qosDelta64(metric_t *m, uint64_t *last, uint64_t now)
+{
+	metricsAdd(m, now>=*last ? now-*last : now);
+	*last=now;
+}
+
+static void qosDelta32(metric_t *m, uint32_t *last, uint32_t now)
+{
+	metricsAdd(m, now>=*last ? now-*last : now);
+	*last=now;
+}
+
+static void qosStats(qosIface_t *ifc, const struct tcmsg *tcm, int len)
+{
+	struct gnet_stats_basic basic;
+	struct gnet_stats_queue queue;
+	struct rtattr *rta=TCA_RTA(tcm), *s;
+	bool haveBasic=false, haveQueue=false;
+	int slen;
+
+	for (; RTA_OK(rta, len); rta=RTA_NEXT(rta, len))
+	{
+		if (rta->rta_type!=TCA_STATS2)
+			continue;
+		slen=RTA_PAYLOAD(rta);
+		for (s=RTA_DATA(rta); RTA_OK(s, slen); s=RTA_NEXT(s, slen))
+		{
+			if (s->rta_type==TCA_STATS_BASIC && RTA_PAYLOAD(s)>=sizeof(basic))
+			{
+				memcpy(&basic, RTA_DATA(s), sizeof(basic));
+				haveBasic=true;
+			}
+			else if (s->rta_type==TCA_STATS_QUEUE && RTA_PAYLOAD(s)>=sizeof(queue))
+			{
+				memcpy(&queue, RTA_DATA(s), sizeof(queue));
+				haveQueue=true;
+			}
+		}
+	}
+	if (!haveBasic || !haveQueue)
+		return;
+
+	if (tcm->tcm_handle==QOS_VOICE)
+	{
+		qosDelta64(ifc->mVoiceBytes, &ifc->lastVoiceBytes, basic.bytes);
+		qosDelta32(ifc->mVoiceDrops, &ifc->lastVoiceDrops, queue.drops);
+	}
+	else if (tcm->tcm_handle==QOS_BULK)
+		qosDelta64(ifc->mBulkBytes, &ifc->lastBulkBytes, basic.bytes);
+	else if (tcm->tcm_handle==QOS_ROOT && tcm->tcm_parent==TC_H_ROOT)
+	{
+		qosDelta32(ifc->mDrops, &ifc->lastDrops, queue.drops);
+		metricsSet(ifc->mBacklog, queue.backlog);
+	}
+}
+
+// Dumps an interface's qdiscs or classes into qosStats()
+static void qosDump(qosIface_t *ifc, uint16_t type)
+{
+	uint8_t buf[QOS_BUF_LEN];
+	struct nlmsghdr *nlh;
+	struct tcmsg *tcm;
+	qosMsg_t m;
+	ssize_t n;
+	bool done=false;
+
+	qosStart(&m, type, NLM_F_DUMP, ifc->ifindex, 0, 0);
+	if (send(reqFd, &m, m.nlh.nlmsg_len, 0)<0)
+		return;
+
+	while (!done && (n=recv(reqFd, buf, sizeof(buf), 0))>0)
+	{
+		for (nlh=(struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh=NLMSG_NEXT(nlh, n))
+		{
+			if (nlh->nlmsg_type==NLMSG_DONE || nlh->nlmsg_type==NLMSG_ERROR)
+			{
+				done=true;
+				break;
+			}
+			tcm=NLMSG_DATA(nlh);
+			if (nlh->nlmsg_seq==m.nlh.nlmsg_seq && tcm->tcm_ifindex==ifc->ifindex)
+				qosStats(ifc, tcm, nlh->nlmsg_len-NLMSG_LENGTH(sizeof(*tcm)));
+		}
+	}
+}
+
+static void qosStatsHandler(uint64_t expirations, void *ctx)
+{
+	int i;
+
+	(void)expirations;
+	(void)ctx;
+	for (i=0; i<numIfaces; i++)
+	{
+		if (ifaces[i].ifindex && ifaces[i].up)
+		{
+			qosDump(&ifaces[i], RTM_GETQDISC);
+			qosDump(&ifaces[i], RTM_GETTCLASS);
+		}
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	qosLinkHandler
+Synopsis:
+	rtnetlink link notifications.  One of our interfaces coming up (or
+	turning up again with a new ifindex after a driver reload) gets the
+	setup put back.
+Author:
+	agent
+Inputs:
+	standard evloop poll handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void qosLinkHandler(int fd, uint32_t events, void *ctx)
+{
+	uint8_t buf[QOS_BUF_LEN];
+	struct nlmsghdr *nlh;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	const char *name;
+	qosIface_t *ifc;
+	ssize_t n;
+	int len, i;
+	bool up;
+
+	(void)events;
+	(void)ctx;
+	while ((n=recv(fd, buf, sizeof(buf), MSG_DONTWAIT))>0)
+	{
+		for (nlh=(struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh=NLMSG_NEXT(nlh, n))
+		{
+			if (nlh->nlmsg_type!=RTM_NEWLINK && nlh->nlmsg_type!=RTM_DELLINK)
+				continue;
+			ifi=NLMSG_DATA(nlh);
+			len=IFLA_PAYLOAD(nlh);
+			name=NULL;
+			for (rta=IFLA_RTA(ifi); RTA_OK(rta, len); rta=RTA_NEXT(rta, len))
+			{
+				if (rta->rta_type==IFLA_IFNAME)
+					name=RTA_DATA(rta);
+			}
+			if (name==NULL)
+				continue;
+
+			for (i=0; i<numIfaces; i++)
+			{
+				ifc=&ifaces[i];
+				if (strcmp(ifc->name, name)!=0)
+					continue;
+				if (nlh->nlmsg_type==RTM_DELLINK)
+				{
+					ifc->ifindex=0;
+					ifc->up=false;
+					continue;
+				}
+				up=(ifi->ifi_flags & IFF_UP)!=0;
+				if (up && (!ifc->up || ifc->ifindex!=ifi->ifi_index))
+				{
+					ifc->ifindex=ifi->ifi_index;
+					ifc->up=true;
+					qosApply(ifc);
+				}
+				ifc->up=up;
+			}
+		}
+	}
+}
+
+static void qosAddIface(const char *name)
+{
+	qosIface_t *ifc=&ifaces[numIfaces];
+	char metric[METRICS_NAME_LEN];
+
+	if (name[0]=='\0' || numIfaces>=QOS_MAX_IFACES)
+		return;
+	memset(ifc, 0, sizeof(*ifc));
+	snprintf(ifc->name, sizeof(ifc->name), "%s", name);
+
+	snprintf(metric, sizeof(metric), "cosmon_qos_applied_total{interface=\"%s\"}", ifc->name);
+	ifc->mApplied=metricsRegister(metric, "Times the traffic priority setup was installed", METRIC_COUNTER);
+	snprintf(metric, sizeof(metric), "cosmon_qos_failed_total{interface=\"%s\"}", ifc->name);
+	ifc->mFailed=metricsRegister(metric, "Times installing the traffic priority setup failed", METRIC_COUNTER);
+	snprintf(metric, sizeof(metric), "cosmon_qos_voice_bytes_total{interface=\"%s\"}", ifc->name);
+	ifc->mVoiceBytes=metricsRegister(metric, "Bytes sent through the voice class", METRIC_COUNTER);
+	snprintf(metric, sizeof(metric), "cosmon_qos_voice_drops_total{interface=\"%s\"}", ifc->name);
+	ifc->mVoiceDrops=metricsRegister(metric, "Voice packets dropped", METRIC_COUNTER);
+	snprintf(metric, sizeof(metric), "cosmon_qos_bulk_bytes_total{interface=\"%s\"}", ifc->name);
+	ifc->mBulkBytes=metricsRegister(metric, "Bytes sent through the bulk class", METRIC_COUNTER);
+	snprintf(metric, sizeof(metric), "cosmon_qos_drops_total{interface=\"%s\"}", ifc->name);
+	ifc->mDrops=metricsRegister(metric, "Packets dropped by the traffic priority qdisc", METRIC_COUNTER);
+	snprintf(metric, sizeof(metric), "cosmon_qos_backlog_bytes{interface=\"%s\"}", ifc->name);
+	ifc->mBacklog=metricsRegister(metric, "Bytes queued in the traffic priority qdisc", METRIC_GAUGE);
+	numIfaces++;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	qosInit
+Synopsis:
+	Reads [traffic priority] and sets up every [network devices]
+	interface that's up.  The rest get it when they come up.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void qosInit(void)
+{
+	struct sockaddr_nl sa;
+	char list[64], *tok, *save;
+	unsigned int statsS;
+	int i;
+
+	if (!iniparser_getboolean(ini, "traffic priority:enable", 0))
+		return;
+
+	snprintf(list, sizeof(list), "%s", iniparser_getstring(ini, "traffic priority:ports", DEFAULT_QOS_PORTS));
+	for (tok=strtok_r(list, ", ", &save); tok && numPorts<QOS_MAX_PORTS; tok=strtok_r(NULL, ", ", &save))
+		ports[numPorts++]=atoi(tok);
+	uplinkBps=	iniparser_getint(ini, "traffic priority:uplink_kbit", DEFAULT_QOS_UPLINK)*1000/8;
+	voiceBps=	iniparser_getint(ini, "traffic priority:voice_kbit", DEFAULT_QOS_VOICE)*1000/8;
+	dscp=		iniparser_getint(ini, "traffic priority:dscp", DEFAULT_QOS_DSCP);
+	statsS=		iniparser_getint(ini, "traffic priority:stats_interval_s", DEFAULT_QOS_STATS_S);
+	marking=	dscp>=0 && dscp<64;
+	if (numPorts==0 || uplinkBps==0 || voiceBps>=uplinkBps)
+	{
+		fprintf(stderr, "Traffic priority: need ports and voice_kbit < uplink_kbit, disabled\n");
+		return;
+	}
+
+	reqFd=socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	eventFd=socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family=AF_NETLINK;
+	sa.nl_groups=RTMGRP_LINK;
+	if (reqFd<0 || eventFd<0 || bind(eventFd, (struct sockaddr *)&sa, sizeof(sa))<0 ||
+		evloopAddPoller(eventFd, EPOLLIN, qosLinkHandler, NULL)<0)
+	{
+		fprintf(stderr, "Traffic priority: no rtnetlink, disabled\n");
+		return;
+	}
+
+	qosAddIface(iniparser_getstring(ini, "network devices:wifi interface name", "wlan0"));
+	qosAddIface(iniparser_getstring(ini, "network devices:wired interface name", "eth0"));
+	for (i=0; i<numIfaces; i++)
+	{
+		ifaces[i].ifindex=if_nametoindex(ifaces[i].name);
+		if (ifaces[i].ifindex)
+		{
+			ifaces[i].up=true;
+			qosApply(&ifaces[i]);
+		}
+	}
+	if (statsS)
+		evloopAddTimer(statsS*1000, statsS*1000, qosStatsHandler, NULL);
+	printf("\tTraffic priority: UDP %u%s, %u of %u kbit/s, DSCP %d\n", ports[0], numPorts>1 ? "..." : "",
+		   voiceBps*8/1000, uplinkBps*8/1000, marking ? dscp : -1);
+}
+
+// Exiting: give the interfaces their default qdisc back
+void qosRestore(void)
+{
+	int i;
+
+	for (i=0; i<numIfaces; i++)
+	{
+		if (ifaces[i].ifindex)
+			qosDelRoot(&ifaces[i]);
+	}
+}
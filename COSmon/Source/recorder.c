@@ -0,0 +1,537 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  recorder.c
+*
+*  Synopsis:	Records every received transmission for later review.  A couple
+*				of seconds of pre-roll are always kept in RAM; when the channel
+*				keys (COS after the attack filter) the pre-roll and everything
+*				until it unkeys is written to an 8 kHz IMA-ADPCM WAV file, 4
+*				bits a sample, about 14 MB per hour of airtime.
+*
+*				The SD card only ever sees whole 64 KiB chunks at 64 KiB
+*				aligned offsets (the WAV header lives at the front of the first
+*				chunk and is patched at the end), plus one short write for the
+*				tail.  Old recordings are deleted by age and total size after
+*				each new one.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <iniparser.h>
+
+#include "recorder.h"
+#include "audio.h"
+#include "channel.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define REC_RATE				8000
+#define REC_BLOCK_ALIGN			256			// IMA-ADPCM block, bytes
+#define REC_BLOCK_SAMPLES		505			// (256-4)*2+1 for mono
+#define REC_HEADER_LEN			60
+#define REC_CHUNK				65536		// write size and alignment
+#define REC_MAX_PREROLL_MS		10000
+#define REC_MAX_FILES			4096		// looked at per retention pass
+#define REC_DIR_LEN				192
+#define REC_MAX_SAME_SECOND		100			// ch1-<time>-2.wav ... on a quick re-key
+#define DEFAULT_REC_DIR			"/var/spool/COSmon"
+#define DEFAULT_REC_PREROLL_MS	2000
+#define DEFAULT_REC_DAYS		14
+#define DEFAULT_REC_MAX_MB		500
+
+typedef struct
+{
+	bool			enabled;
+	int				idx;
+	unsigned int	decim;
+
+	int16_t			preroll[REC_RATE*REC_MAX_PREROLL_MS/1000];
+	unsigned int	prerollLen;
+	unsigned int	prerollPos;
+	unsigned int	prerollFill;
+
+	int				fd;					// -1 when not recording
+	bool			failed;				// couldn't record this transmission, wait for the next
+	char			path[REC_DIR_LEN+64];
+	uint8_t			*chunk;				// REC_CHUNK, page aligned
+	size_t			chunkFill;
+	int16_t			pending[REC_BLOCK_SAMPLES];
+	unsigned int	pendingLen;
+	int				index;				// ADPCM step index, carried between blocks
+	uint64_t		samples;
+	uint64_t		bytes;
+
+	metric_t		*mRecordings;
+	metric_t		*mBytes;
+	metric_t		*mAirtimeMs;
+	metric_t		*mBytesPerHour;
+	metric_t		*mErrors;
+	metric_t		*mDeleted;
+} recorder_t;
+
+static recorder_t	recorders[MAX_CHANNELS];
+static char			recDir[REC_DIR_LEN]=DEFAULT_REC_DIR;
+static unsigned int	retentionDays=DEFAULT_REC_DAYS;
+static uint64_t		maxBytes=(uint64_t)DEFAULT_REC_MAX_MB*1024*1024;
+
+static const int16_t imaStep[89]=
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+	11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+	32767
+};
+
+static const int8_t imaIndex[8]={-1, -1, -1, -1, 2, 4, 6, 8};
+
+static void recorderBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid);
+
+
+/*-----------------------------------------------------------------------------
+	IMA-ADPCM, the WAV flavour (format 0x11).  Each 256 byte block starts
+	with the first sample and the step index so blocks decode on their own.
+-----------------------------------------------------------------------------*/
+static uint8_t imaEncodeSample(int sample, int *pred, int *index)
+{
+	int step=imaStep[*index], diff=sample-*pred, delta=step>>3;
+	uint8_t nib=0;
+
+	if (diff<0)
+	{
+		nib=8;
+		diff=-diff;
+	}
+	if (diff>=step) { nib|=4; diff-=step; delta+=step; }
+	step>>=1;
+	if (diff>=step) { nib|=2; diff-=step; delta+=step; }
+	step>>=1;
+	if (diff>=step) { nib|=1; delta+=step; }
+
+	*pred+=(nib & 8) ? -delta : delta;
+	if (*pred>32767)
+		*pred=32767;
+	else if (*pred<-32768)
+		*pred=-32768;
+
+	*index+=imaIndex[nib & 7];
+	if (*index<0)
+		*index=0;
+	else if (*index>88)
+		*index=88;
+	return nib;
+}
+
+static void imaEncodeBlock(const int16_t *in, uint8_t *out, int *index)
+{
+	int pred=in[0], i;
+	uint8_t nib;
+
+	out[0]=pred & 0xff;
+	out[1]=(pred>>8) & 0xff;
+	out[2]=*index;
+	out[3]=0;
+	for (i=1; i<REC_BLOCK_SAMPLES; i++)
+	{
+		nib=imaEncodeSample(in[i], &pred, index);
+		if ((i-1) & 1)
+			out[4+(i-1)/2]|=nib<<4;
+		else
+			out[4+(i-1)/2]=nib;
+	}
+}
+
+static void put16(uint8_t *p, uint16_t v) { p[0]=v; p[1]=v>>8; }
+static void put32(uint8_t *p, uint32_t v) { p[0]=v; p[1]=v>>8; p[2]=v>>16; p[3]=v>>24; }
+
+static void wavHeader(uint8_t *h, uint32_t dataBytes, uint32_t samples)
+{
+	memcpy(h, "RIFF", 4);
+	put32(h+4, REC_HEADER_LEN-8+dataBytes);
+	memcpy(h+8, "WAVEfmt ", 8);
+	put32(h+16, 20);
+	put16(h+20, 0x11);									// IMA-ADPCM
+	put16(h+22, 1);
+	put32(h+24, REC_RATE);
+	put32(h+28, REC_RATE*REC_BLOCK_ALIGN/REC_BLOCK_SAMPLES);
+	put16(h+32, REC_BLOCK_ALIGN);
+	put16(h+34, 4);
+	put16(h+36, 2);
+	put16(h+38, REC_BLOCK_SAMPLES);
+	memcpy(h+40, "fact", 4);
+	put32(h+44, 4);
+	put32(h+48, samples);
+	memcpy(h+52, "data", 4);
+	put32(h+56, dataBytes);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	recorderInit
+Synopsis:
+	Reads [recorder] and hooks the recorder onto a channel's audio.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	unsigned int rate: capture sample rate
+	unsigned int blockFrames: capture samples per block
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void recorderInit(int idx, unsigned int rate, unsigned int blockFrames)
+{
+	recorder_t *rec=&recorders[idx];
+	char name[METRICS_NAME_LEN];
+	unsigned int ms;
+
+	(void)blockFrames;
+	memset(rec, 0, sizeof(*rec));
+	rec->fd=-1;
+	if (!iniparser_getboolean(ini, "recorder:enable", 0))
+		return;
+	if (rate%REC_RATE!=0)
+	{
+		fprintf(stderr, "Recorder needs a sample rate that is a multiple of %d\n", REC_RATE);
+		return;
+	}
+
+	snprintf(recDir, sizeof(recDir), "%s", iniparser_getstring(ini, "recorder:directory", DEFAULT_REC_DIR));
+	retentionDays=	iniparser_getint(ini, "recorder:retention_days", DEFAULT_REC_DAYS);
+	maxBytes=		(uint64_t)iniparser_getint(ini, "recorder:max_mb", DEFAULT_REC_MAX_MB)*1024*1024;
+	ms=				iniparser_getint(ini, "recorder:pre_roll_ms", DEFAULT_REC_PREROLL_MS);
+	if (ms>REC_MAX_PREROLL_MS)
+		ms=REC_MAX_PREROLL_MS;
+
+	if (mkdir(recDir, 0755)<0 && errno!=EEXIST)
+	{
+		fprintf(stderr, "Recorder: can't create %s: %s\n", recDir, strerror(errno));
+		return;
+	}
+	if (posix_memalign((void **)&rec->chunk, 4096, REC_CHUNK)!=0)
+		return;
+
+	rec->idx=idx;
+	rec->decim=rate/REC_RATE;
+	rec->prerollLen=REC_RATE*ms/1000;
+
+	snprintf(name, sizeof(name), "cosmon_recorder_recordings_total{channel=\"%d\"}", idx+1);
+	rec->mRecordings=metricsRegister(name, "Transmissions recorded", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_recorder_bytes_total{channel=\"%d\"}", idx+1);
+	rec->mBytes=metricsRegister(name, "Bytes written to recordings", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_recorder_airtime_ms_total{channel=\"%d\"}", idx+1);
+	rec->mAirtimeMs=metricsRegister(name, "Audio recorded, including pre-roll", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_recorder_bytes_per_airtime_hour{channel=\"%d\"}", idx+1);
+	rec->mBytesPerHour=metricsRegister(name, "Recording bytes written per hour of recorded audio", METRIC_GAUGE);
+	snprintf(name, sizeof(name), "cosmon_recorder_write_errors_total{channel=\"%d\"}", idx+1);
+	rec->mErrors=metricsRegister(name, "Recordings cut short by a write error", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_recorder_deleted_total{channel=\"%d\"}", idx+1);
+	rec->mDeleted=metricsRegister(name, "Recordings deleted by the retention rules", METRIC_COUNTER);
+
+	if (audioAddAnalyzer(idx, "recorder", recorderBlock, NULL)==0)
+		rec->enabled=true;
+}
+
+// Hands a full chunk to the card.  Always REC_CHUNK bytes at a REC_CHUNK aligned offset.
+static bool recorderFlushChunk(recorder_t *rec)
+{
+	if (write(rec->fd, rec->chunk, REC_CHUNK)!=REC_CHUNK)
+		return false;
+	rec->bytes+=REC_CHUNK;
+	rec->chunkFill=0;
+	return true;
+}
+
+static bool recorderPush(recorder_t *rec, const int16_t *samples, unsigned int n)
+{
+	uint8_t block[REC_BLOCK_ALIGN];
+	size_t part;
+	unsigned int i;
+
+	for (i=0; i<n; i++)
+	{
+		rec->pending[rec->pendingLen++]=samples[i];
+		if (rec->pendingLen<REC_BLOCK_SAMPLES)
+			continue;
+
+		imaEncodeBlock(rec->pending, block, &rec->index);
+		rec->pendingLen=0;
+		rec->samples+=REC_BLOCK_SAMPLES;
+
+		// The 60 byte header puts blocks off the chunk boundaries, so a
+		// block can straddle two chunks
+		part=REC_CHUNK-rec->chunkFill;
+		if (part>REC_BLOCK_ALIGN)
+			part=REC_BLOCK_ALIGN;
+		memcpy(rec->chunk+rec->chunkFill, block, part);
+		rec->chunkFill+=part;
+		if (rec->chunkFill==REC_CHUNK)
+		{
+			if (!recorderFlushChunk(rec))
+				return false;
+			memcpy(rec->chunk, block+part, REC_BLOCK_ALIGN-part);
+			rec->chunkFill=REC_BLOCK_ALIGN-part;
+		}
+	}
+	return true;
+}
+
+static void recorderOpen(recorder_t *rec)
+{
+	char stamp[32];
+	time_t t=time(NULL);
+	unsigned int i;
+
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&t));
+	snprintf(rec->path, sizeof(rec->path), "%s/ch%d-%s.wav", recDir, rec->idx+1, stamp);
+	// Never overwrite: a kerchunk or a fading mobile re-keys within the second
+	rec->fd=open(rec->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	for (i=2; rec->fd<0 && errno==EEXIST && i<=REC_MAX_SAME_SECOND; i++)
+	{
+		snprintf(rec->path, sizeof(rec->path), "%s/ch%d-%s-%u.wav", recDir, rec->idx+1, stamp, i);
+		rec->fd=open(rec->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	}
+	if (rec->fd<0)
+	{
+		// Once per transmission, not every block of it
+		fprintf(stderr, "Recorder: can't create %s: %s\n", rec->path, strerror(errno));
+		metricsInc(rec->mErrors);
+		rec->failed=true;
+		return;
+	}
+
+	rec->chunkFill=REC_HEADER_LEN;			// patched on close
+	rec->pendingLen=0;
+	rec->index=0;
+	rec->samples=0;
+	rec->bytes=0;
+
+	// Pre-roll first, oldest sample first
+	for (i=0; i<rec->prerollFill; i++)
+		recorderPush(rec, &rec->preroll[(rec->prerollPos+rec->prerollLen-rec->prerollFill+i)%rec->prerollLen], 1);
+	rec->prerollFill=0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	recorderRetention
+Synopsis:
+	Deletes recordings older than retention_days, then the oldest ones
+	until the directory is under max_mb.
+Author:
+	agent
+Inputs:
+	recorder_t *rec: for the metrics
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+typedef struct
+{
+	time_t		mtime;
+	off_t		size;
+	char		name[64];
+} recFile_t;
+
+static int recFileCmp(const void *a, const void *b)
+{
+	const recFile_t *fa=a, *fb=b;
+
+	return fa->mtime<fb->mtime ? -1 : fa->mtime>fb->mtime;
+}
+
+static void recorderRetention(recorder_t *rec)
+{
+	static recFile_t files[REC_MAX_FILES];
+	char path[REC_DIR_LEN+NAME_MAX+2];
+	struct dirent *de;
+	struct stat st;
+	time_t oldest=time(NULL)-(time_t)retentionDays*86400;
+	uint64_t total=0;
+	int n=0, i;
+	DIR *dir;
+
+	dir=opendir(recDir);
+	if (dir==NULL)
+		return;
+	while ((de=readdir(dir))!=NULL && n<REC_MAX_FILES)
+	{
+		if (strncmp(de->d_name, "ch", 2)!=0 || strstr(de->d_name, ".wav")==NULL ||
+			strlen(de->d_name)>=sizeof(files[0].name))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", recDir, de->d_name);
+		if (stat(path, &st)<0 || !S_ISREG(st.st_mode))
+			continue;
+		if (retentionDays && st.st_mtime<oldest)
+		{
+			if (unlink(path)==0)
+				metricsInc(rec->mDeleted);
+			continue;
+		}
+		files[n].mtime=st.st_mtime;
+		files[n].size=st.st_size;
+		memcpy(files[n].name, de->d_name, strlen(de->d_name)+1);
+		total+=st.st_size;
+		n++;
+	}
+	closedir(dir);
+
+	qsort(files, n, sizeof(files[0]), recFileCmp);
+	for (i=0; i<n && total>maxBytes; i++)
+	{
+		snprintf(path, sizeof(path), "%s/%s", recDir, files[i].name);
+		if (unlink(path)==0)
+		{
+			metricsInc(rec->mDeleted);
+			total-=files[i].size;
+		}
+	}
+}
+
+static void recorderClose(recorder_t *rec)
+{
+	uint8_t header[REC_HEADER_LEN];
+	uint64_t ms, airtimeMs;
+	size_t tail;
+	bool ok=true;
+
+	// Last partial block, padded with its last sample (the fact chunk has the real length)
+	if (rec->pendingLen)
+	{
+		uint64_t real=rec->samples+rec->pendingLen;
+
+		while (ok && rec->pendingLen)
+			ok=recorderPush(rec, &rec->pending[rec->pendingLen-1], 1);
+		rec->samples=real;
+	}
+
+	tail=rec->chunkFill;
+	if (ok && tail && write(rec->fd, rec->chunk, tail)!=(ssize_t)tail)
+		ok=false;
+	rec->bytes+=tail;
+
+	wavHeader(header, rec->bytes-REC_HEADER_LEN, rec->samples);
+	if (ok && pwrite(rec->fd, header, sizeof(header), 0)!=sizeof(header))
+		ok=false;
+	close(rec->fd);
+	rec->fd=-1;
+
+	ms=rec->samples*1000/REC_RATE;
+	if (!ok)
+	{
+		fprintf(stderr, "Recorder: write to %s failed\n", rec->path);
+		metricsInc(rec->mErrors);
+	}
+	printf("Recorded channel %d: %.1f s, %llu bytes, %s\n", rec->idx+1, ms/1000.0,
+		   (unsigned long long)rec->bytes, rec->path);
+
+	metricsInc(rec->mRecordings);
+	metricsAdd(rec->mBytes, rec->bytes);
+	metricsAdd(rec->mAirtimeMs, ms);
+	airtimeMs=rec->mAirtimeMs ? rec->mAirtimeMs->count : 0;
+	if (airtimeMs && rec->mBytes)
+		metricsSet(rec->mBytesPerHour, (double)rec->mBytes->count*3600000.0/airtimeMs);
+
+	recorderRetention(rec);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	recorderBlock
+Synopsis:
+	Analyzer callback.  Decimates to 8 kHz, then either feeds the pre-roll
+	or the open recording.  A lost or torn block goes in as silence so
+	the recording keeps time.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+	const int16_t *samples: mono S16 samples
+	unsigned int n: number of samples
+	uint64_t captureUs: when the block was complete
+	bool valid: false if the block was lost before the call
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void recorderBlock(int idx, const int16_t *samples, unsigned int n, uint64_t captureUs, bool valid)
+{
+	recorder_t *rec=&recorders[idx];
+	int16_t out[AUDIO_BLOCK_MS*REC_RATE/1000];
+	unsigned int i, j, m=n/rec->decim;
+	chState_t state=__atomic_load_n(&channels[idx].state, __ATOMIC_RELAXED);
+	bool keyed=(state==CH_KEYED || state==CH_HANG);
+	int32_t sum;
+
+	(void)captureUs;
+	if (m>sizeof(out)/sizeof(out[0]))
+		m=sizeof(out)/sizeof(out[0]);
+	for (i=0; i<m && valid; i++)
+	{
+		sum=0;
+		for (j=0; j<rec->decim; j++)
+			sum+=samples[i*rec->decim+j];
+		out[i]=sum/(int32_t)rec->decim;
+	}
+	if (!valid || !audioBlockIntact())
+		memset(out, 0, m*sizeof(out[0]));
+
+	if (!keyed)
+		rec->failed=false;
+	if (rec->fd<0 && keyed && !rec->failed)
+		recorderOpen(rec);
+
+	if (rec->fd<0)
+	{
+		for (i=0; i<m && rec->prerollLen; i++)
+		{
+			rec->preroll[rec->prerollPos]=out[i];
+			rec->prerollPos=(rec->prerollPos+1)%rec->prerollLen;
+			if (rec->prerollFill<rec->prerollLen)
+				rec->prerollFill++;
+		}
+		return;
+	}
+
+	if (!recorderPush(rec, out, m))
+	{
+		rec->failed=true;
+		recorderClose(rec);
+	}
+	else if (!keyed)
+		recorderClose(rec);
+}
@@ -0,0 +1,554 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  repeat.c
+*
+*  Synopsis:	Local repeat fallback for the two HT mini-repeater.  While
+*				Asterisk is down, the RX channel's state machine (attack, COS
+*				timeout and all) keys the TX radio directly through a GPIO or a
+*				CM108 GPIO over hidraw, with its own tail and TX timeout, and
+*				RX audio is copied to the TX FOB through ALSA mmap with a few
+*				ms of buffering (into both channels: CM108 playback is stereo
+*				only).  Asterisk coming back ends it.
+*
+*				The audio thread opens the FOBs only while local repeat is
+*				active so chan_simpleusb gets them back when Asterisk returns.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+#include <iniparser.h>
+
+#include "repeat.h"
+#include "gpio.h"
+#include "channel.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+#include "mqtt.h"
+
+#define REPEAT_POLL_MS					20
+#define REPEAT_LATENCY_MS				100			// how often the audio path is measured
+#define REPEAT_RETRY_US					1000000		// reopen the FOBs after a failure
+#define REPEAT_DEVICE_LEN				64
+#define DEFAULT_REPEAT_CAPTURE			"hw:CARD=Device"
+#define DEFAULT_REPEAT_PLAYBACK			"hw:CARD=Device_1"
+#define DEFAULT_REPEAT_RATE				48000
+#define DEFAULT_REPEAT_PERIOD			96			// frames, 2 ms at 48 kHz
+#define DEFAULT_REPEAT_TAKEOVER_MS		5000
+#define DEFAULT_REPEAT_HANG_MS			1500
+#define DEFAULT_REPEAT_TIMEOUT_MS		180000
+
+typedef enum
+{
+	PTT_NONE=0,
+	PTT_GPIO,
+	PTT_CM108
+} repeatPtt_t;
+
+static struct
+{
+	bool			enabled;
+	bool			asteriskDown;
+	bool			active;				// read by the audio thread
+	bool			passAudio;			// read by the audio thread
+	int				rxIdx;
+
+	repeatPtt_t		pttType;
+	int				pttGpio;			// wiringPi pin, or CM108 GPIO 1..8
+	int				pttFd;				// CM108 hidraw
+	bool			ptt;
+	bool			timedOut;			// held off until RX drops
+	uint64_t		keyedUs;
+	uint64_t		tailUs;				// 0: not in the tail
+	uint64_t		hangUs;
+	uint64_t		timeoutUs;
+
+	int				takeoverTimer;
+	int				pollTimer;
+	uint32_t		takeoverMs;
+
+	char			captureDevice[REPEAT_DEVICE_LEN];
+	char			playbackDevice[REPEAT_DEVICE_LEN];
+	unsigned int	rate;
+	unsigned int	capChannels;		// what the FOBs settled on, RX uses the first
+	unsigned int	playChannels;
+	snd_pcm_uframes_t period;
+	pthread_t		thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	wake;
+
+	metric_t		*mActive;
+	metric_t		*mTakeovers;
+	metric_t		*mKeyups;
+	metric_t		*mTimeouts;
+	metric_t		*mLatency;
+	metric_t		*mLatencyGauge;
+	metric_t		*mXruns;
+} rp={ .lock=PTHREAD_MUTEX_INITIALIZER, .wake=PTHREAD_COND_INITIALIZER, .pttFd=-1 };
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	repeatSetPtt
+Synopsis:
+	Keys / unkeys the TX radio.  CM108: HID output report 0, bytes are
+	report id, reserved, GPIO data, GPIO direction mask, reserved.
+Author:
+	agent
+Inputs:
+	bool on: key
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void repeatSetPtt(bool on)
+{
+	uint8_t report[5]={ 0 };
+
+	rp.ptt=on;
+	if (rp.pttType==PTT_GPIO)
+		digitalWrite(rp.pttGpio, on ? HIGH : LOW);
+	else if (rp.pttType==PTT_CM108 && rp.pttFd>=0)
+	{
+		report[3]=1<<(rp.pttGpio-1);
+		report[2]=on ? report[3] : 0;
+		if (write(rp.pttFd, report, sizeof(report))!=(ssize_t)sizeof(report))
+			fprintf(stderr, "Local repeat: CM108 PTT write failed\n");
+	}
+	mqttState("local_repeat/ptt", on ? "1" : "0");
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	repeatPollHandler
+Synopsis:
+	Every REPEAT_POLL_MS while active.  RX keyed (as far as its channel
+	state machine is concerned) keys TX, RX dropping starts the tail.  TX
+	on too long drops PTT until RX lets go.
+Author:
+	agent
+Inputs:
+	standard evloop timer handler args
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void repeatPollHandler(uint64_t expirations, void *ctx)
+{
+	bool rx=channelKeyed(&channels[rp.rxIdx]);
+	uint64_t now=evloopNowUs();
+
+	(void)expirations;
+	(void)ctx;
+
+	if (!rx)
+		rp.timedOut=false;
+	__atomic_store_n(&rp.passAudio, rx && !rp.timedOut, __ATOMIC_RELAXED);
+
+	if (rx && !rp.timedOut)
+	{
+		rp.tailUs=0;
+		if (!rp.ptt)
+		{
+			rp.keyedUs=now;
+			metricsInc(rp.mKeyups);
+			repeatSetPtt(true);
+		}
+		else if (now-rp.keyedUs>=rp.timeoutUs)
+		{
+			printf("Local repeat: TX timeout\n");
+			metricsInc(rp.mTimeouts);
+			rp.timedOut=true;
+			repeatSetPtt(false);
+		}
+	}
+	else if (rp.ptt)
+	{
+		if (rp.tailUs==0)
+			rp.tailUs=now+rp.hangUs;
+		else if (now>=rp.tailUs)
+		{
+			rp.tailUs=0;
+			repeatSetPtt(false);
+		}
+	}
+}
+
+static void repeatSetActive(bool active)
+{
+	pthread_mutex_lock(&rp.lock);
+	__atomic_store_n(&rp.active, active, __ATOMIC_RELAXED);
+	pthread_cond_signal(&rp.wake);
+	pthread_mutex_unlock(&rp.lock);
+	metricsSet(rp.mActive, active);
+	mqttState("local_repeat", active ? "active" : "off");
+}
+
+// Asterisk has been gone for takeover_ms
+static void repeatTakeoverHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	if (!rp.asteriskDown)
+		return;
+
+	printf("Asterisk down, local repeat active\n");
+	metricsInc(rp.mTakeovers);
+	rp.tailUs=0;
+	rp.timedOut=channelKeyed(&channels[rp.rxIdx]);		// don't key up mid-transmission
+	repeatSetActive(true);
+	evloopArmTimer(rp.pollTimer, REPEAT_POLL_MS, REPEAT_POLL_MS);
+}
+
+void repeatAsteriskDown(void)
+{
+	if (!rp.enabled || rp.asteriskDown)
+		return;
+	rp.asteriskDown=true;
+	evloopArmTimer(rp.takeoverTimer, rp.takeoverMs, 0);
+}
+
+// Exiting or shutting down: the TX must not be left keyed with nothing to time it out
+void repeatRestore(void)
+{
+	if (!rp.enabled)
+		return;
+	rp.enabled=false;			// no takeover from here on
+	evloopArmTimer(rp.takeoverTimer, 0, 0);
+	evloopArmTimer(rp.pollTimer, 0, 0);
+	__atomic_store_n(&rp.passAudio, false, __ATOMIC_RELAXED);
+	if (rp.active)
+		repeatSetActive(false);
+	repeatSetPtt(false);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	repeatAsteriskUp
+Synopsis:
+	Asterisk is back: unkey, let go of the FOBs and hand the node back.
+	Called before the channels resync with Asterisk.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void repeatAsteriskUp(void)
+{
+	if (!rp.enabled || !rp.asteriskDown)
+		return;
+	rp.asteriskDown=false;
+	evloopArmTimer(rp.takeoverTimer, 0, 0);
+	if (!rp.active)
+		return;
+
+	evloopArmTimer(rp.pollTimer, 0, 0);
+	if (rp.ptt)
+		repeatSetPtt(false);
+	__atomic_store_n(&rp.passAudio, false, __ATOMIC_RELAXED);
+	repeatSetActive(false);
+	printf("Local repeat handed back to Asterisk\n");
+}
+
+/*-----------------------------------------------------------------------------
+	Audio path
+-----------------------------------------------------------------------------*/
+static int repeatOpenPcm(snd_pcm_t **pcm, const char *device, snd_pcm_stream_t stream, unsigned int *channels)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_uframes_t period=rp.period, buffer=rp.period*3;
+	int err, dir=0;
+
+	err=snd_pcm_open(pcm, device, stream, 0);
+	if (err<0)
+		return err;
+
+	// mmap, S16, three short periods.  Mono if the device does it, hw: on a
+	// CM108 only plays stereo and plughw: would add a copy and buffering.
+	*channels=1;
+	snd_pcm_hw_params_malloc(&hw);
+	if ((err=snd_pcm_hw_params_any(*pcm, hw))<0 ||
+		(err=snd_pcm_hw_params_set_access(*pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED))<0 ||
+		(err=snd_pcm_hw_params_set_format(*pcm, hw, SND_PCM_FORMAT_S16_LE))<0 ||
+		(err=snd_pcm_hw_params_set_channels_near(*pcm, hw, channels))<0 ||
+		(err=snd_pcm_hw_params_set_rate(*pcm, hw, rp.rate, 0))<0 ||
+		(err=snd_pcm_hw_params_set_period_size_near(*pcm, hw, &period, &dir))<0 ||
+		(err=snd_pcm_hw_params_set_buffer_size_near(*pcm, hw, &buffer))<0 ||
+		(err=snd_pcm_hw_params(*pcm, hw))<0)
+	{
+		snd_pcm_hw_params_free(hw);
+		snd_pcm_close(*pcm);
+		return err;
+	}
+	snd_pcm_hw_params_free(hw);
+	return snd_pcm_prepare(*pcm);
+}
+
+static inline int16_t *repeatFrames(const snd_pcm_channel_area_t *area, snd_pcm_uframes_t offset)
+{
+	return (int16_t *)((uint8_t *)area->addr+(area->first+offset*area->step)/8);
+}
+
+// RX (its first channel) into every TX channel, or silence if in is NULL
+static void repeatCopy(int16_t *out, const int16_t *in, snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t i;
+	unsigned int c;
+
+	if (rp.capChannels==1 && rp.playChannels==1)
+	{
+		if (in)
+			memcpy(out, in, frames*sizeof(int16_t));
+		else
+			memset(out, 0, frames*sizeof(int16_t));
+		return;
+	}
+	for (i=0; i<frames; i++)
+	{
+		for (c=0; c<rp.playChannels; c++)
+			*out++=(in ? in[i*rp.capChannels] : 0);
+	}
+}
+
+// Playback primed with silence, both started together
+static int repeatStartPcms(snd_pcm_t *cap, snd_pcm_t *play)
+{
+	const snd_pcm_channel_area_t *pa;
+	snd_pcm_uframes_t poff, frames=rp.period*2;
+	int err;
+
+	snd_pcm_drop(cap);
+	snd_pcm_drop(play);
+	if ((err=snd_pcm_prepare(cap))<0 || (err=snd_pcm_prepare(play))<0)
+		return err;
+	if ((err=snd_pcm_mmap_begin(play, &pa, &poff, &frames))<0)
+		return err;
+	repeatCopy(repeatFrames(pa, poff), NULL, frames);
+	snd_pcm_mmap_commit(play, poff, frames);
+	if ((err=snd_pcm_start(play))<0)
+		return err;
+	return snd_pcm_start(cap);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	repeatAudioRun
+Synopsis:
+	Copies RX capture to TX playback straight between the two mmap
+	buffers until local repeat ends.  Silence goes out while RX isn't
+	keyed.  Any xrun restarts both with the playback primed, which keeps
+	the latency where it started.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	0 when local repeat ended, -1 if the FOBs couldn't be opened
+-----------------------------------------------------------------------------*/
+static int repeatAudioRun(void)
+{
+	const snd_pcm_channel_area_t *ca, *pa;
+	snd_pcm_t *cap, *play;
+	snd_pcm_sframes_t avail, pavail, cdelay, pdelay;
+	snd_pcm_uframes_t frames, coff, poff;
+	uint64_t lastMeasure=0, now, latencyUs;
+	int err;
+
+	if ((err=repeatOpenPcm(&cap, rp.captureDevice, SND_PCM_STREAM_CAPTURE, &rp.capChannels))<0)
+	{
+		fprintf(stderr, "Local repeat: can't open %s: %s\n", rp.captureDevice, snd_strerror(err));
+		return -1;
+	}
+	if ((err=repeatOpenPcm(&play, rp.playbackDevice, SND_PCM_STREAM_PLAYBACK, &rp.playChannels))<0)
+	{
+		fprintf(stderr, "Local repeat: can't open %s: %s\n", rp.playbackDevice, snd_strerror(err));
+		snd_pcm_close(cap);
+		return -1;
+	}
+	err=repeatStartPcms(cap, play);
+
+	while (err>=0 && __atomic_load_n(&rp.active, __ATOMIC_RELAXED))
+	{
+		if (snd_pcm_wait(cap, 100)<0 ||
+			(avail=snd_pcm_avail_update(cap))<0 || (pavail=snd_pcm_avail_update(play))<0)
+		{
+			metricsInc(rp.mXruns);
+			err=repeatStartPcms(cap, play);
+			continue;
+		}
+
+		// Playback can only be as far ahead as it was primed
+		if (avail>pavail)
+			avail=pavail;
+		while (avail>0)
+		{
+			frames=avail;
+			if (snd_pcm_mmap_begin(cap, &ca, &coff, &frames)<0 ||
+				snd_pcm_mmap_begin(play, &pa, &poff, &frames)<0)
+				break;
+			repeatCopy(repeatFrames(pa, poff),
+					   __atomic_load_n(&rp.passAudio, __ATOMIC_RELAXED) ? repeatFrames(ca, coff) : NULL, frames);
+			snd_pcm_mmap_commit(cap, coff, frames);
+			snd_pcm_mmap_commit(play, poff, frames);
+			avail-=frames;
+		}
+
+		// RX mic to TX speaker: what's in capture plus what's queued for playback
+		now=evloopNowUs();
+		if (now-lastMeasure>=REPEAT_LATENCY_MS*1000 &&
+			snd_pcm_delay(cap, &cdelay)==0 && snd_pcm_delay(play, &pdelay)==0 && cdelay+pdelay>=0)
+		{
+			lastMeasure=now;
+			latencyUs=(uint64_t)(cdelay+pdelay)*1000000/rp.rate;
+			metricsObserve(rp.mLatency, latencyUs);
+			metricsSet(rp.mLatencyGauge, latencyUs/1000.0);
+		}
+	}
+	if (err<0)
+		fprintf(stderr, "Local repeat: audio stopped: %s\n", snd_strerror(err));
+
+	snd_pcm_drop(play);
+	snd_pcm_close(play);
+	snd_pcm_close(cap);
+	return err<0 ? -1 : 0;
+}
+
+static void *repeatAudioThread(void *arg)
+{
+	(void)arg;
+	for (;;)
+	{
+		pthread_mutex_lock(&rp.lock);
+		while (!rp.active)
+			pthread_cond_wait(&rp.wake, &rp.lock);
+		pthread_mutex_unlock(&rp.lock);
+
+		if (repeatAudioRun()<0)
+			usleep(REPEAT_RETRY_US);
+	}
+	return NULL;
+}
+
+// "gpio:<wiringPi pin>" or "cm108:<hidraw device>:<GPIO 1-8>"
+static int repeatParsePtt(const char *ptt)
+{
+	char dev[REPEAT_DEVICE_LEN];
+	const char *colon;
+
+	if (strncmp(ptt, "gpio:", 5)==0)
+	{
+		rp.pttType=PTT_GPIO;
+		rp.pttGpio=atoi(ptt+5);
+		pinMode(rp.pttGpio, OUTPUT);
+		digitalWrite(rp.pttGpio, LOW);
+		return 0;
+	}
+	if (strncmp(ptt, "cm108:", 6)==0 && (colon=strrchr(ptt, ':'))>ptt+6)
+	{
+		snprintf(dev, sizeof(dev), "%.*s", (int)(colon-(ptt+6)), ptt+6);
+		rp.pttGpio=atoi(colon+1);
+		if (rp.pttGpio<1 || rp.pttGpio>8)
+			return -1;
+		rp.pttType=PTT_CM108;
+		rp.pttFd=open(dev, O_WRONLY | O_CLOEXEC);
+		if (rp.pttFd<0)
+		{
+			fprintf(stderr, "Local repeat: can't open %s\n", dev);
+			return -1;
+		}
+		return 0;
+	}
+	return -1;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	repeatInit
+Synopsis:
+	Reads [local repeat], sets up PTT and the audio thread.  Nothing runs
+	until Asterisk goes away.  Call after the GPIOs are set up.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void repeatInit(void)
+{
+	if (!iniparser_getboolean(ini, "local repeat:enable", 0))
+		return;
+
+	rp.rxIdx=iniparser_getint(ini, "local repeat:rx_channel", 1)-1;
+	if (rp.rxIdx<0 || rp.rxIdx>=MAX_CHANNELS || !channels[rp.rxIdx].enabled)
+	{
+		fprintf(stderr, "Local repeat: rx_channel isn't enabled, local repeat disabled\n");
+		return;
+	}
+	if (repeatParsePtt(iniparser_getstring(ini, "local repeat:ptt", ""))<0)
+	{
+		fprintf(stderr, "Local repeat: bad ptt, local repeat disabled\n");
+		return;
+	}
+
+	snprintf(rp.captureDevice, sizeof(rp.captureDevice), "%s",
+			 iniparser_getstring(ini, "local repeat:capture_device", DEFAULT_REPEAT_CAPTURE));
+	snprintf(rp.playbackDevice, sizeof(rp.playbackDevice), "%s",
+			 iniparser_getstring(ini, "local repeat:playback_device", DEFAULT_REPEAT_PLAYBACK));
+	rp.rate=		iniparser_getint(ini, "local repeat:sample_rate", DEFAULT_REPEAT_RATE);
+	rp.period=		iniparser_getint(ini, "local repeat:period_frames", DEFAULT_REPEAT_PERIOD);
+	rp.takeoverMs=	iniparser_getint(ini, "local repeat:takeover_ms", DEFAULT_REPEAT_TAKEOVER_MS);
+	rp.hangUs=		(uint64_t)iniparser_getint(ini, "local repeat:hang_ms", DEFAULT_REPEAT_HANG_MS)*1000;
+	rp.timeoutUs=	(uint64_t)iniparser_getint(ini, "local repeat:tx_timeout_ms", DEFAULT_REPEAT_TIMEOUT_MS)*1000;
+	if (rp.takeoverMs<1)
+		rp.takeoverMs=1;
+
+	rp.mActive=			metricsRegister("cosmon_local_repeat_active", "1 while COSmon is repeating locally without Asterisk", METRIC_GAUGE);
+	rp.mTakeovers=		metricsRegister("cosmon_local_repeat_takeovers_total", "Times local repeat took over from Asterisk", METRIC_COUNTER);
+	rp.mKeyups=			metricsRegister("cosmon_local_repeat_keyups_total", "TX key-ups while repeating locally", METRIC_COUNTER);
+	rp.mTimeouts=		metricsRegister("cosmon_local_repeat_timeouts_total", "Local repeat TX timeouts", METRIC_COUNTER);
+	rp.mLatency=		metricsRegister("cosmon_local_repeat_latency_us", "Local repeat RX to TX audio latency", METRIC_HISTOGRAM);
+	rp.mLatencyGauge=	metricsRegister("cosmon_local_repeat_latency_ms", "Last local repeat RX to TX audio latency", METRIC_GAUGE);
+	rp.mXruns=			metricsRegister("cosmon_local_repeat_xruns_total", "Local repeat audio under / overruns", METRIC_COUNTER);
+
+	rp.takeoverTimer=	evloopAddTimer(0, 0, repeatTakeoverHandler, NULL);
+	rp.pollTimer=		evloopAddTimer(0, 0, repeatPollHandler, NULL);
+	if (rp.takeoverTimer<0 || rp.pollTimer<0 || pthread_create(&rp.thread, NULL, repeatAudioThread, NULL)!=0)
+	{
+		fprintf(stderr, "Local repeat: can't start, disabled\n");
+		return;
+	}
+	rp.enabled=true;
+	printf("Local repeat: channel %d to %s after %u ms without Asterisk\n", rp.rxIdx+1, rp.playbackDevice, rp.takeoverMs);
+}
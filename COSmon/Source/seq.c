@@ -0,0 +1,258 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  seq.c
+*
+*  Synopsis:	Stackless coroutines ("sequences") for COSmon's multi-step flows:
+*				start-up, Asterisk reconnect and shutdown.  Each step can
+*				have a timeout and waits are timers on the event loop, so a
+*				slow astdn.sh or a missing Asterisk never stalls COS
+*				handling.  How long every step took goes to the metrics.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "seq.h"
+#include "evloop.h"
+
+extern char **environ;
+
+static void seqRun(seq_t *sq)
+{
+	if (sq->running)
+		sq->func(sq);
+}
+
+static void seqTimerHandler(uint64_t expirations, void *ctx)
+{
+	seq_t *sq=(seq_t *)ctx;
+
+	(void)expirations;
+	sq->sleeping=false;
+	seqRun(sq);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	seqInit
+Synopsis:
+	Sets up a sequence.  Call once at start-up, before the loop runs.
+Author:
+	agent
+Inputs:
+	seq_t *sq: sequence
+	const char *name: used in metrics and log messages (literal)
+	seqFunc_t func: the sequence body
+	void *ctx: whatever the body needs
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void seqInit(seq_t *sq, const char *name, seqFunc_t func, void *ctx)
+{
+	char metricName[METRICS_NAME_LEN];
+
+	memset(sq, 0, sizeof(*sq));
+	sq->name=name;
+	sq->func=func;
+	sq->ctx=ctx;
+	sq->step=-1;
+	sq->timerFd=evloopAddTimer(0, 0, seqTimerHandler, sq);
+
+	snprintf(metricName, sizeof(metricName), "cosmon_seq_timeouts_total{seq=\"%s\"}", name);
+	sq->mTimeouts=metricsRegister(metricName, "Sequence steps that hit their timeout", METRIC_COUNTER);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	seqStart
+Synopsis:
+	(Re)starts a sequence from the top and runs it up to its first wait.
+Author:
+	agent
+Inputs:
+	seq_t *sq: sequence
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void seqStart(seq_t *sq)
+{
+	sq->resume=0;
+	sq->step=-1;
+	sq->timedOut=false;
+	sq->sleeping=false;
+	sq->stepDeadlineUs=0;
+	sq->running=true;
+	seqRun(sq);
+}
+
+// Something the sequence may be waiting on happened, re-check now instead of at the next poll
+void seqWake(seq_t *sq)
+{
+	if (sq->running && !sq->sleeping)
+		seqRun(sq);
+}
+
+bool seqRunning(const seq_t *sq)
+{
+	return sq->running;
+}
+
+static void seqCloseStep(seq_t *sq)
+{
+	if (sq->step<0)
+		return;
+	metricsSet(sq->steps[sq->step].mDuration, (evloopNowUs()-sq->stepStartUs)/1e6);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	seqStep
+Synopsis:
+	Ends the current step (recording its duration) and starts a new one.
+Author:
+	agent
+Inputs:
+	seq_t *sq: sequence
+	const char *step: step name (literal)
+	uint32_t timeoutMs: how long SEQ_WAIT_UNTIL waits in this step, 0=forever
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void seqStep(seq_t *sq, const char *step, uint32_t timeoutMs)
+{
+	char metricName[METRICS_NAME_LEN];
+	int i;
+
+	seqCloseStep(sq);
+
+	for (i=0; i<sq->numSteps; i++)
+	{
+		if (sq->steps[i].name==step)
+			break;
+	}
+	if (i==sq->numSteps && i<SEQ_MAX_STEPS)
+	{
+		// first time through this step, give it a metric
+		snprintf(metricName, sizeof(metricName), "cosmon_seq_step_seconds{seq=\"%s\",step=\"%s\"}", sq->name, step);
+		sq->steps[i].name=step;
+		sq->steps[i].mDuration=metricsRegister(metricName, "How long the last run of a sequence step took", METRIC_GAUGE);
+		sq->numSteps++;
+	}
+	sq->step=(i<SEQ_MAX_STEPS) ? i : -1;
+
+	sq->stepStartUs=evloopNowUs();
+	sq->stepDeadlineUs=timeoutMs ? sq->stepStartUs+(uint64_t)timeoutMs*1000 : 0;
+	sq->timedOut=false;
+}
+
+void seqSleep(seq_t *sq, uint32_t ms)
+{
+	sq->sleeping=true;
+	evloopArmTimer(sq->timerFd, ms ? ms : 1, 0);
+}
+
+void seqPoll(seq_t *sq)
+{
+	sq->sleeping=false;
+	evloopArmTimer(sq->timerFd, SEQ_POLL_MS, 0);
+}
+
+bool seqStepExpired(seq_t *sq)
+{
+	if (sq->stepDeadlineUs==0 || evloopNowUs()<sq->stepDeadlineUs)
+		return false;
+
+	fprintf(stderr, "%s: step %s timed out\n", sq->name, sq->step>=0 ? sq->steps[sq->step].name : "?");
+	metricsInc(sq->mTimeouts);
+	sq->timedOut=true;
+	return true;
+}
+
+void seqFinish(seq_t *sq)
+{
+	seqCloseStep(sq);
+	sq->step=-1;
+	sq->running=false;
+	evloopArmTimer(sq->timerFd, 0, 0);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	seqSpawn
+Synopsis:
+	Starts a program without waiting for it (system() would block the loop).
+	Pair with SEQ_WAIT_UNTIL(sq, seqChildExited(pid)).
+Author:
+	agent
+Inputs:
+	const char *path: program to run, no arguments
+Outputs:
+	pid of the child or -1
+-----------------------------------------------------------------------------*/
+pid_t seqSpawn(const char *path)
+{
+	pid_t pid;
+	char *argv[2];
+	posix_spawnattr_t attr;
+	sigset_t noSignals;
+	int ret;
+
+	argv[0]=(char *)path;
+	argv[1]=NULL;
+
+	// We block signals for the signalfd, don't let the child inherit that
+	sigemptyset(&noSignals);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &noSignals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	ret=posix_spawn(&pid, path, NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	if (ret!=0)
+	{
+		fprintf(stderr, "Can't run %s\n", path);
+		return -1;
+	}
+	return pid;
+}
+
+bool seqChildExited(pid_t pid)
+{
+	pid_t ret;
+
+	if (pid<=0)
+		return true;
+	ret=waitpid(pid, NULL, WNOHANG);
+	return ret==pid || (ret<0 && errno==ECHILD);
+}
@@ -0,0 +1,118 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  seq.h
+*
+*  Synopsis:	Header file for seq.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _SEQ
+#define _SEQ
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "metrics.h"
+
+#define SEQ_WAITING			0
+#define SEQ_DONE			1
+#define SEQ_MAX_STEPS		8
+#define SEQ_POLL_MS			100		// how often SEQ_WAIT_UNTIL re-checks its condition
+
+/*
+	Stackless sequences (protothread style) run off the event loop.
+
+	A sequence function is re-entered from the top every time it is resumed
+	and jumps back to where it left off with a switch on the line number, so
+	locals do NOT survive a wait.  Keep state in the seq ctx or statics.
+
+	static int mySeq(seq_t *sq)
+	{
+		SEQ_BEGIN(sq);
+		seqStep(sq, "first", 5000);
+		SEQ_WAIT_UNTIL(sq, somethingReady());
+		if (SEQ_TIMED_OUT(sq))
+			...
+		SEQ_SLEEP(sq, 1000);
+		SEQ_END(sq);
+	}
+*/
+#define SEQ_BEGIN(sq)			switch ((sq)->resume) { case 0:
+
+#define SEQ_END(sq)				} seqFinish(sq); return SEQ_DONE
+
+#define SEQ_SLEEP(sq, ms)		do { seqSleep((sq), (ms)); (sq)->resume=__LINE__; return SEQ_WAITING; \
+									 case __LINE__:; } while (0)
+
+#define SEQ_WAIT_UNTIL(sq, cond) \
+								do { (sq)->resume=__LINE__; __attribute__((fallthrough)); case __LINE__: \
+									 if (!(cond) && !seqStepExpired(sq)) { seqPoll(sq); \
+									 return SEQ_WAITING; } } while (0)
+
+#define SEQ_TIMED_OUT(sq)		((sq)->timedOut)
+
+typedef struct seq_s seq_t;
+typedef int (*seqFunc_t)(seq_t *sq);
+
+typedef struct
+{
+	const char	*name;
+	metric_t	*mDuration;
+} seqStepInfo_t;
+
+struct seq_s
+{
+	const char		*name;
+	seqFunc_t		func;
+	void			*ctx;
+	uint16_t		resume;				// line to resume at, 0 = top
+	bool			running;
+	bool			sleeping;			// in SEQ_SLEEP, ignore seqWake()
+	bool			timedOut;			// current step ran past its timeout
+	int				timerFd;
+	int				step;				// index into steps[], -1 = none yet
+	uint64_t		stepStartUs;
+	uint64_t		stepDeadlineUs;		// 0 = no timeout
+	seqStepInfo_t	steps[SEQ_MAX_STEPS];
+	int				numSteps;
+	metric_t		*mTimeouts;
+};
+
+void seqInit(seq_t *sq, const char *name, seqFunc_t func, void *ctx);
+void seqStart(seq_t *sq);
+void seqWake(seq_t *sq);
+bool seqRunning(const seq_t *sq);
+void seqStep(seq_t *sq, const char *step, uint32_t timeoutMs);
+void seqSleep(seq_t *sq, uint32_t ms);
+void seqPoll(seq_t *sq);
+bool seqStepExpired(seq_t *sq);
+void seqFinish(seq_t *sq);
+pid_t seqSpawn(const char *path);
+bool seqChildExited(pid_t pid);
+
+#endif
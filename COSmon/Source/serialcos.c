@@ -0,0 +1,464 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  serialcos.c
+*
+*  Synopsis:	COS (and optionally PTT sense) from a USB serial adapter's modem
+*				status lines, for nodes without a GPIO header.  A thread per port
+*				sleeps in TIOCMIWAIT, timestamps each change and hands it to the
+*				event loop through a small ring and an eventfd, so the channel
+*				state machine sees the edge with the time it actually happened.
+*				RTS and DTR can drive LEDs (COS or network status).
+*
+*				device = "sim:/path" reads a FIFO or pty instead: C / c sets /
+*				clears COS, P / p PTT.  Handy on the bench, e.g.
+*				mkfifo /tmp/cos; echo C > /tmp/cos
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/serial.h>
+#include <iniparser.h>
+
+#include "serialcos.h"
+#include "channel.h"
+#include "dutycycle.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define SERIAL_RING			64				// edges between two loop passes
+#define SERIAL_SIM_PREFIX	"sim:"
+
+typedef struct
+{
+	uint64_t	us;
+	bool		ptt;				// else COS
+	bool		level;
+} serialEdge_t;
+
+typedef struct
+{
+	bool			enabled;
+	bool			sim;
+	int				idx;
+	int				fd;
+	int				eventFd;
+	int				cosBit;			// TIOCM_* input lines
+	int				pttBit;			// 0: not wired
+	bool			activeLow;
+	bool			cos;			// latest levels, read by the loop
+	bool			ptt;
+	uint32_t		lastICount;		// interrupt count of the COS line
+	pthread_t		thread;
+	serialEdge_t	ring[SERIAL_RING];
+	uint32_t		head;			// written by the thread
+	uint32_t		tail;			// written by the loop
+
+	metric_t		*mEdges;
+	metric_t		*mGlitches;
+	metric_t		*mOverruns;
+} serialPort_t;
+
+static serialPort_t	ports[MAX_CHANNELS];
+static int			ledCosBit=0;		// TIOCM_RTS / TIOCM_DTR or 0
+static int			ledNetworkBit=0;
+
+
+/*-----------------------------------------------------------------------------
+	Config.  Channel 1 uses [serial], channel 2 serial_* keys in [channel 2]
+	(like capture_device).  Active level and LEDs are [serial] only.
+-----------------------------------------------------------------------------*/
+static const char *serialGetString(int idx, const char *key, const char *def)
+{
+	char fullKey[64];
+
+	if (idx==0)
+		snprintf(fullKey, sizeof(fullKey), "serial:%s", key);
+	else
+		snprintf(fullKey, sizeof(fullKey), "channel %d:serial_%s", idx+1, key);
+	return iniparser_getstring(ini, fullKey, def);
+}
+
+// "CTS", "DSR", "DCD" (or "CD"), "RI" to the TIOCM_* bit, 0 if empty / unknown
+static int serialLineBit(const char *name)
+{
+	if (strcasecmp(name, "CTS")==0)
+		return TIOCM_CTS;
+	if (strcasecmp(name, "DSR")==0)
+		return TIOCM_DSR;
+	if (strcasecmp(name, "DCD")==0 || strcasecmp(name, "CD")==0)
+		return TIOCM_CD;
+	if (strcasecmp(name, "RI")==0)
+		return TIOCM_RNG;
+	return 0;
+}
+
+static int serialLedBit(const char *name)
+{
+	if (strcasecmp(name, "RTS")==0)
+		return TIOCM_RTS;
+	if (strcasecmp(name, "DTR")==0)
+		return TIOCM_DTR;
+	return 0;
+}
+
+const char *serialDevice(int idx)
+{
+	if (idx==0 && !iniparser_getboolean(ini, "serial:enable", 0))
+		return "";
+	return serialGetString(idx, "device", "");
+}
+
+static void serialSetLine(serialPort_t *p, int bit, bool on)
+{
+	if (bit && !p->sim)
+		ioctl(p->fd, on ? TIOCMBIS : TIOCMBIC, &bit);
+}
+
+static uint32_t serialICount(serialPort_t *p)
+{
+	struct serial_icounter_struct ic;
+
+	if (p->sim || ioctl(p->fd, TIOCGICOUNT, &ic)<0)
+		return 0;
+	switch (p->cosBit)
+	{
+		case TIOCM_CTS:	return ic.cts;
+		case TIOCM_DSR:	return ic.dsr;
+		case TIOCM_CD:	return ic.dcd;
+		default:		return ic.rng;
+	}
+}
+
+// Thread side: queue an edge and poke the loop
+static void serialEdge(serialPort_t *p, bool ptt, bool level, uint64_t us)
+{
+	uint32_t head=p->head;
+	uint64_t one=1;
+
+	if (ptt)
+		__atomic_store_n(&p->ptt, level, __ATOMIC_RELEASE);
+	else
+	{
+		__atomic_store_n(&p->cos, level, __ATOMIC_RELEASE);
+		serialSetLine(p, ledCosBit, level);
+	}
+	metricsInc(p->mEdges);
+
+	if (head-__atomic_load_n(&p->tail, __ATOMIC_ACQUIRE)>=SERIAL_RING)
+	{
+		// The loop still polls the latest level, only the timestamp is lost
+		metricsInc(p->mOverruns);
+	}
+	else
+	{
+		p->ring[head%SERIAL_RING]=(serialEdge_t){ us, ptt, level };
+		__atomic_store_n(&p->head, head+1, __ATOMIC_RELEASE);
+	}
+	if (write(p->eventFd, &one, sizeof(one))<0)
+		metricsInc(p->mOverruns);
+}
+
+// Bench mode: levels come in as characters on a FIFO / pty
+static void serialSimRead(serialPort_t *p)
+{
+	char buf[64];
+	ssize_t n, i;
+
+	n=read(p->fd, buf, sizeof(buf));
+	if (n<=0)
+	{
+		usleep(100000);
+		return;
+	}
+	for (i=0; i<n; i++)
+	{
+		if ((buf[i]=='C' && !p->cos) || (buf[i]=='c' && p->cos))
+			serialEdge(p, false, buf[i]=='C', evloopNowUs());
+		else if (p->pttBit && ((buf[i]=='P' && !p->ptt) || (buf[i]=='p' && p->ptt)))
+			serialEdge(p, true, buf[i]=='P', evloopNowUs());
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	serialThread
+Synopsis:
+	Sleeps in TIOCMIWAIT until one of our lines changes, then works out
+	which one and queues the edge.  If the COS line's interrupt count
+	moved by more than the level change explains, the line bounced
+	quicker than we woke up: counted as a glitch.
+Author:
+	agent
+Inputs:
+	void *arg: serialPort_t
+Outputs:
+	NULL
+-----------------------------------------------------------------------------*/
+static void *serialThread(void *arg)
+{
+	serialPort_t *p=arg;
+	int status, mask=p->cosBit | p->pttBit;
+	uint32_t count;
+	uint64_t now;
+	bool level;
+
+	for (;;)
+	{
+		if (p->sim)
+		{
+			serialSimRead(p);
+			continue;
+		}
+
+		if (ioctl(p->fd, TIOCMIWAIT, mask)<0)
+		{
+			if (errno==EINTR)
+				continue;
+			fprintf(stderr, "Channel %d: serial port %s gone (%s)\n", p->idx+1, serialDevice(p->idx), strerror(errno));
+			return NULL;
+		}
+		now=evloopNowUs();
+		if (ioctl(p->fd, TIOCMGET, &status)<0)
+			continue;
+
+		level=((status & p->cosBit)!=0)!=p->activeLow;
+		count=serialICount(p);
+		if (count-p->lastICount>(uint32_t)(level!=p->cos ? 1 : 0))
+			metricsInc(p->mGlitches);
+		p->lastICount=count;
+		if (level!=p->cos)
+			serialEdge(p, false, level, now);
+
+		if (p->pttBit)
+		{
+			level=((status & p->pttBit)!=0)!=p->activeLow;
+			if (level!=p->ptt)
+				serialEdge(p, true, level, now);
+		}
+	}
+	return NULL;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	serialEdgeHandler
+Synopsis:
+	Loop side: feeds the queued edges to the channel and duty cycle
+	governor with their own timestamps.
+Author:
+	agent
+Inputs:
+	standard evloop read handler args, ctx is the serialPort_t
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void serialEdgeHandler(int fd, const uint8_t *data, ssize_t len, void *ctx)
+{
+	serialPort_t *p=ctx;
+	serialEdge_t *e;
+	uint32_t tail=p->tail;
+
+	(void)fd;
+	(void)data;
+	(void)len;
+
+	while (tail!=__atomic_load_n(&p->head, __ATOMIC_ACQUIRE))
+	{
+		e=&p->ring[tail%SERIAL_RING];
+		if (e->ptt)
+			dutyPoll(p->idx, e->level, e->us);
+		else
+			channelPoll(&channels[p->idx], e->level, e->us);
+		tail++;
+	}
+	__atomic_store_n(&p->tail, tail, __ATOMIC_RELEASE);
+}
+
+static int serialOpen(serialPort_t *p, const char *dev)
+{
+	struct termios tio;
+	int status;
+
+	if (strncmp(dev, SERIAL_SIM_PREFIX, strlen(SERIAL_SIM_PREFIX))==0)
+	{
+		// O_RDWR so a FIFO neither blocks here nor hits EOF between writers
+		p->sim=true;
+		p->fd=open(dev+strlen(SERIAL_SIM_PREFIX), O_RDWR | O_NOCTTY | O_CLOEXEC);
+		return p->fd<0 ? -1 : 0;
+	}
+
+	p->fd=open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (p->fd<0)
+		return -1;
+
+	// Don't wait for (or hang up on) carrier, don't drop RTS / DTR on close
+	if (tcgetattr(p->fd, &tio)==0)
+	{
+		cfmakeraw(&tio);
+		tio.c_cflag|=CLOCAL;
+		tio.c_cflag&=~HUPCL;
+		tcsetattr(p->fd, TCSANOW, &tio);
+	}
+
+	if (ioctl(p->fd, TIOCMGET, &status)<0)
+	{
+		close(p->fd);
+		return -1;
+	}
+	p->cos=((status & p->cosBit)!=0)!=p->activeLow;
+	p->ptt=p->pttBit && ((status & p->pttBit)!=0)!=p->activeLow;
+	p->lastICount=serialICount(p);
+
+	// Opening the port raises RTS and DTR, LEDs start off
+	serialSetLine(p, ledCosBit, p->cos);
+	serialSetLine(p, ledNetworkBit, false);
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	serialInit
+Synopsis:
+	Opens the channel's serial port (if it has one) and starts watching
+	its modem lines.  Edges go to the channel once serialStart() is called.
+Author:
+	agent
+Inputs:
+	int idx: 0 based channel number
+Outputs:
+	0 if the channel gets COS from a serial port, -1 otherwise
+-----------------------------------------------------------------------------*/
+int serialInit(int idx)
+{
+	serialPort_t *p=&ports[idx];
+	const char *dev=serialDevice(idx);
+	char name[METRICS_NAME_LEN];
+	sigset_t allSigs, oldSigs;
+	int err;
+
+	memset(p, 0, sizeof(*p));
+	p->idx=idx;
+	p->fd=-1;
+	p->eventFd=-1;
+	if (dev[0]=='\0' || !channels[idx].enabled)
+		return -1;
+
+	ledCosBit=		serialLedBit(iniparser_getstring(ini, "serial:led_cos", ""));
+	ledNetworkBit=	serialLedBit(iniparser_getstring(ini, "serial:led_network", ""));
+	p->activeLow=	iniparser_getboolean(ini, "serial:active_low", 0);
+	p->cosBit=		serialLineBit(serialGetString(idx, "cos_line", "DCD"));
+	p->pttBit=		serialLineBit(serialGetString(idx, "ptt_line", ""));
+	if (p->cosBit==0 || p->cosBit==p->pttBit)
+	{
+		fprintf(stderr, "Channel %d: bad serial cos_line / ptt_line\n", idx+1);
+		return -1;
+	}
+
+	if (serialOpen(p, dev)<0)
+	{
+		fprintf(stderr, "Channel %d: can't open %s: %s\n", idx+1, dev, strerror(errno));
+		return -1;
+	}
+	p->eventFd=eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (p->eventFd<0)
+	{
+		close(p->fd);
+		return -1;
+	}
+
+	snprintf(name, sizeof(name), "cosmon_serial_edges_total{channel=\"%d\"}", idx+1);
+	p->mEdges=metricsRegister(name, "Modem line changes seen on the serial COS port", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_serial_glitches_total{channel=\"%d\"}", idx+1);
+	p->mGlitches=metricsRegister(name, "COS line bounces too short to see the level of", METRIC_COUNTER);
+	snprintf(name, sizeof(name), "cosmon_serial_overruns_total{channel=\"%d\"}", idx+1);
+	p->mOverruns=metricsRegister(name, "Serial COS edges the event loop didn't pick up in time", METRIC_COUNTER);
+
+	// Started before main() routes signals to the event loop, so make sure
+	// this thread never takes them
+	sigfillset(&allSigs);
+	pthread_sigmask(SIG_BLOCK, &allSigs, &oldSigs);
+	err=pthread_create(&p->thread, NULL, serialThread, p);
+	pthread_sigmask(SIG_SETMASK, &oldSigs, NULL);
+	if (err!=0)
+	{
+		close(p->eventFd);
+		close(p->fd);
+		return -1;
+	}
+	p->enabled=true;
+	return 0;
+}
+
+// Channel state machine is ready, start taking edges
+void serialStart(void)
+{
+	int i;
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (ports[i].enabled && evloopAddReader(ports[i].eventFd, sizeof(uint64_t), serialEdgeHandler, &ports[i])<0)
+			fprintf(stderr, "Channel %d: serial COS edges will only be polled\n", i+1);
+	}
+}
+
+bool serialCos(int idx)
+{
+	return __atomic_load_n(&ports[idx].cos, __ATOMIC_ACQUIRE);
+}
+
+bool serialPttWired(int idx)
+{
+	return ports[idx].enabled && ports[idx].pttBit;
+}
+
+bool serialPtt(int idx)
+{
+	return __atomic_load_n(&ports[idx].ptt, __ATOMIC_ACQUIRE);
+}
+
+// Network status LED on RTS / DTR of every serial port
+void serialNetworkLed(bool on)
+{
+	int i;
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (ports[i].enabled)
+			serialSetLine(&ports[i], ledNetworkBit, on);
+	}
+}
@@ -0,0 +1,160 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  shmstate.c
+*
+*  Synopsis:	COSmon's shared state: a small POSIX shared memory segment
+*				(/dev/shm/COSmon) holding what the daemon knows about each
+*				channel, so other programs can read it without asking.
+*				Writers go through shmstateBegin()/shmstateEnd() (a seqlock,
+*				never blocks the COS path); readers retry if they raced a
+*				write.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmstate.h"
+#include "evloop.h"
+
+static cosmonShared_t	*shared=NULL;
+static cosmonShared_t	dummy;				// writes land here if shm isn't available
+static pthread_mutex_t	writeLock=PTHREAD_MUTEX_INITIALIZER;
+
+
+/*-----------------------------------------------------------------------------
+Function:
+	shmstateInit
+Synopsis:
+	Creates (or re-uses) and maps the shared state segment.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	0 on success, -1 on failure (COSmon carries on without it)
+-----------------------------------------------------------------------------*/
+int shmstateInit(void)
+{
+	int fd;
+	void *p;
+
+	fd=shm_open(SHMSTATE_NAME, O_CREAT | O_RDWR, 0644);
+	if (fd<0)
+	{
+		perror("shm_open");
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(cosmonShared_t))<0)
+	{
+		perror("ftruncate");
+		close(fd);
+		return -1;
+	}
+	p=mmap(NULL, sizeof(cosmonShared_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p==MAP_FAILED)
+	{
+		perror("mmap");
+		return -1;
+	}
+
+	shared=(cosmonShared_t *)p;
+	memset(shared, 0, sizeof(*shared));
+	shared->version=SHMSTATE_VERSION;
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	shmstateBegin
+Synopsis:
+	Starts an update.  Write the fields you need through the returned
+	pointer then call shmstateEnd().  Keep it short.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	pointer to the shared state (never NULL)
+-----------------------------------------------------------------------------*/
+cosmonShared_t *shmstateBegin(void)
+{
+	cosmonShared_t *s=shared ? shared : &dummy;
+
+	pthread_mutex_lock(&writeLock);		// only ever contended by other COSmon threads
+	__atomic_add_fetch(&s->seq, 1, __ATOMIC_ACQ_REL);
+	return s;
+}
+
+void shmstateEnd(void)
+{
+	cosmonShared_t *s=shared ? shared : &dummy;
+
+	s->updatedUs=evloopNowUs();
+	__atomic_add_fetch(&s->seq, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&writeLock);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	shmstateRead
+Synopsis:
+	Takes a consistent copy of the shared state (for readers in other
+	processes, who map the segment themselves).
+Author:
+	agent
+Inputs:
+	const cosmonShared_t *s: mapped segment
+	cosmonShared_t *copy: where to put the copy
+Outputs:
+	true if a consistent copy was taken
+-----------------------------------------------------------------------------*/
+bool shmstateRead(const cosmonShared_t *s, cosmonShared_t *copy)
+{
+	uint32_t before, after;
+	int tries;
+
+	for (tries=0; tries<100; tries++)
+	{
+		before=__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if (before & 1)
+			continue;
+		memcpy(copy, (const void *)s, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after=__atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+		if (before==after)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  shmstate.h
+*
+*  Synopsis:	Header file for shmstate.c.  Layout of COSmon's shared state
+*				segment.  Other programs on the node (aslLCD, scripts) can map
+*				/dev/shm/COSmon read-only and read it with shmstateRead().
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _SHMSTATE
+#define _SHMSTATE
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SHMSTATE_NAME			"/COSmon"
+#define SHMSTATE_VERSION		3			// bump when the layout changes
+#define SHMSTATE_CHANNELS		2
+#define SHMSTATE_LINKS			16
+#define SHMSTATE_NODE_LEN		8
+
+typedef struct
+{
+	uint8_t		enabled;
+	uint8_t		state;				// chState_t
+	uint8_t		cos;				// raw COS level
+	uint8_t		ptt;				// HT PTT line sensed
+	uint8_t		txThrottled;		// duty cycle governor tripped
+	uint8_t		pad[3];
+	float		txDutyPercent;		// over the governor window
+	float		levelRmsDb;			// FOB input, dBFS over the last 100 ms
+	float		levelPeakDb;		// dBFS
+	float		levelDcOffset;		// fraction of full scale
+	float		levelAdjustDb;		// recommended HT volume change, 0 = fine
+	uint32_t	levelClipped;		// clipped samples since start
+} shmChannel_t;
+
+typedef struct
+{
+	uint32_t		version;			// SHMSTATE_VERSION
+	uint32_t		seq;				// odd while being written (seqlock)
+	uint64_t		updatedUs;			// CLOCK_MONOTONIC
+	shmChannel_t	channel[SHMSTATE_CHANNELS];
+	uint8_t			amiConnected;		// the rest is only valid while this is set
+	uint8_t			registered;			// IAX2 registration up
+	uint16_t		numLinks;			// may be more than fit in links[]
+	char			links[SHMSTATE_LINKS][SHMSTATE_NODE_LEN];	// linked node numbers
+} cosmonShared_t;
+
+int  shmstateInit(void);
+cosmonShared_t *shmstateBegin(void);
+void shmstateEnd(void);
+bool shmstateRead(const cosmonShared_t *shared, cosmonShared_t *copy);
+
+#endif
@@ -0,0 +1,717 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  soak.c
+*
+*  Synopsis:	Soak test.  Runs the real channel code (pipeline, state machine,
+*				command governor...) against synthetic COS traffic for weeks
+*				of virtual time in a few minutes: evloopNowUs() is driven from
+*				here and Asterisk commands come here instead of the socket.
+*				Traffic models, each a Poisson process per channel: QSOs (a
+*				string of overs, some from fading mobiles that drop out
+*				briefly), kerchunk storms, stuck carriers, plus Asterisk
+*				restarts.  Checked all along: Asterisk never left keyed after
+*				COS drops, timeouts on time, no fd or memory growth.  Prints
+*				key latency and command churn at the end.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <iniparser.h>
+
+#include "soak.h"
+#include "channel.h"
+#include "astctl.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+
+#define SOAK_MAX_EDGES			512				// queued COS changes per channel
+#define SOAK_MAX_ACKS			16
+#define SOAK_SEC_US				1000000ULL
+#define SOAK_HOUR_US			(3600*SOAK_SEC_US)
+#define SOAK_DAY_US				(24*SOAK_HOUR_US)
+#define SOAK_QSO_OVERS			6				// mean overs per QSO
+#define SOAK_QSO_MAX_OVERS		20
+#define SOAK_OVER_MEAN_US		(20*SOAK_SEC_US)
+#define SOAK_OVER_MIN_US		(1*SOAK_SEC_US)
+#define SOAK_OVER_MAX_US		(120*SOAK_SEC_US)
+#define SOAK_FADE_MEAN_US		(2*SOAK_SEC_US)	// between dropouts of a fading mobile
+#define SOAK_FADE_MIN_US		50000ULL
+#define SOAK_FADE_MAX_US		400000ULL
+#define SOAK_STORM_MIN			10				// kerchunks per storm
+#define SOAK_STORM_MAX			40
+#define SOAK_KERCHUNK_MIN_US	150000ULL
+#define SOAK_KERCHUNK_MAX_US	600000ULL
+#define SOAK_STUCK_US			(600*SOAK_SEC_US)	// with the timeout disabled
+#define SOAK_OUTAGE_MIN_US		(5*SOAK_SEC_US)		// Asterisk restart
+#define SOAK_OUTAGE_MAX_US		(60*SOAK_SEC_US)
+#define SOAK_RSS_SLACK_KB		1024
+#define DEFAULT_SOAK_DAYS				21
+#define DEFAULT_SOAK_SEED				1
+#define DEFAULT_SOAK_QSO_PER_HOUR		2
+#define DEFAULT_SOAK_STORMS_PER_DAY		2
+#define DEFAULT_SOAK_STUCK_PER_DAY		1
+#define DEFAULT_SOAK_RESTARTS_PER_DAY	1
+#define DEFAULT_SOAK_FADE_PERCENT		30
+#define DEFAULT_SOAK_TOLERANCE_MS		500
+
+typedef struct
+{
+	uint64_t	us;
+	bool		level;
+} soakEdge_t;
+
+typedef struct
+{
+	// traffic generator
+	soakEdge_t	edges[SOAK_MAX_EDGES];
+	int			head;
+	int			count;
+	bool		level;
+	uint64_t	nextQsoUs;
+	uint64_t	nextStormUs;
+	uint64_t	nextStuckUs;
+
+	// what the poll saw and what Asterisk was told
+	bool		cos;
+	uint64_t	cosSinceUs;
+	bool		astKeyed;
+	uint64_t	keyedUs;				// last key, not counting resends
+	bool		reported;				// this key already counted as a violation
+
+	uint32_t	qsos;
+	uint32_t	overs;
+	uint32_t	fadingOvers;
+	uint32_t	storms;
+	uint32_t	kerchunks;
+	uint32_t	stucks;
+	uint64_t	commands;
+	uint64_t	keys;
+	uint64_t	timeouts;
+	uint64_t	latencySumUs;
+	uint64_t	latencyMaxUs;
+	uint64_t	timeoutDevMaxUs;
+} soakChan_t;
+
+typedef struct
+{
+	evloopWriteDone_t	done;
+	void				*ctx;
+	ssize_t				len;
+} soakAck_t;
+
+static bool			enabled=false;
+static uint32_t		days;
+static uint64_t		rng;
+static double		qsoMeanUs;				// between arrivals, 0 = model off
+static double		stormMeanUs;
+static double		stuckMeanUs;
+static double		restartMeanUs;
+static double		fadePercent;
+static uint64_t		tolUs;
+
+static soakChan_t	soaks[MAX_CHANNELS];
+static soakAck_t	acks[SOAK_MAX_ACKS];
+static int			numAcks;
+static uint64_t		startUs;
+static bool			astUp=true;
+static bool			reconnecting=false;		// commands now are channelReconnect()'s resends
+static uint64_t		astDownUs;
+static uint64_t		nextRestartUs;
+static uint32_t		restarts;
+static uint64_t		dropped;
+static uint64_t		hourCommands;
+static uint64_t		peakHourCommands;
+static uint32_t		violations;
+
+static metric_t		*mViolations;
+static metric_t		*mLatency;
+static metric_t		*mVirtualS;
+
+
+/*-----------------------------------------------------------------------------
+	Random numbers: xorshift64*, same traffic for the same seed
+-----------------------------------------------------------------------------*/
+static uint64_t soakRand(void)
+{
+	rng^=rng>>12;
+	rng^=rng<<25;
+	rng^=rng>>27;
+	return rng*0x2545F4914F6CDD1DULL;
+}
+
+// 0 <= u < 1
+static double soakUniform(void)
+{
+	return (soakRand()>>11)*(1.0/9007199254740992.0);
+}
+
+static uint64_t soakRangeUs(uint64_t lo, uint64_t hi)
+{
+	return lo+(uint64_t)(soakUniform()*(hi-lo));
+}
+
+// Exponential: the gap between arrivals of a Poisson process
+static uint64_t soakExpUs(double meanUs)
+{
+	return (uint64_t)(-meanUs*log(1.0-soakUniform()));
+}
+
+static uint64_t soakNext(double meanUs, uint64_t now)
+{
+	return meanUs>0.0 ? now+soakExpUs(meanUs) : UINT64_MAX;
+}
+
+static void soakViolation(int idx, uint64_t now, const char *fmt, ...)
+{
+	uint64_t t=(now-startUs)/SOAK_SEC_US;
+	va_list ap;
+
+	printf("Soak: day %llu %02llu:%02llu:%02llu ", (unsigned long long)t/86400, (unsigned long long)t/3600%24,
+		   (unsigned long long)t/60%60, (unsigned long long)t%60);
+	if (idx>=0)
+		printf("channel %d: ", idx+1);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	violations++;
+	metricsInc(mViolations);
+}
+
+
+/*-----------------------------------------------------------------------------
+	Traffic models.  Each one queues the COS changes of one activity; a
+	channel only starts the next one when it is quiet again.
+-----------------------------------------------------------------------------*/
+static bool soakRoom(const soakChan_t *s, int n)
+{
+	return s->count+n<=SOAK_MAX_EDGES;
+}
+
+static void soakPush(soakChan_t *s, uint64_t us, bool level)
+{
+	soakEdge_t *e=&s->edges[(s->head+s->count)%SOAK_MAX_EDGES];
+
+	e->us=us;
+	e->level=level;
+	s->count++;
+}
+
+// Overs with the far end's overs (which we don't hear) in between
+static void soakQso(soakChan_t *s, uint64_t t)
+{
+	uint64_t end, fade, len;
+	int overs, i;
+
+	overs=1+(int)(-(SOAK_QSO_OVERS-1)*log(1.0-soakUniform()));
+	if (overs>SOAK_QSO_MAX_OVERS)
+		overs=SOAK_QSO_MAX_OVERS;
+	s->qsos++;
+
+	for (i=0; i<overs && soakRoom(s, 2); i++)
+	{
+		len=soakExpUs(SOAK_OVER_MEAN_US);
+		if (len<SOAK_OVER_MIN_US)
+			len=SOAK_OVER_MIN_US;
+		if (len>SOAK_OVER_MAX_US)
+			len=SOAK_OVER_MAX_US;
+		end=t+len;
+
+		soakPush(s, t, true);
+		if (soakUniform()*100.0<fadePercent)
+		{
+			// fading mobile, COS drops out now and then
+			s->fadingOvers++;
+			fade=t+soakExpUs(SOAK_FADE_MEAN_US);
+			while (fade+SOAK_FADE_MAX_US<end && soakRoom(s, 3))
+			{
+				len=soakRangeUs(SOAK_FADE_MIN_US, SOAK_FADE_MAX_US);
+				soakPush(s, fade, false);
+				soakPush(s, fade+len, true);
+				fade+=len+soakExpUs(SOAK_FADE_MEAN_US);
+			}
+		}
+		soakPush(s, end, false);
+		s->overs++;
+		t=end+SOAK_OVER_MIN_US+soakExpUs(SOAK_OVER_MEAN_US);
+	}
+}
+
+static void soakStorm(soakChan_t *s, uint64_t t)
+{
+	uint64_t len;
+	int n, i;
+
+	n=(int)soakRangeUs(SOAK_STORM_MIN, SOAK_STORM_MAX);
+	s->storms++;
+	for (i=0; i<n && soakRoom(s, 2); i++)
+	{
+		len=soakRangeUs(SOAK_KERCHUNK_MIN_US, SOAK_KERCHUNK_MAX_US);
+		soakPush(s, t, true);
+		soakPush(s, t+len, false);
+		t+=len+soakRangeUs(SOAK_KERCHUNK_MAX_US, 5*SOAK_KERCHUNK_MAX_US);
+		s->kerchunks++;
+	}
+}
+
+// Up to twice the timeout, so it always times out
+static void soakStuck(soakChan_t *s, const channel_t *ch, uint64_t t)
+{
+	uint64_t len=(ch->timeoutUs==CHANNEL_NEVER_US ? SOAK_STUCK_US : ch->timeoutUs)+10*SOAK_SEC_US;
+
+	s->stucks++;
+	soakPush(s, t, true);
+	soakPush(s, t+soakRangeUs(len, 2*len), false);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	soakGenerate
+Synopsis:
+	Synthetic COS for one channel at the current virtual time.
+Author:
+	agent
+Inputs:
+	soakChan_t *s: channel's soak state
+	const channel_t *ch: the channel
+	uint64_t now: virtual time
+Outputs:
+	COS level
+-----------------------------------------------------------------------------*/
+static bool soakGenerate(soakChan_t *s, const channel_t *ch, uint64_t now)
+{
+	if (s->count==0 && !s->level)
+	{
+		if (s->nextStuckUs<=now)
+		{
+			soakStuck(s, ch, now);
+			s->nextStuckUs=soakNext(stuckMeanUs, now);
+		}
+		else if (s->nextStormUs<=now)
+		{
+			soakStorm(s, now);
+			s->nextStormUs=soakNext(stormMeanUs, now);
+		}
+		else if (s->nextQsoUs<=now)
+		{
+			soakQso(s, now);
+			s->nextQsoUs=soakNext(qsoMeanUs, now);
+		}
+	}
+
+	while (s->count>0 && s->edges[s->head].us<=now)
+	{
+		s->level=s->edges[s->head].level;
+		s->head=(s->head+1)%SOAK_MAX_EDGES;
+		s->count--;
+	}
+	return s->level;
+}
+
+
+/*-----------------------------------------------------------------------------
+	Pretend Asterisk
+-----------------------------------------------------------------------------*/
+static void soakKey(soakChan_t *s, uint64_t now)
+{
+	uint64_t latency;
+
+	s->astKeyed=true;
+	if (reconnecting)
+		return;
+	s->keys++;
+	s->keyedUs=now;
+	if (!s->cos)
+		return;
+	latency=now-s->cosSinceUs;
+	s->latencySumUs+=latency;
+	if (latency>s->latencyMaxUs)
+		s->latencyMaxUs=latency;
+	metricsObserve(mLatency, latency);
+}
+
+// A timeout has to come timeout_ms after the key (or the rekey out of hang)
+static void soakUnkey(soakChan_t *s, const channel_t *ch, uint64_t now)
+{
+	uint64_t held, dev;
+	bool wasKeyed=s->astKeyed;
+
+	s->astKeyed=false;
+	s->reported=false;
+	if (reconnecting || !wasKeyed || ch->state!=CH_TIMED_OUT)
+		return;
+
+	s->timeouts++;
+	held=now-(s->keyedUs>s->cosSinceUs ? s->keyedUs : s->cosSinceUs);
+	dev=(held>ch->timeoutUs ? held-ch->timeoutUs : ch->timeoutUs-held);
+	if (dev>s->timeoutDevMaxUs)
+		s->timeoutDevMaxUs=dev;
+	if (dev>tolUs)
+		soakViolation(ch->idx, now, "timed out after %llu ms, timeout is %llu ms",
+					  (unsigned long long)held/1000, (unsigned long long)ch->timeoutUs/1000);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	soakSink
+Synopsis:
+	Every command to Asterisk ends up here.  Keeps track of whether
+	Asterisk thinks the channel is keyed; the write completes (and the
+	channel gets its EV_ACK) on the next poll.
+Author:
+	agent
+Inputs:
+	const char *cmd: CLI command
+	evloopWriteDone_t done: completion callback
+	void *ctx: passed back to done()
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void soakSink(const char *cmd, evloopWriteDone_t done, void *ctx)
+{
+	channel_t *ch=NULL;
+	int i;
+
+	if (!astUp)
+	{
+		dropped++;
+		return;
+	}
+	hourCommands++;
+	if (done && numAcks<SOAK_MAX_ACKS)
+	{
+		acks[numAcks].done=	done;
+		acks[numAcks].ctx=	ctx;
+		acks[numAcks].len=	strlen(cmd)+1;
+		numAcks++;
+	}
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (ctx==&channels[i])
+			ch=&channels[i];
+	}
+	if (ch==NULL)
+		return;
+
+	soaks[ch->idx].commands++;
+	if (strcmp(cmd, ch->keyCmd)==0)
+		soakKey(&soaks[ch->idx], evloopNowUs());
+	else if (strcmp(cmd, ch->unkeyCmd)==0)
+		soakUnkey(&soaks[ch->idx], ch, evloopNowUs());
+}
+
+static void soakAcks(void)
+{
+	soakAck_t done[SOAK_MAX_ACKS];
+	int n=numAcks;
+	int i;
+
+	memcpy(done, acks, n*sizeof(done[0]));
+	numAcks=0;
+	for (i=0; i<n; i++)
+		done[i].done(done[i].len, done[i].ctx);
+}
+
+// Asterisk restarts forget every key; on the way back up we reconnect
+static void soakAsterisk(uint64_t now)
+{
+	int i;
+
+	if (astUp && now>=nextRestartUs)
+	{
+		astUp=false;
+		astDownUs=now+soakRangeUs(SOAK_OUTAGE_MIN_US, SOAK_OUTAGE_MAX_US);
+		restarts++;
+		for (i=0; i<MAX_CHANNELS; i++)
+		{
+			soaks[i].astKeyed=false;
+			soaks[i].reported=false;
+		}
+	}
+	else if (!astUp && now>=astDownUs)
+	{
+		astUp=true;
+		reconnecting=true;
+		channelReconnect(now);
+		reconnecting=false;
+		nextRestartUs=soakNext(restartMeanUs, now);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	soakCheck
+Synopsis:
+	Invariants checked after every poll: Asterisk is unkeyed within the
+	hang time of COS dropping, and within the timeout of it coming up.
+	tolerance_ms covers the poll interval, debounce and so on.
+Author:
+	agent
+Inputs:
+	soakChan_t *s: channel's soak state
+	const channel_t *ch: the channel
+	uint64_t now: virtual time
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+static void soakCheck(soakChan_t *s, const channel_t *ch, uint64_t now)
+{
+	uint64_t held;
+
+	if (!s->astKeyed || s->reported)
+		return;
+
+	if (!s->cos)
+	{
+		held=now-s->cosSinceUs;
+		if (held<=ch->hangUs+tolUs)
+			return;
+		soakViolation(ch->idx, now, "still keyed %llu ms after COS dropped", (unsigned long long)held/1000);
+	}
+	else
+	{
+		if (ch->timeoutUs==CHANNEL_NEVER_US)
+			return;
+		held=now-(s->keyedUs>s->cosSinceUs ? s->keyedUs : s->cosSinceUs);
+		if (held<=ch->timeoutUs+tolUs)
+			return;
+		soakViolation(ch->idx, now, "still keyed %llu ms into a transmission, timeout is %llu ms",
+					  (unsigned long long)held/1000, (unsigned long long)ch->timeoutUs/1000);
+	}
+	s->reported=true;
+}
+
+static long soakRssKb(void)
+{
+	FILE *fp=fopen("/proc/self/statm", "r");
+	long pages=0;
+
+	if (fp==NULL)
+		return 0;
+	if (fscanf(fp, "%*d %ld", &pages)!=1)
+		pages=0;
+	fclose(fp);
+	return pages*(sysconf(_SC_PAGESIZE)/1024);
+}
+
+static int soakFds(void)
+{
+	DIR *dir=opendir("/proc/self/fd");
+	struct dirent *de;
+	int n=0;
+
+	if (dir==NULL)
+		return 0;
+	while ((de=readdir(dir))!=NULL)
+	{
+		if (de->d_name[0]!='.')
+			n++;
+	}
+	closedir(dir);
+	return n-1;		// not counting the one opendir() used
+}
+
+static void soakReport(double wallS)
+{
+	const soakChan_t *s;
+	double hours=days*24.0;
+	int i;
+
+	printf("\nSoak test: %u days of virtual time in %.1f s (%.0fx)\n", days, wallS, days*86400.0/wallS);
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		if (!channels[i].enabled)
+			continue;
+		s=&soaks[i];
+		printf("\tChannel %d traffic: %u QSOs (%u overs, %u fading), %u kerchunk storms (%u kerchunks), %u stuck carriers\n",
+			   i+1, s->qsos, s->overs, s->fadingOvers, s->storms, s->kerchunks, s->stucks);
+		printf("\tChannel %d commands: %llu (%.1f per hour), %llu keys, key latency avg %llu ms max %llu ms\n",
+			   i+1, (unsigned long long)s->commands, s->commands/hours, (unsigned long long)s->keys,
+			   (unsigned long long)(s->keys ? s->latencySumUs/s->keys/1000 : 0), (unsigned long long)s->latencyMaxUs/1000);
+		printf("\tChannel %d timeouts: %llu, worst %llu ms off\n", i+1,
+			   (unsigned long long)s->timeouts, (unsigned long long)s->timeoutDevMaxUs/1000);
+	}
+	printf("\tBusiest hour: %llu commands\n", (unsigned long long)peakHourCommands);
+	printf("\tAsterisk restarts: %u, %llu commands dropped while it was down\n", restarts, (unsigned long long)dropped);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	soakRun
+Synopsis:
+	Runs the soak test in place of COSmon's event loop.  Virtual time moves
+	one poll interval per pass, as fast as the CPU goes.
+Author:
+	agent
+Inputs:
+	uint32_t pollMs: COS poll interval
+Outputs:
+	0 if every invariant held, -1 if not
+-----------------------------------------------------------------------------*/
+int soakRun(uint32_t pollMs)
+{
+	struct timespec t0, t1;
+	uint64_t now, endUs, nextHourUs, nextDayUs;
+	long rssKb, baseRssKb=0;
+	int fds, baseFds=0;
+	uint32_t day=0;
+	soakChan_t *s;
+	bool cos;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	startUs=now=evloopNowUs();
+	endUs=startUs+days*SOAK_DAY_US;
+	nextHourUs=startUs+SOAK_HOUR_US;
+	nextDayUs=startUs+SOAK_DAY_US;
+	evloopSetVirtualTime(now);
+	astctlSetSink(soakSink);
+
+	for (i=0; i<MAX_CHANNELS; i++)
+	{
+		s=&soaks[i];
+		s->cosSinceUs=	now;
+		s->nextQsoUs=	soakNext(qsoMeanUs, now);
+		s->nextStormUs=	soakNext(stormMeanUs, now);
+		s->nextStuckUs=	soakNext(stuckMeanUs, now);
+	}
+	nextRestartUs=soakNext(restartMeanUs, now);
+	printf("Soak test running\n");
+	fflush(stdout);
+
+	while (now<endUs)
+	{
+		now+=(uint64_t)pollMs*1000;
+		evloopSetVirtualTime(now);
+		soakAcks();
+		soakAsterisk(now);
+
+		for (i=0; i<MAX_CHANNELS; i++)
+		{
+			if (!channels[i].enabled)
+				continue;
+			s=&soaks[i];
+			cos=soakGenerate(s, &channels[i], now);
+			if (cos!=s->cos)
+			{
+				s->cos=cos;
+				s->cosSinceUs=now;
+			}
+			channelPoll(&channels[i], cos, now);
+			soakCheck(s, &channels[i], now);
+		}
+
+		if (now>=nextHourUs)
+		{
+			if (hourCommands>peakHourCommands)
+				peakHourCommands=hourCommands;
+			hourCommands=0;
+			nextHourUs+=SOAK_HOUR_US;
+		}
+
+		// Once a day: nothing should grow after the first one
+		if (now>=nextDayUs)
+		{
+			day++;
+			nextDayUs+=SOAK_DAY_US;
+			rssKb=soakRssKb();
+			fds=soakFds();
+			metricsSet(mVirtualS, (now-startUs)/(double)SOAK_SEC_US);
+			printf("Soak day %u: RSS %ld kB, %d fds, %u violations\n", day, rssKb, fds, violations);
+			fflush(stdout);
+			if (day==1)
+			{
+				baseRssKb=rssKb;
+				baseFds=fds;
+			}
+			else if (fds>baseFds)
+				soakViolation(-1, now, "%d fds open, %d after the first day", fds, baseFds);
+			else if (rssKb>baseRssKb+SOAK_RSS_SLACK_KB)
+				soakViolation(-1, now, "RSS %ld kB, %ld kB after the first day", rssKb, baseRssKb);
+		}
+	}
+
+	astctlSetSink(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	soakReport((t1.tv_sec-t0.tv_sec)+(t1.tv_nsec-t0.tv_nsec)/1e9);
+	metricsDump(stdout);
+	printf("Soak test %s: %u violations\n", violations ? "FAILED" : "passed", violations);
+
+	return violations ? -1 : 0;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	soakInit
+Synopsis:
+	Reads [soak].  Rates of 0 turn that traffic model off.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void soakInit(void)
+{
+	double rate;
+
+	if (!iniparser_getboolean(ini, "soak:enable", 0))
+		return;
+	days=	iniparser_getint(ini, "soak:days", DEFAULT_SOAK_DAYS);
+	rng=	iniparser_getint(ini, "soak:seed", DEFAULT_SOAK_SEED)*0x9E3779B97F4A7C15ULL | 1;
+	rate=	iniparser_getdouble(ini, "soak:qso_per_hour", DEFAULT_SOAK_QSO_PER_HOUR);
+	qsoMeanUs=		rate>0.0 ? SOAK_HOUR_US/rate : 0.0;
+	rate=	iniparser_getdouble(ini, "soak:storms_per_day", DEFAULT_SOAK_STORMS_PER_DAY);
+	stormMeanUs=	rate>0.0 ? SOAK_DAY_US/rate : 0.0;
+	rate=	iniparser_getdouble(ini, "soak:stuck_per_day", DEFAULT_SOAK_STUCK_PER_DAY);
+	stuckMeanUs=	rate>0.0 ? SOAK_DAY_US/rate : 0.0;
+	rate=	iniparser_getdouble(ini, "soak:restarts_per_day", DEFAULT_SOAK_RESTARTS_PER_DAY);
+	restartMeanUs=	rate>0.0 ? SOAK_DAY_US/rate : 0.0;
+	fadePercent=	iniparser_getdouble(ini, "soak:fade_percent", DEFAULT_SOAK_FADE_PERCENT);
+	tolUs=			(uint64_t)iniparser_getint(ini, "soak:tolerance_ms", DEFAULT_SOAK_TOLERANCE_MS)*1000;
+
+	mViolations=	metricsRegister("cosmon_soak_violations_total", "Soak test invariant violations", METRIC_COUNTER);
+	mLatency=		metricsRegister("cosmon_soak_key_latency_us", "Soak test COS up to key command, virtual time", METRIC_HISTOGRAM);
+	mVirtualS=		metricsRegister("cosmon_soak_virtual_seconds", "Soak test virtual time so far", METRIC_GAUGE);
+	enabled=true;
+	printf("\tSoak test: %u days of virtual time, seed %d\n", days, iniparser_getint(ini, "soak:seed", DEFAULT_SOAK_SEED));
+}
+
+bool soakEnabled(void)
+{
+	return enabled;
+}
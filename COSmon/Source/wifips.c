@@ -0,0 +1,346 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  wifips.c
+*
+*  Synopsis:	Turns Wi-Fi power save off on the wifi interface while COS or
+*				PTT is active (and for idle_hold_s after) and back on when things
+*				go quiet.  Power save buffers downlink frames until the next
+*				beacon, which is 100+ ms of jitter on IAX2 audio, but battery
+*				nodes can't afford it off all the time.
+*
+*				Talks nl80211 over a raw generic netlink socket (no libnl); the
+*				set requests go out from the event loop and the acks come back
+*				on a poller.
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+#include <iniparser.h>
+
+#include "wifips.h"
+#include "evloop.h"
+#include "ini.h"
+#include "metrics.h"
+#include "mqtt.h"
+
+#define WIFIPS_BUF_LEN				4096
+#define WIFIPS_ACCOUNT_MS			10000		// how often time in each mode is brought up to date
+#define DEFAULT_WIFIPS_HOLD_S		30
+
+// One netlink message with a generic netlink header and up to two u32 / string attributes
+typedef struct
+{
+	struct nlmsghdr		nlh;
+	struct genlmsghdr	genl;
+	uint8_t				attrs[64];
+} wifiPsMsg_t;
+
+static struct
+{
+	bool			enabled;
+	bool			powerSave;
+	int				nlFd;
+	uint16_t		family;
+	uint32_t		ifindex;
+	uint32_t		seq;
+	unsigned int	active;				// WIFIPS_SRC_* bits
+	bool			held;				// active, or idle hold running
+	int				holdTimer;
+	uint32_t		holdMs;
+	uint64_t		modeSinceUs;
+
+	metric_t		*mSwitches;
+	metric_t		*mOnMs;
+	metric_t		*mOffMs;
+	metric_t		*mErrors;
+	metric_t		*mState;
+} wps={ .nlFd=-1 };
+
+
+static void wifiPsPut(wifiPsMsg_t *m, uint16_t type, const void *data, uint16_t len)
+{
+	struct nlattr *a=(struct nlattr *)((uint8_t *)m+NLMSG_ALIGN(m->nlh.nlmsg_len));
+
+	a->nla_type=type;
+	a->nla_len=NLA_HDRLEN+len;
+	memcpy((uint8_t *)a+NLA_HDRLEN, data, len);
+	m->nlh.nlmsg_len=NLMSG_ALIGN(m->nlh.nlmsg_len)+NLA_ALIGN(a->nla_len);
+}
+
+static void wifiPsHeader(wifiPsMsg_t *m, uint16_t family, uint8_t cmd)
+{
+	memset(m, 0, sizeof(*m));
+	m->nlh.nlmsg_len=NLMSG_LENGTH(GENL_HDRLEN);
+	m->nlh.nlmsg_type=family;
+	m->nlh.nlmsg_flags=NLM_F_REQUEST | NLM_F_ACK;
+	m->nlh.nlmsg_seq=++wps.seq;
+	m->genl.cmd=cmd;
+	m->genl.version=1;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	wifiPsResolveFamily
+Synopsis:
+	Asks the generic netlink controller for nl80211's family id.  Blocking
+	(with a timeout), init time only.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	family id or -1
+-----------------------------------------------------------------------------*/
+static int wifiPsResolveFamily(void)
+{
+	uint8_t buf[WIFIPS_BUF_LEN];
+	struct timeval tv={ 1, 0 };
+	struct nlmsghdr *nlh;
+	struct nlattr *a;
+	wifiPsMsg_t m;
+	ssize_t n;
+	int len;
+
+	wifiPsHeader(&m, GENL_ID_CTRL, CTRL_CMD_GETFAMILY);
+	wifiPsPut(&m, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+	if (send(wps.nlFd, &m, m.nlh.nlmsg_len, 0)<0)
+		return -1;
+
+	setsockopt(wps.nlFd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	n=recv(wps.nlFd, buf, sizeof(buf), 0);
+	if (n<0)
+		return -1;
+
+	for (nlh=(struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh=NLMSG_NEXT(nlh, n))
+	{
+		if (nlh->nlmsg_type!=GENL_ID_CTRL)
+			continue;
+		a=(struct nlattr *)((uint8_t *)NLMSG_DATA(nlh)+GENL_HDRLEN);
+		len=nlh->nlmsg_len-NLMSG_LENGTH(GENL_HDRLEN);
+		while (len>=NLA_HDRLEN && a->nla_len>=NLA_HDRLEN && a->nla_len<=len)
+		{
+			if (a->nla_type==CTRL_ATTR_FAMILY_ID)
+				return *(uint16_t *)((uint8_t *)a+NLA_HDRLEN);
+			len-=NLA_ALIGN(a->nla_len);
+			a=(struct nlattr *)((uint8_t *)a+NLA_ALIGN(a->nla_len));
+		}
+	}
+	return -1;
+}
+
+// Acks for our set requests.  Only errors are interesting.
+static void wifiPsAckHandler(int fd, uint32_t events, void *ctx)
+{
+	uint8_t buf[WIFIPS_BUF_LEN];
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	ssize_t n;
+
+	(void)events;
+	(void)ctx;
+	while ((n=recv(fd, buf, sizeof(buf), MSG_DONTWAIT))>0)
+	{
+		for (nlh=(struct nlmsghdr *)buf; NLMSG_OK(nlh, n); nlh=NLMSG_NEXT(nlh, n))
+		{
+			if (nlh->nlmsg_type!=NLMSG_ERROR)
+				continue;
+			err=NLMSG_DATA(nlh);
+			if (err->error)
+			{
+				metricsInc(wps.mErrors);
+				fprintf(stderr, "Wi-Fi power save: nl80211 said %s\n", strerror(-err->error));
+			}
+		}
+	}
+}
+
+// Adds the time spent in the current mode to its counter
+static void wifiPsAccount(void)
+{
+	uint64_t now=evloopNowUs();
+
+	metricsAdd(wps.powerSave ? wps.mOnMs : wps.mOffMs, (now-wps.modeSinceUs)/1000);
+	wps.modeSinceUs=now;
+}
+
+static void wifiPsAccountHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	wifiPsAccount();
+}
+
+static void wifiPsSet(bool on)
+{
+	wifiPsMsg_t m;
+	uint32_t state=on ? NL80211_PS_ENABLED : NL80211_PS_DISABLED;
+
+	if (on==wps.powerSave)
+		return;
+
+	wifiPsHeader(&m, wps.family, NL80211_CMD_SET_POWER_SAVE);
+	wifiPsPut(&m, NL80211_ATTR_IFINDEX, &wps.ifindex, sizeof(wps.ifindex));
+	wifiPsPut(&m, NL80211_ATTR_PS_STATE, &state, sizeof(state));
+	evloopWrite(wps.nlFd, &m, m.nlh.nlmsg_len);
+
+	wifiPsAccount();
+	wps.powerSave=on;
+	metricsInc(wps.mSwitches);
+	metricsSet(wps.mState, on);
+	mqttState("wifi_power_save", on ? "on" : "off");
+}
+
+// idle_hold_s of nothing happening
+static void wifiPsHoldHandler(uint64_t expirations, void *ctx)
+{
+	(void)expirations;
+	(void)ctx;
+	wps.held=false;
+	wifiPsSet(true);
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	wifiPsActivity
+Synopsis:
+	COS or PTT changed on a channel.  Any of them active turns power save
+	off; the last one going idle starts the hold.
+Author:
+	agent
+Inputs:
+	unsigned int source: WIFIPS_SRC_COS(idx) or WIFIPS_SRC_PTT(idx)
+	bool active: new state
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void wifiPsActivity(unsigned int source, bool active)
+{
+	if (!wps.enabled)
+		return;
+
+	if (active)
+		wps.active|=source;
+	else
+		wps.active&=~source;
+
+	if (wps.active)
+	{
+		evloopArmTimer(wps.holdTimer, 0, 0);
+		wps.held=true;
+		wifiPsSet(false);
+	}
+	else if (wps.held)
+		evloopArmTimer(wps.holdTimer, wps.holdMs ? wps.holdMs : 1, 0);
+}
+
+// Exiting: leave the battery saving mode on
+void wifiPsRestore(void)
+{
+	wifiPsMsg_t m;
+	uint32_t state=NL80211_PS_ENABLED;
+
+	if (!wps.enabled || wps.powerSave)
+		return;
+	wifiPsHeader(&m, wps.family, NL80211_CMD_SET_POWER_SAVE);
+	wifiPsPut(&m, NL80211_ATTR_IFINDEX, &wps.ifindex, sizeof(wps.ifindex));
+	wifiPsPut(&m, NL80211_ATTR_PS_STATE, &state, sizeof(state));
+	if (send(wps.nlFd, &m, m.nlh.nlmsg_len, 0)<0)
+		perror("nl80211");
+	wps.powerSave=true;
+}
+
+/*-----------------------------------------------------------------------------
+Function:
+	wifiPsInit
+Synopsis:
+	Reads [wifi power save], finds nl80211 and the interface named by
+	network devices:wifi interface name, and starts with power save on.
+Author:
+	agent
+Inputs:
+	None
+Outputs:
+	None
+-----------------------------------------------------------------------------*/
+void wifiPsInit(void)
+{
+	const char *ifname;
+	int family;
+
+	if (!iniparser_getboolean(ini, "wifi power save:enable", 0))
+		return;
+
+	ifname=iniparser_getstring(ini, "network devices:wifi interface name", "wlan0");
+	wps.ifindex=if_nametoindex(ifname);
+	wps.holdMs=iniparser_getint(ini, "wifi power save:idle_hold_s", DEFAULT_WIFIPS_HOLD_S)*1000;
+	if (wps.ifindex==0)
+	{
+		fprintf(stderr, "Wi-Fi power save: no interface %s, disabled\n", ifname);
+		return;
+	}
+
+	wps.nlFd=socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+	if (wps.nlFd<0 || (family=wifiPsResolveFamily())<0)
+	{
+		fprintf(stderr, "Wi-Fi power save: no nl80211, disabled\n");
+		if (wps.nlFd>=0)
+			close(wps.nlFd);
+		return;
+	}
+	wps.family=family;
+	if (evloopAddPoller(wps.nlFd, EPOLLIN, wifiPsAckHandler, NULL)<0)
+	{
+		close(wps.nlFd);
+		return;
+	}
+
+	wps.mSwitches=	metricsRegister("cosmon_wifi_powersave_switches_total", "Wi-Fi power save mode changes", METRIC_COUNTER);
+	wps.mOnMs=		metricsRegister("cosmon_wifi_powersave_on_ms_total", "Time with Wi-Fi power save on (ms)", METRIC_COUNTER);
+	wps.mOffMs=		metricsRegister("cosmon_wifi_powersave_off_ms_total", "Time with Wi-Fi power save off (ms)", METRIC_COUNTER);
+	wps.mErrors=	metricsRegister("cosmon_wifi_powersave_errors_total", "nl80211 power save requests refused", METRIC_COUNTER);
+	wps.mState=		metricsRegister("cosmon_wifi_powersave", "1 while Wi-Fi power save is on", METRIC_GAUGE);
+
+	wps.holdTimer=evloopAddTimer(0, 0, wifiPsHoldHandler, NULL);
+	evloopAddTimer(WIFIPS_ACCOUNT_MS, WIFIPS_ACCOUNT_MS, wifiPsAccountHandler, NULL);
+	wps.enabled=true;
+
+	// Quiet to start with.  powerSave=false first so the request goes out.
+	wps.modeSinceUs=evloopNowUs();
+	wifiPsSet(true);
+	printf("\tWi-Fi power save on %s: off while active, idle hold %u s\n", ifname, wps.holdMs/1000);
+}
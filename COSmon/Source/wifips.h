@@ -0,0 +1,45 @@
+/****************************************************************************
+*  Copyright (c)2026 agent
+*
+*	COSmon is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as
+*	published by the Free Software Foundation, either version 3 of the
+*	License, or (at your option) any later version.
+*
+*	COSmon is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public
+*	License along with wiringPi.
+*	If not, see <http://www.gnu.org/licenses/>.
+*
+*	This file is part of COSmon:
+*	https://github.com/ IT AIN'T THERE YET
+*
+*  wifips.h
+*
+*  Synopsis:	Header file for wifips.c
+*
+*  Projects:	COSmon
+*
+*  File Version History:
+*    Date    |      Eng     |               Description
+*  ----------+--------------+------------------------------------------------
+*  10/17/26  | agent        |  Original Version
+*
+****************************************************************************/
+#ifndef _WIFIPS
+#define _WIFIPS
+
+#include <stdbool.h>
+
+#define WIFIPS_SRC_COS(idx)		(1u<<(idx))
+#define WIFIPS_SRC_PTT(idx)		(1u<<((idx)+8))
+
+void wifiPsInit(void);
+void wifiPsActivity(unsigned int source, bool active);
+void wifiPsRestore(void);
+
+#endif